@@ -71,6 +71,26 @@ ApplicationWindow {
 
                     Item { Layout.fillWidth: true }
 
+                    ComboBox {
+                        id: speedBox
+                        Layout.preferredWidth: 90
+                        model: [0.5, 0.75, 1.0, 1.25, 1.5, 2.0]
+                        currentIndex: model.indexOf(window.audioManager.playbackSpeed)
+                        displayText: window.audioManager.playbackSpeed.toFixed(2) + "x"
+                        focusPolicy: Qt.NoFocus
+                        onActivated: (index) => window.audioManager.playbackSpeed = model[index]
+                    }
+
+                    Slider {
+                        id: volumeSlider
+                        Layout.preferredWidth: 120
+                        from: 0.0
+                        to: 1.0
+                        value: window.audioManager.volume
+                        focusPolicy: Qt.NoFocus
+                        onMoved: window.audioManager.volume = value
+                    }
+
                     PlaybackButtons {
                         id: playbackButtons
                         audioManager: window.audioManager
@@ -1,12 +1,40 @@
 #include "audio_decoder.h"
+#include "seek_index.h"
+#include "dsd_converter.h"
 #include <QProcess>
 #include <QCoreApplication>
 #include <QFileInfo>
 #include <QDir>
 #include <QFile>
+#include <QTemporaryFile>
 #include <QDebug>
 #include <fstream>
 #include <cstring>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+uint32_t readLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t readLe64(const uint8_t* p) {
+    return readLe32(p) | (static_cast<uint64_t>(readLe32(p + 4)) << 32);
+}
+
+uint32_t readBe32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+uint64_t readBe64(const uint8_t* p) {
+    return (static_cast<uint64_t>(readBe32(p)) << 32) | readBe32(p + 4);
+}
+
+// Bytes of each channel converted per pass when the file does not dictate it.
+const size_t kDsdChunkBytes = 4096;
+
+} // namespace
 
 QStringList AudioDecoder::getSupportedFormats() {
     QStringList formats;
@@ -24,9 +52,15 @@ QStringList AudioDecoder::getSupportedFormats() {
                 << "ALAC Files (*.alac)"
                 << "OGG Files (*.ogg)"
                 << "Opus Files (*.opus)"
-                << "WMA Files (*.wma)";
+                << "WMA Files (*.wma)"
+                << "DSD Files (*.dsf *.dff)"
+                << "CUE Sheets (*.cue)"
+                << "Playlists (*.m3u *.m3u8 *.pls *.xspf)";
     } else {
-        formats << "WAV Files (*.wav)";
+        formats << "WAV Files (*.wav)"
+                << "DSD Files (*.dsf *.dff)"
+                << "CUE Sheets (*.cue)"
+                << "Playlists (*.m3u *.m3u8 *.pls *.xspf)";
     }
     
     return formats;
@@ -36,13 +70,15 @@ bool AudioDecoder::isFormatSupported(const QString& extension) {
     return supportedExtensions().contains(extension.toLower());
 }
 
-bool AudioDecoder::loadAudioFile(const QString& filePath, AudioData& audioData) {
+bool AudioDecoder::loadAudioFile(const QString& filePath, AudioData& audioData, bool allowDop) {
     audioData.reset();
     
     QString extension = QFileInfo(filePath).suffix().toLower();
     
     if (extension == "wav") {
         return loadWavFile(filePath, audioData);
+    } else if (extension == "dsf" || extension == "dff") {
+        return loadDsdFile(filePath, audioData, allowDop);
     } else if (isFormatSupported(extension) && isFfmpegAvailable()) {
         return loadWithFfmpeg(filePath, audioData);
     }
@@ -51,13 +87,7 @@ bool AudioDecoder::loadAudioFile(const QString& filePath, AudioData& audioData)
     return false;
 }
 
-bool AudioDecoder::loadWavFile(const QString& filePath, AudioData& audioData) {
-    std::ifstream file(filePath.toStdString().c_str(), std::ios::binary);
-    if (!file.is_open()) {
-        qDebug() << "Cannot open file:" << filePath;
-        return false;
-    }
-
+bool AudioDecoder::readWavHeader(std::ifstream& file, WavFormat& format) {
     char riffHeader[12];
     file.read(riffHeader, 12);
     if (!file || strncmp(riffHeader, "RIFF", 4) != 0 || strncmp(riffHeader + 8, "WAVE", 4) != 0) {
@@ -68,12 +98,12 @@ bool AudioDecoder::loadWavFile(const QString& filePath, AudioData& audioData) {
     char chunkId[4];
     uint32_t chunkSize;
     bool foundFmt = false, foundData = false;
-    uint32_t dataSize = 0;
-    
+    format.dataSize = 0;
+
     while (!foundFmt || !foundData) {
         file.read(chunkId, 4);
         file.read(reinterpret_cast<char*>(&chunkSize), 4);
-        
+
         if (!file) {
             qDebug() << "Unexpected end of file";
             return false;
@@ -85,60 +115,297 @@ bool AudioDecoder::loadWavFile(const QString& filePath, AudioData& audioData) {
                 return false;
             }
 
-            char fmtData[16];
-            file.read(fmtData, 16);
+            char fmtData[26] = {};
+            uint32_t fmtRead = std::min<uint32_t>(chunkSize, sizeof(fmtData));
+            file.read(fmtData, fmtRead);
             if (!file) return false;
 
-            uint16_t audioFormat = *reinterpret_cast<uint16_t*>(fmtData);
-            audioData.channels = *reinterpret_cast<uint16_t*>(fmtData + 2);
-            audioData.sampleRate = *reinterpret_cast<uint32_t*>(fmtData + 4);
-            uint16_t bitsPerSample = *reinterpret_cast<uint16_t*>(fmtData + 14);
+            format.audioFormat = *reinterpret_cast<uint16_t*>(fmtData);
+            format.channels = *reinterpret_cast<uint16_t*>(fmtData + 2);
+            format.sampleRate = *reinterpret_cast<uint32_t*>(fmtData + 4);
+            format.bitsPerSample = *reinterpret_cast<uint16_t*>(fmtData + 14);
 
-            if (audioFormat != 1 || bitsPerSample != 16) {
-                qDebug() << "Only 16-bit PCM WAV files are supported";
-                return false;
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format code at the start
+            // of the sub-format GUID.
+            if (format.audioFormat == 0xFFFE && fmtRead >= 26) {
+                format.audioFormat = *reinterpret_cast<uint16_t*>(fmtData + 24);
             }
 
             foundFmt = true;
-            if (chunkSize > 16) {
-                file.seekg(chunkSize - 16, std::ios::cur);
+            if (chunkSize > fmtRead) {
+                file.seekg(chunkSize - fmtRead + (chunkSize & 1), std::ios::cur);
             }
-            
+
         } else if (strncmp(chunkId, "data", 4) == 0) {
-            dataSize = chunkSize;
+            format.dataSize = chunkSize;
             foundData = true;
+            if (!foundFmt) {
+                qDebug() << "WAV data chunk precedes fmt chunk";
+                return false;
+            }
             break;
         } else {
-            file.seekg(chunkSize, std::ios::cur);
+            file.seekg(chunkSize + (chunkSize & 1), std::ios::cur);
         }
     }
 
-    if (!foundFmt || !foundData || dataSize == 0) {
+    if (!foundFmt || !foundData || format.dataSize == 0 || format.channels == 0) {
         qDebug() << "Missing required WAV chunks or invalid data size";
         return false;
     }
 
-    audioData.totalFrames = dataSize / (audioData.channels * 2);
-    audioData.samples.resize(dataSize / 2);
+    return true;
+}
 
-    file.read(reinterpret_cast<char*>(audioData.samples.data()), dataSize);
+bool AudioDecoder::loadWavFile(const QString& filePath, AudioData& audioData) {
+    std::ifstream file(filePath.toStdString().c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        qDebug() << "Cannot open file:" << filePath;
+        return false;
+    }
+
+    WavFormat format;
+    if (!readWavHeader(file, format)) {
+        return false;
+    }
+
+    if (format.audioFormat != 1 || format.bitsPerSample != 16) {
+        qDebug() << "Only 16-bit PCM WAV files are supported";
+        return false;
+    }
+
+    audioData.channels = format.channels;
+    audioData.sampleRate = format.sampleRate;
+    audioData.totalFrames = format.dataSize / (audioData.channels * 2);
+    audioData.samples.resize(format.dataSize / 2);
+
+    file.read(reinterpret_cast<char*>(audioData.samples.data()), format.dataSize);
     
     return file.good();
 }
 
+bool AudioDecoder::readDsdHeader(const uint8_t* data, uint64_t size, DsdFormat& format) {
+    format.dataOffset = 0;
+    format.bytesPerChannel = 0;
+
+    if (size >= 92 && memcmp(data, "DSD ", 4) == 0) {
+        // DSF: little-endian "DSD ", "fmt " and "data" chunks in that order.
+        uint64_t fmt = readLe64(data + 4);
+        if (fmt > size - 52 || memcmp(data + fmt, "fmt ", 4) != 0) {
+            qDebug() << "Invalid DSF header";
+            return false;
+        }
+        const uint8_t* p = data + fmt;
+        uint64_t fmtSize = readLe64(p + 4);
+        uint32_t bitsPerSample = readLe32(p + 32);
+        if (readLe32(p + 16) != 0 || (bitsPerSample != 1 && bitsPerSample != 8)) {
+            qDebug() << "Unsupported DSF format";
+            return false;
+        }
+        format.channels = static_cast<int>(readLe32(p + 24));
+        format.sampleRate = readLe32(p + 28);
+        format.lsbFirst = bitsPerSample == 1;
+        format.blockSize = readLe32(p + 44);
+        uint64_t sampleCount = readLe64(p + 36);
+
+        uint64_t chunk = fmt + fmtSize;
+        if (fmtSize < 52 || chunk > size - 12 || memcmp(data + chunk, "data", 4) != 0 ||
+            format.blockSize == 0 || format.channels < 1 || format.channels > 8) {
+            qDebug() << "Invalid DSF header";
+            return false;
+        }
+        format.dataOffset = chunk + 12;
+        uint64_t dataSize = std::min(readLe64(data + chunk + 4), size - chunk) - 12;
+        uint64_t blocks = dataSize / (static_cast<uint64_t>(format.blockSize) * format.channels);
+        // The last block of each channel is padded; the sample count is exact.
+        format.bytesPerChannel = std::min(sampleCount / 8, blocks * format.blockSize);
+    } else if (size >= 16 && memcmp(data, "FRM8", 4) == 0 && memcmp(data + 12, "DSD ", 4) == 0) {
+        // DSDIFF: big-endian IFF chunks, each padded to an even size.
+        format.sampleRate = 0;
+        format.channels = 0;
+        format.lsbFirst = false;
+        format.blockSize = 0;
+        uint64_t dataSize = 0;
+        bool compressed = false;
+
+        uint64_t pos = 16;
+        while (pos + 12 <= size && format.dataOffset == 0) {
+            const uint8_t* id = data + pos;
+            uint64_t chunkSize = std::min(readBe64(data + pos + 4), size - pos - 12);
+            uint64_t body = pos + 12;
+
+            if (memcmp(id, "PROP", 4) == 0 && chunkSize >= 4 && memcmp(data + body, "SND ", 4) == 0) {
+                uint64_t sub = body + 4;
+                while (sub + 12 <= body + chunkSize) {
+                    const uint8_t* subId = data + sub;
+                    uint64_t subSize = std::min(readBe64(data + sub + 4), body + chunkSize - sub - 12);
+                    const uint8_t* p = data + sub + 12;
+                    if (memcmp(subId, "FS  ", 4) == 0 && subSize >= 4) {
+                        format.sampleRate = readBe32(p);
+                    } else if (memcmp(subId, "CHNL", 4) == 0 && subSize >= 2) {
+                        format.channels = (p[0] << 8) | p[1];
+                    } else if (memcmp(subId, "CMPR", 4) == 0 && subSize >= 4) {
+                        compressed = memcmp(p, "DSD ", 4) != 0;
+                    }
+                    sub += 12 + subSize + (subSize & 1);
+                }
+            } else if (memcmp(id, "DSD ", 4) == 0) {
+                format.dataOffset = body;
+                dataSize = chunkSize;
+            } else if (memcmp(id, "DST ", 4) == 0) {
+                compressed = true;
+                break;
+            }
+            pos = body + chunkSize + (chunkSize & 1);
+        }
+
+        if (compressed) {
+            qDebug() << "DST-compressed DFF files are not supported";
+            return false;
+        }
+        if (format.dataOffset == 0 || format.channels < 1 || format.channels > 8) {
+            qDebug() << "Invalid DFF header";
+            return false;
+        }
+        format.bytesPerChannel = dataSize / format.channels;
+    } else {
+        qDebug() << "Not a DSF or DFF file";
+        return false;
+    }
+
+    // DSD64 (2.8224 MHz) up to DSD512 on either rate family.
+    bool family = format.sampleRate % 44100 == 0 || format.sampleRate % 48000 == 0;
+    if (!family || format.sampleRate < 2822400 || format.sampleRate > 24576000) {
+        qDebug() << "Unsupported DSD rate:" << format.sampleRate;
+        return false;
+    }
+    if (format.bytesPerChannel == 0) {
+        qDebug() << "DSD file has no samples";
+        return false;
+    }
+    return true;
+}
+
+bool AudioDecoder::loadDsdFile(const QString& filePath, AudioData& audioData, bool dop) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Cannot open file:" << filePath;
+        return false;
+    }
+    const uint8_t* data = file.map(0, file.size());
+    DsdFormat format;
+    if (!data || !readDsdHeader(data, static_cast<uint64_t>(file.size()), format)) {
+        return false;
+    }
+
+    const size_t channels = static_cast<size_t>(format.channels);
+    const size_t chunk = format.blockSize ? format.blockSize : kDsdChunkBytes;
+    const size_t stride = format.blockSize ? 1 : channels;
+    const uint8_t* base = data + format.dataOffset;
+    // Start of chunk `index` of a channel; its bytes are stride apart.
+    auto chunkData = [&](uint64_t index, size_t channel) {
+        return format.blockSize
+            ? base + (index * channels + channel) * format.blockSize
+            : base + index * chunk * channels + channel;
+    };
+    const uint64_t chunks = (format.bytesPerChannel + chunk - 1) / chunk;
+
+    audioData.channels = format.channels;
+
+    if (dop) {
+        // Two DSD bytes per channel and frame, sent oldest bit first.
+        static const auto reversed = [] {
+            std::vector<uint8_t> table(256);
+            for (int i = 0; i < 256; ++i) {
+                uint8_t value = 0;
+                for (int bit = 0; bit < 8; ++bit) {
+                    value |= ((i >> bit) & 1) << (7 - bit);
+                }
+                table[i] = value;
+            }
+            return table;
+        }();
+        const uint8_t* order = format.lsbFirst ? reversed.data() : nullptr;
+
+        audioData.sampleRate = format.sampleRate / 16;
+        audioData.totalFrames = format.bytesPerChannel / 2;
+        audioData.samples.resize(audioData.totalFrames * channels);
+        audioData.dop = true;
+
+        for (size_t ch = 0; ch < channels; ++ch) {
+            int16_t* out = audioData.samples.data() + ch;
+            uint8_t high = 0;
+            for (uint64_t index = 0, byte = 0; index < chunks; ++index) {
+                const uint8_t* p = chunkData(index, ch);
+                size_t count = static_cast<size_t>(std::min<uint64_t>(chunk, format.bytesPerChannel - byte));
+                for (size_t i = 0; i < count; ++i, ++byte, p += stride) {
+                    uint8_t value = order ? order[*p] : *p;
+                    if (byte & 1) {
+                        if (byte / 2 < audioData.totalFrames) {
+                            out[byte / 2 * channels] = static_cast<int16_t>((high << 8) | value);
+                        }
+                    } else {
+                        high = value;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    DsdConverter converter(format.sampleRate, format.channels, format.lsbFirst);
+    audioData.sampleRate = converter.outputRate();
+    audioData.samples.reserve(format.bytesPerChannel / converter.bytesPerSample() * channels + channels);
+
+    // TPDF dither of one LSB peak from a pair of uniform xorshift values.
+    uint32_t rng = 0x9e3779b9u;
+    auto uniform = [&rng]() {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return static_cast<float>(rng >> 8) * (1.0f / 16777216.0f);
+    };
+
+    std::vector<std::vector<float>> pcm(channels);
+    for (uint64_t index = 0; index < chunks; ++index) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(chunk, format.bytesPerChannel - index * chunk));
+        for (size_t ch = 0; ch < channels; ++ch) {
+            pcm[ch].clear();
+            converter.process(static_cast<int>(ch), chunkData(index, ch), count, stride, pcm[ch]);
+        }
+
+        const size_t frames = pcm[0].size();
+        for (size_t i = 0; i < frames; ++i) {
+            for (size_t ch = 0; ch < channels; ++ch) {
+                float value = pcm[ch][i] * 32768.0f + uniform() - uniform();
+                value = std::max(-32768.0f, std::min(32767.0f, std::nearbyint(value)));
+                audioData.samples.push_back(static_cast<int16_t>(value));
+            }
+        }
+    }
+    audioData.totalFrames = audioData.samples.size() / channels;
+    return audioData.totalFrames > 0;
+}
+
 bool AudioDecoder::loadWithFfmpeg(const QString& filePath, AudioData& audioData) {
     if (!isFfmpegAvailable()) {
         return false;
     }
 
-    QString tempWavPath = QDir::temp().absoluteFilePath("temp_audio.wav");
+    // Unique per call so several decodes can run in parallel.
+    QTemporaryFile tempWav(QDir::temp().absoluteFilePath("hires_decode_XXXXXX.wav"));
+    if (!tempWav.open()) {
+        qDebug() << "Failed to create temporary WAV file";
+        return false;
+    }
+    QString tempWavPath = tempWav.fileName();
+    tempWav.close();
     
     QProcess ffmpegProcess;
     QStringList arguments;
     arguments << "-i" << filePath
               << "-acodec" << "pcm_s16le"
               << "-ar" << "44100"
-              << "-ac" << "2"
               << "-f" << "wav"
               << "-y"
               << tempWavPath;
@@ -156,26 +423,27 @@ bool AudioDecoder::loadWithFfmpeg(const QString& filePath, AudioData& audioData)
         return false;
     }
 
-    bool success = loadWavFile(tempWavPath, audioData);
-    QFile::remove(tempWavPath);
-    
-    return success;
+    return loadWavFile(tempWavPath, audioData);
 }
 
 bool AudioDecoder::isFfmpegAvailable() {
-    QString ffmpegPath = QCoreApplication::applicationDirPath() + "/ffmpeg.exe";
-    
-    QProcess process;
-    process.start(ffmpegPath, QStringList() << "-version");
-    process.waitForFinished(3000);
-    
-    return process.exitCode() == 0;
+    // Probed once; spawning a process per query stalls bulk decoding.
+    static const bool available = [] {
+        QString ffmpegPath = QCoreApplication::applicationDirPath() + "/ffmpeg.exe";
+
+        QProcess process;
+        process.start(ffmpegPath, QStringList() << "-version");
+        process.waitForFinished(3000);
+
+        return process.exitCode() == 0;
+    }();
+    return available;
 }
 
 const QStringList& AudioDecoder::supportedExtensions() {
     static const QStringList extensions = {
         "wav", "mp3", "flac", "m4a", "m4r", "aac", "ac3", 
-        "aif", "aiff", "alac", "ogg", "opus", "wma"
+        "aif", "aiff", "alac", "ogg", "opus", "wma", "dsf", "dff"
     };
     return extensions;
 }
@@ -187,7 +455,27 @@ double AudioDecoder::getAudioDuration(const QString& filePath) {
     }
 
     QString extension = QFileInfo(filePath).suffix().toLower();
+
+    // Compressed files are measured from their frame headers; only what the
+    // index cannot read is decoded in full.
+    if (SeekIndex::isIndexable(extension)) {
+        SeekIndex index;
+        if (index.load(filePath)) {
+            return index.duration();
+        }
+    }
     
+    if (extension == "dsf" || extension == "dff") {
+        QFile file(filePath);
+        DsdFormat format;
+        const uint8_t* data = file.open(QIODevice::ReadOnly) ? file.map(0, file.size()) : nullptr;
+        if (data && readDsdHeader(data, static_cast<uint64_t>(file.size()), format)) {
+            return static_cast<double>(format.bytesPerChannel) * 8.0 / format.sampleRate;
+        }
+        qDebug() << "Failed to get duration for:" << filePath;
+        return 0.0;
+    }
+
     AudioData tempData;
     
     if (extension == "wav") {
@@ -203,3 +491,78 @@ double AudioDecoder::getAudioDuration(const QString& filePath) {
     qDebug() << "Failed to get duration for:" << filePath;
     return 0.0;
 }
+
+bool AudioDecoder::loadImpulseResponse(const QString& filePath, std::vector<float>& samples,
+                                       int& channels, unsigned int& sampleRate) {
+    samples.clear();
+    QString extension = QFileInfo(filePath).suffix().toLower();
+
+    if (extension != "wav") {
+        AudioData audioData;
+        if (!loadAudioFile(filePath, audioData)) {
+            return false;
+        }
+
+        samples.resize(audioData.samples.size());
+        for (size_t i = 0; i < samples.size(); ++i) {
+            samples[i] = audioData.samples[i] / 32768.0f;
+        }
+        channels = audioData.channels;
+        sampleRate = audioData.sampleRate;
+        return true;
+    }
+
+    std::ifstream file(filePath.toStdString().c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        qDebug() << "Cannot open file:" << filePath;
+        return false;
+    }
+
+    WavFormat format;
+    if (!readWavHeader(file, format)) {
+        return false;
+    }
+
+    bool isPcm = format.audioFormat == 1 &&
+                 (format.bitsPerSample == 16 || format.bitsPerSample == 24 || format.bitsPerSample == 32);
+    bool isFloat = format.audioFormat == 3 && format.bitsPerSample == 32;
+    if (!isPcm && !isFloat) {
+        qDebug() << "Unsupported impulse response format:" << format.audioFormat << format.bitsPerSample << "bit";
+        return false;
+    }
+
+    const size_t bytesPerSample = format.bitsPerSample / 8;
+    std::vector<unsigned char> raw(format.dataSize);
+    file.read(reinterpret_cast<char*>(raw.data()), format.dataSize);
+    size_t count = static_cast<size_t>(file.gcount()) / bytesPerSample;
+    count -= count % format.channels;
+    if (count == 0) {
+        qDebug() << "Impulse response has no samples";
+        return false;
+    }
+
+    samples.resize(count);
+    const unsigned char* p = raw.data();
+    for (size_t i = 0; i < count; ++i, p += bytesPerSample) {
+        if (isFloat) {
+            float value;
+            memcpy(&value, p, sizeof(float));
+            samples[i] = value;
+        } else if (format.bitsPerSample == 16) {
+            samples[i] = static_cast<int16_t>(p[0] | (p[1] << 8)) / 32768.0f;
+        } else if (format.bitsPerSample == 24) {
+            int32_t value = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) |
+                                                 (static_cast<uint32_t>(p[1]) << 16) |
+                                                 (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+            samples[i] = value / 8388608.0f;
+        } else {
+            int32_t value;
+            memcpy(&value, p, sizeof(int32_t));
+            samples[i] = static_cast<float>(value / 2147483648.0);
+        }
+    }
+
+    channels = format.channels;
+    sampleRate = format.sampleRate;
+    return true;
+}
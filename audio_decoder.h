@@ -5,20 +5,25 @@
 #include <QStringList>
 #include <vector>
 #include <cstdint>
+#include <iosfwd>
 
 struct AudioData {
     std::vector<int16_t> samples;
     size_t totalFrames;
     int channels;
     unsigned int sampleRate;
+    // DSD-over-PCM: each sample carries 16 raw DSD bits, first in time at
+    // the top, and sampleRate is the DSD rate / 16. Not audio to process.
+    bool dop;
 
-    AudioData() : totalFrames(0), channels(0), sampleRate(0) {}
+    AudioData() : totalFrames(0), channels(0), sampleRate(0), dop(false) {}
 
     void reset() {
         samples.clear();
         totalFrames = 0;
         channels = 0;
         sampleRate = 0;
+        dop = false;
     }
 
     bool isValid() const {
@@ -34,13 +39,43 @@ class AudioDecoder {
 public:
     static QStringList getSupportedFormats();
     static bool isFormatSupported(const QString& extension);
-    static bool loadAudioFile(const QString& filePath, AudioData& audioData);
+    // DSF and DFF files are converted to PCM unless allowDop asks for their
+    // DoP framing.
+    static bool loadAudioFile(const QString& filePath, AudioData& audioData, bool allowDop = false);
     static double getAudioDuration(const QString& filePath);
+    static bool isFfmpegAvailable();
+
+    // Full-precision float samples for filter impulse responses. WAV files
+    // are read natively at any PCM or float bit depth; other formats go
+    // through the regular decode path.
+    static bool loadImpulseResponse(const QString& filePath, std::vector<float>& samples,
+                                    int& channels, unsigned int& sampleRate);
 
 private:
+    struct WavFormat {
+        uint16_t audioFormat;
+        uint16_t channels;
+        uint32_t sampleRate;
+        uint16_t bitsPerSample;
+        uint32_t dataSize;
+    };
+
+    struct DsdFormat {
+        unsigned int sampleRate;
+        int channels;
+        bool lsbFirst;
+        uint64_t dataOffset;
+        uint64_t bytesPerChannel;
+        // DSF stores blockSize bytes of each channel in turn; DFF
+        // interleaves single bytes (blockSize 0).
+        uint32_t blockSize;
+    };
+
+    static bool readWavHeader(std::ifstream& file, WavFormat& format);
     static bool loadWavFile(const QString& filePath, AudioData& audioData);
+    static bool readDsdHeader(const uint8_t* data, uint64_t size, DsdFormat& format);
+    static bool loadDsdFile(const QString& filePath, AudioData& audioData, bool dop);
     static bool loadWithFfmpeg(const QString& filePath, AudioData& audioData);
-    static bool isFfmpegAvailable();
     static const QStringList& supportedExtensions();
 };
 
@@ -1,41 +1,205 @@
 #include "audio_player.h"
 #include <QDebug>
 #include <cstring>
+#include <cmath>
 #include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIO_PLAYER_SSE2 1
+#endif
+
+// A new scrub grain every 10 ms keeps the response to the handle well
+// under 20 ms; holding still plays on for 150 ms.
+static const double kScrubHopSeconds = 0.01;
+static const size_t kScrubHoldGrains = 15;
+
+static void int16ToFloat(const int16_t* input, float* output, size_t count) {
+    const float scale = 1.0f / 32768.0f;
+    size_t i = 0;
+#ifdef AUDIO_PLAYER_SSE2
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#endif
+    for (; i < count; ++i) {
+        output[i] = input[i] * scale;
+    }
+}
+
+static void int16ToInt24(const int16_t* input, uint8_t* output, size_t count) {
+    // Bit-exact widening: the 16-bit sample becomes the top two bytes.
+    for (size_t i = 0; i < count; ++i, output += 3) {
+        uint16_t value = static_cast<uint16_t>(input[i]);
+        output[0] = 0;
+        output[1] = static_cast<uint8_t>(value);
+        output[2] = static_cast<uint8_t>(value >> 8);
+    }
+}
+
+static void fadeGains(CrossfadeCurve curve, double t, float& fadeOut, float& fadeIn) {
+    t = std::max(0.0, std::min(1.0, t));
+    switch (curve) {
+    case CrossfadeCurve::EqualPower:
+        fadeOut = static_cast<float>(std::cos(t * 1.57079632679489662));
+        fadeIn = static_cast<float>(std::sin(t * 1.57079632679489662));
+        break;
+    case CrossfadeCurve::SCurve:
+        fadeIn = static_cast<float>(t * t * (3.0 - 2.0 * t));
+        fadeOut = 1.0f - fadeIn;
+        break;
+    default:
+        fadeIn = static_cast<float>(t);
+        fadeOut = 1.0f - fadeIn;
+        break;
+    }
+}
+
+// The clock the callback anchors playback positions to, in seconds. Like
+// stream time it runs at wall-clock rate, but reading it needs no PortAudio
+// call.
+static double steadySeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Frames of data covered by startTime..endTime, endTime 0 meaning the end.
+static void rangeFrames(const AudioData& data, double startTime, double endTime, size_t& start, size_t& end) {
+    end = data.totalFrames;
+    if (endTime > 0.0) {
+        end = std::min(end, static_cast<size_t>(endTime * data.sampleRate + 0.5));
+    }
+    start = std::min(end, static_cast<size_t>(std::max(0.0, startTime) * data.sampleRate + 0.5));
+}
 
 AudioPlayer::AudioPlayer()
-    : currentFrame_(0)
+    : sampleRate_(0)
+    , channels_(0)
+    , dop_(false)
+    , currentFrame_(0)
+    , rangeStart_(0)
+    , totalFrames_(0)
     , stream_(nullptr)
     , state_(PlaybackState::Stopped)
-    , initialized_(false) {
+    , streamActive_(false)
+    , initialized_(false)
+    , controlStopping_(false)
+    , outputBits_(16)
+    , outputChannels_(0)
+    , deviceChannels_(0)
+    , bytesPerSample_(2)
+    , outputLatency_(0.0)
+    , dopMarker_(0x05)
+    , clockSequence_(0)
+    , clockFrame_(0.0)
+    , clockRate_(1.0)
+    , clockTime_(0.0)
+    , pendingStartTime_(0.0)
+    , pendingEndTime_(0.0)
+    , pendingShared_(false)
+    , pendingRetired_(false)
+    , nextVersion_(0)
+    , appliedNextVersion_(0)
+    , transitions_(0)
+    , crossfadeSeconds_(0.0f)
+    , crossfadeCurve_(static_cast<int>(CrossfadeCurve::EqualPower))
+    , nextFrame_(0)
+    , nextStart_(0)
+    , nextEnd_(0)
+    , nextShared_(false)
+    , nextRetired_(false)
+    , scrubbing_(false)
+    , scrubTarget_(0)
+    , scrubActive_(false)
+    , scrubStart_(0)
+    , scrubPrevious_(0)
+    , scrubOffset_(0)
+    , scrubLastTarget_(0)
+    , scrubStill_(0)
+    , scrubGain_(0.0f)
+    , scrubPreviousGain_(0.0f)
+    , seekVersion_(0)
+    , appliedSeekVersion_(0)
+    , stretchActive_(false) {
 }
 
 AudioPlayer::~AudioPlayer() {
     shutdown();
 }
 
-bool AudioPlayer::initialize() {
-    PaError err = Pa_Initialize();
-    if (err != paNoError) {
-        qDebug() << "PortAudio initialization failed:" << Pa_GetErrorText(err);
-        return false;
+void AudioPlayer::initialize() {
+    std::lock_guard<std::mutex> lock(controlMutex_);
+    if (control_.joinable()) {
+        return;
     }
 
-    initialized_ = true;
-    qDebug() << "PortAudio initialized successfully";
-    return true;
+    controlStopping_ = false;
+    control_ = std::thread(&AudioPlayer::controlLoop, this);
+    controlTasks_.push_back([this]() {
+        PaError err = Pa_Initialize();
+        if (err != paNoError) {
+            qDebug() << "PortAudio initialization failed:" << Pa_GetErrorText(err);
+            return;
+        }
+        initialized_ = true;
+        qDebug() << "PortAudio initialized successfully";
+    });
+    controlWake_.notify_one();
 }
 
 void AudioPlayer::shutdown() {
-    closeStream();
-    
-    if (initialized_) {
-        Pa_Terminate();
-        initialized_ = false;
+    if (!control_.joinable()) {
+        return;
+    }
+
+    runOnControlThread([this]() {
+        closeStream();
+        if (initialized_) {
+            Pa_Terminate();
+            initialized_ = false;
+        }
+    });
+    {
+        std::lock_guard<std::mutex> lock(controlMutex_);
+        controlStopping_ = true;
+    }
+    controlWake_.notify_one();
+    control_.join();
+}
+
+void AudioPlayer::runOnControlThread(const std::function<void()>& task) {
+    initialize();
+    std::packaged_task<void()> packaged(task);
+    std::future<void> done = packaged.get_future();
+    {
+        std::lock_guard<std::mutex> lock(controlMutex_);
+        controlTasks_.push_back([&packaged]() { packaged(); });
     }
+    controlWake_.notify_one();
+    done.wait();
 }
 
-bool AudioPlayer::loadAudio(const AudioData& audioData) {
+void AudioPlayer::controlLoop() {
+    std::unique_lock<std::mutex> lock(controlMutex_);
+    for (;;) {
+        controlWake_.wait(lock, [this]() { return controlStopping_ || !controlTasks_.empty(); });
+        if (controlTasks_.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(controlTasks_.front());
+        controlTasks_.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+bool AudioPlayer::loadAudio(const AudioData& audioData, double startTime, double endTime) {
     if (!audioData.isValid()) {
         qDebug() << "Invalid audio data";
         return false;
@@ -43,14 +207,47 @@ bool AudioPlayer::loadAudio(const AudioData& audioData) {
 
     stop();
     audioData_ = audioData;
-    currentFrame_ = 0;
-    
+    sampleRate_.store(audioData_.sampleRate, std::memory_order_relaxed);
+    channels_.store(audioData_.channels, std::memory_order_relaxed);
+    dop_.store(audioData_.dop, std::memory_order_relaxed);
     qDebug() << "Audio loaded - Duration:" << audioData_.getDuration() << "seconds";
+    return setRange(startTime, endTime);
+}
+
+bool AudioPlayer::setRange(double startTime, double endTime) {
+    if (sampleRate_.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    stop();
+    size_t start = 0;
+    size_t end = 0;
+    rangeFrames(audioData_, startTime, endTime, start, end);
+    if (start >= end) {
+        qDebug() << "Empty playback range:" << startTime << "-" << endTime;
+        return false;
+    }
+    currentFrame_ = start;
+    rangeStart_ = start;
+    totalFrames_ = end;
+
+    // The stream is closed, so the queued track can be dropped directly.
+    {
+        std::lock_guard<std::mutex> lock(nextMutex_);
+        pendingNext_ = AudioData();
+        pendingShared_ = false;
+        pendingRetired_ = false;
+        nextData_ = AudioData();
+        nextRetired_ = false;
+        nextFrame_ = 0;
+        nextShared_ = false;
+        appliedNextVersion_.store(nextVersion_.load());
+    }
     return true;
 }
 
 bool AudioPlayer::play() {
-    if (!audioData_.isValid()) {
+    if (sampleRate_.load(std::memory_order_relaxed) == 0) {
         qDebug() << "No valid audio data loaded";
         return false;
     }
@@ -59,13 +256,21 @@ bool AudioPlayer::play() {
         return true;
     }
 
-    if (!stream_ && !createStream()) {
-        return false;
-    }
-
-    PaError err = Pa_StartStream(stream_);
-    if (err != paNoError) {
-        qDebug() << "Failed to start audio stream:" << Pa_GetErrorText(err);
+    bool started = false;
+    runOnControlThread([this, &started]() {
+        if (!stream_ && !createStream()) {
+            return;
+        }
+        streamActive_.store(true, std::memory_order_relaxed);
+        PaError err = Pa_StartStream(stream_);
+        if (err != paNoError) {
+            qDebug() << "Failed to start audio stream:" << Pa_GetErrorText(err);
+            streamActive_.store(false, std::memory_order_relaxed);
+            return;
+        }
+        started = true;
+    });
+    if (!started) {
         return false;
     }
 
@@ -80,7 +285,8 @@ bool AudioPlayer::pause() {
     }
 
     if (stream_) {
-        PaError err = Pa_StopStream(stream_);
+        PaError err = paNoError;
+        runOnControlThread([this, &err]() { err = Pa_StopStream(stream_); });
         if (err != paNoError) {
             qDebug() << "Failed to pause stream:" << Pa_GetErrorText(err);
             return false;
@@ -93,23 +299,87 @@ bool AudioPlayer::pause() {
 }
 
 bool AudioPlayer::stop() {
-    closeStream();
-    currentFrame_ = 0;
+    if (stream_) {
+        runOnControlThread([this]() { closeStream(); });
+    }
+    currentFrame_ = rangeStart_.load();
     state_ = PlaybackState::Stopped;
     
     qDebug() << "Playback stopped";
     return true;
 }
 
+PlaybackState AudioPlayer::getState() const {
+    // The callback completes the stream on its own once the data runs out.
+    if (state_ == PlaybackState::Playing && stream_ && !streamActive_.load(std::memory_order_acquire)) {
+        return PlaybackState::Stopped;
+    }
+    return state_;
+}
+
 double AudioPlayer::getProgress() const {
-    if (audioData_.totalFrames == 0) {
+    const double start = static_cast<double>(rangeStart_.load(std::memory_order_acquire));
+    const double end = static_cast<double>(totalFrames_.load(std::memory_order_acquire));
+    if (end <= start) {
+        return 0.0;
+    }
+    return std::clamp((getPlaybackFrame() - start) / (end - start), 0.0, 1.0);
+}
+
+double AudioPlayer::getPlaybackFrame() const {
+    const double written = static_cast<double>(currentFrame_.load(std::memory_order_relaxed));
+    const double sampleRate = sampleRate_.load(std::memory_order_relaxed);
+    // Stopping the stream drains it, so outside playback nothing is in flight.
+    if (state_ != PlaybackState::Playing || !stream_ || sampleRate <= 0.0 ||
+        !streamActive_.load(std::memory_order_acquire)) {
+        return written;
+    }
+
+    unsigned sequence;
+    double frame;
+    double rate;
+    double time;
+    do {
+        sequence = clockSequence_.load(std::memory_order_acquire);
+        frame = clockFrame_.load(std::memory_order_relaxed);
+        rate = clockRate_.load(std::memory_order_relaxed);
+        time = clockTime_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) || sequence != clockSequence_.load(std::memory_order_relaxed));
+
+    double estimate = time > 0.0
+        ? frame - (time - steadySeconds()) * sampleRate * rate
+        : written - outputLatency_ * sampleRate * rate;
+
+    // A seek moves the read position before the next callback re-anchors
+    // the clock; never report more than the device can be holding.
+    double maxLag = (outputLatency_ * sampleRate + 4.0 * kFramesPerBuffer) * rate;
+    if (rate != 1.0) {
+        maxLag += 0.1 * sampleRate;
+    }
+    return std::clamp(estimate, std::max(0.0, written - maxLag), written);
+}
+
+double AudioPlayer::getRemainingTime() const {
+    const double sampleRate = sampleRate_.load(std::memory_order_relaxed);
+    if (sampleRate <= 0.0) {
         return 0.0;
     }
-    return static_cast<double>(currentFrame_) / audioData_.totalFrames;
+    double remaining = static_cast<double>(totalFrames_.load(std::memory_order_acquire)) - getPlaybackFrame();
+    return std::max(0.0, remaining / (sampleRate * clockRate_.load(std::memory_order_relaxed)));
+}
+
+double AudioPlayer::getDuration() const {
+    size_t start = rangeStart_.load(std::memory_order_acquire);
+    size_t end = totalFrames_.load(std::memory_order_acquire);
+    const unsigned sampleRate = sampleRate_.load(std::memory_order_relaxed);
+    return sampleRate > 0 && end > start
+        ? static_cast<double>(end - start) / sampleRate
+        : 0.0;
 }
 
 void AudioPlayer::seek(double position) {
-    if (!audioData_.isValid()) {
+    if (sampleRate_.load(std::memory_order_relaxed) == 0) {
         return;
     }
     
@@ -117,29 +387,81 @@ void AudioPlayer::seek(double position) {
     position = std::max(0.0, std::min(1.0, position));
     
     // Calculate the target frame
-    size_t targetFrame = static_cast<size_t>(position * audioData_.totalFrames);
+    size_t start = rangeStart_.load(std::memory_order_acquire);
+    size_t end = totalFrames_.load(std::memory_order_acquire);
+    size_t targetFrame = start + static_cast<size_t>(position * (end - start));
     
     // Update current frame position
     currentFrame_ = targetFrame;
+    seekVersion_.fetch_add(1, std::memory_order_release);
     
     qDebug() << "Seeking to position:" << position << "frame:" << targetFrame;
 }
 
-QStringList AudioPlayer::getAvailableDevices() const {
-    QStringList devices;
+bool AudioPlayer::beginScrub(double position) {
+    if (sampleRate_.load(std::memory_order_relaxed) == 0 || dop_.load(std::memory_order_relaxed)) {
+        return false;
+    }
 
-    if (!initialized_) {
-        return devices;
+    scrubTo(position);
+    if (scrubbing_.load(std::memory_order_relaxed)) {
+        return true;
     }
 
-    int deviceCount = Pa_GetDeviceCount();
-    for (int i = 0; i < deviceCount; i++) {
-        const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(i);
-        if (deviceInfo->maxOutputChannels > 0) {
-            devices << QString("%1: %2").arg(i).arg(deviceInfo->name);
+    bool started = false;
+    runOnControlThread([this, &started]() {
+        if (!stream_ && !createStream()) {
+            return;
         }
+        scrubbing_.store(true, std::memory_order_release);
+
+        // Paused, stopped or run out: the stream has to run for the grains.
+        if (Pa_IsStreamActive(stream_) != 1) {
+            Pa_StopStream(stream_);
+            streamActive_.store(true, std::memory_order_relaxed);
+            PaError err = Pa_StartStream(stream_);
+            if (err != paNoError) {
+                qDebug() << "Failed to start stream for scrubbing:" << Pa_GetErrorText(err);
+                streamActive_.store(false, std::memory_order_relaxed);
+                scrubbing_.store(false, std::memory_order_relaxed);
+                return;
+            }
+        }
+        started = true;
+    });
+    return started;
+}
+
+void AudioPlayer::scrubTo(double position) {
+    position = std::max(0.0, std::min(1.0, position));
+    size_t start = rangeStart_.load(std::memory_order_acquire);
+    size_t end = totalFrames_.load(std::memory_order_acquire);
+    scrubTarget_.store(start + static_cast<size_t>(position * (end - start)), std::memory_order_relaxed);
+}
+
+void AudioPlayer::endScrub() {
+    if (!scrubbing_.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+    if (state_ != PlaybackState::Playing && stream_) {
+        runOnControlThread([this]() { Pa_StopStream(stream_); });
     }
+}
 
+QStringList AudioPlayer::getAvailableDevices() {
+    QStringList devices;
+    runOnControlThread([this, &devices]() {
+        if (!initialized_) {
+            return;
+        }
+        int deviceCount = Pa_GetDeviceCount();
+        for (int i = 0; i < deviceCount; i++) {
+            const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(i);
+            if (deviceInfo->maxOutputChannels > 0) {
+                devices << QString("%1: %2").arg(i).arg(deviceInfo->name);
+            }
+        }
+    });
     return devices;
 }
 
@@ -147,6 +469,13 @@ bool AudioPlayer::createStream() {
     if (stream_) {
         return true;
     }
+    if (!initialized_) {
+        return false;
+    }
+
+    const unsigned sampleRate = sampleRate_.load(std::memory_order_relaxed);
+    const int sourceChannels = channels_.load(std::memory_order_relaxed);
+    const bool dop = dop_.load(std::memory_order_relaxed);
 
     PaStreamParameters outputParameters;
     outputParameters.device = Pa_GetDefaultOutputDevice();
@@ -155,16 +484,79 @@ bool AudioPlayer::createStream() {
         return false;
     }
 
-    outputParameters.channelCount = audioData_.channels;
-    outputParameters.sampleFormat = paInt16;
-    outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
+    if (sourceChannels > ChannelMixer::kMaxChannels) {
+        qDebug() << "Sources with more than" << ChannelMixer::kMaxChannels << "channels are not supported";
+        return false;
+    }
+
+    // The device gets the requested channel count, or the source's, as far
+    // as it goes; the mixer maps the source onto whatever is negotiated.
+    const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(outputParameters.device);
+    int channels = outputChannels_ > 0 ? outputChannels_ : sourceChannels;
+    channels = std::max(1, std::min(channels, std::min(deviceInfo->maxOutputChannels, ChannelMixer::kMaxChannels)));
+    if (dop) {
+        channels = sourceChannels;
+    }
+
+    outputParameters.channelCount = channels;
+    outputParameters.sampleFormat = outputBits_ == 24 ? paInt24 : paInt16;
+    outputParameters.suggestedLatency = deviceInfo->defaultLowOutputLatency;
     outputParameters.hostApiSpecificStreamInfo = nullptr;
 
+    if (!dop && channels > 2 &&
+        Pa_IsFormatSupported(nullptr, &outputParameters, sampleRate) != paFormatIsSupported) {
+        qDebug() << "Device does not accept" << channels << "channels, using stereo";
+        outputParameters.channelCount = channels = 2;
+    }
+
+    if (dop) {
+        // The DAC only recognises DoP in 24-bit words at DSD rate / 16.
+        outputParameters.sampleFormat = paInt24;
+        if (Pa_IsFormatSupported(nullptr, &outputParameters, sampleRate) != paFormatIsSupported) {
+            qDebug() << "Device does not accept 24-bit output at" << sampleRate << "Hz, needed for DoP";
+            return false;
+        }
+    } else if (outputParameters.sampleFormat == paInt24 &&
+        Pa_IsFormatSupported(nullptr, &outputParameters, sampleRate) != paFormatIsSupported) {
+        qDebug() << "Device does not accept 24-bit output, using 16-bit";
+        outputParameters.sampleFormat = paInt16;
+    }
+    int bits = outputParameters.sampleFormat == paInt24 ? 24 : 16;
+    bytesPerSample_ = bits / 8;
+
+    deviceChannels_ = channels;
+
+    // Everything after the mixer runs at the device channel count.
+    mixer_.prepare(sourceChannels, channels);
+    replayGain_.prepare(sampleRate, channels);
+    eq_.prepare(sampleRate, channels);
+    convolver_.prepare(sampleRate, channels, kFramesPerBuffer);
+    volume_.prepare(sampleRate, channels);
+    quantizer_.prepare(sampleRate, channels, bits);
+    spectrumTap_.prepare(sampleRate, channels);
+    levelTap_.prepare(channels);
+    processBuffer_.assign(kFramesPerBuffer * sourceChannels, 0.0f);
+    mixBuffer_.assign(kFramesPerBuffer * sourceChannels, 0.0f);
+    channelBuffer_.assign(kFramesPerBuffer * channels + ChannelMixer::kMaxChannels, 0.0f);
+    stretcher_.prepare(sampleRate, sourceChannels);
+    stretchBuffer_.assign(kFramesPerBuffer * sourceChannels, 0.0f);
+    stretchActive_ = false;
+    dopMarker_ = 0x05;
+    clockRate_.store(1.0, std::memory_order_relaxed);
+
+    // Hann grains of twice the hop sum to unity at 50% overlap.
+    const double pi = 3.14159265358979323846;
+    size_t hop = std::max<size_t>(1, static_cast<size_t>(sampleRate * kScrubHopSeconds));
+    scrubWindow_.resize(2 * hop);
+    for (size_t i = 0; i < scrubWindow_.size(); ++i) {
+        scrubWindow_[i] = static_cast<float>(0.5 - 0.5 * std::cos(pi * i / hop));
+    }
+
     PaError err = Pa_OpenStream(&stream_,
                                 nullptr,
                                 &outputParameters,
-                                audioData_.sampleRate,
-                                256,
+                                sampleRate,
+                                kFramesPerBuffer,
                                 paClipOff,
                                 audioCallback,
                                 this);
@@ -173,6 +565,12 @@ bool AudioPlayer::createStream() {
         qDebug() << "Failed to open audio stream:" << Pa_GetErrorText(err);
         return false;
     }
+    Pa_SetStreamFinishedCallback(stream_, streamFinished);
+
+    const PaStreamInfo* info = Pa_GetStreamInfo(stream_);
+    outputLatency_ = info ? info->outputLatency : 0.0;
+    clockTime_.store(0.0, std::memory_order_relaxed);
+    qDebug() << "Output latency:" << outputLatency_ * 1000.0 << "ms";
 
     return true;
 }
@@ -183,6 +581,11 @@ void AudioPlayer::closeStream() {
         Pa_CloseStream(stream_);
         stream_ = nullptr;
     }
+    deviceChannels_ = 0;
+}
+
+void AudioPlayer::streamFinished(void* userData) {
+    static_cast<AudioPlayer*>(userData)->streamActive_.store(false, std::memory_order_release);
 }
 
 int AudioPlayer::audioCallback(const void* inputBuffer, void* outputBuffer,
@@ -198,26 +601,527 @@ int AudioPlayer::processAudio(const void* inputBuffer, void* outputBuffer,
                              unsigned long framesPerBuffer,
                              const PaStreamCallbackTimeInfo* timeInfo,
                              PaStreamCallbackFlags statusFlags) {
-    int16_t* output = static_cast<int16_t*>(outputBuffer);
+    uint8_t* output = static_cast<uint8_t*>(outputBuffer);
+    const size_t frameBytes = static_cast<size_t>(deviceChannels_) * bytesPerSample_;
 
-    size_t framesRemaining = audioData_.totalFrames - currentFrame_;
-    size_t framesToCopy = std::min(static_cast<size_t>(framesPerBuffer), framesRemaining);
+#ifdef AUDIO_PLAYER_SSE2
+    // Flush denormals to zero so decaying filter tails stay cheap.
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
 
-    if (framesToCopy > 0) {
-        memcpy(output,
-               &audioData_.samples[currentFrame_ * audioData_.channels],
-               framesToCopy * audioData_.channels * sizeof(int16_t));
+    updateNext();
 
-        currentFrame_ += framesToCopy;
+    // Bit-perfect copy unless a processing stage is active.
+    bool gainActive = replayGain_.update();
+    bool eqActive = eq_.update();
+    bool convolverActive = convolver_.update();
+    bool volumeActive = volume_.update();
+    bool mixing = mixer_.update();
+    bool processing = gainActive || eqActive || convolverActive || volumeActive || mixing;
+    const bool dop = audioData_.dop;
 
-        if (framesToCopy < framesPerBuffer) {
-            memset(&output[framesToCopy * audioData_.channels], 0,
-                   (framesPerBuffer - framesToCopy) * audioData_.channels * sizeof(int16_t));
+    if (scrubbing_.load(std::memory_order_acquire)) {
+        if (!scrubActive_) {
+            // Start with a fresh grain at the target on the first frame.
+            scrubActive_ = true;
+            scrubOffset_ = scrubWindow_.size() / 2;
+            scrubLastTarget_ = static_cast<size_t>(-1);
+            scrubGain_ = 0.0f;
         }
-    } else {
-        memset(output, 0, framesPerBuffer * audioData_.channels * sizeof(int16_t));
+        renderScrub(output, framesPerBuffer);
+        return paContinue;
+    }
+    scrubActive_ = false;
+
+    // A seek leaves stale lookahead in the stretcher.
+    unsigned seekVersion = seekVersion_.load(std::memory_order_acquire);
+    if (seekVersion != appliedSeekVersion_) {
+        appliedSeekVersion_ = seekVersion;
+        stretcher_.reset();
+    }
+
+    bool stretching = stretcher_.update() && !dop;
+    if (!stretching && stretchActive_) {
+        // Back to normal speed: step back over the input the stretcher had
+        // buffered but not played, so nothing is skipped.
+        size_t pending = static_cast<size_t>(stretcher_.pendingInput());
+        size_t frame = currentFrame_.load(std::memory_order_relaxed);
+        currentFrame_.compare_exchange_strong(frame, frame > pending ? frame - pending : 0,
+                                              std::memory_order_relaxed);
+        stretcher_.reset();
+    }
+    stretchActive_ = stretching;
+
+    size_t produced = stretching
+        ? renderStretched(output, framesPerBuffer)
+        : renderDirect(output, framesPerBuffer, processing && !dop);
+
+    publishClock(timeInfo, produced);
+
+    if (produced < framesPerBuffer) {
+        fillSilence(output + produced * frameBytes, framesPerBuffer - produced);
+    }
+
+    if (produced == 0) {
         return paComplete;
     }
 
     return paContinue;
-}
\ No newline at end of file
+}
+
+size_t AudioPlayer::renderDirect(uint8_t* output, size_t frames, bool processing) {
+    // Unprocessed audio is copied as is, so then both channel counts match.
+    const size_t channels = static_cast<size_t>(audioData_.channels);
+    const size_t frameBytes = static_cast<size_t>(deviceChannels_) * bytesPerSample_;
+
+    size_t produced = 0;
+    while (produced < frames) {
+        size_t frame = currentFrame_.load(std::memory_order_relaxed);
+        size_t end = totalFrames_.load(std::memory_order_relaxed);
+
+        if (frame >= end) {
+            if (!promoteNext(frame)) {
+                break;
+            }
+            continue;
+        }
+
+        size_t remaining = end - frame;
+        size_t count = std::min(frames - produced, remaining);
+        size_t fadeFrames = crossfadeFrames();
+        const int16_t* input = &audioData_.samples[frame * channels];
+        uint8_t* out = output + produced * frameBytes;
+
+        if (remaining > fadeFrames) {
+            count = std::min(count, remaining - fadeFrames);
+            nextFrame_ = 0;
+            if (audioData_.dop) {
+                packDop(input, out, count);
+            } else if (processing) {
+                processBlock(input, nullptr, out, count, 0, 0);
+            } else if (bytesPerSample_ == 2) {
+                memcpy(out, input, count * frameBytes);
+            } else {
+                int16ToInt24(input, out, count * channels);
+            }
+            if (!processing && !audioData_.dop && spectrumTap_.isEnabled()) {
+                spectrumTap_.write(input, count);
+            }
+            if (!processing && !audioData_.dop && levelTap_.isEnabled()) {
+                levelTap_.write(input, count);
+            }
+        } else {
+            // Overlap: derive the incoming position from the outgoing one so
+            // the two stay aligned across seeks.
+            nextFrame_ = fadeFrames - remaining;
+            const int16_t* incoming = &nextData_.samples[(nextStart_ + nextFrame_) * channels];
+            processBlock(input, incoming, out, count, nextFrame_, fadeFrames);
+            nextFrame_ += count;
+        }
+
+        // A seek from the GUI thread wins over the advance.
+        currentFrame_.compare_exchange_strong(frame, frame + count, std::memory_order_relaxed);
+        produced += count;
+    }
+
+    return produced;
+}
+
+void AudioPlayer::packDop(const int16_t* input, uint8_t* output, size_t frames) {
+    // 24-bit little-endian words: the newer DSD byte, the older one, then
+    // the marker, which alternates 0x05 / 0xFA from frame to frame.
+    const size_t channels = static_cast<size_t>(audioData_.channels);
+    uint8_t marker = dopMarker_;
+    for (size_t i = 0; i < frames; ++i) {
+        for (size_t ch = 0; ch < channels; ++ch, output += 3) {
+            uint16_t value = static_cast<uint16_t>(*input++);
+            output[0] = static_cast<uint8_t>(value);
+            output[1] = static_cast<uint8_t>(value >> 8);
+            output[2] = marker;
+        }
+        marker = marker == 0x05 ? 0xFA : 0x05;
+    }
+    dopMarker_ = marker;
+}
+
+void AudioPlayer::fillSilence(uint8_t* output, size_t frames) {
+    if (!audioData_.dop) {
+        memset(output, 0, frames * deviceChannels_ * bytesPerSample_);
+        return;
+    }
+
+    // Zeros would drop the DAC out of DoP mode with a click; send DSD
+    // silence instead.
+    const int16_t idle = 0x6969;
+    const size_t channels = static_cast<size_t>(audioData_.channels);
+    int16_t block[8];
+    std::fill(block, block + channels, idle);
+    for (size_t i = 0; i < frames; ++i) {
+        packDop(block, output + i * channels * 3, 1);
+    }
+}
+
+size_t AudioPlayer::renderStretched(uint8_t* output, size_t frames) {
+    const size_t frameBytes = static_cast<size_t>(deviceChannels_) * bytesPerSample_;
+    float* buffer = processBuffer_.data();
+    float* input = stretchBuffer_.data();
+
+    size_t produced = 0;
+    while (produced < frames) {
+        size_t count = stretcher_.read(buffer, std::min(frames - produced, static_cast<size_t>(kFramesPerBuffer)));
+        if (count == 0) {
+            if (stretcher_.isFinished()) {
+                break;
+            }
+            size_t read = readSource(input, kFramesPerBuffer);
+            if (read == 0) {
+                stretcher_.drain();
+            } else {
+                stretcher_.write(input, read);
+            }
+            continue;
+        }
+
+        finishBlock(buffer, output + produced * frameBytes, count);
+        produced += count;
+    }
+    return produced;
+}
+
+size_t AudioPlayer::readSource(float* output, size_t frames) {
+    const size_t channels = static_cast<size_t>(audioData_.channels);
+    const CrossfadeCurve curve = static_cast<CrossfadeCurve>(crossfadeCurve_.load(std::memory_order_relaxed));
+    float* mix = mixBuffer_.data();
+
+    size_t produced = 0;
+    while (produced < frames) {
+        size_t frame = currentFrame_.load(std::memory_order_relaxed);
+        size_t end = totalFrames_.load(std::memory_order_relaxed);
+
+        if (frame >= end) {
+            if (!promoteNext(frame)) {
+                break;
+            }
+            continue;
+        }
+
+        size_t remaining = end - frame;
+        size_t count = std::min(frames - produced, remaining);
+        size_t fadeFrames = crossfadeFrames();
+        const int16_t* input = &audioData_.samples[frame * channels];
+        float* out = output + produced * channels;
+
+        if (remaining > fadeFrames) {
+            count = std::min(count, remaining - fadeFrames);
+            nextFrame_ = 0;
+            int16ToFloat(input, out, count * channels);
+        } else {
+            count = std::min(count, static_cast<size_t>(kFramesPerBuffer));
+            nextFrame_ = fadeFrames - remaining;
+            int16ToFloat(input, out, count * channels);
+            int16ToFloat(&nextData_.samples[(nextStart_ + nextFrame_) * channels], mix, count * channels);
+            crossfade(out, mix, count, audioData_.channels, nextFrame_, fadeFrames, curve);
+            nextFrame_ += count;
+        }
+
+        currentFrame_.compare_exchange_strong(frame, frame + count, std::memory_order_relaxed);
+        produced += count;
+    }
+    return produced;
+}
+
+bool AudioPlayer::promoteNext(size_t frame) {
+    if (nextShared_) {
+        // Another span of the same data: adjacent CUE tracks carry on from
+        // the current frame, anything else jumps there.
+        nextShared_ = false;
+        rangeStart_.store(nextStart_, std::memory_order_relaxed);
+        totalFrames_.store(nextEnd_, std::memory_order_release);
+        if (frame != nextStart_) {
+            currentFrame_.compare_exchange_strong(frame, nextStart_, std::memory_order_relaxed);
+        }
+        transitions_.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    if (nextRetired_ || !nextData_.isValid()) {
+        return false;
+    }
+
+    // Continue into the queued track. The finished one is parked in
+    // nextData_, untouched, and handed back to the GUI thread with the
+    // next swap.
+    std::swap(audioData_, nextData_);
+    nextRetired_ = true;
+    rangeStart_.store(nextStart_, std::memory_order_relaxed);
+    totalFrames_.store(nextEnd_, std::memory_order_release);
+    currentFrame_.compare_exchange_strong(frame, nextStart_ + nextFrame_, std::memory_order_relaxed);
+    nextFrame_ = 0;
+    transitions_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void AudioPlayer::publishClock(const PaStreamCallbackTimeInfo* timeInfo, size_t produced) {
+    // Anchor at the end of this buffer so the frame number belongs to the
+    // track that is current after any transition inside it. Stream time
+    // only tells how far ahead of now that is; some host APIs leave the
+    // timestamps empty, and the reported latency stands in.
+    double delay = outputLatency_;
+    if (timeInfo && timeInfo->outputBufferDacTime > 0.0 && timeInfo->currentTime > 0.0) {
+        delay = timeInfo->outputBufferDacTime - timeInfo->currentTime;
+    }
+    const double dacTime = steadySeconds() + delay;
+
+    // The stretcher holds read-ahead input and plays it at its own rate.
+    double frame = static_cast<double>(currentFrame_.load(std::memory_order_relaxed));
+    double rate = 1.0;
+    if (stretchActive_) {
+        frame = std::max(0.0, frame - stretcher_.pendingInput());
+        rate = stretcher_.speed();
+    }
+
+    unsigned sequence = clockSequence_.load(std::memory_order_relaxed);
+    clockSequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    clockFrame_.store(frame, std::memory_order_relaxed);
+    clockRate_.store(rate, std::memory_order_relaxed);
+    clockTime_.store(dacTime + static_cast<double>(produced) / audioData_.sampleRate, std::memory_order_relaxed);
+    clockSequence_.store(sequence + 2, std::memory_order_release);
+}
+
+void AudioPlayer::processBlock(const int16_t* input, const int16_t* incoming, uint8_t* output,
+                               size_t frames, size_t fadePosition, size_t fadeFrames) {
+    const size_t channels = static_cast<size_t>(audioData_.channels);
+    const CrossfadeCurve curve = static_cast<CrossfadeCurve>(crossfadeCurve_.load(std::memory_order_relaxed));
+    float* buffer = processBuffer_.data();
+    float* mix = mixBuffer_.data();
+
+    while (frames > 0) {
+        size_t chunk = std::min(frames, static_cast<size_t>(kFramesPerBuffer));
+        size_t samples = chunk * channels;
+
+        int16ToFloat(input, buffer, samples);
+        if (incoming) {
+            int16ToFloat(incoming, mix, samples);
+            crossfade(buffer, mix, chunk, audioData_.channels, fadePosition, fadeFrames, curve);
+            incoming += samples;
+            fadePosition += chunk;
+        }
+        finishBlock(buffer, output, chunk);
+
+        input += samples;
+        output += chunk * deviceChannels_ * bytesPerSample_;
+        frames -= chunk;
+    }
+}
+
+void AudioPlayer::finishBlock(float* buffer, uint8_t* output, size_t frames) {
+    if (mixer_.isActive()) {
+        mixer_.process(buffer, channelBuffer_.data(), frames);
+        buffer = channelBuffer_.data();
+    }
+    if (replayGain_.isActive()) {
+        replayGain_.process(buffer, frames);
+    }
+    if (eq_.isActive()) {
+        eq_.process(buffer, frames);
+    }
+    if (convolver_.isActive()) {
+        convolver_.process(buffer, frames);
+    }
+    if (volume_.isActive()) {
+        volume_.process(buffer, frames);
+    }
+    if (spectrumTap_.isEnabled()) {
+        spectrumTap_.write(buffer, frames);
+    }
+    if (levelTap_.isEnabled()) {
+        levelTap_.write(buffer, frames);
+    }
+    quantizer_.process(buffer, output, frames);
+}
+
+void AudioPlayer::renderScrub(uint8_t* output, size_t frames) {
+    const size_t channels = static_cast<size_t>(audioData_.channels);
+    const size_t totalFrames = totalFrames_.load(std::memory_order_relaxed);
+    const size_t hop = scrubWindow_.size() / 2;
+    const float scale = 1.0f / 32768.0f;
+    const int16_t* samples = audioData_.samples.data();
+    float* buffer = processBuffer_.data();
+
+    while (frames > 0) {
+        size_t chunk = std::min(frames, static_cast<size_t>(kFramesPerBuffer));
+
+        for (size_t i = 0; i < chunk; ++i) {
+            if (scrubOffset_ >= hop) {
+                startGrain();
+            }
+
+            // The previous grain is in its second half, the current one in
+            // its first.
+            size_t previous = scrubPrevious_ + hop + scrubOffset_;
+            size_t current = scrubStart_ + scrubOffset_;
+            float fadeOut = scrubWindow_[hop + scrubOffset_] * scrubPreviousGain_ * scale;
+            float fadeIn = scrubWindow_[scrubOffset_] * scrubGain_ * scale;
+            if (previous >= totalFrames) {
+                fadeOut = 0.0f;
+                previous = 0;
+            }
+            if (current >= totalFrames) {
+                fadeIn = 0.0f;
+                current = 0;
+            }
+
+            const int16_t* a = samples + previous * channels;
+            const int16_t* b = samples + current * channels;
+            float* out = buffer + i * channels;
+            for (size_t ch = 0; ch < channels; ++ch) {
+                out[ch] = a[ch] * fadeOut + b[ch] * fadeIn;
+            }
+            ++scrubOffset_;
+        }
+
+        finishBlock(buffer, output, chunk);
+        output += chunk * deviceChannels_ * bytesPerSample_;
+        frames -= chunk;
+    }
+}
+
+void AudioPlayer::startGrain() {
+    const size_t hop = scrubWindow_.size() / 2;
+    size_t target = scrubTarget_.load(std::memory_order_relaxed);
+
+    scrubPrevious_ = scrubStart_;
+    scrubPreviousGain_ = scrubGain_;
+    scrubOffset_ = 0;
+
+    if (target != scrubLastTarget_) {
+        scrubStart_ = target;
+        scrubLastTarget_ = target;
+        scrubStill_ = 0;
+        scrubGain_ = 1.0f;
+    } else {
+        // Holding still plays on briefly from there, then goes quiet, so a
+        // spot can be auditioned without the handle having to move.
+        scrubStart_ += hop;
+        scrubGain_ = ++scrubStill_ < kScrubHoldGrains ? 1.0f : 0.0f;
+    }
+}
+
+void AudioPlayer::crossfade(float* output, const float* incoming, size_t frames, int channels,
+                            size_t position, size_t length, CrossfadeCurve curve) {
+    // Gains are evaluated every kStep frames and interpolated in between,
+    // which keeps the transcendental curves off the per-sample path.
+    const size_t kStep = 32;
+
+    for (size_t i = 0; i < frames;) {
+        size_t count = std::min(frames - i, kStep);
+        float out0, in0, out1, in1;
+        fadeGains(curve, static_cast<double>(position + i) / length, out0, in0);
+        fadeGains(curve, static_cast<double>(position + i + count) / length, out1, in1);
+        const float outStep = (out1 - out0) / count;
+        const float inStep = (in1 - in0) / count;
+
+        for (size_t f = 0; f < count; ++f, ++i) {
+            const float fadeOut = out0 + outStep * f;
+            const float fadeIn = in0 + inStep * f;
+            float* sample = output + i * channels;
+            const float* next = incoming + i * channels;
+            for (int ch = 0; ch < channels; ++ch) {
+                sample[ch] = sample[ch] * fadeOut + next[ch] * fadeIn;
+            }
+        }
+    }
+}
+
+bool AudioPlayer::queueNext(AudioData&& audioData, double startTime, double endTime) {
+    if (!audioData.isValid() || audioData.channels != channels_.load(std::memory_order_relaxed) ||
+        audioData.sampleRate != sampleRate_.load(std::memory_order_relaxed) ||
+        audioData.dop != dop_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(nextMutex_);
+    pendingNext_ = std::move(audioData);
+    pendingStartTime_ = startTime;
+    pendingEndTime_ = endTime;
+    pendingShared_ = false;
+    pendingRetired_ = false;
+    nextVersion_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool AudioPlayer::queueRange(double startTime, double endTime) {
+    if (sampleRate_.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(nextMutex_);
+    pendingNext_ = AudioData();
+    pendingStartTime_ = startTime;
+    pendingEndTime_ = endTime;
+    pendingShared_ = true;
+    pendingRetired_ = false;
+    nextVersion_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void AudioPlayer::clearNext() {
+    std::lock_guard<std::mutex> lock(nextMutex_);
+    pendingNext_ = AudioData();
+    pendingShared_ = false;
+    pendingRetired_ = false;
+    nextVersion_.fetch_add(1, std::memory_order_release);
+}
+
+void AudioPlayer::releaseRetired() {
+    // Once the callback has taken the pending track, pendingNext_ holds
+    // whatever it swapped out: a replaced or already finished track.
+    std::lock_guard<std::mutex> lock(nextMutex_);
+    if (pendingRetired_) {
+        pendingNext_ = AudioData();
+        pendingRetired_ = false;
+    }
+}
+
+void AudioPlayer::setCrossfade(double seconds, CrossfadeCurve curve) {
+    crossfadeSeconds_.store(static_cast<float>(std::max(0.0, seconds)), std::memory_order_relaxed);
+    crossfadeCurve_.store(static_cast<int>(curve), std::memory_order_relaxed);
+}
+
+void AudioPlayer::setOutputBits(int bits) {
+    outputBits_ = bits == 24 ? 24 : 16;
+}
+
+void AudioPlayer::setOutputChannels(int channels) {
+    outputChannels_ = std::max(0, std::min(channels, ChannelMixer::kMaxChannels));
+}
+
+void AudioPlayer::updateNext() {
+    unsigned version = nextVersion_.load(std::memory_order_acquire);
+    if (version != appliedNextVersion_.load(std::memory_order_relaxed) && nextMutex_.try_lock()) {
+        std::swap(nextData_, pendingNext_);
+        pendingRetired_ = true;
+        nextRetired_ = false;
+        nextFrame_ = 0;
+        nextShared_ = pendingShared_;
+        // Spans resolve against the data they index; a shared one against
+        // the current buffer, whose format cannot change before it plays.
+        rangeFrames(nextShared_ ? audioData_ : nextData_, pendingStartTime_, pendingEndTime_,
+                    nextStart_, nextEnd_);
+        appliedNextVersion_.store(nextVersion_.load(std::memory_order_relaxed), std::memory_order_release);
+        nextMutex_.unlock();
+    }
+}
+
+size_t AudioPlayer::crossfadeFrames() const {
+    // Spans of one image are consecutive parts of a recording; overlapping
+    // them would double up the music.
+    if (nextShared_ || nextRetired_ || !nextData_.isValid() || audioData_.dop) {
+        return 0;
+    }
+
+    size_t current = totalFrames_.load(std::memory_order_relaxed) - rangeStart_.load(std::memory_order_relaxed);
+    size_t frames = static_cast<size_t>(crossfadeSeconds_.load(std::memory_order_relaxed) * audioData_.sampleRate);
+    return std::min(frames, std::min(current, nextEnd_ - nextStart_));
+}
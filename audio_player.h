@@ -2,8 +2,24 @@
 #define AUDIO_PLAYER_H
 
 #include "audio_decoder.h"
+#include "parametric_eq.h"
+#include "fft_convolver.h"
+#include "gain_stage.h"
+#include "quantizer.h"
+#include "sample_tap.h"
+#include "level_tap.h"
+#include "time_stretch.h"
+#include "channel_mixer.h"
 #include <QStringList>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include "portaudio.h"
@@ -15,26 +31,99 @@ enum class PlaybackState {
     Paused
 };
 
+enum class CrossfadeCurve {
+    Linear,
+    EqualPower,
+    SCurve
+};
+
 class AudioPlayer {
 public:
+    static constexpr unsigned long kFramesPerBuffer = 256;
+
     AudioPlayer();
     ~AudioPlayer();
 
-    bool initialize();
+    // Starts the thread every PortAudio call is made on and has it bring
+    // PortAudio up, which enumerates every device and can take a while.
+    // Returns at once; whatever needs PortAudio first queues behind it.
+    void initialize();
     void shutdown();
 
-    bool loadAudio(const AudioData& audioData);
+    // Plays startTime..endTime of the data; endTime 0 runs to the end.
+    bool loadAudio(const AudioData& audioData, double startTime = 0.0, double endTime = 0.0);
+    // Switches to another span of the loaded data without copying it, e.g.
+    // the next track of a CUE sheet image. Stops playback like loadAudio().
+    bool setRange(double startTime, double endTime);
+    size_t rangeStart() const { return rangeStart_.load(std::memory_order_acquire); }
+    size_t rangeEnd() const { return totalFrames_.load(std::memory_order_acquire); }
     bool play();
     bool pause();
     bool stop();
 
-    PlaybackState getState() const { return state_; }
+    PlaybackState getState() const;
+    // Position of what is currently heard, i.e. compensated for the output
+    // latency, interpolated from the clock published by the callback.
+    // Progress, duration and seek positions are relative to the range.
     double getProgress() const;
-    double getDuration() const { return audioData_.getDuration(); }
+    double getPlaybackFrame() const;
+    // Seconds until the last frame of the current track leaves the DAC.
+    double getRemainingTime() const;
+    double getDuration() const;
     void seek(double position);
-    QStringList getAvailableDevices() const;
 
-    bool isInitialized() const { return initialized_; }
+    // Queues the track that follows the current one. Playback runs into it
+    // without reopening the stream, overlapping the two by the crossfade
+    // duration. Fails when the format differs from the current track.
+    // DoP data always plays through a 24-bit stream, untouched by the DSP
+    // chain, speed and scrubbing, and without crossfades.
+    bool queueNext(AudioData&& audioData, double startTime = 0.0, double endTime = 0.0);
+    // Queues another span of the current data instead. A span that starts
+    // where the current one ends continues sample-exact; no crossfade.
+    bool queueRange(double startTime, double endTime);
+    void clearNext();
+    // Frees what the callback handed back once it took the last queued
+    // change: a replaced next track or the one that just finished.
+    void releaseRetired();
+    void setCrossfade(double seconds, CrossfadeCurve curve);
+    unsigned trackTransitions() const { return transitions_.load(std::memory_order_acquire); }
+
+    // Scrub mode replaces playback with short windowed grains taken at the
+    // scrub position, which the GUI moves while dragging. The stream runs
+    // even when paused, and the previous state resumes on endScrub().
+    bool beginScrub(double position);
+    void scrubTo(double position);
+    void endScrub();
+    bool isScrubbing() const { return scrubbing_.load(std::memory_order_relaxed); }
+
+    QStringList getAvailableDevices();
+
+    // Whether PortAudio is up already; does not wait for it.
+    bool isInitialized() const { return initialized_.load(std::memory_order_relaxed); }
+
+    GainStage& replayGain() { return replayGain_; }
+    ParametricEq& equalizer() { return eq_; }
+    FftConvolver& convolver() { return convolver_; }
+    GainStage& volume() { return volume_; }
+    Quantizer& quantizer() { return quantizer_; }
+    // Mono sum of what is sent to the device, for visualisation.
+    SampleTap& spectrumTap() { return spectrumTap_; }
+    LevelTap& levelTap() { return levelTap_; }
+    // Playback speed with pitch preserved; unity bypasses it.
+    TimeStretcher& timeStretch() { return stretcher_; }
+    // Source to device channel matrix, ahead of the rest of the chain.
+    ChannelMixer& channelMixer() { return mixer_; }
+
+    // Device sample format, 16 or 24 bit. Takes effect when the stream is
+    // next opened; falls back to 16 bit if the device refuses 24.
+    void setOutputBits(int bits);
+    int outputBits() const { return outputBits_; }
+    // Device channel count; 0 follows the source. Takes effect when the
+    // stream is next opened and is capped at what the device offers.
+    void setOutputChannels(int channels);
+    int outputChannels() const { return outputChannels_; }
+    // Channel count of the open stream, 0 when there is none.
+    int deviceChannels() const { return deviceChannels_; }
 
 private:
     static int audioCallback(const void* inputBuffer, void* outputBuffer,
@@ -48,14 +137,132 @@ private:
                     const PaStreamCallbackTimeInfo* timeInfo,
                     PaStreamCallbackFlags statusFlags);
 
+    static void streamFinished(void* userData);
+    // Runs task on the control thread and waits for it.
+    void runOnControlThread(const std::function<void()>& task);
+    void controlLoop();
     bool createStream();
     void closeStream();
+    void updateNext();
+    size_t crossfadeFrames() const;
+    void publishClock(const PaStreamCallbackTimeInfo* timeInfo, size_t produced);
+    void processBlock(const int16_t* input, const int16_t* incoming, uint8_t* output,
+                      size_t frames, size_t fadePosition, size_t fadeFrames);
+    void finishBlock(float* buffer, uint8_t* output, size_t frames);
+    size_t renderDirect(uint8_t* output, size_t frames, bool processing);
+    void packDop(const int16_t* input, uint8_t* output, size_t frames);
+    void fillSilence(uint8_t* output, size_t frames);
+    size_t renderStretched(uint8_t* output, size_t frames);
+    size_t readSource(float* output, size_t frames);
+    bool promoteNext(size_t frame);
+    void renderScrub(uint8_t* output, size_t frames);
+    void startGrain();
+    static void crossfade(float* output, const float* incoming, size_t frames, int channels,
+                          size_t position, size_t length, CrossfadeCurve curve);
 
     AudioData audioData_;
-    size_t currentFrame_;
+    // Format of audioData_ for the GUI thread. The callback swaps audioData_
+    // for the queued track, so it is only read on the GUI thread while the
+    // stream is closed; a queued track has the same format, so these stay.
+    // sampleRate_ is 0 until something is loaded.
+    std::atomic<unsigned> sampleRate_;
+    std::atomic<int> channels_;
+    std::atomic<bool> dop_;
+    // currentFrame_ indexes audioData_; the range being played is
+    // [rangeStart_, totalFrames_).
+    std::atomic<size_t> currentFrame_;
+    std::atomic<size_t> rangeStart_;
+    std::atomic<size_t> totalFrames_;
     PaStream* stream_;
     PlaybackState state_;
-    bool initialized_;
+    // Cleared by PortAudio once the stream stops or runs out, so the GUI
+    // thread can tell without asking it.
+    std::atomic<bool> streamActive_;
+    // Set on the control thread.
+    std::atomic<bool> initialized_;
+
+    // Every PortAudio call outside the callback is made on control_, from
+    // Pa_Initialize to Pa_Terminate: WASAPI and DirectSound initialize COM
+    // on the thread that brings them up and expect it to stay.
+    std::thread control_;
+    std::mutex controlMutex_;
+    std::condition_variable controlWake_;
+    std::deque<std::function<void()>> controlTasks_;
+    bool controlStopping_;
+
+    GainStage replayGain_;
+    ParametricEq eq_;
+    FftConvolver convolver_;
+    GainStage volume_;
+    Quantizer quantizer_;
+    SampleTap spectrumTap_;
+    LevelTap levelTap_;
+    ChannelMixer mixer_;
+    int outputBits_;
+    int outputChannels_;
+    int deviceChannels_;
+    size_t bytesPerSample_;
+    std::vector<float> processBuffer_;
+    std::vector<float> mixBuffer_;
+    std::vector<float> channelBuffer_;
+    double outputLatency_;
+    // DoP marker of the next frame, audio thread only.
+    uint8_t dopMarker_;
+
+    // Output clock: after each buffer the callback records which frame of
+    // the current track reaches the DAC at which stream time. Readers retry
+    // while the sequence is odd or changes underneath them.
+    std::atomic<unsigned> clockSequence_;
+    std::atomic<double> clockFrame_;
+    std::atomic<double> clockRate_;
+    std::atomic<double> clockTime_;
+
+    // Next track handoff: the GUI thread fills pendingNext_ under nextMutex_
+    // and the callback swaps it with nextData_, so decoded buffers are only
+    // ever freed on the GUI thread. After a swap pendingRetired_ marks what
+    // came back, for releaseRetired() to free.
+    std::mutex nextMutex_;
+    AudioData pendingNext_;
+    double pendingStartTime_;
+    double pendingEndTime_;
+    bool pendingShared_;
+    bool pendingRetired_;
+    std::atomic<unsigned> nextVersion_;
+    std::atomic<unsigned> appliedNextVersion_;
+    std::atomic<unsigned> transitions_;
+    std::atomic<float> crossfadeSeconds_;
+    std::atomic<int> crossfadeCurve_;
+
+    // Audio thread only. nextShared_ marks a queued span of audioData_,
+    // nextRetired_ a finished track parked in nextData_ until the next swap.
+    AudioData nextData_;
+    size_t nextFrame_;
+    size_t nextStart_;
+    size_t nextEnd_;
+    bool nextShared_;
+    bool nextRetired_;
+
+    // Scrubbing: the GUI sets the target frame; the callback starts a new
+    // Hann grain there every hop, overlapping the previous one by half.
+    std::atomic<bool> scrubbing_;
+    std::atomic<size_t> scrubTarget_;
+    std::vector<float> scrubWindow_;
+    bool scrubActive_;
+    size_t scrubStart_;
+    size_t scrubPrevious_;
+    size_t scrubOffset_;
+    size_t scrubLastTarget_;
+    size_t scrubStill_;
+    float scrubGain_;
+    float scrubPreviousGain_;
+
+    // Time-stretch sits between the source and the DSP chain. Seeks bump
+    // seekVersion_ so the callback drops the stretcher's read-ahead.
+    TimeStretcher stretcher_;
+    std::atomic<unsigned> seekVersion_;
+    unsigned appliedSeekVersion_;
+    bool stretchActive_;
+    std::vector<float> stretchBuffer_;
 };
 
 #endif // AUDIO_PLAYER_H
@@ -1,34 +1,163 @@
 #include "audiomanager.h"
 #include <QUrl>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cmath>
+
+namespace {
+
+const quint32 kSessionMagic = 0x48525353; // "HRSS"
+const quint32 kSessionVersion = 2;
+// Changes within this long of each other share one snapshot write.
+const int kSessionSaveDelayMs = 2000;
+// Many callbacks' worth, so the player has swapped out the finished track.
+const int kReleaseRetiredDelayMs = 100;
+
+QString displayName(const TrackEntry& track) {
+    return track.artist.isEmpty() ? track.title : track.artist + " - " + track.title;
+}
+
+// Tracks tagged with the same album and album artist form an album; without
+// an album tag, tracks from the same folder do.
+bool sameAlbum(const TrackStore& tracks, int row, int other) {
+    if (tracks.albumId(row) != tracks.albumId(other)) {
+        return false;
+    }
+    return tracks.albumId(row) == 0 ? tracks.directoryId(row) == tracks.directoryId(other)
+                                    : tracks.albumArtistId(row) == tracks.albumArtistId(other);
+}
+
+} // namespace
 
 AudioManager::AudioManager(QObject* parent)
     : QObject(parent)
     , player_(std::make_unique<AudioPlayer>())
     , playlistManager_(std::make_unique<PlaylistManager>(this))
-    , progress_(0.0)
+    , playlistFilter_(std::make_unique<PlaylistFilter>(playlistManager_.get()))
+    , loudnessScanner_(std::make_unique<LoudnessScanner>())
+    , folderImporter_(std::make_unique<FolderImporter>())
+    , libraryWatcher_(std::make_unique<LibraryWatcher>())
+    , waveform_(std::make_unique<WaveformProvider>())
+    , spectrum_(std::make_unique<SpectrumAnalyzer>(player_->spectrumTap()))
+    , levelMeter_(std::make_unique<LevelMeter>(player_->levelTap()))
     , duration_(0.0)
     , isLoading_(false)
     , loadingStatus_("Ready")
     , autoAdvance_(true)
+    , replayGainMode_(ReplayGainTrack)
+    , replayGainDb_(0.0)
+    , albumTrack_(0)
+    , albumEnergy_(0.0)
+    , albumWeight_(0.0)
+    , albumPeak_(0.0)
+    , albumLoudnessValid_(false)
+    , crossfadeDuration_(0.0)
+    , crossfadeCurve_(CrossfadeEqualPower)
+    , volume_(1.0)
+    , dsdOutput_(DsdPcm)
+    , preloadGeneration_(0)
+    , seenTransitions_(0)
+    , resumeId_(0)
+    , resumePosition_(0.0)
 {
-    progressTimer_ = new QTimer(this);
-    connect(progressTimer_, &QTimer::timeout, this, &AudioManager::updateProgress);
-
-    if (!player_->initialize()) {
-        qDebug() << "Failed to initialize audio player";
-    }
+    preloadPool_.setMaxThreadCount(1);
+
+    // Fires when the end of the current track is heard; positions in
+    // between are read by the view when it renders.
+    trackEventTimer_ = new QTimer(this);
+    trackEventTimer_->setSingleShot(true);
+    trackEventTimer_->setTimerType(Qt::PreciseTimer);
+    connect(trackEventTimer_, &QTimer::timeout, this, &AudioManager::onTrackEvent);
+
+    connect(loudnessScanner_.get(), &LoudnessScanner::resultsReady, this, &AudioManager::onLoudnessResults);
+    connect(loudnessScanner_.get(), &LoudnessScanner::progressChanged, this, &AudioManager::loudnessAnalysisChanged);
+    connect(folderImporter_.get(), &FolderImporter::tracksFound, this, &AudioManager::onTracksFound);
+    connect(folderImporter_.get(), &FolderImporter::progressChanged, this, &AudioManager::importChanged);
+    connect(folderImporter_.get(), &FolderImporter::foldersScanned, libraryWatcher_.get(), &LibraryWatcher::addFolders);
+    connect(libraryWatcher_.get(), &LibraryWatcher::changed, this, &AudioManager::onLibraryChanged);
+    connect(playlistManager_.get(), &PlaylistManager::playlistCleared, libraryWatcher_.get(), &LibraryWatcher::clear);
+    connect(playlistManager_.get(), &PlaylistManager::tracksAdded, this, [this](int first, int last) {
+        QStringList filePaths;
+        for (int i = first; i <= last; ++i) {
+            filePaths << playlistManager_->tracks().filePath(i);
+        }
+        filePaths.removeDuplicates();
+        loudnessScanner_->analyze(filePaths);
+    });
+
+    // Keep the pre-decoded next track in step with playlist edits.
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsInserted, this, &AudioManager::preloadNext);
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsRemoved, this, &AudioManager::preloadNext);
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsMoved, this, &AudioManager::preloadNext);
+    connect(playlistManager_.get(), &QAbstractItemModel::layoutChanged, this, &AudioManager::preloadNext);
+    connect(playlistManager_.get(), &QAbstractItemModel::modelReset, this, &AudioManager::preloadNext);
+
+    // The album loudness sum holds until tracks come, go or change what
+    // it is made of.
+    auto invalidateAlbumLoudness = [this]() { albumLoudnessValid_ = false; };
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsInserted, this, invalidateAlbumLoudness);
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsRemoved, this, invalidateAlbumLoudness);
+    connect(playlistManager_.get(), &QAbstractItemModel::modelReset, this, invalidateAlbumLoudness);
+    connect(playlistManager_.get(), &QAbstractItemModel::dataChanged, this,
+            [this](const QModelIndex&, const QModelIndex&, const QList<int>& roles) {
+                if (roles.isEmpty() || roles.contains(PlaylistManager::DurationRole) ||
+                    roles.contains(PlaylistManager::AlbumRole) || roles.contains(PlaylistManager::AlbumArtistRole)) {
+                    albumLoudnessValid_ = false;
+                }
+            });
+
+    // Device enumeration runs alongside the rest of startup; the first
+    // stream to open waits for it.
+    QElapsedTimer startup;
+    startup.start();
+    player_->initialize();
+    const qint64 initializeMs = startup.restart();
+
+    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dataDir);
+    sessionPath_ = QDir(dataDir).absoluteFilePath("session.snapshot");
+    restoreSession();
+    qDebug() << "Startup: audio initialize" << initializeMs << "ms, session restore" << startup.elapsed() << "ms,"
+             << playlistManager_->trackCount() << "tracks";
+
+    sessionTimer_ = new QTimer(this);
+    sessionTimer_->setSingleShot(true);
+    sessionTimer_->setInterval(kSessionSaveDelayMs);
+    connect(sessionTimer_, &QTimer::timeout, this, &AudioManager::saveSession);
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsInserted, this, &AudioManager::scheduleSessionSave);
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsRemoved, this, &AudioManager::scheduleSessionSave);
+    connect(playlistManager_.get(), &QAbstractItemModel::rowsMoved, this, &AudioManager::scheduleSessionSave);
+    connect(playlistManager_.get(), &QAbstractItemModel::layoutChanged, this, &AudioManager::scheduleSessionSave);
+    connect(playlistManager_.get(), &QAbstractItemModel::modelReset, this, &AudioManager::scheduleSessionSave);
+    connect(playlistManager_.get(), &QAbstractItemModel::dataChanged, this, &AudioManager::scheduleSessionSave);
+    connect(playlistManager_.get(), &PlaylistManager::currentIndexChanged, this, &AudioManager::scheduleSessionSave);
+    connect(this, &AudioManager::isPlayingChanged, this, &AudioManager::scheduleSessionSave);
+    connect(this, &AudioManager::outputBitsChanged, this, &AudioManager::scheduleSessionSave);
+    connect(this, &AudioManager::outputChannelsChanged, this, &AudioManager::scheduleSessionSave);
+    connect(this, &AudioManager::dsdOutputChanged, this, &AudioManager::scheduleSessionSave);
 }
 
-AudioManager::~AudioManager() = default;
+AudioManager::~AudioManager() {
+    sessionTimer_->stop();
+    saveSession();
+    preloadPool_.clear();
+    preloadPool_.waitForDone();
+}
 
 bool AudioManager::isPlaying() const {
     return player_ && player_->getState() == PlaybackState::Playing;
 }
 
 bool AudioManager::isFfmpegAvailable() const {
-    return AudioDecoder::getSupportedFormats().size() > 1;
+    return AudioDecoder::isFfmpegAvailable();
 }
 
 bool AudioManager::loadFile(const QString& filePath) {
@@ -81,6 +210,54 @@ void AudioManager::addMultipleToPlaylist(const QStringList& filePaths) {
     }
 }
 
+void AudioManager::importFolder(const QString& folder) {
+    folderImporter_->import(folder);
+}
+
+void AudioManager::cancelImport() {
+    folderImporter_->cancel();
+}
+
+void AudioManager::onTracksFound(const std::vector<TrackEntry>& tracks) {
+    // A folder imported again, or walked again after it changed, only adds
+    // the files the playlist does not have yet.
+    const TrackStore& store = playlistManager_->tracks();
+    std::vector<TrackEntry> added;
+    added.reserve(tracks.size());
+    for (const TrackEntry& track : tracks) {
+        if (store.rowsOf(track.filePath).empty()) {
+            added.push_back(track);
+        }
+    }
+    if (added.empty()) {
+        return;
+    }
+
+    bool wasEmpty = playlistManager_->trackCount() == 0;
+    playlistManager_->insertEntries(playlistManager_->trackCount(), added);
+
+    // Auto-play the first batch imported into an empty playlist
+    if (wasEmpty && playlistManager_->trackCount() > 0 && loadCurrentTrack()) {
+        play();
+    }
+}
+
+void AudioManager::onLibraryChanged(const LibraryChanges& changes) {
+    QStringList changed = playlistManager_->applyLibraryChanges(changes);
+    for (const QString& folder : changes.newFolders) {
+        folderImporter_->import(folder);
+    }
+
+    // Rewritten files need decoding and measuring again; the caches notice
+    // the new size and time by themselves.
+    if (changed.contains(loadedPath_)) {
+        loadedPath_.clear();
+    }
+    if (!changed.isEmpty()) {
+        loudnessScanner_->analyze(changed);
+    }
+}
+
 void AudioManager::playNext() {
     qDebug() << "playNext() called";
     qDebug() << "Before next() - currentIndex:" << playlistManager_->currentIndex() 
@@ -116,7 +293,13 @@ void AudioManager::playTrackAt(int index) {
 bool AudioManager::loadCurrentTrack() {
     qDebug() << "loadCurrentTrack() called - currentIndex:" << playlistManager_->currentIndex();
     
-    QString filePath = playlistManager_->currentFilePath();
+    const int row = playlistManager_->currentIndex();
+    if (row < 0 || row >= playlistManager_->trackCount()) {
+        qDebug() << "loadCurrentTrack() failed - empty filePath";
+        return false;
+    }
+    const TrackEntry track = playlistManager_->tracks().entry(row);
+    const QString& filePath = track.filePath;
     if (filePath.isEmpty()) {
         qDebug() << "loadCurrentTrack() failed - empty filePath";
         return false;
@@ -125,6 +308,45 @@ bool AudioManager::loadCurrentTrack() {
     qDebug() << "Loading current track:" << filePath;
 
     stop();
+
+    // Another track of the image that is already loaded only moves the range.
+    if (filePath == loadedPath_ && player_->setRange(track.startTime, track.endTime)) {
+        qDebug() << "Same file, switching range to" << track.startTime << "-" << track.endTime;
+    } else if (!loadTrackData(track)) {
+        return false;
+    }
+
+    currentFile_ = displayName(track);
+    duration_ = player_->getDuration();
+    waveform_->setRange(player_->rangeStart(), player_->rangeEnd());
+
+    // The track the last session stopped in picks up where it was.
+    if (resumePosition_ > 0.0 && duration_ > 0.0 && playlistManager_->tracks().id(row) == resumeId_) {
+        player_->seek(resumePosition_ / duration_);
+    }
+    resumePosition_ = 0.0;
+
+    // Update track duration in playlist
+    playlistManager_->setTrackDuration(row, duration_);
+    updateReplayGain();
+
+    // Loading dropped any queued track; decode the following one now so
+    // it is ready well before this one ends.
+    seenTransitions_ = player_->trackTransitions();
+    preloadKey_.clear();
+    preloadNext();
+
+    emit currentFileChanged();
+    emit durationChanged();
+    emit progressChanged();
+
+    qDebug() << "Track loaded successfully. Duration:" << duration_ << "seconds";
+    return true;
+}
+
+bool AudioManager::loadTrackData(const TrackEntry& track) {
+    const QString filePath = track.filePath;
+    loadedPath_.clear();
     setLoading(true);
     setLoadingStatus("Loading audio file...");
 
@@ -134,7 +356,7 @@ bool AudioManager::loadCurrentTrack() {
     if (AudioDecoder::isFormatSupported(extension)) {
         setLoadingStatus("Loading " + extension.toUpper() + " file...");
         
-        if (!AudioDecoder::loadAudioFile(filePath, audioData)) {
+        if (!AudioDecoder::loadAudioFile(filePath, audioData, dsdOutput_ == DsdDop)) {
             setLoading(false);
             setLoadingStatus("Ready");
             emit errorOccurred("Failed to load audio file: " + filePath);
@@ -147,30 +369,23 @@ bool AudioManager::loadCurrentTrack() {
         return false;
     }
 
-    if (!player_->loadAudio(audioData)) {
+    if (!player_->loadAudio(audioData, track.startTime, track.endTime)) {
         setLoading(false);
         setLoadingStatus("Ready");
         emit errorOccurred("Failed to load audio data");
         return false;
     }
 
-    currentFile_ = QFileInfo(filePath).baseName();
-    duration_ = audioData.getDuration();
-    progress_ = 0.0;
-
-    // Update track duration in playlist
-    Track* currentTrack = playlistManager_->currentTrack();
-    if (currentTrack) {
-        currentTrack->setDuration(duration_);
+    loadedPath_ = filePath;
+    // DoP samples are not audio; only a cached waveform can be shown.
+    if (audioData.dop) {
+        waveform_->load(filePath, nullptr);
+    } else {
+        waveform_->load(filePath, std::make_shared<AudioData>(std::move(audioData)));
     }
 
     setLoading(false);
     setLoadingStatus("Ready");
-    emit currentFileChanged();
-    emit durationChanged();
-    emit progressChanged();
-
-    qDebug() << "Track loaded successfully. Duration:" << duration_ << "seconds";
     return true;
 }
 
@@ -195,7 +410,7 @@ void AudioManager::play() {
     }
 
     if (player_->play()) {
-        progressTimer_->start(100);
+        scheduleTrackEvent();
         emit isPlayingChanged();
         qDebug() << "Playback started";
     } else {
@@ -205,16 +420,17 @@ void AudioManager::play() {
 
 void AudioManager::pause() {
     if (player_ && player_->pause()) {
-        progressTimer_->stop();
+        trackEventTimer_->stop();
         emit isPlayingChanged();
+        emit progressChanged();
         qDebug() << "Playback paused";
     }
 }
 
 void AudioManager::stop() {
     if (player_ && player_->stop()) {
-        progress_ = 0.0;
-        progressTimer_->stop();
+        trackEventTimer_->stop();
+        spectrum_->reset();
         emit isPlayingChanged();
         emit progressChanged();
         qDebug() << "Playback stopped";
@@ -231,29 +447,77 @@ void AudioManager::seek(double position) {
     position = std::max(0.0, std::min(1.0, position));
     
     player_->seek(position);
-    progress_ = position;
-    
+    if (isPlaying()) {
+        scheduleTrackEvent();
+    }
+
     emit progressChanged();
     qDebug() << "Seeking to position:" << position;
 }
 
+void AudioManager::beginScrub(double position) {
+    if (!player_ || !player_->beginScrub(position)) {
+        return;
+    }
+    // The playing track can't end while grains replace it.
+    trackEventTimer_->stop();
+}
+
+void AudioManager::scrub(double position) {
+    if (player_) {
+        player_->scrubTo(position);
+    }
+}
+
+void AudioManager::endScrub(double position) {
+    if (!player_) {
+        return;
+    }
+    player_->endScrub();
+    seek(position);
+}
+
 QStringList AudioManager::getAudioDevices() {
     return player_ ? player_->getAvailableDevices() : QStringList();
 }
 
-void AudioManager::updateProgress() {
-    if (player_) {
-        double newProgress = player_->getProgress();
-        if (newProgress != progress_) {
-            progress_ = newProgress;
-            emit progressChanged();
-        }
+double AudioManager::progress() const {
+    return player_ ? player_->getProgress() : 0.0;
+}
+
+void AudioManager::scheduleTrackEvent() {
+    // A few ms late is fine; early would only reschedule.
+    int msec = static_cast<int>(std::ceil(player_->getRemainingTime() * 1000.0));
+    trackEventTimer_->start(std::max(msec, 0) + 5);
+}
+
+void AudioManager::onTrackEvent() {
+    if (!player_) {
+        return;
+    }
+
+    if (player_->trackTransitions() != seenTransitions_) {
+        seenTransitions_ = player_->trackTransitions();
+        onTrackTransition();
+        player_->releaseRetired();
+        emit progressChanged();
+    }
+
+    if (player_->getState() == PlaybackState::Stopped) {
+        qDebug() << "Track finished";
+        emit isPlayingChanged();
+        emit progressChanged();
+        onTrackFinished();
+        return;
+    }
 
-        if (player_->getState() == PlaybackState::Stopped && progress_ >= 1.0) {
-            qDebug() << "Track finished";
-            progressTimer_->stop();
-            emit isPlayingChanged();
-            onTrackFinished();
+    // Not there yet: the device is still draining, or the last guess was
+    // early. Retry shortly rather than spinning.
+    if (player_->getState() == PlaybackState::Playing) {
+        if (player_->getRemainingTime() > 0.01) {
+            scheduleTrackEvent();
+        } else {
+            trackEventTimer_->start(10);
         }
     }
 }
@@ -271,6 +535,437 @@ QStringList AudioManager::getSupportedFormats() {
     return AudioDecoder::getSupportedFormats();
 }
 
+bool AudioManager::eqEnabled() const {
+    return player_->equalizer().isEnabled();
+}
+
+void AudioManager::setEqEnabled(bool enabled) {
+    if (player_->equalizer().isEnabled() != enabled) {
+        player_->equalizer().setEnabled(enabled);
+        emit eqEnabledChanged();
+    }
+}
+
+void AudioManager::setEqBand(int index, int type, double frequency, double gainDb, double q, int channel) {
+    if (index < 0 || index >= ParametricEq::kMaxBands || type < Peaking || type > Notch) {
+        qDebug() << "Invalid EQ band:" << index << "type:" << type;
+        return;
+    }
+
+    EqBand band;
+    band.type = static_cast<BiquadType>(type);
+    band.frequency = frequency;
+    band.gainDb = gainDb;
+    band.q = q;
+    band.enabled = true;
+    player_->equalizer().setBand(channel, index, band);
+}
+
+void AudioManager::disableEqBand(int index, int channel) {
+    EqBand band = player_->equalizer().band(channel < 0 ? 0 : channel, index);
+    band.enabled = false;
+    player_->equalizer().setBand(channel, index, band);
+}
+
+void AudioManager::clearEq() {
+    player_->equalizer().clearBands();
+}
+
+bool AudioManager::loadImpulseResponse(const QString& filePath) {
+    QString localPath = filePath.startsWith("file://") ? QUrl(filePath).toLocalFile() : filePath;
+
+    std::vector<float> samples;
+    int channels = 0;
+    unsigned int sampleRate = 0;
+    if (!AudioDecoder::loadImpulseResponse(localPath, samples, channels, sampleRate) ||
+        !player_->convolver().setImpulseResponse(samples, channels, sampleRate)) {
+        emit errorOccurred("Failed to load impulse response: " + localPath);
+        return false;
+    }
+
+    impulseResponse_ = QFileInfo(localPath).fileName();
+    emit impulseResponseChanged();
+    qDebug() << "Impulse response loaded:" << localPath << "taps:" << samples.size() / channels
+             << "channels:" << channels << "rate:" << sampleRate;
+    return true;
+}
+
+void AudioManager::clearImpulseResponse() {
+    player_->convolver().clearImpulseResponse();
+    if (!impulseResponse_.isEmpty()) {
+        impulseResponse_.clear();
+        emit impulseResponseChanged();
+    }
+}
+
+QVariantList AudioManager::mixMatrix(int inputChannels, int outputChannels) const {
+    QVariantList gains;
+    for (float gain : player_->channelMixer().matrix(inputChannels, outputChannels)) {
+        gains << static_cast<double>(gain);
+    }
+    return gains;
+}
+
+bool AudioManager::setMixMatrix(int inputChannels, int outputChannels, const QVariantList& gains) {
+    std::vector<float> matrix;
+    matrix.reserve(gains.size());
+    for (const QVariant& gain : gains) {
+        matrix.push_back(static_cast<float>(gain.toDouble()));
+    }
+    if (!player_->channelMixer().setMatrix(inputChannels, outputChannels, matrix)) {
+        qDebug() << "Invalid mix matrix:" << inputChannels << "x" << outputChannels << "with" << gains.size() << "gains";
+        return false;
+    }
+    return true;
+}
+
+void AudioManager::resetMixMatrix(int inputChannels, int outputChannels) {
+    player_->channelMixer().resetMatrix(inputChannels, outputChannels);
+}
+
+void AudioManager::setReplayGainMode(int mode) {
+    if (mode < ReplayGainOff || mode > ReplayGainAlbum || mode == replayGainMode_) {
+        return;
+    }
+    replayGainMode_ = mode;
+    emit replayGainModeChanged();
+    updateReplayGain();
+}
+
+void AudioManager::analyzeLoudness() {
+    const TrackStore& tracks = playlistManager_->tracks();
+    QStringList filePaths;
+    filePaths.reserve(tracks.size());
+    for (int i = 0; i < tracks.size(); ++i) {
+        filePaths << tracks.filePath(i);
+    }
+    loudnessScanner_->analyze(filePaths);
+}
+
+void AudioManager::cancelLoudnessAnalysis() {
+    loudnessScanner_->cancel();
+}
+
+void AudioManager::onLoudnessResults(const LoudnessResults& results) {
+    const TrackStore& tracks = playlistManager_->tracks();
+    const int current = playlistManager_->currentIndex();
+    const bool hasCurrent = current >= 0 && current < tracks.size();
+    bool affectsGain = false;
+
+    for (const auto& item : results) {
+        const LoudnessResult& result = item.second;
+        if (!result.valid) {
+            continue;
+        }
+        const std::vector<int> rows = playlistManager_->setTrackLoudness(
+            item.first, result.integratedLufs, result.loudnessRangeLu, result.truePeakDb);
+
+        for (int row : rows) {
+            // Tracks added without a length in their tags get the decoded one.
+            if (!tracks.isVirtual(row) && tracks.duration(row) <= 0.0) {
+                playlistManager_->setTrackDuration(row, result.duration);
+            }
+            // Only the current track and the rest of its album move the gain.
+            if (hasCurrent && (row == current ||
+                               (replayGainMode_ == ReplayGainAlbum && sameAlbum(tracks, row, current)))) {
+                affectsGain = true;
+            }
+        }
+    }
+
+    if (affectsGain) {
+        albumLoudnessValid_ = false;
+        updateReplayGain();
+    }
+}
+
+void AudioManager::updateReplayGain() {
+    double gainDb = 0.0;
+    const TrackStore& tracks = playlistManager_->tracks();
+    const int current = playlistManager_->currentIndex();
+
+    if (replayGainMode_ != ReplayGainOff && current >= 0 && current < tracks.size() && tracks.hasLoudness(current)) {
+        double loudness = tracks.loudness(current);
+        double peak = tracks.truePeak(current);
+
+        if (replayGainMode_ == ReplayGainAlbum) {
+            // Album loudness is the duration-weighted energy mean of the
+            // tracks' integrated loudness, summed once per album.
+            const int albumRow = tracks.rowOf(albumTrack_);
+            if (!albumLoudnessValid_ || albumRow < 0 || !sameAlbum(tracks, current, albumRow)) {
+                albumEnergy_ = 0.0;
+                albumWeight_ = 0.0;
+                albumPeak_ = peak;
+                for (int i = 0; i < tracks.size(); ++i) {
+                    if (!tracks.hasLoudness(i) || !sameAlbum(tracks, i, current)) {
+                        continue;
+                    }
+                    double duration = tracks.duration(i) > 0.0 ? tracks.duration(i) : 1.0;
+                    albumEnergy_ += duration * std::pow(10.0, tracks.loudness(i) / 10.0);
+                    albumWeight_ += duration;
+                    albumPeak_ = std::max(albumPeak_, tracks.truePeak(i));
+                }
+                albumLoudnessValid_ = true;
+            }
+            albumTrack_ = tracks.id(current);
+            loudness = 10.0 * std::log10(albumEnergy_ / albumWeight_);
+            peak = albumPeak_;
+        }
+
+        // Never push the true peak above full scale.
+        gainDb = std::min(-18.0 - loudness, -peak);
+    }
+
+    player_->replayGain().setGainDb(gainDb);
+    if (replayGainDb_ != gainDb) {
+        replayGainDb_ = gainDb;
+        emit replayGainChanged();
+    }
+}
+
+void AudioManager::setCrossfadeDuration(double seconds) {
+    seconds = std::max(0.0, std::min(30.0, seconds));
+    if (crossfadeDuration_ != seconds) {
+        crossfadeDuration_ = seconds;
+        player_->setCrossfade(crossfadeDuration_, static_cast<CrossfadeCurve>(crossfadeCurve_));
+        emit crossfadeChanged();
+    }
+}
+
+void AudioManager::setCrossfadeCurve(int curve) {
+    if (curve < CrossfadeLinear || curve > CrossfadeSCurve || curve == crossfadeCurve_) {
+        return;
+    }
+    crossfadeCurve_ = curve;
+    player_->setCrossfade(crossfadeDuration_, static_cast<CrossfadeCurve>(crossfadeCurve_));
+    emit crossfadeChanged();
+}
+
+void AudioManager::setVolume(double volume) {
+    volume = std::max(0.0, std::min(1.0, volume));
+    if (volume_ != volume) {
+        volume_ = volume;
+        player_->volume().setGain(static_cast<float>(volume_ * volume_ * volume_));
+        emit volumeChanged();
+    }
+}
+
+void AudioManager::setDitherMode(int mode) {
+    if (mode < DitherOff || mode > DitherNoiseShaped || mode == ditherMode()) {
+        return;
+    }
+    player_->quantizer().setMode(static_cast<DitherMode>(mode));
+    emit ditherModeChanged();
+}
+
+void AudioManager::setPlaybackSpeed(double speed) {
+    float clamped = std::clamp(static_cast<float>(speed), TimeStretcher::kMinSpeed, TimeStretcher::kMaxSpeed);
+    if (clamped == player_->timeStretch().speed()) {
+        return;
+    }
+    player_->timeStretch().setSpeed(clamped);
+    // The end of the track moves with the speed.
+    if (isPlaying()) {
+        scheduleTrackEvent();
+    }
+    emit playbackSpeedChanged();
+}
+
+void AudioManager::setStretchQuality(int quality) {
+    if (quality < StretchFast || quality > StretchHigh || quality == stretchQuality()) {
+        return;
+    }
+    player_->timeStretch().setQuality(static_cast<StretchQuality>(quality));
+    emit stretchQualityChanged();
+}
+
+void AudioManager::setOutputBits(int bits) {
+    if ((bits != 16 && bits != 24) || bits == player_->outputBits()) {
+        return;
+    }
+    player_->setOutputBits(bits);
+    emit outputBitsChanged();
+}
+
+void AudioManager::setOutputChannels(int channels) {
+    if (channels < 0 || channels > ChannelMixer::kMaxChannels || channels == player_->outputChannels()) {
+        return;
+    }
+    player_->setOutputChannels(channels);
+    emit outputChannelsChanged();
+}
+
+void AudioManager::setDsdOutput(int output) {
+    if (output < DsdPcm || output > DsdDop || output == dsdOutput_) {
+        return;
+    }
+    dsdOutput_ = output;
+    emit dsdOutputChanged();
+}
+
+void AudioManager::scheduleSessionSave() {
+    // Not restarted, so a stream of changes still saves every so often.
+    if (!sessionTimer_->isActive()) {
+        sessionTimer_->start();
+    }
+}
+
+void AudioManager::saveSession() {
+    QSaveFile file(sessionPath_);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write session snapshot:" << sessionPath_;
+        return;
+    }
+
+    const TrackStore& tracks = playlistManager_->tracks();
+    const int current = playlistManager_->currentIndex();
+    double position = 0.0;
+    if (!currentFile_.isEmpty()) {
+        position = player_->getProgress() * duration_;
+    } else if (current >= 0 && tracks.rowOf(resumeId_) == current) {
+        position = resumePosition_;
+    }
+
+    QDataStream out(&file);
+    out << kSessionMagic << kSessionVersion
+        << static_cast<qint32>(player_->outputBits()) << static_cast<qint32>(player_->outputChannels())
+        << static_cast<qint32>(dsdOutput_) << position;
+    playlistManager_->writeSession(out);
+
+    if (!file.commit()) {
+        qDebug() << "Failed to commit session snapshot:" << sessionPath_;
+    }
+}
+
+void AudioManager::restoreSession() {
+    QFile file(sessionPath_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    // One read; the rows are copied out of it a column at a time.
+    const QByteArray data = file.readAll();
+    QDataStream in(data);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 bits = 0;
+    qint32 channels = 0;
+    qint32 dsdOutput = 0;
+    double position = 0.0;
+    in >> magic >> version;
+    if (magic != kSessionMagic || version != kSessionVersion) {
+        qDebug() << "Ignoring session snapshot with unknown format";
+        return;
+    }
+    in >> bits >> channels >> dsdOutput >> position;
+    if (in.status() != QDataStream::Ok) {
+        return;
+    }
+
+    setOutputBits(bits);
+    setOutputChannels(channels);
+    setDsdOutput(dsdOutput);
+    if (!playlistManager_->restoreSession(in)) {
+        qDebug() << "Session snapshot is damaged, starting with an empty playlist";
+        return;
+    }
+    const TrackStore& tracks = playlistManager_->tracks();
+    const int current = playlistManager_->currentIndex();
+    if (current >= 0 && position > 0.0) {
+        resumeId_ = tracks.id(current);
+        resumePosition_ = position;
+    }
+
+    // Measurements come back with the rows; only an interrupted scan is
+    // picked up again.
+    QStringList unmeasured;
+    for (int row = 0; row < tracks.size(); ++row) {
+        if (!tracks.hasLoudness(row)) {
+            unmeasured << tracks.filePath(row);
+        }
+    }
+    unmeasured.removeDuplicates();
+    loudnessScanner_->analyze(unmeasured);
+}
+
+void AudioManager::preloadNext() {
+    if (currentFile_.isEmpty()) {
+        return;
+    }
+
+    const TrackStore& tracks = playlistManager_->tracks();
+    const int next = playlistManager_->currentIndex() + 1;
+    const bool hasNext = autoAdvance_ && next > 0 && next < tracks.size();
+    QString nextPath = hasNext ? tracks.filePath(next) : QString();
+    QString key = hasNext ? nextPath + '#' + QString::number(tracks.startTime(next)) : QString();
+    if (key == preloadKey_) {
+        return;
+    }
+
+    preloadKey_ = key;
+    unsigned generation = ++preloadGeneration_;
+    player_->clearNext();
+    if (nextPath.isEmpty()) {
+        return;
+    }
+
+    double startTime = tracks.startTime(next);
+    double endTime = tracks.endTime(next);
+    if (nextPath == loadedPath_) {
+        // The next CUE track lives in the buffer that is playing already.
+        player_->queueRange(startTime, endTime);
+        return;
+    }
+
+    bool allowDop = dsdOutput_ == DsdDop;
+    preloadPool_.start(QRunnable::create([this, nextPath, startTime, endTime, generation, allowDop]() {
+        auto audioData = std::make_shared<AudioData>();
+        bool ok = AudioDecoder::loadAudioFile(nextPath, *audioData, allowDop);
+        if (ok && !audioData->dop) {
+            WaveformProvider::buildCache(nextPath, *audioData);
+        }
+        QMetaObject::invokeMethod(this, [this, nextPath, startTime, endTime, generation, ok, audioData]() {
+            if (generation != preloadGeneration_) {
+                return;
+            }
+            if (!ok) {
+                qDebug() << "Failed to pre-decode next track:" << nextPath;
+            } else if (!player_->queueNext(std::move(*audioData), startTime, endTime)) {
+                qDebug() << "Next track format differs, it will start after a gap:" << nextPath;
+            }
+            player_->releaseRetired();
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void AudioManager::onTrackTransition() {
+    // The player already runs the pre-decoded track; only the playlist and
+    // the exposed state need to follow.
+    playlistManager_->next();
+    const int row = playlistManager_->currentIndex();
+    if (row < 0 || row >= playlistManager_->trackCount()) {
+        return;
+    }
+
+    const TrackEntry track = playlistManager_->tracks().entry(row);
+    qDebug() << "Continued into next track:" << track.filePath;
+    currentFile_ = displayName(track);
+    loadedPath_ = track.filePath;
+    duration_ = player_->getDuration();
+    playlistManager_->setTrackDuration(row, duration_);
+    updateReplayGain();
+    waveform_->load(track.filePath, nullptr);
+    waveform_->setRange(player_->rangeStart(), player_->rangeEnd());
+
+    emit currentFileChanged();
+    emit durationChanged();
+    preloadNext();
+
+    // The finished track comes back with the callback's next swap, which
+    // preloadNext() has just asked for; free it then rather than whenever
+    // the next track is queued.
+    QTimer::singleShot(kReleaseRetiredDelayMs, this, [this]() { player_->releaseRetired(); });
+}
 
 void AudioManager::setLoading(bool loading)
 {
@@ -5,10 +5,19 @@
 #include <QString>
 #include <QTimer>
 #include <QStringList>
+#include <QVariant>
+#include <QThreadPool>
 #include <memory>
 #include "audio_decoder.h"
 #include "audio_player.h"
 #include "playlist_manager.h"
+#include "playlist_filter.h"
+#include "loudness_scanner.h"
+#include "folder_importer.h"
+#include "library_watcher.h"
+#include "waveform_provider.h"
+#include "spectrum_analyzer.h"
+#include "level_meter.h"
 
 class AudioManager : public QObject
 {
@@ -21,23 +30,139 @@ class AudioManager : public QObject
     Q_PROPERTY(bool isLoading READ isLoading NOTIFY isLoadingChanged)
     Q_PROPERTY(QString loadingStatus READ loadingStatus NOTIFY loadingStatusChanged)
     Q_PROPERTY(PlaylistManager* playlist READ playlist CONSTANT)
+    Q_PROPERTY(PlaylistFilter* search READ search CONSTANT)
+    Q_PROPERTY(WaveformProvider* waveform READ waveform CONSTANT)
+    Q_PROPERTY(SpectrumAnalyzer* spectrum READ spectrum CONSTANT)
+    Q_PROPERTY(LevelMeter* levelMeter READ levelMeter CONSTANT)
+    Q_PROPERTY(bool eqEnabled READ eqEnabled WRITE setEqEnabled NOTIFY eqEnabledChanged)
+    Q_PROPERTY(int eqMaxBands READ eqMaxBands CONSTANT)
+    Q_PROPERTY(QString impulseResponse READ impulseResponse NOTIFY impulseResponseChanged)
+    Q_PROPERTY(int replayGainMode READ replayGainMode WRITE setReplayGainMode NOTIFY replayGainModeChanged)
+    Q_PROPERTY(double replayGain READ replayGain NOTIFY replayGainChanged)
+    Q_PROPERTY(bool isAnalyzingLoudness READ isAnalyzingLoudness NOTIFY loudnessAnalysisChanged)
+    Q_PROPERTY(int loudnessPending READ loudnessPending NOTIFY loudnessAnalysisChanged)
+    Q_PROPERTY(bool isImporting READ isImporting NOTIFY importChanged)
+    Q_PROPERTY(int importedCount READ importedCount NOTIFY importChanged)
+    Q_PROPERTY(double crossfadeDuration READ crossfadeDuration WRITE setCrossfadeDuration NOTIFY crossfadeChanged)
+    Q_PROPERTY(int crossfadeCurve READ crossfadeCurve WRITE setCrossfadeCurve NOTIFY crossfadeChanged)
+    Q_PROPERTY(double volume READ volume WRITE setVolume NOTIFY volumeChanged)
+    Q_PROPERTY(int ditherMode READ ditherMode WRITE setDitherMode NOTIFY ditherModeChanged)
+    Q_PROPERTY(int outputBits READ outputBits WRITE setOutputBits NOTIFY outputBitsChanged)
+    Q_PROPERTY(double playbackSpeed READ playbackSpeed WRITE setPlaybackSpeed NOTIFY playbackSpeedChanged)
+    Q_PROPERTY(int stretchQuality READ stretchQuality WRITE setStretchQuality NOTIFY stretchQualityChanged)
+    Q_PROPERTY(int dsdOutput READ dsdOutput WRITE setDsdOutput NOTIFY dsdOutputChanged)
+    Q_PROPERTY(int outputChannels READ outputChannels WRITE setOutputChannels NOTIFY outputChannelsChanged)
 
 public:
+    enum EqBandType {
+        Peaking = static_cast<int>(BiquadType::Peaking),
+        LowShelf = static_cast<int>(BiquadType::LowShelf),
+        HighShelf = static_cast<int>(BiquadType::HighShelf),
+        LowPass = static_cast<int>(BiquadType::LowPass),
+        HighPass = static_cast<int>(BiquadType::HighPass),
+        Notch = static_cast<int>(BiquadType::Notch)
+    };
+    Q_ENUM(EqBandType)
+
+    enum ReplayGainMode {
+        ReplayGainOff,
+        ReplayGainTrack,
+        ReplayGainAlbum
+    };
+    Q_ENUM(ReplayGainMode)
+
+    enum CrossfadeCurveType {
+        CrossfadeLinear = static_cast<int>(CrossfadeCurve::Linear),
+        CrossfadeEqualPower = static_cast<int>(CrossfadeCurve::EqualPower),
+        CrossfadeSCurve = static_cast<int>(CrossfadeCurve::SCurve)
+    };
+    Q_ENUM(CrossfadeCurveType)
+
+    enum DitherModeType {
+        DitherOff = static_cast<int>(DitherMode::Off),
+        DitherTpdf = static_cast<int>(DitherMode::Tpdf),
+        DitherNoiseShaped = static_cast<int>(DitherMode::NoiseShaped)
+    };
+    Q_ENUM(DitherModeType)
+
+    enum StretchQualityType {
+        StretchFast = static_cast<int>(StretchQuality::Fast),
+        StretchBalanced = static_cast<int>(StretchQuality::Balanced),
+        StretchHigh = static_cast<int>(StretchQuality::High)
+    };
+    Q_ENUM(StretchQualityType)
+
+    enum DsdOutputType {
+        DsdPcm,
+        DsdDop
+    };
+    Q_ENUM(DsdOutputType)
+
     explicit AudioManager(QObject* parent = nullptr);
     ~AudioManager();
 
     bool isPlaying() const;
-    double progress() const { return progress_; }
+    // Latency compensated and computed on each read; progressChanged only
+    // marks jumps (seek, load, stop, track change), so views that move with
+    // playback read it once per rendered frame.
+    double progress() const;
     QString currentFile() const { return currentFile_; }
     double duration() const { return duration_; }
     bool isFfmpegAvailable() const;
     bool isLoading() const { return isLoading_; }
     QString loadingStatus() const { return loadingStatus_; }
     PlaylistManager* playlist() const { return playlistManager_.get(); }
+    PlaylistFilter* search() const { return playlistFilter_.get(); }
+    WaveformProvider* waveform() const { return waveform_.get(); }
+    SpectrumAnalyzer* spectrum() const { return spectrum_.get(); }
+    LevelMeter* levelMeter() const { return levelMeter_.get(); }
+    bool eqEnabled() const;
+    void setEqEnabled(bool enabled);
+    int eqMaxBands() const { return ParametricEq::kMaxBands; }
+    QString impulseResponse() const { return impulseResponse_; }
+    int replayGainMode() const { return replayGainMode_; }
+    void setReplayGainMode(int mode);
+    double replayGain() const { return replayGainDb_; }
+    bool isAnalyzingLoudness() const { return loudnessScanner_->isBusy(); }
+    int loudnessPending() const { return loudnessScanner_->pendingCount(); }
+    bool isImporting() const { return folderImporter_->isBusy(); }
+    int importedCount() const { return folderImporter_->foundCount(); }
+    // Seconds of overlap between consecutive tracks; 0 plays them gaplessly.
+    double crossfadeDuration() const { return crossfadeDuration_; }
+    void setCrossfadeDuration(double seconds);
+    int crossfadeCurve() const { return crossfadeCurve_; }
+    void setCrossfadeCurve(int curve);
+    // Slider position 0..1, mapped to gain with a cubic taper so equal
+    // steps sound roughly equal.
+    double volume() const { return volume_; }
+    void setVolume(double volume);
+    int ditherMode() const { return static_cast<int>(player_->quantizer().mode()); }
+    void setDitherMode(int mode);
+    // 16 or 24; applies from the next track load.
+    int outputBits() const { return player_->outputBits(); }
+    void setOutputBits(int bits);
+    // 0.5..2.0 with pitch preserved.
+    double playbackSpeed() const { return player_->timeStretch().speed(); }
+    void setPlaybackSpeed(double speed);
+    int stretchQuality() const { return static_cast<int>(player_->timeStretch().quality()); }
+    void setStretchQuality(int quality);
+    // DSF/DFF as converted PCM or as DoP for DACs that decode it; applies
+    // from the next track load.
+    int dsdOutput() const { return dsdOutput_; }
+    void setDsdOutput(int output);
+    // Device channels, 1..8, or 0 to follow each file; applies from the
+    // next track load.
+    int outputChannels() const { return player_->outputChannels(); }
+    void setOutputChannels(int channels);
 
     Q_INVOKABLE bool loadFile(const QString& filePath);
     Q_INVOKABLE void addToPlaylist(const QString& filePath);
     Q_INVOKABLE void addMultipleToPlaylist(const QStringList& filePaths);
+    // Adds every playable file under the folder; tracks appear while the
+    // walk is still running. The folder is then watched, so files added,
+    // changed, moved or deleted there follow into the playlist.
+    Q_INVOKABLE void importFolder(const QString& folder);
+    Q_INVOKABLE void cancelImport();
     Q_INVOKABLE void play();
     Q_INVOKABLE void pause();
     Q_INVOKABLE void stop();
@@ -45,9 +170,35 @@ public:
     Q_INVOKABLE void playPrevious();
     Q_INVOKABLE void playTrackAt(int index);
     Q_INVOKABLE void seek(double position);
+    // Audible scrubbing while the seek handle is dragged; endScrub() seeks
+    // to the final position and carries on in the previous state.
+    Q_INVOKABLE void beginScrub(double position);
+    Q_INVOKABLE void scrub(double position);
+    Q_INVOKABLE void endScrub(double position);
     Q_INVOKABLE QStringList getAudioDevices();
     Q_INVOKABLE QStringList getSupportedFormats();
 
+    // Equalizer. A negative channel applies the band to every channel.
+    Q_INVOKABLE void setEqBand(int index, int type, double frequency, double gainDb, double q, int channel = -1);
+    Q_INVOKABLE void disableEqBand(int index, int channel = -1);
+    Q_INVOKABLE void clearEq();
+
+    // Channel matrix for one source/device channel count pair, row-major
+    // with a row per device channel. Without a custom matrix the ITU
+    // downmix is used.
+    Q_INVOKABLE QVariantList mixMatrix(int inputChannels, int outputChannels) const;
+    Q_INVOKABLE bool setMixMatrix(int inputChannels, int outputChannels, const QVariantList& gains);
+    Q_INVOKABLE void resetMixMatrix(int inputChannels, int outputChannels);
+
+    // Room-correction FIR filter.
+    Q_INVOKABLE bool loadImpulseResponse(const QString& filePath);
+    Q_INVOKABLE void clearImpulseResponse();
+
+    // Loudness analysis runs automatically for added tracks; these rescan
+    // or stop it explicitly.
+    Q_INVOKABLE void analyzeLoudness();
+    Q_INVOKABLE void cancelLoudnessAnalysis();
+
 signals:
     void isPlayingChanged();
     void progressChanged();
@@ -56,26 +207,84 @@ signals:
     void isFfmpegAvailableChanged();
     void isLoadingChanged();
     void loadingStatusChanged();
+    void eqEnabledChanged();
+    void impulseResponseChanged();
+    void replayGainModeChanged();
+    void replayGainChanged();
+    void loudnessAnalysisChanged();
+    void importChanged();
+    void crossfadeChanged();
+    void volumeChanged();
+    void ditherModeChanged();
+    void outputBitsChanged();
+    void playbackSpeedChanged();
+    void stretchQualityChanged();
+    void dsdOutputChanged();
+    void outputChannelsChanged();
     void errorOccurred(const QString& error);
 
-private slots:
-    void updateProgress();
-
 private:
     void setLoadingStatus(const QString& status);
     void setLoading(bool loading);
     bool loadCurrentTrack();
+    bool loadTrackData(const TrackEntry& track);
     void onTrackFinished();
+    void onLoudnessResults(const LoudnessResults& results);
+    void onTracksFound(const std::vector<TrackEntry>& tracks);
+    void onLibraryChanged(const LibraryChanges& changes);
+    void updateReplayGain();
+    void preloadNext();
+    void onTrackTransition();
+    void scheduleTrackEvent();
+    void onTrackEvent();
+    void scheduleSessionSave();
+    void saveSession();
+    void restoreSession();
 
     std::unique_ptr<AudioPlayer> player_;
     std::unique_ptr<PlaylistManager> playlistManager_;
-    double progress_;
+    // After the playlist, so it goes first and stops its search.
+    std::unique_ptr<PlaylistFilter> playlistFilter_;
+    std::unique_ptr<LoudnessScanner> loudnessScanner_;
+    std::unique_ptr<FolderImporter> folderImporter_;
+    std::unique_ptr<LibraryWatcher> libraryWatcher_;
+    std::unique_ptr<WaveformProvider> waveform_;
+    std::unique_ptr<SpectrumAnalyzer> spectrum_;
+    std::unique_ptr<LevelMeter> levelMeter_;
     QString currentFile_;
+    // File whose samples the player holds; CUE tracks of it need no decode.
+    QString loadedPath_;
     double duration_;
-    QTimer* progressTimer_;
+    QTimer* trackEventTimer_;
     bool isLoading_;
     QString loadingStatus_;
     bool autoAdvance_;
+    QString impulseResponse_;
+    int replayGainMode_;
+    double replayGainDb_;
+    // Album mode's energy sum, weight and peak for the album of track
+    // albumTrack_.
+    quint32 albumTrack_;
+    double albumEnergy_;
+    double albumWeight_;
+    double albumPeak_;
+    bool albumLoudnessValid_;
+    double crossfadeDuration_;
+    int crossfadeCurve_;
+    double volume_;
+    int dsdOutput_;
+    QThreadPool preloadPool_;
+    QString preloadKey_;
+    unsigned preloadGeneration_;
+    unsigned seenTransitions_;
+    // Session snapshot: the playlist, where playback stood and the output
+    // settings, rewritten a little after any of them changes and on exit.
+    QString sessionPath_;
+    QTimer* sessionTimer_;
+    // Where the restored current track stopped; applied when it is first
+    // loaded.
+    quint32 resumeId_;
+    double resumePosition_;
 };
 
 #endif // AUDIOMANAGER_H
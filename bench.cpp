@@ -0,0 +1,170 @@
+// Times the output-path DSP stages and the playlist store against the
+// targets they were written to:
+//   EQ         10 bands, stereo 192 kHz, under 1% of one core
+//   convolver  65536-tap stereo FIR at 44.1, 96 and 192 kHz, per channel
+//   stretch    stereo 96 kHz at each quality, over 20x realtime
+//   store      10k one-at-a-time TrackStore inserts in milliseconds
+// Exits non-zero when a target with a pass mark is missed.
+
+#include "fft_convolver.h"
+#include "parametric_eq.h"
+#include "time_stretch.h"
+#include "track_store.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Audio pushed through each stage per measurement.
+const double kAudioSeconds = 20.0;
+const size_t kBlockFrames = 256;
+const size_t kImpulseTaps = 65536;
+const int kTracks = 10000;
+
+const double kMaxEqCorePercent = 1.0;
+const double kMinStretchRealtime = 20.0;
+const double kMaxInsertMs = 100.0;
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::vector<float> noise(size_t samples, unsigned seed, float level) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> distribution(-level, level);
+    std::vector<float> result(samples);
+    for (float& sample : result) {
+        sample = distribution(random);
+    }
+    return result;
+}
+
+bool report(const char* name, double value, const char* unit, bool pass) {
+    std::printf("%-36s %10.3f %-12s %s\n", name, value, unit, pass ? "ok" : "MISSED");
+    return pass;
+}
+
+bool benchEq() {
+    const double sampleRate = 192000.0;
+    const int channels = 2;
+    ParametricEq eq;
+    eq.prepare(sampleRate, channels);
+    for (int i = 0; i < 10; ++i) {
+        EqBand band;
+        band.frequency = 31.25 * (1 << i);
+        band.gainDb = i % 2 == 0 ? 3.0 : -3.0;
+        band.q = 1.4;
+        band.enabled = true;
+        eq.setBand(-1, i, band);
+    }
+    eq.setEnabled(true);
+
+    const std::vector<float> input = noise(kBlockFrames * channels, 1, 0.5f);
+    std::vector<float> block(input.size());
+    const size_t blocks = static_cast<size_t>(kAudioSeconds * sampleRate / kBlockFrames);
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < blocks; ++i) {
+        block = input;
+        if (eq.update()) {
+            eq.process(block.data(), kBlockFrames);
+        }
+    }
+    const double percent = 100.0 * secondsSince(start) / kAudioSeconds;
+    return report("eq 10 bands stereo 192k", percent, "% core", percent < kMaxEqCorePercent);
+}
+
+void benchConvolver(double sampleRate) {
+    const int channels = 2;
+    FftConvolver convolver;
+    convolver.prepare(sampleRate, channels, kBlockFrames);
+    // A decaying noise tail, the shape of a measured room response.
+    std::vector<float> impulse = noise(kImpulseTaps * channels, 2, 1.0f);
+    for (size_t i = 0; i < impulse.size(); ++i) {
+        impulse[i] *= static_cast<float>(std::exp(-6.0 * static_cast<double>(i) / impulse.size()));
+    }
+    convolver.setImpulseResponse(impulse, channels, sampleRate);
+
+    const std::vector<float> input = noise(kBlockFrames * channels, 3, 0.5f);
+    std::vector<float> block(input.size());
+    const size_t blocks = static_cast<size_t>(kAudioSeconds * sampleRate / kBlockFrames);
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < blocks; ++i) {
+        block = input;
+        if (convolver.update()) {
+            convolver.process(block.data(), kBlockFrames);
+        }
+    }
+    const double percent = 100.0 * secondsSince(start) / kAudioSeconds / channels;
+    char name[64];
+    std::snprintf(name, sizeof(name), "convolver 64k taps %.1fk", sampleRate / 1000.0);
+    report(name, percent, "% core/ch", true);
+}
+
+bool benchStretch(StretchQuality quality, const char* name) {
+    const double sampleRate = 96000.0;
+    const int channels = 2;
+    TimeStretcher stretcher;
+    stretcher.prepare(sampleRate, channels);
+    stretcher.setQuality(quality);
+    stretcher.setSpeed(1.5f);
+    stretcher.update();
+
+    const std::vector<float> input = noise(kBlockFrames * channels, 4, 0.5f);
+    std::vector<float> output(kBlockFrames * channels);
+    const size_t inputFrames = static_cast<size_t>(kAudioSeconds * sampleRate);
+    size_t written = 0;
+    const Clock::time_point start = Clock::now();
+    while (!stretcher.isFinished()) {
+        if (stretcher.read(output.data(), kBlockFrames) > 0) {
+            continue;
+        }
+        if (written >= inputFrames) {
+            stretcher.drain();
+        } else {
+            stretcher.write(input.data(), kBlockFrames);
+            written += kBlockFrames;
+        }
+    }
+    const double realtime = kAudioSeconds / secondsSince(start);
+    return report(name, realtime, "x realtime", realtime > kMinStretchRealtime);
+}
+
+bool benchTrackStore() {
+    std::vector<TrackEntry> entries(kTracks);
+    for (int i = 0; i < kTracks; ++i) {
+        TrackEntry& entry = entries[static_cast<size_t>(i)];
+        entry.filePath = QString("/music/Artist %1/Album %2/%3 Track.flac").arg(i / 200).arg(i / 12).arg(i % 12 + 1);
+        entry.title = QString("Track %1").arg(i);
+        entry.artist = QString("Artist %1").arg(i / 200);
+        entry.album = QString("Album %1").arg(i / 12);
+        entry.trackNumber = i % 12 + 1;
+        entry.duration = 240.0;
+    }
+
+    TrackStore store;
+    const Clock::time_point start = Clock::now();
+    for (const TrackEntry& entry : entries) {
+        store.insert(store.size(), std::vector<TrackEntry>(1, entry));
+    }
+    const double ms = 1000.0 * secondsSince(start);
+    return report("track store 10k inserts", ms, "ms", ms < kMaxInsertMs);
+}
+
+} // namespace
+
+int main() {
+    bool pass = benchEq();
+    for (double sampleRate : { 44100.0, 96000.0, 192000.0 }) {
+        benchConvolver(sampleRate);
+    }
+    pass = benchStretch(StretchQuality::Fast, "stretch 1.5x stereo 96k fast") && pass;
+    pass = benchStretch(StretchQuality::Balanced, "stretch 1.5x stereo 96k balanced") && pass;
+    pass = benchStretch(StretchQuality::High, "stretch 1.5x stereo 96k high") && pass;
+    pass = benchTrackStore() && pass;
+    return pass ? 0 : 1;
+}
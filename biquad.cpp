@@ -0,0 +1,85 @@
+#include "biquad.h"
+#include <algorithm>
+#include <cmath>
+
+BiquadCoefficients BiquadCoefficients::design(BiquadType type, double sampleRate,
+                                              double frequency, double gainDb, double q) {
+    BiquadCoefficients c;
+    if (sampleRate <= 0.0) {
+        return c;
+    }
+
+    frequency = std::max(1.0, std::min(frequency, sampleRate * 0.499));
+    q = std::max(0.01, q);
+
+    const double pi = 3.14159265358979323846;
+    const double A = std::pow(10.0, gainDb / 40.0);
+    const double w0 = 2.0 * pi * frequency / sampleRate;
+    const double cosW0 = std::cos(w0);
+    const double alpha = std::sin(w0) / (2.0 * q);
+
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0;
+    double a0 = 1.0, a1 = 0.0, a2 = 0.0;
+
+    switch (type) {
+    case BiquadType::Peaking:
+        b0 = 1.0 + alpha * A;
+        b1 = -2.0 * cosW0;
+        b2 = 1.0 - alpha * A;
+        a0 = 1.0 + alpha / A;
+        a1 = -2.0 * cosW0;
+        a2 = 1.0 - alpha / A;
+        break;
+    case BiquadType::LowShelf: {
+        const double sqrtA2alpha = 2.0 * std::sqrt(A) * alpha;
+        b0 = A * ((A + 1.0) - (A - 1.0) * cosW0 + sqrtA2alpha);
+        b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * cosW0);
+        b2 = A * ((A + 1.0) - (A - 1.0) * cosW0 - sqrtA2alpha);
+        a0 = (A + 1.0) + (A - 1.0) * cosW0 + sqrtA2alpha;
+        a1 = -2.0 * ((A - 1.0) + (A + 1.0) * cosW0);
+        a2 = (A + 1.0) + (A - 1.0) * cosW0 - sqrtA2alpha;
+        break;
+    }
+    case BiquadType::HighShelf: {
+        const double sqrtA2alpha = 2.0 * std::sqrt(A) * alpha;
+        b0 = A * ((A + 1.0) + (A - 1.0) * cosW0 + sqrtA2alpha);
+        b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cosW0);
+        b2 = A * ((A + 1.0) + (A - 1.0) * cosW0 - sqrtA2alpha);
+        a0 = (A + 1.0) - (A - 1.0) * cosW0 + sqrtA2alpha;
+        a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cosW0);
+        a2 = (A + 1.0) - (A - 1.0) * cosW0 - sqrtA2alpha;
+        break;
+    }
+    case BiquadType::LowPass:
+        b0 = (1.0 - cosW0) / 2.0;
+        b1 = 1.0 - cosW0;
+        b2 = (1.0 - cosW0) / 2.0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cosW0;
+        a2 = 1.0 - alpha;
+        break;
+    case BiquadType::HighPass:
+        b0 = (1.0 + cosW0) / 2.0;
+        b1 = -(1.0 + cosW0);
+        b2 = (1.0 + cosW0) / 2.0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cosW0;
+        a2 = 1.0 - alpha;
+        break;
+    case BiquadType::Notch:
+        b0 = 1.0;
+        b1 = -2.0 * cosW0;
+        b2 = 1.0;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cosW0;
+        a2 = 1.0 - alpha;
+        break;
+    }
+
+    c.b0 = b0 / a0;
+    c.b1 = b1 / a0;
+    c.b2 = b2 / a0;
+    c.a1 = a1 / a0;
+    c.a2 = a2 / a0;
+    return c;
+}
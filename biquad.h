@@ -0,0 +1,32 @@
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+enum class BiquadType {
+    Peaking,
+    LowShelf,
+    HighShelf,
+    LowPass,
+    HighPass,
+    Notch
+};
+
+// Normalised transposed direct form II coefficients (a0 == 1).
+struct BiquadCoefficients {
+    double b0;
+    double b1;
+    double b2;
+    double a1;
+    double a2;
+
+    BiquadCoefficients() : b0(1.0), b1(0.0), b2(0.0), a1(0.0), a2(0.0) {}
+
+    bool isIdentity() const {
+        return b0 == 1.0 && b1 == 0.0 && b2 == 0.0 && a1 == 0.0 && a2 == 0.0;
+    }
+
+    // RBJ audio EQ cookbook designs.
+    static BiquadCoefficients design(BiquadType type, double sampleRate,
+                                     double frequency, double gainDb, double q);
+};
+
+#endif // BIQUAD_H
@@ -0,0 +1,230 @@
+#include "channel_mixer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHANNEL_MIXER_SSE2 1
+#endif
+
+namespace {
+
+enum Speaker { L, R, C, Lfe, Ls, Rs, Lb, Rb, Cs, None = -1 };
+
+// WAV channel order by channel count.
+const int kLayouts[ChannelMixer::kMaxChannels + 1][ChannelMixer::kMaxChannels] = {
+    { None, None, None, None, None, None, None, None },
+    { C, None, None, None, None, None, None, None },
+    { L, R, None, None, None, None, None, None },
+    { L, R, C, None, None, None, None, None },
+    { L, R, Ls, Rs, None, None, None, None },
+    { L, R, C, Ls, Rs, None, None, None },
+    { L, R, C, Lfe, Ls, Rs, None, None },
+    { L, R, C, Lfe, Cs, Ls, Rs, None },
+    { L, R, C, Lfe, Lb, Rb, Ls, Rs }
+};
+
+const float kMinus3Db = 0.70710678f;
+
+int indexOf(int channels, int speaker) {
+    for (int ch = 0; ch < channels; ++ch) {
+        if (kLayouts[channels][ch] == speaker) {
+            return ch;
+        }
+    }
+    return -1;
+}
+
+// Adds gain from one input to the output speaker, or to its nearest
+// neighbours when the output layout lacks it. Every layout has either a
+// centre or a left/right pair, so this always terminates.
+void route(float* column, int outputs, int speaker, float gain, int stride) {
+    int index = indexOf(outputs, speaker);
+    if (index >= 0) {
+        column[index * stride] += gain;
+        return;
+    }
+
+    switch (speaker) {
+    case C:
+        route(column, outputs, L, gain * kMinus3Db, stride);
+        route(column, outputs, R, gain * kMinus3Db, stride);
+        break;
+    case L:
+    case R:
+        route(column, outputs, C, gain * kMinus3Db, stride);
+        break;
+    case Ls:
+        route(column, outputs, L, gain * kMinus3Db, stride);
+        break;
+    case Rs:
+        route(column, outputs, R, gain * kMinus3Db, stride);
+        break;
+    case Lb:
+        route(column, outputs, Ls, gain, stride);
+        break;
+    case Rb:
+        route(column, outputs, Rs, gain, stride);
+        break;
+    case Cs:
+        route(column, outputs, Lb, gain * kMinus3Db, stride);
+        route(column, outputs, Rb, gain * kMinus3Db, stride);
+        break;
+    default:
+        break;
+    }
+}
+
+bool validPair(int inputs, int outputs) {
+    return inputs >= 1 && inputs <= ChannelMixer::kMaxChannels &&
+           outputs >= 1 && outputs <= ChannelMixer::kMaxChannels;
+}
+
+} // namespace
+
+ChannelMixer::ChannelMixer()
+    : inputs_(0)
+    , outputs_(0)
+    , pendingVersion_(0)
+    , rtInputs_(0)
+    , rtOutputs_(0)
+    , active_(false)
+    , appliedVersion_(0) {
+    std::memset(columns_, 0, sizeof(columns_));
+}
+
+void ChannelMixer::prepare(int inputChannels, int outputChannels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    inputs_ = std::max(1, std::min(inputChannels, kMaxChannels));
+    outputs_ = std::max(1, std::min(outputChannels, kMaxChannels));
+    publishLocked();
+
+    // The stream is closed, so the audio-thread state can be set directly.
+    applyLocked();
+}
+
+bool ChannelMixer::setMatrix(int inputChannels, int outputChannels, const std::vector<float>& gains) {
+    if (!validPair(inputChannels, outputChannels) ||
+        gains.size() != static_cast<size_t>(inputChannels * outputChannels)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    custom_[std::make_pair(inputChannels, outputChannels)] = gains;
+    if (inputChannels == inputs_ && outputChannels == outputs_) {
+        publishLocked();
+    }
+    return true;
+}
+
+void ChannelMixer::resetMatrix(int inputChannels, int outputChannels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (custom_.erase(std::make_pair(inputChannels, outputChannels)) > 0 &&
+        inputChannels == inputs_ && outputChannels == outputs_) {
+        publishLocked();
+    }
+}
+
+std::vector<float> ChannelMixer::matrix(int inputChannels, int outputChannels) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = custom_.find(std::make_pair(inputChannels, outputChannels));
+    return it != custom_.end() ? it->second : ituMatrix(inputChannels, outputChannels);
+}
+
+std::vector<float> ChannelMixer::ituMatrix(int inputChannels, int outputChannels) {
+    if (!validPair(inputChannels, outputChannels)) {
+        return std::vector<float>();
+    }
+
+    std::vector<float> gains(inputChannels * outputChannels, 0.0f);
+    for (int in = 0; in < inputChannels; ++in) {
+        route(gains.data() + in, outputChannels, kLayouts[inputChannels][in], 1.0f, inputChannels);
+    }
+
+    float loudest = 0.0f;
+    for (int out = 0; out < outputChannels; ++out) {
+        float sum = 0.0f;
+        for (int in = 0; in < inputChannels; ++in) {
+            sum += std::fabs(gains[out * inputChannels + in]);
+        }
+        loudest = std::max(loudest, sum);
+    }
+    if (loudest > 1.0f) {
+        for (float& gain : gains) {
+            gain /= loudest;
+        }
+    }
+    return gains;
+}
+
+void ChannelMixer::publishLocked() {
+    auto it = custom_.find(std::make_pair(inputs_, outputs_));
+    pending_ = it != custom_.end() ? it->second : ituMatrix(inputs_, outputs_);
+    pendingVersion_.fetch_add(1, std::memory_order_release);
+}
+
+bool ChannelMixer::update() {
+    if (pendingVersion_.load(std::memory_order_acquire) != appliedVersion_ && mutex_.try_lock()) {
+        applyLocked();
+        mutex_.unlock();
+    }
+    return active_;
+}
+
+void ChannelMixer::applyLocked() {
+    rtInputs_ = inputs_;
+    rtOutputs_ = outputs_;
+    bool identity = rtInputs_ == rtOutputs_;
+    std::memset(columns_, 0, sizeof(columns_));
+    for (int out = 0; out < rtOutputs_; ++out) {
+        for (int in = 0; in < rtInputs_; ++in) {
+            float gain = pending_[out * rtInputs_ + in];
+            columns_[in][out] = gain;
+            identity = identity && gain == (in == out ? 1.0f : 0.0f);
+        }
+    }
+    active_ = !identity;
+    appliedVersion_ = pendingVersion_.load(std::memory_order_relaxed);
+}
+
+void ChannelMixer::process(const float* input, float* output, size_t frames) {
+    const int inputs = rtInputs_;
+    const size_t outputs = static_cast<size_t>(rtOutputs_);
+
+#ifdef CHANNEL_MIXER_SSE2
+    // Each frame stores whole vectors; the lanes past the last output are
+    // overwritten by the next frame, hence the slack the caller provides.
+    if (outputs <= 4) {
+        for (size_t f = 0; f < frames; ++f, input += inputs, output += outputs) {
+            __m128 acc = _mm_setzero_ps();
+            for (int in = 0; in < inputs; ++in) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(columns_[in]), _mm_set1_ps(input[in])));
+            }
+            _mm_storeu_ps(output, acc);
+        }
+    } else {
+        for (size_t f = 0; f < frames; ++f, input += inputs, output += outputs) {
+            __m128 lo = _mm_setzero_ps();
+            __m128 hi = _mm_setzero_ps();
+            for (int in = 0; in < inputs; ++in) {
+                __m128 sample = _mm_set1_ps(input[in]);
+                lo = _mm_add_ps(lo, _mm_mul_ps(_mm_load_ps(columns_[in]), sample));
+                hi = _mm_add_ps(hi, _mm_mul_ps(_mm_load_ps(columns_[in] + 4), sample));
+            }
+            _mm_storeu_ps(output, lo);
+            _mm_storeu_ps(output + 4, hi);
+        }
+    }
+#else
+    for (size_t f = 0; f < frames; ++f, input += inputs, output += outputs) {
+        for (size_t out = 0; out < outputs; ++out) {
+            float sum = 0.0f;
+            for (int in = 0; in < inputs; ++in) {
+                sum += columns_[in][out] * input[in];
+            }
+            output[out] = sum;
+        }
+    }
+#endif
+}
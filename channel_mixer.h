@@ -0,0 +1,66 @@
+#ifndef CHANNEL_MIXER_H
+#define CHANNEL_MIXER_H
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Maps the source channels onto the device's with a gain matrix, as the
+// first stage of the float pipeline. Channels follow the WAV order for their
+// count (5.1 is L R C LFE Ls Rs, 7.1 adds Lb Rb before Ls Rs). The matrix
+// for an input/output pair is a custom one set from the GUI if there is one,
+// otherwise the ITU-R BS.775 downmix: centre and surrounds fold into the
+// fronts at -3 dB, LFE is dropped, and the result is scaled so no output can
+// exceed full scale. Upmixing with the default matrix only fills the
+// matching speakers.
+//
+// The multiply runs frame by frame with the output channels in SSE2 lanes,
+// so each input sample costs one or two vector multiply-adds.
+class ChannelMixer {
+public:
+    static constexpr int kMaxChannels = 8;
+
+    ChannelMixer();
+
+    // Call while the stream is closed.
+    void prepare(int inputChannels, int outputChannels);
+
+    // GUI thread. Gains are row-major, outputs x inputs. Setting the matrix
+    // of the prepared pair applies it to the running stream.
+    bool setMatrix(int inputChannels, int outputChannels, const std::vector<float>& gains);
+    void resetMatrix(int inputChannels, int outputChannels);
+    std::vector<float> matrix(int inputChannels, int outputChannels) const;
+    static std::vector<float> ituMatrix(int inputChannels, int outputChannels);
+
+    // Audio thread. update() returns false for a plain pass-through, so the
+    // caller can skip process() and keep the bit-exact path. output needs
+    // kMaxChannels floats of room past the last frame.
+    bool update();
+    bool isActive() const { return active_; }
+    void process(const float* input, float* output, size_t frames);
+
+private:
+    void publishLocked();
+    void applyLocked();
+
+    // GUI side, guarded by mutex_.
+    mutable std::mutex mutex_;
+    std::map<std::pair<int, int>, std::vector<float>> custom_;
+    int inputs_;
+    int outputs_;
+    std::vector<float> pending_;
+    std::atomic<unsigned> pendingVersion_;
+
+    // Audio thread only. Column-major, each input's gains padded to eight
+    // output lanes.
+    alignas(16) float columns_[kMaxChannels][kMaxChannels];
+    int rtInputs_;
+    int rtOutputs_;
+    bool active_;
+    unsigned appliedVersion_;
+};
+
+#endif // CHANNEL_MIXER_H
@@ -0,0 +1,90 @@
+import QtQuick
+import AudioEngine 1.0
+
+Item {
+    id: root
+    property var audioManager
+    readonly property var meter: audioManager.levelMeter
+    property int barSpacing: 3
+
+    implicitWidth: 36
+    implicitHeight: 90
+
+    Binding {
+        target: root.meter
+        property: "active"
+        value: root.visible && Window.visibility !== Window.Hidden
+               && Window.visibility !== Window.Minimized
+    }
+
+    // Ticks with the scene graph, so ballistics advance once per rendered
+    // frame and stop with rendering. Idle meters stop it while paused.
+    FrameAnimation {
+        running: root.meter.active && (audioManager.isPlaying || !root.meter.idle)
+        onTriggered: root.meter.advance(frameTime)
+    }
+
+    Rectangle {
+        id: clipIndicator
+        anchors.top: parent.top
+        width: parent.width
+        height: 6
+        radius: 2
+        color: root.meter.clipped ? "#e22134" : "#404040"
+
+        MouseArea {
+            anchors.fill: parent
+            anchors.margins: -4
+            cursorShape: Qt.PointingHandCursor
+            onClicked: root.meter.resetClip()
+        }
+    }
+
+    Row {
+        anchors.top: clipIndicator.bottom
+        anchors.topMargin: 4
+        anchors.bottom: parent.bottom
+        width: parent.width
+        spacing: root.barSpacing
+
+        Repeater {
+            id: bars
+            model: root.meter
+
+            Rectangle {
+                width: Math.max(2, (root.width - root.barSpacing * (bars.count - 1)) / Math.max(1, bars.count))
+                height: parent.height
+                radius: 1
+                color: "#282828"
+
+                // Peak
+                Rectangle {
+                    anchors.bottom: parent.bottom
+                    width: parent.width
+                    height: model.peak * parent.height
+                    radius: 1
+                    color: model.clip ? "#e22134" : "#1aa34a"
+                    opacity: 0.5
+                }
+
+                // RMS
+                Rectangle {
+                    anchors.bottom: parent.bottom
+                    width: parent.width
+                    height: model.rms * parent.height
+                    radius: 1
+                    color: "#1ed760"
+                }
+
+                // Peak hold
+                Rectangle {
+                    y: Math.min(parent.height - 2, (1 - model.hold) * parent.height)
+                    width: parent.width
+                    height: 2
+                    color: model.hold > 0.95 ? "#e22134" : "white"
+                    visible: model.hold > 0
+                }
+            }
+        }
+    }
+}
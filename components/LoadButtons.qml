@@ -83,6 +83,80 @@ RowLayout {
         onClicked: playlistFileDialog.open()
     }
 
+    Button {
+        text: audioManager.isImporting ? "Cancel Import (" + audioManager.importedCount + ")" : "Add Folder"
+        enabled: !audioManager.isLoading || audioManager.isImporting
+        hoverEnabled: true
+        flat: true
+        focusPolicy: Qt.NoFocus
+        down: false
+
+        background: Rectangle {
+            implicitWidth: 120
+            implicitHeight: 36
+            radius: 18
+            color: parent.enabled ? (parent.hovered ? "#1a1a1a" : "transparent") : "transparent"
+            border.color: parent.enabled ? (parent.hovered ? "#1db954" : "#535353") : "#404040"
+            border.width: 1
+            opacity: parent.enabled ? 1.0 : 0.5
+
+            Behavior on color { ColorAnimation { duration: 150 } }
+            Behavior on border.color { ColorAnimation { duration: 150 } }
+            Behavior on opacity { NumberAnimation { duration: 150 } }
+        }
+
+        contentItem: Text {
+            text: parent.text
+            color: parent.enabled ? (parent.hovered ? "#1db954" : "#b3b3b3") : "#535353"
+            font.pointSize: 12
+            font.family: "Arial"
+            font.weight: Font.Bold
+            horizontalAlignment: Text.AlignHCenter
+            verticalAlignment: Text.AlignVCenter
+
+            Behavior on color { ColorAnimation { duration: 150 } }
+        }
+
+        onClicked: audioManager.isImporting ? audioManager.cancelImport() : folderDialog.open()
+    }
+
+    Button {
+        text: "Save Playlist"
+        enabled: audioManager.playlist.trackCount > 0
+        hoverEnabled: true
+        flat: true
+        focusPolicy: Qt.NoFocus
+        down: false
+
+        background: Rectangle {
+            implicitWidth: 120
+            implicitHeight: 36
+            radius: 18
+            color: parent.enabled ? (parent.hovered ? "#1a1a1a" : "transparent") : "transparent"
+            border.color: parent.enabled ? (parent.hovered ? "#1db954" : "#535353") : "#404040"
+            border.width: 1
+            opacity: parent.enabled ? 1.0 : 0.5
+
+            Behavior on color { ColorAnimation { duration: 150 } }
+            Behavior on border.color { ColorAnimation { duration: 150 } }
+            Behavior on opacity { NumberAnimation { duration: 150 } }
+        }
+
+        contentItem: Text {
+            text: parent.text
+            color: parent.enabled ? (parent.hovered ? "#1db954" : "#b3b3b3") : "#535353"
+            font.pointSize: 12
+            font.family: "Arial"
+            font.weight: Font.Bold
+            horizontalAlignment: Text.AlignHCenter
+            verticalAlignment: Text.AlignVCenter
+
+            Behavior on color { ColorAnimation { duration: 150 } }
+        }
+
+        onClicked: savePlaylistDialog.open()
+    }
+
     FileDialog {
         id: fileDialog
         title: "Select Audio File"
@@ -97,4 +171,19 @@ RowLayout {
         fileMode: FileDialog.OpenFiles
         onAccepted: audioManager.addMultipleToPlaylist(selectedFiles)
     }
+
+    FileDialog {
+        id: savePlaylistDialog
+        title: "Save Playlist"
+        fileMode: FileDialog.SaveFile
+        defaultSuffix: "m3u8"
+        nameFilters: ["M3U8 Playlist (*.m3u8)", "M3U Playlist (*.m3u)", "PLS Playlist (*.pls)", "XSPF Playlist (*.xspf)"]
+        onAccepted: audioManager.playlist.savePlaylist(selectedFile)
+    }
+
+    FolderDialog {
+        id: folderDialog
+        title: "Add Folder to Playlist"
+        onAccepted: audioManager.importFolder(selectedFolder)
+    }
 }
\ No newline at end of file
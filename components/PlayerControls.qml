@@ -6,8 +6,20 @@ import AudioEngine 1.0
 RowLayout {
     id: root
     property var audioManager
+    // Playback position read at vsync while playing, so it moves smoothly
+    // and costs nothing when paused or not rendered. Otherwise it follows
+    // progressChanged, which marks seeks and track changes.
+    readonly property double progress: clock.running ? clock.progress : audioManager.progress
     spacing: 20
 
+    FrameAnimation {
+        id: clock
+        property double progress: 0
+        running: audioManager.isPlaying && root.visible
+        onTriggered: progress = audioManager.progress
+        onRunningChanged: progress = audioManager.progress
+    }
+
     Rectangle {
         width: 90
         height: 90
@@ -31,10 +43,22 @@ RowLayout {
             font.pointSize: 32
             font.family: "Arial"
             font.weight: Font.Bold
+            visible: headerCover.status !== Image.Ready
+        }
+
+        Image {
+            id: headerCover
+            anchors.fill: parent
+            source: audioManager.playlist.currentFilePath !== ""
+                ? "image://cover/" + encodeURIComponent(audioManager.playlist.currentFilePath) : ""
+            sourceSize: Qt.size(256, 256)
+            fillMode: Image.PreserveAspectCrop
+            visible: status === Image.Ready
+            onStatusChanged: if (status === Image.Ready) parent.rotation = 0
         }
 
         RotationAnimator on rotation {
-            running: audioManager.isPlaying
+            running: audioManager.isPlaying && headerCover.status !== Image.Ready
             from: 0
             to: 360
             duration: 10000
@@ -75,180 +99,16 @@ RowLayout {
         }
 
         Text {
-            text: formatTime(audioManager.progress * audioManager.duration) + " / " + formatTime(audioManager.duration)
+            text: formatTime(root.progress * audioManager.duration) + " / " + formatTime(audioManager.duration)
             color: "#b3b3b3"
             font.pointSize: 11
             font.family: "Arial"
         }
 
-        Item {
+        SeekBar {
+            audioManager: root.audioManager
+            progress: root.progress
             Layout.fillWidth: true
-            height: 5
-            
-            property bool isDragging: false
-            property double seekPosition: 0.0
-            property bool wasPlayingBeforeDrag: false
-            
-            // Force property change notifications
-            onSeekPositionChanged: {
-                console.log("seekPosition changed to:", seekPosition)
-            }
-            
-            onIsDraggingChanged: {
-                console.log("isDragging changed to:", isDragging)
-            }
-            
-            Rectangle {
-                id: trackBackground
-                anchors.fill: parent
-                color: "#404040"
-                radius: 2.5
-                
-                Rectangle {
-                    id: progressBar
-                    width: parent.width * (parent.isDragging ? parent.seekPosition : audioManager.progress)
-                    height: parent.height
-                    radius: 2.5
-                    color: "#1db954"
-                    
-                    // Debug width changes
-                    onWidthChanged: console.log("Progress bar width changed:", width, "isDragging:", parent.isDragging, "seekPos:", parent.seekPosition, "audioPos:", audioManager.progress)
-                    
-                    Behavior on width {
-                        enabled: !parent.isDragging
-                        NumberAnimation { duration: 200; easing.type: Easing.OutCubic }
-                    }
-                }
-                
-                Rectangle {
-                    id: handle
-                    width: parent.isDragging ? 16 : 12
-                    height: parent.isDragging ? 16 : 12
-                    radius: width / 2
-                    color: "white"
-                    x: Math.max(0, Math.min(parent.width - width, 
-                        (parent.isDragging ? parent.seekPosition : audioManager.progress) * parent.width - width/2))
-                    y: parent.isDragging ? -5.5 : -3.5
-                    visible: audioManager.duration > 0
-                    opacity: parent.isDragging ? 1.0 : (mouseArea.containsMouse ? 1.0 : 0.8)
-                    
-                    // Drop shadow when dragging
-                    Rectangle {
-                        anchors.centerIn: parent
-                        anchors.topMargin: parent.isDragging ? 2 : 0
-                        width: parent.width
-                        height: parent.height
-                        radius: width / 2
-                        color: "black"
-                        opacity: parent.isDragging ? 0.3 : 0.0
-                        z: -1
-                        
-                        Behavior on opacity { NumberAnimation { duration: 150 } }
-                        Behavior on anchors.topMargin { NumberAnimation { duration: 150 } }
-                    }
-                    
-                    Rectangle {
-                        anchors.centerIn: parent
-                        width: parent.isDragging ? 10 : 8
-                        height: parent.isDragging ? 10 : 8
-                        radius: width / 2
-                        color: "#1db954"
-                        
-                        Behavior on width { NumberAnimation { duration: 150 } }
-                        Behavior on height { NumberAnimation { duration: 150 } }
-                    }
-                    
-                    Behavior on x {
-                        enabled: !parent.isDragging
-                        NumberAnimation { duration: 200; easing.type: Easing.OutCubic }
-                    }
-                    
-                    Behavior on width { NumberAnimation { duration: 150 } }
-                    Behavior on height { NumberAnimation { duration: 150 } }
-                    Behavior on y { NumberAnimation { duration: 150 } }
-                    Behavior on opacity { NumberAnimation { duration: 150 } }
-                }
-                
-            }
-            
-            MouseArea {
-                id: mouseArea
-                anchors.fill: parent
-                hoverEnabled: true
-                cursorShape: parent.isDragging ? Qt.ClosedHandCursor : Qt.PointingHandCursor
-                
-                property bool wasDragging: false
-                property bool isDragActive: false
-                property real startMouseX: 0
-                
-                onPressed: {
-                    if (audioManager.duration > 0) {
-                        isDragActive = true
-                        startMouseX = mouseX
-                        parent.isDragging = true
-                        parent.seekPosition = Math.max(0, Math.min(1, mouseX / width))
-                        wasDragging = false
-                        
-                        // Debug press
-                        console.log("PRESSED - seekPosition set to:", parent.seekPosition, "mouseX:", mouseX, "width:", width)
-                        
-                        // Lưu trạng thái và pause audio nếu đang phát
-                        parent.wasPlayingBeforeDrag = audioManager.isPlaying
-                        if (audioManager.isPlaying) {
-                            audioManager.pause()
-                        }
-                    }
-                }
-                
-                onPositionChanged: {
-                    if (isDragActive && audioManager.duration > 0) {
-                        // Update seekPosition NGAY LẬP TỨC cho real-time UI
-                        var newPosition = Math.max(0, Math.min(1, mouseX / width))
-                        parent.seekPosition = newPosition
-                        
-                        // Debug log
-                        console.log("Drag position:", newPosition, "mouseX:", mouseX, "width:", width)
-                        
-                        // Mark as dragging chỉ để phân biệt với click
-                        if (Math.abs(mouseX - startMouseX) > 3) {
-                            wasDragging = true
-                        }
-                        // KHÔNG seek audio trong lúc drag để tránh tiếng ồn
-                    }
-                }
-                
-                onReleased: {
-                    if (isDragActive && audioManager.duration > 0) {
-                        // Seek to final position
-                        audioManager.seek(parent.seekPosition)
-                        
-                        // Khôi phục audio nếu đang phát trước khi drag
-                        if (parent.wasPlayingBeforeDrag) {
-                            audioManager.play()
-                        }
-                        
-                        // Reset drag state
-                        parent.isDragging = false
-                        isDragActive = false
-                        wasDragging = false
-                        parent.wasPlayingBeforeDrag = false
-                    }
-                }
-                
-                // Handle click vs drag distinction
-                onClicked: {
-                    // Only handle click if it wasn't a drag operation
-                    if (!wasDragging && audioManager.duration > 0) {
-                        var position = Math.max(0, Math.min(1, mouseX / width))
-                        audioManager.seek(position)
-                    }
-                }
-                
-                // Prevent context menu
-                onPressAndHold: {
-                    // Do nothing to prevent context menu
-                }
-            }
         }
 
         Text {
@@ -260,6 +120,20 @@ RowLayout {
         }
     }
 
+    SpectrumView {
+        audioManager: root.audioManager
+        Layout.preferredWidth: 240
+        Layout.preferredHeight: 90
+        Layout.alignment: Qt.AlignVCenter
+    }
+
+    LevelMeterView {
+        audioManager: root.audioManager
+        Layout.preferredWidth: 36
+        Layout.preferredHeight: 90
+        Layout.alignment: Qt.AlignVCenter
+    }
+
     function formatTime(seconds) {
         if (isNaN(seconds) || seconds < 0) return "00:00"
         var mins = Math.floor(seconds / 60)
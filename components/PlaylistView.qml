@@ -39,6 +39,28 @@ Rectangle {
                 Layout.fillWidth: true
             }
 
+            TextField {
+                id: searchField
+                Layout.preferredWidth: 220
+                placeholderText: "Search title, artist, album"
+                color: "white"
+                placeholderTextColor: "#535353"
+                font.pointSize: 11
+                font.family: "Arial"
+                selectByMouse: true
+                // Every keystroke goes to the filter, which drops the
+                // search it replaces.
+                onTextChanged: audioManager.search.query = text
+                Keys.onEscapePressed: text = ""
+
+                background: Rectangle {
+                    radius: 14
+                    color: "#282828"
+                    border.color: searchField.activeFocus ? "#1db954" : "transparent"
+                    border.width: 1
+                }
+            }
+
             Rectangle {
                 width: Math.max(40, countText.implicitWidth + 16)
                 height: 28
@@ -48,7 +70,8 @@ Rectangle {
                 Text {
                     id: countText
                     anchors.centerIn: parent
-                    text: audioManager.playlist.trackCount.toString() + " songs"
+                    text: (playlistView.filtering ? audioManager.search.count + " of " : "")
+                        + audioManager.playlist.trackCount.toString() + " songs"
                     color: "black"
                     font.pointSize: 11
                     font.family: "Arial"
@@ -56,6 +79,67 @@ Rectangle {
                 }
             }
 
+            Button {
+                id: sortButton
+                width: 36
+                height: 36
+                enabled: audioManager.playlist.trackCount > 1
+                flat: true
+                focusPolicy: Qt.NoFocus
+                down: false
+                hoverEnabled: true
+
+                background: Rectangle {
+                    radius: 18
+                    color: "transparent"
+                    border.color: parent.enabled ? (parent.hovered ? "white" : "#b3b3b3") : "#535353"
+                    border.width: 1
+
+                    Behavior on border.color { ColorAnimation { duration: 150 } }
+                }
+
+                contentItem: Text {
+                    text: "⇅"
+                    color: parent.enabled ? (parent.hovered ? "white" : "#b3b3b3") : "#535353"
+                    font.pointSize: 14
+                    font.family: "Arial"
+                    horizontalAlignment: Text.AlignHCenter
+                    verticalAlignment: Text.AlignVCenter
+
+                    Behavior on color { ColorAnimation { duration: 150 } }
+                }
+
+                onClicked: sortMenu.open()
+
+                Menu {
+                    id: sortMenu
+                    y: sortButton.height
+
+                    MenuItem {
+                        text: "Title"
+                        onTriggered: audioManager.playlist.sortBy([PlaylistManager.TitleRole])
+                    }
+                    MenuItem {
+                        text: "Artist"
+                        onTriggered: audioManager.playlist.sortBy([PlaylistManager.ArtistRole, PlaylistManager.AlbumRole,
+                                                                   PlaylistManager.DiscNumberRole, PlaylistManager.TrackNumberRole])
+                    }
+                    MenuItem {
+                        text: "Album"
+                        onTriggered: audioManager.playlist.sortBy([PlaylistManager.AlbumRole, PlaylistManager.DiscNumberRole,
+                                                                   PlaylistManager.TrackNumberRole])
+                    }
+                    MenuItem {
+                        text: "Duration"
+                        onTriggered: audioManager.playlist.sortBy([PlaylistManager.DurationRole])
+                    }
+                    MenuItem {
+                        text: "File path"
+                        onTriggered: audioManager.playlist.sortBy([PlaylistManager.FilePathRole])
+                    }
+                }
+            }
+
             Button {
                 width: 36
                 height: 36
@@ -98,14 +182,60 @@ Rectangle {
 
             ListView {
                 id: playlistView
-                model: audioManager.playlist
+                // While a search is active the rows are the filter's, and
+                // index is a row of the filter, not of the playlist.
+                readonly property bool filtering: audioManager.search.active
+                model: filtering ? audioManager.search : audioManager.playlist
                 spacing: 8
+                focus: true
+
+                // Selected rows as keys; replaced wholesale so bindings update.
+                property var selection: ({})
+                property int anchorRow: -1
+
+                Keys.onDeletePressed: removeSelection()
+                Keys.onPressed: function(event) {
+                    if (event.modifiers & Qt.ControlModifier) {
+                        if (event.key === Qt.Key_Up) {
+                            moveSelection(-1)
+                            event.accepted = true
+                        } else if (event.key === Qt.Key_Down) {
+                            moveSelection(1)
+                            event.accepted = true
+                        } else if (event.key === Qt.Key_A) {
+                            selectRange(0, count - 1)
+                            event.accepted = true
+                        }
+                    }
+                }
+
+                Connections {
+                    target: audioManager.playlist
+                    function onTrackCountChanged() {
+                        playlistView.selection = ({})
+                        playlistView.anchorRow = -1
+                    }
+                    function onLayoutChanged() {
+                        playlistView.selection = ({})
+                        playlistView.anchorRow = -1
+                    }
+                }
+
+                Connections {
+                    target: audioManager.search
+                    function onCountChanged() {
+                        playlistView.selection = ({})
+                        playlistView.anchorRow = -1
+                    }
+                }
 
                 delegate: Rectangle {
                     width: playlistView.width
                     height: 64
                     radius: 8
-                    color: isCurrent ? "#1db954" : (hoverArea.containsMouse ? "#282828" : "transparent")
+                    color: isCurrent ? "#1db954" : (selected ? "#333333" : (hoverArea.containsMouse ? "#282828" : "transparent"))
+
+                    readonly property bool selected: playlistView.selection[index] === true
 
                     Behavior on color { ColorAnimation { duration: 200 } }
 
@@ -113,8 +243,23 @@ Rectangle {
                         id: hoverArea
                         anchors.fill: parent
                         hoverEnabled: true
+                        onClicked: function(mouse) {
+                            playlistView.forceActiveFocus()
+                            if ((mouse.modifiers & Qt.ShiftModifier) && playlistView.anchorRow >= 0) {
+                                selectRange(playlistView.anchorRow, index)
+                                return
+                            }
+                            var selection = (mouse.modifiers & Qt.ControlModifier) ? Object.assign({}, playlistView.selection) : {}
+                            if (selection[index]) {
+                                delete selection[index]
+                            } else {
+                                selection[index] = true
+                            }
+                            playlistView.selection = selection
+                            playlistView.anchorRow = index
+                        }
                         onDoubleClicked: {
-                            audioManager.playTrackAt(index)
+                            audioManager.playTrackAt(playlistRow(index))
                             if (!audioManager.isPlaying) {
                                 audioManager.play()
                             }
@@ -128,8 +273,8 @@ Rectangle {
                         spacing: 12
 
                         Rectangle {
-                            width: 36
-                            height: 36
+                            width: 40
+                            height: 40
                             radius: 4
                             color: isCurrent ? "black" : "transparent"
 
@@ -140,6 +285,18 @@ Rectangle {
                                 font.pointSize: 14
                                 font.family: "Arial"
                                 font.weight: Font.Bold
+                                visible: cover.status !== Image.Ready
+                            }
+
+                            // Thumbnails come off the GUI thread; rows without
+                            // art keep their number.
+                            Image {
+                                id: cover
+                                anchors.fill: parent
+                                source: "image://cover/" + encodeURIComponent(filePath)
+                                sourceSize: Qt.size(64, 64)
+                                fillMode: Image.PreserveAspectCrop
+                                visible: status === Image.Ready
                             }
                         }
 
@@ -186,11 +343,14 @@ Rectangle {
                                 }
 
                                 Text {
-                                    text: hoverArea.containsMouse ? "Double-click to play" : "Song"
+                                    text: hoverArea.containsMouse ? "Double-click to play"
+                                        : ([artist, album].filter(function(part) { return part !== "" }).join(" — ") || "Song")
                                     color: isCurrent ? "black" : "#b3b3b3"
                                     font.pointSize: 11
                                     font.family: "Arial"
                                     font.weight: Font.Normal
+                                    elide: Text.ElideRight
+                                    Layout.maximumWidth: 320
 
                                     Behavior on color { ColorAnimation { duration: 200 } }
                                 }
@@ -329,6 +489,46 @@ Rectangle {
         onAccepted: audioManager.addMultipleToPlaylist(selectedFiles)
     }
 
+    function playlistRow(row) {
+        return playlistView.filtering ? audioManager.search.sourceRow(row) : row
+    }
+
+    // In playlist rows, ascending.
+    function selectedRows() {
+        return Object.keys(playlistView.selection).map(Number).map(playlistRow)
+            .filter(function(row) { return row >= 0 }).sort(function(a, b) { return a - b })
+    }
+
+    function selectRange(from, to) {
+        var selection = {}
+        for (var row = Math.min(from, to); row <= Math.max(from, to); ++row) {
+            selection[row] = true
+        }
+        playlistView.selection = selection
+    }
+
+    function removeSelection() {
+        var rows = selectedRows()
+        if (rows.length > 0) {
+            audioManager.playlist.removeTracks(rows)
+        }
+    }
+
+    // Moves the selection one row up or down; scattered rows close up
+    // into one block.
+    function moveSelection(step) {
+        // Neighbours in the filter need not be neighbours in the playlist.
+        if (playlistView.filtering) return
+        var rows = selectedRows()
+        if (rows.length === 0) return
+        var destination = step < 0 ? rows[0] - 1 : rows[rows.length - 1] + 2
+        if (destination < 0 || destination > playlistView.count) return
+        audioManager.playlist.moveTracks(rows, destination)
+        var first = step < 0 ? destination : destination - rows.length
+        selectRange(first, first + rows.length - 1)
+        playlistView.anchorRow = first
+    }
+
     function formatTime(seconds) {
         if (isNaN(seconds) || seconds < 0) return "00:00"
         var mins = Math.floor(seconds / 60)
@@ -5,95 +5,122 @@ import AudioEngine 1.0
 Item {
     id: root
     property var audioManager
+    property double progress: audioManager.progress
     property bool isDragging: false
     property double seekPosition: 0.0
-    
-    height: 5
-    
+    readonly property double position: isDragging ? seekPosition : progress
+    readonly property bool hasWaveform: audioManager.waveform.ready
+
+    height: 48
+
+    // Flat bar until the waveform overview is available
     Rectangle {
         id: trackBackground
-        anchors.fill: parent
+        anchors.verticalCenter: parent.verticalCenter
+        width: parent.width
+        height: 5
         color: "#404040"
         radius: 2.5
-        
+        visible: !root.hasWaveform
+
         Rectangle {
             id: progressBar
-            width: parent.width * (root.isDragging ? root.seekPosition : audioManager.progress)
+            width: parent.width * root.position
             height: parent.height
             radius: 2.5
             color: "#1db954"
-            
-            Behavior on width {
-                enabled: !root.isDragging
-                NumberAnimation { duration: 200; easing.type: Easing.OutCubic }
-            }
         }
-        
-        Rectangle {
-            id: handle
-            width: 12
-            height: 12
-            radius: 6
-            color: "white"
-            x: Math.max(0, Math.min(parent.width - width, 
-                (root.isDragging ? root.seekPosition : audioManager.progress) * parent.width - width/2))
-            y: -3.5
-            visible: audioManager.duration > 0
-            
-            Rectangle {
-                anchors.centerIn: parent
-                width: 8
-                height: 8
-                radius: 4
-                color: "#1db954"
-            }
-            
-            Behavior on x {
-                enabled: !root.isDragging
-                NumberAnimation { duration: 200; easing.type: Easing.OutCubic }
-            }
+    }
+
+    Waveform {
+        anchors.fill: parent
+        source: audioManager.waveform
+        color: "#404040"
+        rmsColor: "#6a6a6a"
+        visible: root.hasWaveform
+    }
+
+    // Played part: the same geometry in the accent colours, clipped
+    Item {
+        width: parent.width * root.position
+        height: parent.height
+        clip: true
+        visible: root.hasWaveform
+
+        Waveform {
+            width: root.width
+            height: root.height
+            source: audioManager.waveform
+            color: "#1aa34a"
+            rmsColor: "#1ed760"
         }
     }
-    
+
+    Rectangle {
+        id: handle
+        width: root.isDragging ? 4 : 2
+        height: parent.height
+        radius: width / 2
+        color: "white"
+        x: Math.max(0, Math.min(parent.width - width, root.position * parent.width - width / 2))
+        visible: audioManager.duration > 0
+        opacity: root.isDragging || mouseArea.containsMouse ? 1.0 : 0.8
+
+        Behavior on width { NumberAnimation { duration: 150 } }
+        Behavior on opacity { NumberAnimation { duration: 150 } }
+    }
+
     MouseArea {
         id: mouseArea
         anchors.fill: parent
         hoverEnabled: true
-        cursorShape: Qt.PointingHandCursor
-        
+        cursorShape: root.isDragging ? Qt.ClosedHandCursor : Qt.PointingHandCursor
+
         property bool wasDragging: false
-        
+        property real startMouseX: 0
+
         onPressed: {
             if (audioManager.duration > 0) {
                 root.isDragging = true
                 root.seekPosition = Math.max(0, Math.min(1, mouseX / width))
+                startMouseX = mouseX
                 mouseArea.wasDragging = false
             }
         }
-        
+
         onPositionChanged: {
             if (root.isDragging && audioManager.duration > 0) {
                 root.seekPosition = Math.max(0, Math.min(1, mouseX / width))
-                mouseArea.wasDragging = true
+                // Grains start once it is clearly a drag, so a plain click
+                // seeks without a blip.
+                if (!mouseArea.wasDragging && Math.abs(mouseX - startMouseX) > 3) {
+                    mouseArea.wasDragging = true
+                    audioManager.beginScrub(root.seekPosition)
+                } else if (mouseArea.wasDragging) {
+                    audioManager.scrub(root.seekPosition)
+                }
             }
         }
-        
+
         onReleased: {
             if (root.isDragging && audioManager.duration > 0) {
-                audioManager.seek(root.seekPosition)
+                if (mouseArea.wasDragging) {
+                    audioManager.endScrub(root.seekPosition)
+                } else {
+                    audioManager.seek(root.seekPosition)
+                }
                 root.isDragging = false
-                mouseArea.wasDragging = false
             }
         }
-        
-        onClicked: {
-            if (!mouseArea.wasDragging && audioManager.duration > 0) {
-                var position = Math.max(0, Math.min(1, mouseX / width))
-                audioManager.seek(position)
+
+        onCanceled: {
+            if (root.isDragging && mouseArea.wasDragging) {
+                audioManager.endScrub(audioManager.progress)
             }
+            root.isDragging = false
         }
     }
-    
+
     Rectangle {
         id: tooltip
         visible: mouseArea.containsMouse && audioManager.duration > 0
@@ -102,7 +129,7 @@ Item {
         opacity: 0.8
         width: tooltipText.implicitWidth + 8
         height: tooltipText.implicitHeight + 8
-        
+
         Text {
             id: tooltipText
             anchors.centerIn: parent
@@ -111,13 +138,13 @@ Item {
             font.family: "Arial"
             text: formatTime(tooltip.hoverPosition * audioManager.duration)
         }
-        
-        property double hoverPosition: mouseArea.containsMouse ? 
+
+        property double hoverPosition: mouseArea.containsMouse ?
             Math.max(0, Math.min(1, mouseArea.mouseX / mouseArea.width)) : 0
-        
+
         x: Math.max(0, Math.min(root.width - width, mouseArea.mouseX - width/2))
         y: -height - 8
-        
+
         function formatTime(seconds) {
             if (isNaN(seconds) || seconds < 0) return "00:00"
             var mins = Math.floor(seconds / 60)
@@ -125,4 +152,4 @@ Item {
             return (mins < 10 ? "0" : "") + mins + ":" + (secs < 10 ? "0" : "") + secs
         }
     }
-}
\ No newline at end of file
+}
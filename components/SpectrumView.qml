@@ -0,0 +1,51 @@
+import QtQuick
+import AudioEngine 1.0
+
+Item {
+    id: root
+    property var audioManager
+    property int barSpacing: 2
+
+    implicitWidth: 240
+    implicitHeight: 90
+
+    // Analysis only runs while the bars can actually be seen and are
+    // moving; paused, they hold their last levels.
+    Binding {
+        target: audioManager.spectrum
+        property: "active"
+        value: audioManager.isPlaying && root.visible && root.width > 0 && root.height > 0
+               && Window.visibility !== Window.Hidden
+               && Window.visibility !== Window.Minimized
+    }
+
+    Row {
+        anchors.fill: parent
+        spacing: root.barSpacing
+
+        Repeater {
+            model: audioManager.spectrum
+
+            Item {
+                width: Math.max(1, (root.width - root.barSpacing * (audioManager.spectrum.bands - 1)) / audioManager.spectrum.bands)
+                height: root.height
+
+                Rectangle {
+                    anchors.bottom: parent.bottom
+                    width: parent.width
+                    height: Math.max(1, model.level * parent.height)
+                    radius: 1
+                    color: "#1db954"
+                }
+
+                Rectangle {
+                    y: Math.min(parent.height - 2, (1 - model.peak) * parent.height)
+                    width: parent.width
+                    height: 2
+                    color: "#b3b3b3"
+                    visible: model.peak > 0
+                }
+            }
+        }
+    }
+}
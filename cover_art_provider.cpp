@@ -0,0 +1,298 @@
+#include "cover_art_provider.h"
+#include "tag_reader.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QUrl>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+const int kThumbnailSizes[] = { 64, 256, 512 };
+const int kDefaultSize = 256;
+const qint64 kMaxRecentBytes = 48 * 1024 * 1024;
+// Disk cache limit, and what it is trimmed to once over.
+const qint64 kMaxCacheBytes = 64 * 1024 * 1024;
+const qint64 kTrimmedCacheBytes = kMaxCacheBytes * 3 / 4;
+const int kJpegQuality = 88;
+// What an entry without a picture is counted as.
+const qint64 kEmptyEntryBytes = 64;
+// Names of folder images, most preferred first.
+const char* const kFolderImageNames[] = { "cover", "folder", "front", "albumart" };
+
+qint64 modifiedTime(const QString& path) {
+    QFileInfo info(path);
+    return info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+QString hashName(const QByteArray& data, int size) {
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex()) + '-' +
+           QString::number(size) + ".thumb";
+}
+
+// Runs on the provider's pool and reports back through finished(), which
+// the engine waits for before it deletes the response, cancelled or not.
+class CoverArtResponse : public QQuickImageResponse, public QRunnable {
+public:
+    CoverArtResponse(CoverArtProvider* provider, const QString& filePath, int size)
+        : provider_(provider)
+        , filePath_(filePath)
+        , size_(size)
+        , cancelled_(false) {
+        setAutoDelete(false);
+    }
+
+    void run() override {
+        if (!cancelled_.load()) {
+            image_ = provider_->thumbnail(filePath_, size_);
+        }
+        emit finished();
+    }
+
+    void cancel() override {
+        cancelled_.store(true);
+    }
+
+    QQuickTextureFactory* textureFactory() const override {
+        return image_.isNull() ? nullptr : QQuickTextureFactory::textureFactoryForImage(image_);
+    }
+
+    QString errorString() const override {
+        return image_.isNull() && !cancelled_.load() ? QString("No cover art") : QString();
+    }
+
+private:
+    CoverArtProvider* provider_;
+    QString filePath_;
+    int size_;
+    std::atomic<bool> cancelled_;
+    QImage image_;
+};
+
+} // namespace
+
+CoverArtProvider::CoverArtProvider()
+    : recentBytes_(0)
+    , cacheDir_(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails")
+    , cacheScanned_(false)
+    , cacheBytes_(0) {
+    // Leave cores for decoding and the audio callback.
+    pool_.setMaxThreadCount(std::max(1, std::min(4, QThread::idealThreadCount() / 2)));
+}
+
+CoverArtProvider::~CoverArtProvider() {
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+QQuickImageResponse* CoverArtProvider::requestImageResponse(const QString& id, const QSize& requestedSize) {
+    auto* response = new CoverArtResponse(this, QUrl::fromPercentEncoding(id.toUtf8()), thumbnailSize(requestedSize));
+    pool_.start(response);
+    return response;
+}
+
+QImage CoverArtProvider::thumbnail(const QString& filePath, int size) {
+    const QString key = QString::number(size) + '/' + filePath;
+    QImage image;
+    if (recall(key, image)) {
+        return image;
+    }
+
+    // The embedded picture, else the folder image; the cache entry is
+    // named after whichever it is. No picture is not kept on disk.
+    QByteArray picture;
+    QString name;
+    TagReader tags;
+    if (tags.read(filePath) && tags.hasPicture()) {
+        picture = tags.picture();
+        name = hashName(picture, size);
+    }
+    QString source;
+    if (picture.isEmpty()) {
+        source = folderImage(filePath);
+        if (!source.isEmpty()) {
+            name = hashName(source.toUtf8() + "\n" + QByteArray::number(modifiedTime(source)), size);
+        }
+    }
+
+    if (!name.isEmpty() && !readCache(name, image)) {
+        if (!picture.isEmpty()) {
+            QBuffer buffer(&picture);
+            if (buffer.open(QIODevice::ReadOnly)) {
+                image = decode(&buffer, size);
+            }
+        } else {
+            QFile file(source);
+            if (file.open(QIODevice::ReadOnly)) {
+                image = decode(&file, size);
+            }
+        }
+        if (!image.isNull()) {
+            writeCache(name, image);
+        }
+    }
+
+    remember(key, image);
+    return image;
+}
+
+int CoverArtProvider::thumbnailSize(const QSize& requested) {
+    const int wanted = requested.isValid() ? std::max(requested.width(), requested.height()) : kDefaultSize;
+    for (int size : kThumbnailSizes) {
+        if (size >= wanted) {
+            return size;
+        }
+    }
+    return kThumbnailSizes[sizeof(kThumbnailSizes) / sizeof(kThumbnailSizes[0]) - 1];
+}
+
+QImage CoverArtProvider::decode(QIODevice* device, int size) {
+    QImageReader reader(device);
+    reader.setAutoTransform(true);
+    // Scaling while reading lets the JPEG decoder skip most of the work.
+    const QSize full = reader.size();
+    if (full.isValid() && (full.width() > size || full.height() > size)) {
+        reader.setScaledSize(full.scaled(QSize(size, size), Qt::KeepAspectRatio));
+    }
+    QImage image = reader.read();
+    return image.isNull() ? image : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+QString CoverArtProvider::folderImage(const QString& filePath) {
+    const QDir folder = QFileInfo(filePath).absoluteDir();
+    const QStringList names = folder.entryList(QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files);
+
+    QString best;
+    int bestRank = static_cast<int>(sizeof(kFolderImageNames) / sizeof(kFolderImageNames[0]));
+    for (const QString& name : names) {
+        for (int rank = 0; rank < bestRank; ++rank) {
+            if (name.startsWith(QLatin1String(kFolderImageNames[rank]), Qt::CaseInsensitive)) {
+                best = name;
+                bestRank = rank;
+                break;
+            }
+        }
+    }
+    return best.isEmpty() ? QString() : folder.absoluteFilePath(best);
+}
+
+void CoverArtProvider::scanCache() {
+    if (cacheScanned_) {
+        return;
+    }
+    cacheScanned_ = true;
+
+    // Raw pixels per track and size, as the cache used to be kept.
+    QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/covers").removeRecursively();
+
+    QDir().mkpath(cacheDir_);
+    const QFileInfoList files = QDir(cacheDir_).entryInfoList(QStringList() << "*.thumb", QDir::Files);
+    for (const QFileInfo& info : files) {
+        cacheFiles_.insert(info.fileName(), { info.size(), info.lastModified().toMSecsSinceEpoch() });
+        cacheBytes_ += info.size();
+    }
+}
+
+bool CoverArtProvider::readCache(const QString& name, QImage& image) {
+    const QString path = cacheDir_ + '/' + name;
+    QImage stored;
+    if (!stored.load(path)) {
+        return false;
+    }
+    image = stored.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    // Recently used, for the trim; the time is kept on the file so it
+    // lasts to the next run.
+    const QDateTime now = QDateTime::currentDateTime();
+    QFile file(path);
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(now, QFileDevice::FileModificationTime);
+    }
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    scanCache();
+    auto it = cacheFiles_.find(name);
+    if (it != cacheFiles_.end()) {
+        it.value().used = now.toMSecsSinceEpoch();
+    }
+    return true;
+}
+
+void CoverArtProvider::writeCache(const QString& name, const QImage& image) {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    scanCache();
+
+    const QString path = cacheDir_ + '/' + name;
+    QSaveFile file(path);
+    const bool alpha = image.hasAlphaChannel();
+    if (!file.open(QIODevice::WriteOnly) || !image.save(&file, alpha ? "PNG" : "JPG", alpha ? -1 : kJpegQuality) ||
+        !file.commit()) {
+        qDebug() << "Failed to write cover art cache:" << path;
+        return;
+    }
+
+    const qint64 bytes = QFileInfo(path).size();
+    auto it = cacheFiles_.find(name);
+    if (it != cacheFiles_.end()) {
+        cacheBytes_ -= it.value().bytes;
+    }
+    cacheFiles_.insert(name, { bytes, QDateTime::currentMSecsSinceEpoch() });
+    cacheBytes_ += bytes;
+    if (cacheBytes_ <= kMaxCacheBytes) {
+        return;
+    }
+
+    // Least recently used first, down to well under the limit so this
+    // does not run again on the next write.
+    std::vector<std::pair<qint64, QString>> byAge;
+    byAge.reserve(static_cast<size_t>(cacheFiles_.size()));
+    for (auto entry = cacheFiles_.constBegin(); entry != cacheFiles_.constEnd(); ++entry) {
+        byAge.emplace_back(entry.value().used, entry.key());
+    }
+    std::sort(byAge.begin(), byAge.end());
+    for (const auto& entry : byAge) {
+        if (cacheBytes_ <= kTrimmedCacheBytes) {
+            break;
+        }
+        QFile::remove(cacheDir_ + '/' + entry.second);
+        cacheBytes_ -= cacheFiles_.value(entry.second).bytes;
+        cacheFiles_.remove(entry.second);
+    }
+}
+
+bool CoverArtProvider::recall(const QString& key, QImage& image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = recentIndex_.constFind(key);
+    if (it == recentIndex_.constEnd()) {
+        return false;
+    }
+    recent_.splice(recent_.begin(), recent_, it.value());
+    image = recent_.front().image;
+    return true;
+}
+
+void CoverArtProvider::remember(const QString& key, const QImage& image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (recentIndex_.contains(key)) {
+        return;
+    }
+    recent_.push_front({ key, image });
+    recentIndex_.insert(key, recent_.begin());
+    recentBytes_ += image.isNull() ? kEmptyEntryBytes : image.sizeInBytes();
+
+    while (recentBytes_ > kMaxRecentBytes && recent_.size() > 1) {
+        const Recent& oldest = recent_.back();
+        recentBytes_ -= oldest.image.isNull() ? kEmptyEntryBytes : oldest.image.sizeInBytes();
+        recentIndex_.remove(oldest.key);
+        recent_.pop_back();
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef COVER_ART_PROVIDER_H
+#define COVER_ART_PROVIDER_H
+
+#include <QHash>
+#include <QImage>
+#include <QQuickAsyncImageProvider>
+#include <QString>
+#include <QThreadPool>
+#include <list>
+#include <mutex>
+
+// Serves "image://cover/<percent-encoded audio path>" to QML. The picture
+// is the embedded one (APIC, FLAC/Vorbis PICTURE, MP4 covr) or a cover or
+// folder image next to the file. It is decoded on worker threads straight
+// to one of a few fixed thumbnail sizes, the smallest that covers the
+// requested sourceSize, and kept twice. On disk, thumbnails are JPEG (PNG
+// with alpha) keyed by the picture, i.e. a hash of the embedded data or
+// the folder image's path and time, so an album's tracks share one file;
+// the least recently used go once the folder outgrows its byte limit. In
+// memory, an LRU by track and size bounded by bytes makes scrolling back
+// free.
+//
+// The engine owns the provider; the GUI thread never decodes.
+class CoverArtProvider : public QQuickAsyncImageProvider {
+public:
+    CoverArtProvider();
+    ~CoverArtProvider() override;
+
+    QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requestedSize) override;
+
+    // Worker threads: the thumbnail of filePath, null when it has no art.
+    QImage thumbnail(const QString& filePath, int size);
+
+private:
+    struct Recent {
+        QString key;
+        QImage image;
+    };
+
+    static int thumbnailSize(const QSize& requested);
+    static QImage decode(QIODevice* device, int size);
+    static QString folderImage(const QString& filePath);
+    bool readCache(const QString& name, QImage& image);
+    void writeCache(const QString& name, const QImage& image);
+    // Loads the sizes and ages of the files on disk, once.
+    void scanCache();
+
+    bool recall(const QString& key, QImage& image);
+    void remember(const QString& key, const QImage& image);
+
+    QThreadPool pool_;
+    std::mutex mutex_;
+    // Most recently used first.
+    std::list<Recent> recent_;
+    QHash<QString, std::list<Recent>::iterator> recentIndex_;
+    qint64 recentBytes_;
+
+    struct CacheFile {
+        qint64 bytes;
+        qint64 used;
+    };
+
+    // Disk cache, by file name.
+    QString cacheDir_;
+    std::mutex cacheMutex_;
+    bool cacheScanned_;
+    QHash<QString, CacheFile> cacheFiles_;
+    qint64 cacheBytes_;
+};
+
+#endif // COVER_ART_PROVIDER_H
@@ -0,0 +1,124 @@
+#include "cue_sheet.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringDecoder>
+#include <algorithm>
+
+bool CueSheet::parse(const QString& cuePath, QList<CueEntry>& entries) {
+    entries.clear();
+
+    QFile file(cuePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Cannot open CUE sheet:" << cuePath;
+        return false;
+    }
+
+    const QDir directory = QFileInfo(cuePath).absoluteDir();
+    const QStringList lines = decode(file.readAll()).split('\n', Qt::SkipEmptyParts);
+
+    QString currentFile;
+    QString albumPerformer;
+    CueEntry* track = nullptr;
+
+    auto unquote = [](const QString& text) {
+        if (text.startsWith('"')) {
+            int close = text.indexOf('"', 1);
+            return text.mid(1, close < 0 ? -1 : close - 1);
+        }
+        return text.section(' ', 0, 0);
+    };
+
+    for (const QString& rawLine : lines) {
+        const QString line = rawLine.trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        const QString command = line.section(' ', 0, 0).toUpper();
+        const QString argument = line.mid(command.size()).trimmed();
+
+        if (command == "FILE") {
+            // The file type follows the name; only the name matters here.
+            QString name = argument.startsWith('"') ? unquote(argument) : argument.section(' ', 0, -2);
+            currentFile = QDir::cleanPath(directory.absoluteFilePath(name));
+            track = nullptr;
+        } else if (command == "TRACK") {
+            if (currentFile.isEmpty() || !argument.contains("AUDIO", Qt::CaseInsensitive)) {
+                track = nullptr;
+                continue;
+            }
+            entries.append(CueEntry());
+            track = &entries.last();
+            track->number = argument.section(' ', 0, 0).toInt();
+            track->filePath = currentFile;
+            track->start = -1.0;
+        } else if (command == "TITLE" && track) {
+            track->title = unquote(argument);
+        } else if (command == "PERFORMER") {
+            (track ? track->performer : albumPerformer) = unquote(argument);
+        } else if (command == "INDEX" && track) {
+            double seconds = 0.0;
+            if (argument.section(' ', 0, 0).toInt() == 1 && parseTime(argument.section(' ', 1, 1), seconds)) {
+                track->start = seconds;
+            }
+        }
+    }
+
+    // Drop tracks without INDEX 01, then close each span at the start of the
+    // following track in the same file.
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const CueEntry& entry) {
+        return entry.start < 0.0;
+    }), entries.end());
+
+    for (int i = 0; i < entries.size(); ++i) {
+        CueEntry& entry = entries[i];
+        if (entry.performer.isEmpty()) {
+            entry.performer = albumPerformer;
+        }
+        if (entry.title.isEmpty()) {
+            entry.title = QString("%1 - Track %2").arg(QFileInfo(entry.filePath).completeBaseName()).arg(entry.number, 2, 10, QChar('0'));
+        }
+        if (i + 1 < entries.size() && entries[i + 1].filePath == entry.filePath) {
+            entry.end = entries[i + 1].start;
+        }
+    }
+
+    if (entries.isEmpty()) {
+        qDebug() << "No audio tracks in CUE sheet:" << cuePath;
+        return false;
+    }
+    return true;
+}
+
+QString CueSheet::decode(const QByteArray& data) {
+    // Sheets are written by all kinds of rippers: UTF-8 (with or without a
+    // BOM) where possible, otherwise the local 8-bit code page.
+    QStringDecoder utf8(QStringConverter::Utf8);
+    QString text = utf8.decode(data);
+    if (!utf8.hasError()) {
+        return text;
+    }
+    return QString::fromLocal8Bit(data);
+}
+
+bool CueSheet::parseTime(const QString& text, double& seconds) {
+    // mm:ss:ff with 75 frames per second.
+    const QStringList parts = text.split(':');
+    if (parts.size() != 3) {
+        return false;
+    }
+
+    bool okMinutes = false;
+    bool okSeconds = false;
+    bool okFrames = false;
+    int minutes = parts[0].toInt(&okMinutes);
+    int secs = parts[1].toInt(&okSeconds);
+    int frames = parts[2].toInt(&okFrames);
+    if (!okMinutes || !okSeconds || !okFrames) {
+        return false;
+    }
+
+    seconds = minutes * 60.0 + secs + frames / 75.0;
+    return true;
+}
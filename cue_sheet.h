@@ -0,0 +1,31 @@
+#ifndef CUE_SHEET_H
+#define CUE_SHEET_H
+
+#include <QList>
+#include <QString>
+
+// One TRACK of a CUE sheet: a span of an audio file, in seconds. end is 0
+// for the last track of a file, which runs to the end of it.
+struct CueEntry {
+    int number = 0;
+    QString filePath;
+    QString title;
+    QString performer;
+    double start = 0.0;
+    double end = 0.0;
+};
+
+// Parser for the CUE sheets that accompany single-file CD rips. Tracks
+// start at INDEX 01; the pregap (INDEX 00) is left with the previous
+// track, as it plays on the disc. FILE paths are resolved against the
+// sheet's directory.
+class CueSheet {
+public:
+    static bool parse(const QString& cuePath, QList<CueEntry>& entries);
+
+private:
+    static QString decode(const QByteArray& data);
+    static bool parseTime(const QString& text, double& seconds);
+};
+
+#endif // CUE_SHEET_H
@@ -0,0 +1,186 @@
+#include "dsd_converter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DSD_CONVERTER_SSE2 1
+#endif
+
+namespace {
+
+const double kAttenuationDb = 120.0;
+const size_t kStage1Taps = 96;
+const size_t kTableBytes = kStage1Taps / 8;
+// DSD idle pattern: equal ones and zeros, so a fresh filter starts at zero.
+const uint8_t kSilence = 0x69;
+
+float dot(const float* a, const float* b, size_t count) {
+    size_t i = 0;
+    float sum = 0.0f;
+#ifdef DSD_CONVERTER_SSE2
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    sum = _mm_cvtss_f32(acc0);
+#endif
+    for (; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Kaiser's estimate for the given transition width, as a fraction of the
+// input rate, rounded up to whole SIMD blocks.
+size_t kaiserLength(double transition) {
+    size_t taps = static_cast<size_t>(std::ceil((kAttenuationDb - 7.95) / (14.36 * transition))) + 1;
+    return (taps + 3) & ~static_cast<size_t>(3);
+}
+
+}
+
+DsdConverter::DsdConverter(unsigned dsdRate, int channels, bool lsbFirst)
+    : outputRate_(0)
+    , decimation_(dsdRate >= 8000000 ? 64 : 32) {
+    outputRate_ = dsdRate / static_cast<unsigned>(decimation_);
+    const double finalPass = 0.34 * outputRate_;
+    const double finalStop = 0.5 * outputRate_;
+
+    // Stage 1: bits to rate / 8, protecting only what later stages keep.
+    double rate = dsdRate;
+    double stageOutput = rate / 8.0;
+    std::vector<float> taps = design(kStage1Taps, finalPass / rate, (stageOutput - finalStop) / rate);
+    table_.assign(kTableBytes * 256, 0.0f);
+    for (size_t age = 0; age < kTableBytes; ++age) {
+        for (int value = 0; value < 256; ++value) {
+            float sum = 0.0f;
+            for (int bit = 0; bit < 8; ++bit) {
+                // The newest sample of a byte is its last bit in time.
+                size_t tap = 8 * age + (lsbFirst ? 7 - bit : bit);
+                sum += ((value >> bit) & 1) ? taps[tap] : -taps[tap];
+            }
+            table_[age * 256 + value] = sum;
+        }
+    }
+
+    std::vector<Stage> stages;
+    rate = stageOutput;
+    while (rate > outputRate_ + 0.5) {
+        double output = rate / 2.0;
+        bool last = output <= outputRate_ + 0.5;
+        double stop = last ? finalStop : output - finalStop;
+        Stage stage;
+        stage.taps = design(kaiserLength((stop - finalPass) / rate), finalPass / rate, stop / rate);
+        stage.history.assign(stage.taps.size() - 1, 0.0f);
+        stage.phase = 0;
+        stages.push_back(std::move(stage));
+        rate = output;
+    }
+
+    channels_.resize(std::max(1, channels));
+    for (Channel& channel : channels_) {
+        channel.bytes.assign(kTableBytes - 1, kSilence);
+        channel.stages = stages;
+    }
+}
+
+void DsdConverter::process(int channel, const uint8_t* data, size_t count, size_t stride, std::vector<float>& output) {
+    Channel& state = channels_[channel];
+    const size_t history = kTableBytes - 1;
+
+    state.bytes.resize(history + count);
+    uint8_t* bytes = state.bytes.data();
+    for (size_t i = 0; i < count; ++i) {
+        bytes[history + i] = data[i * stride];
+    }
+
+    scratch_.resize(count);
+    const float* table = table_.data();
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* newest = bytes + history + i;
+        float sum = 0.0f;
+        for (size_t age = 0; age < kTableBytes; ++age) {
+            sum += table[age * 256 + newest[-static_cast<ptrdiff_t>(age)]];
+        }
+        scratch_[i] = sum;
+    }
+    memmove(bytes, bytes + count, history);
+    state.bytes.resize(history);
+
+    const size_t stageCount = state.stages.size();
+    for (size_t s = 0; s < stageCount; ++s) {
+        if (s + 1 == stageCount) {
+            decimate(state.stages[s], scratch_.data(), scratch_.size(), output);
+        } else {
+            scratch2_.clear();
+            decimate(state.stages[s], scratch_.data(), scratch_.size(), scratch2_);
+            scratch_.swap(scratch2_);
+        }
+    }
+}
+
+std::vector<float> DsdConverter::design(size_t taps, double passband, double stopband) {
+    // Kaiser-windowed sinc with the cutoff centred in the transition band
+    // and unity gain at DC.
+    const double pi = 3.14159265358979323846;
+    const double beta = 0.1102 * (kAttenuationDb - 8.7);
+    const double cutoff = 0.5 * (passband + stopband);
+    const double centre = 0.5 * (taps - 1);
+    const double norm = besselI0(beta);
+
+    std::vector<double> h(taps);
+    double sum = 0.0;
+    for (size_t n = 0; n < taps; ++n) {
+        double x = n - centre;
+        double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * x) / (pi * x);
+        double r = x / centre;
+        h[n] = sinc * besselI0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / norm;
+        sum += h[n];
+    }
+
+    std::vector<float> result(taps);
+    for (size_t n = 0; n < taps; ++n) {
+        result[n] = static_cast<float>(h[n] / sum);
+    }
+    return result;
+}
+
+void DsdConverter::decimate(Stage& stage, const float* input, size_t count, std::vector<float>& output) {
+    const size_t length = stage.taps.size();
+    const size_t history = length - 1;
+
+    stage.history.resize(history + count);
+    float* buffer = stage.history.data();
+    memcpy(buffer + history, input, count * sizeof(float));
+
+    // The taps are symmetric, so the window ending at input i is a plain
+    // dot product from buffer + i.
+    output.reserve(output.size() + count / 2 + 1);
+    for (size_t i = stage.phase; i < count; i += 2) {
+        output.push_back(dot(stage.taps.data(), buffer + i, length));
+    }
+    stage.phase = (stage.phase + count) % 2;
+
+    memmove(buffer, buffer + count, history * sizeof(float));
+    stage.history.resize(history);
+}
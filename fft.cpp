@@ -0,0 +1,180 @@
+#include "fft.h"
+#include <cmath>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FFT_SSE2 1
+#endif
+
+RealFft::RealFft()
+    : size_(0)
+    , half_(0) {
+}
+
+RealFft::RealFft(size_t size)
+    : size_(0)
+    , half_(0) {
+    setSize(size);
+}
+
+void RealFft::setSize(size_t size) {
+    if (size < 4 || (size & (size - 1)) != 0) {
+        size_ = 0;
+        half_ = 0;
+        return;
+    }
+    if (size == size_) {
+        return;
+    }
+
+    const double pi = 3.14159265358979323846;
+    size_ = size;
+    half_ = size / 2;
+
+    int bits = 0;
+    while ((size_t(1) << bits) < half_) {
+        ++bits;
+    }
+    bitReverse_.resize(half_);
+    for (size_t i = 0; i < half_; ++i) {
+        uint32_t reversed = 0;
+        for (int b = 0; b < bits; ++b) {
+            if (i & (size_t(1) << b)) {
+                reversed |= 1u << (bits - 1 - b);
+            }
+        }
+        bitReverse_[i] = reversed;
+    }
+
+    // Twiddles for every butterfly stage stored back to back, so each stage
+    // reads a contiguous run: stage h starts at offset h - 1.
+    stageRe_.assign(half_ > 1 ? half_ - 1 : 1, 0.0f);
+    stageIm_.assign(stageRe_.size(), 0.0f);
+    for (size_t h = 1; h < half_; h *= 2) {
+        for (size_t j = 0; j < h; ++j) {
+            double angle = -pi * static_cast<double>(j) / static_cast<double>(h);
+            stageRe_[h - 1 + j] = static_cast<float>(std::cos(angle));
+            stageIm_[h - 1 + j] = static_cast<float>(std::sin(angle));
+        }
+    }
+
+    splitRe_.resize(half_ + 1);
+    splitIm_.resize(half_ + 1);
+    for (size_t k = 0; k <= half_; ++k) {
+        double angle = -2.0 * pi * static_cast<double>(k) / static_cast<double>(size_);
+        splitRe_[k] = static_cast<float>(std::cos(angle));
+        splitIm_[k] = static_cast<float>(std::sin(angle));
+    }
+
+    workRe_.assign(half_, 0.0f);
+    workIm_.assign(half_, 0.0f);
+}
+
+void RealFft::transform(float* re, float* im) {
+    for (size_t i = 0; i < half_; ++i) {
+        size_t j = bitReverse_[i];
+        if (j > i) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (size_t h = 1; h < half_; h *= 2) {
+        const float* wRe = &stageRe_[h - 1];
+        const float* wIm = &stageIm_[h - 1];
+
+        for (size_t base = 0; base < half_; base += 2 * h) {
+            float* aRe = re + base;
+            float* aIm = im + base;
+            float* bRe = aRe + h;
+            float* bIm = aIm + h;
+            size_t j = 0;
+#ifdef FFT_SSE2
+            for (; j + 4 <= h; j += 4) {
+                __m128 wr = _mm_loadu_ps(wRe + j);
+                __m128 wi = _mm_loadu_ps(wIm + j);
+                __m128 br = _mm_loadu_ps(bRe + j);
+                __m128 bi = _mm_loadu_ps(bIm + j);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+                __m128 ar = _mm_loadu_ps(aRe + j);
+                __m128 ai = _mm_loadu_ps(aIm + j);
+                _mm_storeu_ps(bRe + j, _mm_sub_ps(ar, tr));
+                _mm_storeu_ps(bIm + j, _mm_sub_ps(ai, ti));
+                _mm_storeu_ps(aRe + j, _mm_add_ps(ar, tr));
+                _mm_storeu_ps(aIm + j, _mm_add_ps(ai, ti));
+            }
+#endif
+            for (; j < h; ++j) {
+                float tr = wRe[j] * bRe[j] - wIm[j] * bIm[j];
+                float ti = wRe[j] * bIm[j] + wIm[j] * bRe[j];
+                bRe[j] = aRe[j] - tr;
+                bIm[j] = aIm[j] - ti;
+                aRe[j] += tr;
+                aIm[j] += ti;
+            }
+        }
+    }
+}
+
+void RealFft::forward(const float* input, float* re, float* im) {
+    if (size_ == 0) {
+        return;
+    }
+
+    for (size_t n = 0; n < half_; ++n) {
+        workRe_[n] = input[2 * n];
+        workIm_[n] = input[2 * n + 1];
+    }
+    transform(workRe_.data(), workIm_.data());
+
+    for (size_t k = 0; k <= half_; ++k) {
+        size_t a = k % half_;
+        size_t b = (half_ - k) % half_;
+        float zr = workRe_[a], zi = workIm_[a];
+        float mr = workRe_[b], mi = workIm_[b];
+
+        float evenRe = 0.5f * (zr + mr);
+        float evenIm = 0.5f * (zi - mi);
+        float oddRe = 0.5f * (zi + mi);
+        float oddIm = -0.5f * (zr - mr);
+
+        float wr = splitRe_[k], wi = splitIm_[k];
+        re[k] = evenRe + wr * oddRe - wi * oddIm;
+        im[k] = evenIm + wr * oddIm + wi * oddRe;
+    }
+}
+
+void RealFft::inverse(const float* re, const float* im, float* output) {
+    if (size_ == 0) {
+        return;
+    }
+
+    for (size_t k = 0; k < half_; ++k) {
+        float xr = re[k], xi = im[k];
+        float mr = re[half_ - k], mi = -im[half_ - k];
+
+        float evenRe = 0.5f * (xr + mr);
+        float evenIm = 0.5f * (xi + mi);
+        float diffRe = 0.5f * (xr - mr);
+        float diffIm = 0.5f * (xi - mi);
+
+        // Undo the forward twiddle: multiply by conj(W^k).
+        float wr = splitRe_[k], wi = -splitIm_[k];
+        float oddRe = diffRe * wr - diffIm * wi;
+        float oddIm = diffRe * wi + diffIm * wr;
+
+        // Conjugate going in and coming out turns the forward transform
+        // into an inverse one.
+        workRe_[k] = evenRe - oddIm;
+        workIm_[k] = -(evenIm + oddRe);
+    }
+    transform(workRe_.data(), workIm_.data());
+
+    const float scale = 1.0f / static_cast<float>(half_);
+    for (size_t n = 0; n < half_; ++n) {
+        output[2 * n] = workRe_[n] * scale;
+        output[2 * n + 1] = -workIm_[n] * scale;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Power-of-two real FFT built on a half-size radix-2 complex FFT.
+// Spectra are kept in split real/imaginary arrays of size()/2 + 1 bins so
+// callers can run SIMD over them directly. Each instance owns its scratch
+// buffers and must only be used from one thread at a time.
+class RealFft {
+public:
+    RealFft();
+    explicit RealFft(size_t size);
+
+    void setSize(size_t size);
+    size_t size() const { return size_; }
+    size_t bins() const { return size_ / 2 + 1; }
+
+    // Unnormalised forward DFT of size() real samples.
+    void forward(const float* input, float* re, float* im);
+    // Inverse DFT including the 1/size() scale, so inverse(forward(x)) == x.
+    void inverse(const float* re, const float* im, float* output);
+
+private:
+    void transform(float* re, float* im);
+
+    size_t size_;
+    size_t half_;
+    std::vector<uint32_t> bitReverse_;
+    std::vector<float> stageRe_;
+    std::vector<float> stageIm_;
+    std::vector<float> splitRe_;
+    std::vector<float> splitIm_;
+    std::vector<float> workRe_;
+    std::vector<float> workIm_;
+};
+
+#endif // FFT_H
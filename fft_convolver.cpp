@@ -0,0 +1,276 @@
+#include "fft_convolver.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FFT_CONVOLVER_SSE2 1
+#endif
+
+struct FftConvolver::Engine {
+    size_t blockSize;
+    size_t fftSize;
+    size_t bins;
+    size_t stride;
+    size_t partitions;
+    int channels;
+    int kernelChannels;
+    RealFft fft;
+    std::vector<float> kernelRe;
+    std::vector<float> kernelIm;
+    std::vector<float> fdlRe;
+    std::vector<float> fdlIm;
+    std::vector<float> input;
+    std::vector<float> output;
+    std::vector<float> accRe;
+    std::vector<float> accIm;
+    std::vector<float> time;
+    size_t fdlPos;
+    size_t fill;
+};
+
+namespace {
+
+std::vector<float> resampleImpulseResponse(const std::vector<float>& input, int channels,
+                                           double fromRate, double toRate) {
+    const double pi = 3.14159265358979323846;
+    const int zeroCrossings = 32;
+    const size_t inFrames = input.size() / channels;
+    const double ratio = toRate / fromRate;
+    const double cutoff = std::min(1.0, ratio);
+    const double halfWidth = zeroCrossings / cutoff;
+    // An impulse response sampled faster needs proportionally smaller taps
+    // to keep the same frequency response.
+    const double gain = cutoff / ratio;
+    const size_t outFrames = static_cast<size_t>(std::ceil(inFrames * ratio));
+
+    std::vector<float> output(outFrames * channels, 0.0f);
+    for (size_t n = 0; n < outFrames; ++n) {
+        double t = n / ratio;
+        long first = static_cast<long>(std::ceil(t - halfWidth));
+        long last = static_cast<long>(std::floor(t + halfWidth));
+        first = std::max(first, 0L);
+        last = std::min(last, static_cast<long>(inFrames) - 1);
+
+        for (long j = first; j <= last; ++j) {
+            double x = (t - j) * cutoff;
+            double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(pi * x) / (pi * x);
+            double w = 0.5 + 0.5 * std::cos(pi * x / zeroCrossings);
+            double tap = gain * sinc * w;
+            for (int ch = 0; ch < channels; ++ch) {
+                output[n * channels + ch] += static_cast<float>(input[j * channels + ch] * tap);
+            }
+        }
+    }
+    return output;
+}
+
+} // namespace
+
+FftConvolver::FftConvolver()
+    : irChannels_(0)
+    , irSampleRate_(0.0)
+    , sampleRate_(0.0)
+    , channels_(0)
+    , pendingVersion_(0)
+    , blockSize_(0)
+    , appliedVersion_(0) {
+}
+
+FftConvolver::~FftConvolver() = default;
+
+void FftConvolver::prepare(double sampleRate, int channels, size_t blockSize) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sampleRate_ = sampleRate;
+    channels_ = channels;
+    blockSize_.store(blockSize, std::memory_order_relaxed);
+
+    // The stream is closed, so the active engine can be replaced directly.
+    active_ = buildEngine();
+    pending_.reset();
+    appliedVersion_ = pendingVersion_.load(std::memory_order_relaxed);
+}
+
+bool FftConvolver::setImpulseResponse(const std::vector<float>& interleaved, int channels, double sampleRate) {
+    if (channels <= 0 || sampleRate <= 0.0 || interleaved.size() < static_cast<size_t>(channels)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    irSamples_ = interleaved;
+    irChannels_ = channels;
+    irSampleRate_ = sampleRate;
+
+    pending_ = buildEngine();
+    pendingVersion_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void FftConvolver::clearImpulseResponse() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    irSamples_.clear();
+    irChannels_ = 0;
+    irSampleRate_ = 0.0;
+
+    pending_.reset();
+    pendingVersion_.fetch_add(1, std::memory_order_release);
+}
+
+bool FftConvolver::hasImpulseResponse() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !irSamples_.empty();
+}
+
+std::unique_ptr<FftConvolver::Engine> FftConvolver::buildEngine() const {
+    const size_t blockSize = blockSize_.load(std::memory_order_relaxed);
+    if (irSamples_.empty() || irChannels_ <= 0 || channels_ <= 0 || sampleRate_ <= 0.0 || blockSize == 0) {
+        return nullptr;
+    }
+
+    std::vector<float> resampled;
+    const std::vector<float>* ir = &irSamples_;
+    if (std::fabs(irSampleRate_ - sampleRate_) > 0.5) {
+        resampled = resampleImpulseResponse(irSamples_, irChannels_, irSampleRate_, sampleRate_);
+        ir = &resampled;
+    }
+
+    auto engine = std::make_unique<Engine>();
+    Engine& e = *engine;
+    const size_t irFrames = ir->size() / irChannels_;
+
+    e.blockSize = blockSize;
+    e.fftSize = blockSize * 2;
+    e.bins = blockSize + 1;
+    e.stride = (e.bins + 3) & ~size_t(3);
+    e.partitions = std::max<size_t>(1, (irFrames + blockSize - 1) / blockSize);
+    e.channels = channels_;
+    e.kernelChannels = irChannels_;
+    e.fft.setSize(e.fftSize);
+    e.fdlPos = 0;
+    e.fill = 0;
+
+    const size_t spectrum = e.partitions * e.stride;
+    e.kernelRe.assign(spectrum * e.kernelChannels, 0.0f);
+    e.kernelIm.assign(spectrum * e.kernelChannels, 0.0f);
+    e.fdlRe.assign(spectrum * e.channels, 0.0f);
+    e.fdlIm.assign(spectrum * e.channels, 0.0f);
+    e.input.assign(e.fftSize * e.channels, 0.0f);
+    e.output.assign(e.blockSize * e.channels, 0.0f);
+    e.accRe.assign(e.stride, 0.0f);
+    e.accIm.assign(e.stride, 0.0f);
+    e.time.assign(e.fftSize, 0.0f);
+
+    for (int kc = 0; kc < e.kernelChannels; ++kc) {
+        for (size_t p = 0; p < e.partitions; ++p) {
+            std::fill(e.time.begin(), e.time.end(), 0.0f);
+            size_t start = p * blockSize;
+            size_t count = std::min(blockSize, irFrames - start);
+            for (size_t i = 0; i < count; ++i) {
+                e.time[i] = (*ir)[(start + i) * irChannels_ + kc];
+            }
+
+            size_t offset = (kc * e.partitions + p) * e.stride;
+            e.fft.forward(e.time.data(), &e.kernelRe[offset], &e.kernelIm[offset]);
+        }
+    }
+
+    return engine;
+}
+
+bool FftConvolver::update() {
+    if (pendingVersion_.load(std::memory_order_acquire) != appliedVersion_ && mutex_.try_lock()) {
+        // The previous engine ends up in pending_ and is freed by the GUI
+        // thread on its next change, never on the audio thread.
+        std::swap(active_, pending_);
+        appliedVersion_ = pendingVersion_.load(std::memory_order_relaxed);
+        mutex_.unlock();
+    }
+    return active_ != nullptr;
+}
+
+void FftConvolver::process(float* interleaved, size_t frames) {
+    if (!active_) {
+        return;
+    }
+
+    Engine& e = *active_;
+    const int channels = e.channels;
+    size_t offset = 0;
+
+    while (offset < frames) {
+        size_t count = std::min(frames - offset, e.blockSize - e.fill);
+
+        for (int ch = 0; ch < channels; ++ch) {
+            float* in = &e.input[ch * e.fftSize + e.blockSize + e.fill];
+            const float* out = &e.output[ch * e.blockSize + e.fill];
+            float* sample = interleaved + offset * channels + ch;
+            for (size_t i = 0; i < count; ++i, sample += channels) {
+                in[i] = *sample;
+                *sample = out[i];
+            }
+        }
+
+        e.fill += count;
+        offset += count;
+
+        if (e.fill == e.blockSize) {
+            for (int ch = 0; ch < channels; ++ch) {
+                processBlock(e, ch);
+            }
+            e.fdlPos = (e.fdlPos + 1) % e.partitions;
+            e.fill = 0;
+        }
+    }
+}
+
+void FftConvolver::processBlock(Engine& e, int channel) {
+    const size_t stride = e.stride;
+    const size_t spectrum = e.partitions * stride;
+    float* window = &e.input[channel * e.fftSize];
+    float* fdlRe = &e.fdlRe[channel * spectrum];
+    float* fdlIm = &e.fdlIm[channel * spectrum];
+    const int kernelChannel = channel % e.kernelChannels;
+    const float* kernelRe = &e.kernelRe[kernelChannel * spectrum];
+    const float* kernelIm = &e.kernelIm[kernelChannel * spectrum];
+
+    e.fft.forward(window, fdlRe + e.fdlPos * stride, fdlIm + e.fdlPos * stride);
+
+    float* accRe = e.accRe.data();
+    float* accIm = e.accIm.data();
+    std::memset(accRe, 0, stride * sizeof(float));
+    std::memset(accIm, 0, stride * sizeof(float));
+
+    for (size_t p = 0; p < e.partitions; ++p) {
+        size_t slot = (e.fdlPos + e.partitions - p) % e.partitions;
+        const float* xr = fdlRe + slot * stride;
+        const float* xi = fdlIm + slot * stride;
+        const float* hr = kernelRe + p * stride;
+        const float* hi = kernelIm + p * stride;
+        size_t k = 0;
+#ifdef FFT_CONVOLVER_SSE2
+        for (; k < stride; k += 4) {
+            __m128 vxr = _mm_loadu_ps(xr + k);
+            __m128 vxi = _mm_loadu_ps(xi + k);
+            __m128 vhr = _mm_loadu_ps(hr + k);
+            __m128 vhi = _mm_loadu_ps(hi + k);
+            __m128 re = _mm_sub_ps(_mm_mul_ps(vxr, vhr), _mm_mul_ps(vxi, vhi));
+            __m128 im = _mm_add_ps(_mm_mul_ps(vxr, vhi), _mm_mul_ps(vxi, vhr));
+            _mm_storeu_ps(accRe + k, _mm_add_ps(_mm_loadu_ps(accRe + k), re));
+            _mm_storeu_ps(accIm + k, _mm_add_ps(_mm_loadu_ps(accIm + k), im));
+        }
+#endif
+        for (; k < stride; ++k) {
+            accRe[k] += xr[k] * hr[k] - xi[k] * hi[k];
+            accIm[k] += xr[k] * hi[k] + xi[k] * hr[k];
+        }
+    }
+
+    e.fft.inverse(accRe, accIm, e.time.data());
+
+    // Overlap-save: the second half of the circular result is the valid
+    // linear convolution output for the newest block.
+    std::memcpy(&e.output[channel * e.blockSize], e.time.data() + e.blockSize, e.blockSize * sizeof(float));
+    std::memmove(window, window + e.blockSize, e.blockSize * sizeof(float));
+}
@@ -0,0 +1,60 @@
+#ifndef FFT_CONVOLVER_H
+#define FFT_CONVOLVER_H
+
+#include "fft.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Uniformly partitioned overlap-save convolution for long FIR filters such
+// as measured room-correction impulse responses. The impulse response is
+// split into blockSize partitions whose spectra are multiplied against a
+// frequency-domain delay line of past input blocks, so cost grows with the
+// number of partitions rather than the number of taps and the added latency
+// is exactly one block.
+class FftConvolver {
+public:
+    FftConvolver();
+    ~FftConvolver();
+
+    // Call while the stream is closed.
+    void prepare(double sampleRate, int channels, size_t blockSize);
+
+    // GUI thread. The impulse response is interleaved; a mono response is
+    // applied to every output channel. It is resampled to the stream rate
+    // when the two differ.
+    bool setImpulseResponse(const std::vector<float>& interleaved, int channels, double sampleRate);
+    void clearImpulseResponse();
+    bool hasImpulseResponse() const;
+    size_t latencyFrames() const { return blockSize_.load(std::memory_order_relaxed); }
+
+    // Audio thread.
+    bool update();
+    bool isActive() const { return active_ != nullptr; }
+    void process(float* interleaved, size_t frames);
+
+private:
+    struct Engine;
+
+    std::unique_ptr<Engine> buildEngine() const;
+    static void processBlock(Engine& engine, int channel);
+
+    // GUI side, guarded by mutex_.
+    mutable std::mutex mutex_;
+    std::vector<float> irSamples_;
+    int irChannels_;
+    double irSampleRate_;
+    double sampleRate_;
+    int channels_;
+    std::unique_ptr<Engine> pending_;
+    std::atomic<unsigned> pendingVersion_;
+    std::atomic<size_t> blockSize_;
+
+    // Audio thread only.
+    std::unique_ptr<Engine> active_;
+    unsigned appliedVersion_;
+};
+
+#endif // FFT_CONVOLVER_H
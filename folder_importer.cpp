@@ -0,0 +1,236 @@
+#include "folder_importer.h"
+#include "audio_decoder.h"
+#include "playlist_manager.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+#include <QUrl>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace {
+
+const size_t kBatchSize = 2048;
+
+} // namespace
+
+struct FolderImporter::Scan {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<QString> folders;
+    };
+
+    Scan(int workers, unsigned generation)
+        : queues(workers), pending(0), queued(0), running(workers), generation(generation) {}
+
+    // Wakes the idle workers to look at pending, queued and the generation
+    // again.
+    void wake() {
+        { std::lock_guard<std::mutex> lock(idleMutex); }
+        idle.notify_all();
+    }
+
+    std::vector<Queue> queues;
+    // Folders queued or being read; the walk is over once this hits 0.
+    std::atomic<int> pending;
+    // Folders queued only.
+    std::atomic<int> queued;
+    std::atomic<int> running;
+    const unsigned generation;
+    // Workers with nothing to take wait here for another to queue more.
+    std::mutex idleMutex;
+    std::condition_variable idle;
+};
+
+FolderImporter::FolderImporter(QObject* parent)
+    : QObject(parent)
+    , generation_(0)
+    , activeScans_(0)
+    , foundCount_(0) {
+    pool_.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+}
+
+FolderImporter::~FolderImporter() {
+    generation_.fetch_add(1);
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+void FolderImporter::import(const QString& folder) {
+    QString root = folder.startsWith("file://") ? QUrl(folder).toLocalFile() : folder;
+    QFileInfo info(root);
+    if (!info.isDir()) {
+        qDebug() << "Not a folder:" << root;
+        return;
+    }
+
+    if (activeScans_ == 0) {
+        foundCount_ = 0;
+    }
+    ++activeScans_;
+
+    const int workers = pool_.maxThreadCount();
+    auto scan = std::make_shared<Scan>(workers, generation_.load());
+    scan->queues[0].folders.push_back(QDir::cleanPath(info.absoluteFilePath()));
+    scan->pending = 1;
+    scan->queued = 1;
+    for (int worker = 0; worker < workers; ++worker) {
+        pool_.start(QRunnable::create([this, scan, worker]() {
+            work(scan, worker);
+        }));
+    }
+
+    qDebug() << "Importing folder:" << root << "with" << workers << "workers";
+    emit progressChanged();
+}
+
+void FolderImporter::cancel() {
+    // Running workers see the new generation and stop after their folder.
+    generation_.fetch_add(1);
+}
+
+void FolderImporter::work(const std::shared_ptr<Scan>& scan, int worker) {
+    std::vector<TrackEntry> batch;
+    QStringList folders;
+    QString folder;
+
+    while (generation_.load(std::memory_order_relaxed) == scan->generation) {
+        if (takeFolder(*scan, worker, folder)) {
+            scanFolder(*scan, worker, folder, batch);
+            if (scan->pending.fetch_sub(1) == 1) {
+                scan->wake();
+            }
+            folders << folder;
+            if (batch.size() >= kBatchSize) {
+                deliver(std::move(batch), std::move(folders), scan->generation);
+                batch = std::vector<TrackEntry>();
+                folders = QStringList();
+            }
+        } else if (scan->pending.load() == 0) {
+            break;
+        } else {
+            // Others are still reading folders that may hold more.
+            std::unique_lock<std::mutex> lock(scan->idleMutex);
+            scan->idle.wait(lock, [this, &scan]() {
+                return scan->queued.load() > 0 || scan->pending.load() == 0 ||
+                       generation_.load(std::memory_order_relaxed) != scan->generation;
+            });
+        }
+    }
+    // Cancelled, those still waiting have to see it.
+    scan->wake();
+
+    if (!batch.empty() || !folders.isEmpty()) {
+        deliver(std::move(batch), std::move(folders), scan->generation);
+    }
+    if (scan->running.fetch_sub(1) == 1) {
+        QMetaObject::invokeMethod(this, [this]() {
+            onScanDone();
+        }, Qt::QueuedConnection);
+    }
+}
+
+bool FolderImporter::takeFolder(Scan& scan, int worker, QString& folder) {
+    const int workers = static_cast<int>(scan.queues.size());
+    for (int i = 0; i < workers; ++i) {
+        Scan::Queue& queue = scan.queues[(worker + i) % workers];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.folders.empty()) {
+            continue;
+        }
+
+        // Newest from our own queue keeps the walk depth-first and local;
+        // oldest from another's takes the biggest untouched subtree.
+        if (i == 0) {
+            folder = std::move(queue.folders.back());
+            queue.folders.pop_back();
+        } else {
+            folder = std::move(queue.folders.front());
+            queue.folders.pop_front();
+        }
+        scan.queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void FolderImporter::scanFolder(Scan& scan, int worker, const QString& folder, std::vector<TrackEntry>& batch) {
+    const QList<QFileInfo> entries = QDir(folder).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot,
+                                                                QDir::Name | QDir::IgnoreCase);
+    QStringList subfolders;
+    QStringList cueSheets;
+    QStringList files;
+
+    for (const QFileInfo& info : entries) {
+        if (info.isDir()) {
+            // Links are not followed, so one pointing up the tree cannot loop.
+            if (!info.isSymLink()) {
+                subfolders << info.absoluteFilePath();
+            }
+            continue;
+        }
+
+        QString suffix = info.suffix().toLower();
+        if (suffix == "cue") {
+            cueSheets << info.absoluteFilePath();
+        } else if (AudioDecoder::isFormatSupported(suffix)) {
+            files << info.absoluteFilePath();
+        }
+    }
+
+    if (!subfolders.isEmpty()) {
+        scan.pending.fetch_add(static_cast<int>(subfolders.size()));
+        {
+            Scan::Queue& queue = scan.queues[worker];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            // Reversed, so the first subfolder is the next one taken.
+            for (qsizetype i = subfolders.size(); i-- > 0;) {
+                queue.folders.push_back(subfolders[i]);
+            }
+        }
+        scan.queued.fetch_add(static_cast<int>(subfolders.size()));
+        scan.wake();
+    }
+
+    QSet<QString> covered;
+    for (const QString& cueSheet : cueSheets) {
+        for (TrackEntry& track : PlaylistManager::createTracks(cueSheet, false)) {
+            covered.insert(track.filePath);
+            batch.push_back(std::move(track));
+        }
+    }
+    for (const QString& file : files) {
+        if (!covered.contains(file)) {
+            for (TrackEntry& track : PlaylistManager::createTracks(file, false)) {
+                batch.push_back(std::move(track));
+            }
+        }
+    }
+}
+
+void FolderImporter::deliver(std::vector<TrackEntry>&& batch, QStringList&& folders, unsigned generation) {
+    auto tracks = std::make_shared<std::vector<TrackEntry>>(std::move(batch));
+    QMetaObject::invokeMethod(this, [this, tracks, folders = std::move(folders), generation]() {
+        if (generation != generation_.load()) {
+            return;
+        }
+        foundCount_ += static_cast<int>(tracks->size());
+        emit foldersScanned(folders);
+        if (!tracks->empty()) {
+            emit tracksFound(*tracks);
+        }
+        emit progressChanged();
+    }, Qt::QueuedConnection);
+}
+
+void FolderImporter::onScanDone() {
+    --activeScans_;
+    qDebug() << "Folder import finished," << foundCount_ << "tracks found";
+    emit progressChanged();
+}
@@ -0,0 +1,56 @@
+#ifndef FOLDER_IMPORTER_H
+#define FOLDER_IMPORTER_H
+
+#include "track_store.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Walks folder trees for playable files on a private thread pool and hands
+// the tracks back in batches while the walk is still going. Every worker
+// keeps its own deque of folders, takes the newest from it and steals the
+// oldest from the others when it runs dry, so a tree with one huge branch
+// still spreads across all cores. Files get their tags read, nothing is
+// decoded; a duration the headers do not give is filled in when a track is
+// first loaded. CUE sheets are
+// expanded and the images they cover left out.
+class FolderImporter : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FolderImporter(QObject* parent = nullptr);
+    ~FolderImporter();
+
+    void import(const QString& folder);
+    void cancel();
+
+    bool isBusy() const { return activeScans_ > 0; }
+    // Tracks delivered since the importer was last idle.
+    int foundCount() const { return foundCount_; }
+
+signals:
+    void tracksFound(const std::vector<TrackEntry>& tracks);
+    // Every folder walked, for watching; sent along with the tracks.
+    void foldersScanned(const QStringList& folders);
+    void progressChanged();
+
+private:
+    struct Scan;
+
+    void work(const std::shared_ptr<Scan>& scan, int worker);
+    bool takeFolder(Scan& scan, int worker, QString& folder);
+    void scanFolder(Scan& scan, int worker, const QString& folder, std::vector<TrackEntry>& batch);
+    void deliver(std::vector<TrackEntry>&& batch, QStringList&& folders, unsigned generation);
+    void onScanDone();
+
+    QThreadPool pool_;
+    std::atomic<unsigned> generation_;
+    int activeScans_;
+    int foundCount_;
+};
+
+#endif // FOLDER_IMPORTER_H
@@ -0,0 +1,79 @@
+#include "gain_stage.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GAIN_STAGE_SSE2 1
+#endif
+
+GainStage::GainStage()
+    : target_(1.0f)
+    , channels_(0)
+    , rampFrames_(1)
+    , rampRemaining_(0)
+    , current_(1.0f)
+    , rampTarget_(1.0f)
+    , step_(0.0f)
+    , active_(false) {
+}
+
+void GainStage::prepare(double sampleRate, int channels) {
+    channels_ = channels;
+    rampFrames_ = std::max<size_t>(1, static_cast<size_t>(std::lround(sampleRate * 0.02)));
+    rampRemaining_ = 0;
+    current_ = rampTarget_ = target_.load(std::memory_order_relaxed);
+    step_ = 0.0f;
+    active_ = current_ != 1.0f;
+}
+
+void GainStage::setGainDb(double gainDb) {
+    setGain(static_cast<float>(std::pow(10.0, gainDb / 20.0)));
+}
+
+void GainStage::setGain(float gain) {
+    target_.store(std::max(0.0f, gain), std::memory_order_relaxed);
+}
+
+bool GainStage::update() {
+    float target = target_.load(std::memory_order_relaxed);
+    if (target != rampTarget_) {
+        rampTarget_ = target;
+        rampRemaining_ = rampFrames_;
+        step_ = (target - current_) / rampFrames_;
+    }
+    active_ = rampRemaining_ > 0 || current_ != 1.0f;
+    return active_;
+}
+
+void GainStage::process(float* interleaved, size_t frames) {
+    const int channels = channels_;
+
+    size_t ramp = std::min(frames, rampRemaining_);
+    for (size_t i = 0; i < ramp; ++i) {
+        current_ += step_;
+        for (int ch = 0; ch < channels; ++ch) {
+            *interleaved++ *= current_;
+        }
+    }
+    rampRemaining_ -= ramp;
+    if (rampRemaining_ == 0) {
+        current_ = rampTarget_;
+    }
+
+    if (current_ == 1.0f) {
+        return;
+    }
+
+    size_t samples = (frames - ramp) * channels;
+    size_t i = 0;
+#ifdef GAIN_STAGE_SSE2
+    const __m128 gain = _mm_set1_ps(current_);
+    for (; i + 4 <= samples; i += 4) {
+        _mm_storeu_ps(interleaved + i, _mm_mul_ps(_mm_loadu_ps(interleaved + i), gain));
+    }
+#endif
+    for (; i < samples; ++i) {
+        interleaved[i] *= current_;
+    }
+}
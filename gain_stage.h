@@ -0,0 +1,41 @@
+#ifndef GAIN_STAGE_H
+#define GAIN_STAGE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Single gain applied to every channel. Changes are published from the GUI
+// thread through an atomic and ramped linearly over ~20 ms on the audio
+// thread so level changes never click.
+class GainStage {
+public:
+    GainStage();
+
+    // Call while the stream is closed.
+    void prepare(double sampleRate, int channels);
+
+    // GUI thread.
+    void setGainDb(double gainDb);
+    void setGain(float gain);
+    float gain() const { return target_.load(std::memory_order_relaxed); }
+
+    // Audio thread. update() returns false at unity gain with no ramp in
+    // progress, so the caller can skip process().
+    bool update();
+    bool isActive() const { return active_; }
+    void process(float* interleaved, size_t frames);
+
+private:
+    std::atomic<float> target_;
+
+    // Audio thread only.
+    int channels_;
+    size_t rampFrames_;
+    size_t rampRemaining_;
+    float current_;
+    float rampTarget_;
+    float step_;
+    bool active_;
+};
+
+#endif // GAIN_STAGE_H
@@ -0,0 +1,174 @@
+#include "level_meter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// IEC 60268-18 style: peaks fall 20 dB in 1.7 s, RMS integrates over
+// 300 ms, and held peaks stay put for two seconds.
+const float kPeakFallDbPerSecond = 20.0f / 1.7f;
+const float kRmsTimeConstant = 0.3f;
+const float kHoldTime = 2.0f;
+// Samples this close to full scale were clipped on the way out.
+const float kClipLevel = 32767.0f / 32768.0f;
+
+}
+
+LevelMeter::LevelMeter(LevelTap& tap, QObject* parent)
+    : QAbstractListModel(parent)
+    , tap_(tap)
+    , lastFrames_(0)
+    , active_(false)
+    , idle_(true) {
+    resize(tap_.channels());
+}
+
+LevelMeter::~LevelMeter() {
+    tap_.setEnabled(false);
+}
+
+int LevelMeter::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid()) {
+        return 0;
+    }
+    return static_cast<int>(channels_.size());
+}
+
+QVariant LevelMeter::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+
+    const Channel& channel = channels_[index.row()];
+    switch (role) {
+    case PeakRole:
+        return toLevel(channel.peak);
+    case RmsRole:
+        return toLevel(std::sqrt(channel.meanSquare));
+    case HoldRole:
+        return toLevel(channel.hold);
+    case ClipRole:
+        return channel.clip;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> LevelMeter::roleNames() const {
+    QHash<int, QByteArray> roles;
+    roles[PeakRole] = "peak";
+    roles[RmsRole] = "rms";
+    roles[HoldRole] = "hold";
+    roles[ClipRole] = "clip";
+    return roles;
+}
+
+void LevelMeter::setActive(bool active) {
+    if (active == active_) {
+        return;
+    }
+
+    active_ = active;
+    tap_.setEnabled(active);
+    if (active) {
+        // Skip whatever accumulated while nobody was looking.
+        lastFrames_ = tap_.frames();
+        for (int ch = 0; ch < static_cast<int>(channels_.size()); ++ch) {
+            channels_[ch].sumSquares = tap_.sumSquares(ch);
+            tap_.takePeak(ch);
+        }
+    }
+    emit activeChanged();
+}
+
+bool LevelMeter::isClipped() const {
+    return std::any_of(channels_.begin(), channels_.end(), [](const Channel& channel) {
+        return channel.clip;
+    });
+}
+
+void LevelMeter::advance(double seconds) {
+    if (!active_) {
+        return;
+    }
+    if (tap_.channels() != static_cast<int>(channels_.size())) {
+        resize(tap_.channels());
+    }
+
+    const float dt = static_cast<float>(std::clamp(seconds, 0.0, 0.25));
+    const float peakFall = std::pow(10.0f, -kPeakFallDbPerSecond * dt / 20.0f);
+    const float rmsAlpha = 1.0f - std::exp(-dt / kRmsTimeConstant);
+    const float floor = static_cast<float>(std::pow(10.0, kFloorDb / 20.0));
+
+    uint64_t frames = tap_.frames();
+    uint64_t newFrames = frames - lastFrames_;
+    lastFrames_ = frames;
+
+    bool clipped = isClipped();
+    bool idle = true;
+    for (int ch = 0; ch < static_cast<int>(channels_.size()); ++ch) {
+        Channel& channel = channels_[ch];
+
+        double sumSquares = tap_.sumSquares(ch);
+        float meanSquare = newFrames > 0 ? static_cast<float>((sumSquares - channel.sumSquares) / newFrames) : 0.0f;
+        channel.sumSquares = sumSquares;
+        channel.meanSquare += (std::max(meanSquare, 0.0f) - channel.meanSquare) * rmsAlpha;
+
+        float peak = tap_.takePeak(ch);
+        channel.peak = std::max(peak, channel.peak * peakFall);
+        channel.clip = channel.clip || peak >= kClipLevel;
+
+        if (channel.peak >= channel.hold) {
+            channel.hold = channel.peak;
+            channel.holdAge = 0.0f;
+        } else {
+            channel.holdAge += dt;
+            if (channel.holdAge > kHoldTime) {
+                channel.hold = std::max(channel.peak, channel.hold * peakFall);
+            }
+        }
+
+        if (channel.hold > floor || channel.meanSquare > floor * floor) {
+            idle = false;
+        }
+    }
+
+    if (!channels_.empty()) {
+        emit dataChanged(index(0), index(rowCount() - 1), {PeakRole, RmsRole, HoldRole, ClipRole});
+    }
+    if (clipped != isClipped()) {
+        emit clippedChanged();
+    }
+    if (idle != idle_) {
+        idle_ = idle;
+        emit idleChanged();
+    }
+}
+
+void LevelMeter::resetClip() {
+    if (!isClipped()) {
+        return;
+    }
+    for (Channel& channel : channels_) {
+        channel.clip = false;
+    }
+    emit dataChanged(index(0), index(rowCount() - 1), {ClipRole});
+    emit clippedChanged();
+}
+
+float LevelMeter::toLevel(float amplitude) {
+    if (amplitude <= 0.0f) {
+        return 0.0f;
+    }
+    float db = 20.0f * std::log10(amplitude);
+    return std::clamp(static_cast<float>((db - kFloorDb) / -kFloorDb), 0.0f, 1.0f);
+}
+
+void LevelMeter::resize(int channels) {
+    beginResetModel();
+    channels_.assign(std::max(channels, 0), Channel());
+    for (int ch = 0; ch < static_cast<int>(channels_.size()); ++ch) {
+        channels_[ch].sumSquares = tap_.sumSquares(ch);
+    }
+    endResetModel();
+}
@@ -0,0 +1,69 @@
+#ifndef LEVEL_METER_H
+#define LEVEL_METER_H
+
+#include "level_tap.h"
+#include <QAbstractListModel>
+#include <vector>
+
+// Peak and RMS meters, one row per output channel. The view drives
+// advance() once per rendered frame, so ballistics run at display rate on
+// the GUI thread and stop with rendering when the window is hidden.
+// Levels are 0..1 over kFloorDb..0 dBFS.
+class LevelMeter : public QAbstractListModel {
+    Q_OBJECT
+    Q_PROPERTY(bool active READ isActive WRITE setActive NOTIFY activeChanged)
+    Q_PROPERTY(bool idle READ isIdle NOTIFY idleChanged)
+    Q_PROPERTY(bool clipped READ isClipped NOTIFY clippedChanged)
+
+public:
+    enum MeterRoles {
+        PeakRole = Qt::UserRole + 1,
+        RmsRole,
+        HoldRole,
+        ClipRole
+    };
+
+    static constexpr double kFloorDb = -60.0;
+
+    explicit LevelMeter(LevelTap& tap, QObject* parent = nullptr);
+    ~LevelMeter();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    bool isActive() const { return active_; }
+    void setActive(bool active);
+    // True once every meter has fallen back to the floor.
+    bool isIdle() const { return idle_; }
+    bool isClipped() const;
+
+    Q_INVOKABLE void advance(double seconds);
+    Q_INVOKABLE void resetClip();
+
+signals:
+    void activeChanged();
+    void idleChanged();
+    void clippedChanged();
+
+private:
+    struct Channel {
+        float peak = 0.0f;
+        float meanSquare = 0.0f;
+        float hold = 0.0f;
+        float holdAge = 0.0f;
+        double sumSquares = 0.0;
+        bool clip = false;
+    };
+
+    static float toLevel(float amplitude);
+    void resize(int channels);
+
+    LevelTap& tap_;
+    std::vector<Channel> channels_;
+    uint64_t lastFrames_;
+    bool active_;
+    bool idle_;
+};
+
+#endif // LEVEL_METER_H
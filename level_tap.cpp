@@ -0,0 +1,74 @@
+#include "level_tap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+LevelTap::LevelTap()
+    : frames_(0)
+    , channels_(2)
+    , enabled_(false)
+    , stride_(2) {
+    for (int ch = 0; ch < kMaxChannels; ++ch) {
+        peak_[ch].store(0.0f, std::memory_order_relaxed);
+        sumSquares_[ch].store(0.0, std::memory_order_relaxed);
+    }
+}
+
+void LevelTap::prepare(int channels) {
+    stride_ = std::max(1, channels);
+    channels_.store(std::min(stride_, kMaxChannels), std::memory_order_relaxed);
+}
+
+void LevelTap::write(const float* interleaved, size_t frames) {
+    const int channels = std::min(stride_, kMaxChannels);
+    float peaks[kMaxChannels];
+    double sums[kMaxChannels];
+
+    for (int ch = 0; ch < channels; ++ch) {
+        float peak = 0.0f;
+        float sum = 0.0f;
+        const float* sample = interleaved + ch;
+        for (size_t i = 0; i < frames; ++i, sample += stride_) {
+            peak = std::max(peak, std::fabs(*sample));
+            sum += *sample * *sample;
+        }
+        peaks[ch] = peak;
+        sums[ch] = sum;
+    }
+    publish(peaks, sums, frames);
+}
+
+void LevelTap::write(const int16_t* interleaved, size_t frames) {
+    const int channels = std::min(stride_, kMaxChannels);
+    const float scale = 1.0f / 32768.0f;
+    float peaks[kMaxChannels];
+    double sums[kMaxChannels];
+
+    for (int ch = 0; ch < channels; ++ch) {
+        int peak = 0;
+        int64_t sum = 0;
+        const int16_t* sample = interleaved + ch;
+        for (size_t i = 0; i < frames; ++i, sample += stride_) {
+            int value = *sample;
+            peak = std::max(peak, std::abs(value));
+            sum += value * value;
+        }
+        peaks[ch] = peak * scale;
+        sums[ch] = static_cast<double>(sum) * scale * scale;
+    }
+    publish(peaks, sums, frames);
+}
+
+void LevelTap::publish(const float* peaks, const double* sums, size_t frames) {
+    const int channels = std::min(stride_, kMaxChannels);
+    for (int ch = 0; ch < channels; ++ch) {
+        // The reader resets the peak, so merge rather than overwrite.
+        float current = peak_[ch].load(std::memory_order_relaxed);
+        while (peaks[ch] > current &&
+               !peak_[ch].compare_exchange_weak(current, peaks[ch], std::memory_order_relaxed)) {
+        }
+        sumSquares_[ch].store(sumSquares_[ch].load(std::memory_order_relaxed) + sums[ch],
+                              std::memory_order_relaxed);
+    }
+    frames_.store(frames_.load(std::memory_order_relaxed) + frames, std::memory_order_release);
+}
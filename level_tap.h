@@ -0,0 +1,50 @@
+#ifndef LEVEL_TAP_H
+#define LEVEL_TAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Per-channel block statistics of the output, published by the audio
+// callback for the level meters: the running peak since the last reader
+// took it, and monotonically growing sums of squares and frame count that
+// the reader differences over its own interval. The callback does no more
+// than a max and a multiply-add per sample; all ballistics live with the
+// reader.
+class LevelTap {
+public:
+    static constexpr int kMaxChannels = 8;
+
+    LevelTap();
+
+    // Call while the stream is closed.
+    void prepare(int channels);
+
+    void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Audio thread.
+    void write(const float* interleaved, size_t frames);
+    void write(const int16_t* interleaved, size_t frames);
+
+    // Any thread.
+    int channels() const { return channels_.load(std::memory_order_relaxed); }
+    uint64_t frames() const { return frames_.load(std::memory_order_acquire); }
+    double sumSquares(int channel) const { return sumSquares_[channel].load(std::memory_order_relaxed); }
+    // Largest absolute sample since the previous call, 1.0 = full scale.
+    float takePeak(int channel) { return peak_[channel].exchange(0.0f, std::memory_order_relaxed); }
+
+private:
+    void publish(const float* peaks, const double* sums, size_t frames);
+
+    std::atomic<float> peak_[kMaxChannels];
+    std::atomic<double> sumSquares_[kMaxChannels];
+    std::atomic<uint64_t> frames_;
+    std::atomic<int> channels_;
+    std::atomic<bool> enabled_;
+
+    // Audio thread only.
+    int stride_;
+};
+
+#endif // LEVEL_TAP_H
@@ -0,0 +1,435 @@
+#include "library_watcher.h"
+#include "audio_decoder.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QtGlobal>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+
+const int kQuietMs = 250;
+const int kMaxDelayMs = 2000;
+
+bool isUnder(const QString& path, const QString& folder) {
+    return path.size() > folder.size() && path.startsWith(folder) && path.at(folder.size()) == QChar('/');
+}
+
+// Dot files are skipped: rsync and most taggers write to one and rename it
+// over the real name when done.
+bool isTrackFile(const QString& path) {
+    if (path.at(path.lastIndexOf(QChar('/')) + 1) == QChar('.')) {
+        return false;
+    }
+    QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "cue" || AudioDecoder::isFormatSupported(suffix);
+}
+
+qint64 modifiedTime(const QString& folder) {
+    return QFileInfo(folder).lastModified().toMSecsSinceEpoch();
+}
+
+} // namespace
+
+bool LibraryChanges::isEmpty() const {
+    return removedFiles.isEmpty() && removedFolders.isEmpty() && renames.empty() &&
+           writtenFiles.isEmpty() && newFolders.isEmpty() && staleFolders.isEmpty();
+}
+
+LibraryWatcher::LibraryWatcher(QObject* parent)
+    : QObject(parent)
+    , fd_(-1)
+    , notifier_(nullptr)
+    , watcher_(nullptr)
+    , nextWatch_(0)
+    , flushTimer_(new QTimer(this)) {
+    flushTimer_->setSingleShot(true);
+    connect(flushTimer_, &QTimer::timeout, this, &LibraryWatcher::flush);
+
+#ifdef Q_OS_LINUX
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0) {
+        qDebug() << "inotify unavailable, library folders will not be watched:" << strerror(errno);
+        return;
+    }
+    notifier_ = new QSocketNotifier(fd_, QSocketNotifier::Read, this);
+    connect(notifier_, &QSocketNotifier::activated, this, &LibraryWatcher::readEvents);
+#else
+    watcher_ = new QFileSystemWatcher(this);
+    connect(watcher_, &QFileSystemWatcher::directoryChanged, this, &LibraryWatcher::folderChanged);
+#endif
+}
+
+LibraryWatcher::~LibraryWatcher() {
+#ifdef Q_OS_LINUX
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+#endif
+}
+
+void LibraryWatcher::addFolders(const QStringList& folders) {
+#ifdef Q_OS_LINUX
+    if (fd_ < 0) {
+        return;
+    }
+
+    const uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_ONLYDIR | IN_DONT_FOLLOW;
+    for (const QString& folder : folders) {
+        int watch = inotify_add_watch(fd_, QFile::encodeName(folder).constData(), mask);
+        if (watch < 0) {
+            qDebug() << "Cannot watch" << folder << ":" << strerror(errno)
+                     << (errno == ENOSPC ? "(raise fs.inotify.max_user_watches)" : "");
+            continue;
+        }
+        folders_.insert(watch, folder);
+        watches_.insert(folder, watch);
+        modified_.insert(folder, modifiedTime(folder));
+    }
+#else
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (const QString& folder : folders) {
+        if (watches_.contains(folder)) {
+            continue;
+        }
+        if (!watcher_->addPath(folder)) {
+            qDebug() << "Cannot watch" << folder;
+            continue;
+        }
+        const int watch = nextWatch_++;
+        folders_.insert(watch, folder);
+        watches_.insert(folder, watch);
+        listed_.insert(folder, now);
+    }
+#endif
+}
+
+void LibraryWatcher::clear() {
+#ifdef Q_OS_LINUX
+    for (auto it = folders_.constBegin(); it != folders_.constEnd(); ++it) {
+        inotify_rm_watch(fd_, it.key());
+    }
+#else
+    const QStringList watched = watcher_->directories();
+    if (!watched.isEmpty()) {
+        watcher_->removePaths(watched);
+    }
+#endif
+    folders_.clear();
+    watches_.clear();
+    modified_.clear();
+    listed_.clear();
+    movedFrom_.clear();
+    touchedFolders_.clear();
+    pending_ = LibraryChanges();
+    flushTimer_->stop();
+    pendingSince_.invalidate();
+}
+
+void LibraryWatcher::readEvents() {
+#ifdef Q_OS_LINUX
+    alignas(inotify_event) char buffer[65536];
+    for (;;) {
+        ssize_t length = read(fd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        for (const char* p = buffer; p < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            QString name = event->len > 0 ? QFile::decodeName(event->name) : QString();
+            handleEvent(event->wd, event->mask, event->cookie, name);
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    // The kernel queues both halves of a rename together, so a move that
+    // is still unpaired left the watched folders.
+    for (auto it = movedFrom_.constBegin(); it != movedFrom_.constEnd(); ++it) {
+        if (it.value().second) {
+            folderRemoved(it.value().first);
+        } else if (isTrackFile(it.value().first)) {
+            fileRemoved(it.value().first);
+        }
+    }
+    movedFrom_.clear();
+
+    if (!pending_.isEmpty()) {
+        scheduleFlush();
+    }
+#endif
+}
+
+void LibraryWatcher::folderChanged(const QString& folder) {
+    if (!watches_.contains(folder)) {
+        return;
+    }
+    if (!QFileInfo(folder).isDir()) {
+        folderRemoved(folder);
+        scheduleFlush();
+        return;
+    }
+
+    // Which files came or went is worked out against the playlist from the
+    // listing; rewritten ones are told apart by their times.
+    const qint64 since = listed_.value(folder);
+    listed_.insert(folder, QDateTime::currentMSecsSinceEpoch());
+    if (!pending_.staleFolders.contains(folder)) {
+        pending_.staleFolders << folder;
+    }
+    const QFileInfoList entries =
+        QDir(folder).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+    for (const QFileInfo& entry : entries) {
+        const QString path = folder + '/' + entry.fileName();
+        if (entry.isDir()) {
+            if (!watches_.contains(path) && !pending_.newFolders.contains(path)) {
+                pending_.newFolders << path;
+            }
+        } else if (entry.lastModified().toMSecsSinceEpoch() >= since && isTrackFile(path)) {
+            fileWritten(path);
+        }
+    }
+
+    QStringList gone;
+    for (auto it = watches_.constBegin(); it != watches_.constEnd(); ++it) {
+        const QString& subfolder = it.key();
+        if (isUnder(subfolder, folder) && subfolder.indexOf(QChar('/'), folder.size() + 1) < 0 &&
+            !QFileInfo(subfolder).isDir()) {
+            gone << subfolder;
+        }
+    }
+    for (const QString& subfolder : gone) {
+        folderRemoved(subfolder);
+    }
+    scheduleFlush();
+}
+
+void LibraryWatcher::handleEvent(int watch, uint32_t mask, uint32_t cookie, const QString& name) {
+#ifdef Q_OS_LINUX
+    if (mask & IN_Q_OVERFLOW) {
+        recoverFromOverflow();
+        return;
+    }
+    if (mask & IN_IGNORED) {
+        // Deleted, or removed by us; either way the descriptor is dead.
+        QString folder = folders_.take(watch);
+        if (watches_.value(folder, -1) == watch) {
+            watches_.remove(folder);
+            modified_.remove(folder);
+        }
+        return;
+    }
+
+    const QString folder = folders_.value(watch);
+    if (folder.isEmpty() || name.isEmpty()) {
+        return;
+    }
+    const QString path = folder + '/' + name;
+    const bool isFolder = (mask & IN_ISDIR) != 0;
+    touchedFolders_.insert(folder);
+
+    if (mask & IN_MOVED_FROM) {
+        movedFrom_.insert(cookie, qMakePair(path, isFolder));
+    } else if (mask & IN_MOVED_TO) {
+        QPair<QString, bool> from = movedFrom_.take(cookie);
+        if (!from.first.isEmpty()) {
+            renamed(from.first, path, isFolder);
+        } else if (isFolder) {
+            pending_.newFolders << path;
+        } else if (isTrackFile(path)) {
+            fileWritten(path);
+        }
+    } else if (isFolder) {
+        if (mask & IN_CREATE) {
+            pending_.newFolders << path;
+        } else if (mask & IN_DELETE) {
+            folderRemoved(path);
+        }
+    } else if (isTrackFile(path)) {
+        if (mask & IN_CLOSE_WRITE) {
+            fileWritten(path);
+        } else if (mask & IN_DELETE) {
+            fileRemoved(path);
+        }
+    }
+#else
+    Q_UNUSED(watch)
+    Q_UNUSED(mask)
+    Q_UNUSED(cookie)
+    Q_UNUSED(name)
+#endif
+}
+
+void LibraryWatcher::fileWritten(const QString& path) {
+    // Deleted and written again in one batch is an in-place change.
+    pending_.removedFiles.remove(originalPath(path));
+    pending_.writtenFiles.insert(path);
+}
+
+void LibraryWatcher::fileRemoved(const QString& path) {
+    pending_.writtenFiles.remove(path);
+    pending_.removedFiles.insert(originalPath(path));
+}
+
+void LibraryWatcher::folderRemoved(const QString& path) {
+    removeWatches(path);
+    for (const QString& file : pending_.writtenFiles.values()) {
+        if (isUnder(file, path)) {
+            pending_.writtenFiles.remove(file);
+        }
+    }
+    pending_.newFolders.erase(std::remove_if(pending_.newFolders.begin(), pending_.newFolders.end(),
+                                             [&path](const QString& folder) {
+                                                 return folder == path || isUnder(folder, path);
+                                             }),
+                              pending_.newFolders.end());
+    pending_.removedFolders << originalPath(path);
+}
+
+void LibraryWatcher::renamed(const QString& from, const QString& to, bool folder) {
+    if (!folder) {
+        if (!isTrackFile(from) || pending_.writtenFiles.remove(from)) {
+            // A temporary name, or a file that is new in this batch anyway.
+            if (isTrackFile(to)) {
+                fileWritten(to);
+            }
+        } else if (!isTrackFile(to)) {
+            fileRemoved(from);
+        } else {
+            pending_.renames.push_back({from, to, false});
+        }
+        return;
+    }
+
+    // A moved folder keeps its watches; only the names change.
+    QList<QString> moved;
+    for (auto it = watches_.constBegin(); it != watches_.constEnd(); ++it) {
+        if (it.key() == from || isUnder(it.key(), from)) {
+            moved << it.key();
+        }
+    }
+    for (const QString& oldName : moved) {
+        QString newName = to + oldName.mid(from.size());
+        int watch = watches_.take(oldName);
+        watches_.insert(newName, watch);
+        folders_.insert(watch, newName);
+        modified_.insert(newName, modified_.take(oldName));
+    }
+
+    // Pending names inside the folder move with it.
+    for (const QString& file : pending_.writtenFiles.values()) {
+        if (isUnder(file, from)) {
+            pending_.writtenFiles.remove(file);
+            pending_.writtenFiles.insert(to + file.mid(from.size()));
+        }
+    }
+    for (QString& newFolder : pending_.newFolders) {
+        if (newFolder == from || isUnder(newFolder, from)) {
+            newFolder = to + newFolder.mid(from.size());
+        }
+    }
+    pending_.renames.push_back({from, to, true});
+}
+
+QString LibraryWatcher::originalPath(const QString& path) const {
+    QString original = path;
+    for (auto it = pending_.renames.crbegin(); it != pending_.renames.crend(); ++it) {
+        if (original == it->to || (it->folder && isUnder(original, it->to))) {
+            original = it->from + original.mid(it->to.size());
+        }
+    }
+    return original;
+}
+
+void LibraryWatcher::removeWatches(const QString& folder) {
+    QList<QString> gone;
+    for (auto it = watches_.constBegin(); it != watches_.constEnd(); ++it) {
+        if (it.key() == folder || isUnder(it.key(), folder)) {
+            gone << it.key();
+        }
+    }
+    for (const QString& name : gone) {
+        int watch = watches_.take(name);
+        folders_.remove(watch);
+        modified_.remove(name);
+        listed_.remove(name);
+#ifdef Q_OS_LINUX
+        inotify_rm_watch(fd_, watch);
+#else
+        watcher_->removePath(name);
+#endif
+    }
+}
+
+void LibraryWatcher::recoverFromOverflow() {
+    qDebug() << "inotify queue overflowed, checking" << watches_.size() << "watched folders";
+
+    const QStringList folders = watches_.keys();
+    for (const QString& folder : folders) {
+        if (!watches_.contains(folder)) {
+            continue;
+        }
+        QFileInfo info(folder);
+        if (!info.isDir()) {
+            folderRemoved(folder);
+            continue;
+        }
+        if (info.lastModified().toMSecsSinceEpoch() == modified_.value(folder)) {
+            continue;
+        }
+
+        pending_.staleFolders << folder;
+        touchedFolders_.insert(folder);
+        const QStringList subfolders = QDir(folder).entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+        for (const QString& name : subfolders) {
+            QString subfolder = folder + '/' + name;
+            if (!watches_.contains(subfolder)) {
+                pending_.newFolders << subfolder;
+            }
+        }
+    }
+}
+
+void LibraryWatcher::scheduleFlush() {
+    if (!pendingSince_.isValid()) {
+        pendingSince_.start();
+    }
+    int remaining = kMaxDelayMs - static_cast<int>(pendingSince_.elapsed());
+    flushTimer_->start(std::max(0, std::min(kQuietMs, remaining)));
+}
+
+void LibraryWatcher::flush() {
+    pendingSince_.invalidate();
+
+    // Events from this batch moved these folders on; later overflow checks
+    // compare against the new times.
+    for (const QString& folder : touchedFolders_) {
+        if (watches_.contains(folder)) {
+            modified_.insert(folder, modifiedTime(folder));
+        }
+    }
+    touchedFolders_.clear();
+
+    if (pending_.isEmpty()) {
+        return;
+    }
+
+    LibraryChanges changes;
+    std::swap(changes, pending_);
+    qDebug() << "Library changed:" << changes.writtenFiles.size() << "written," << changes.removedFiles.size()
+             << "removed," << changes.renames.size() << "renamed," << changes.newFolders.size() << "new folders,"
+             << changes.removedFolders.size() << "removed folders," << changes.staleFolders.size() << "stale folders";
+    emit changed(changes);
+}
@@ -0,0 +1,98 @@
+#ifndef LIBRARY_WATCHER_H
+#define LIBRARY_WATCHER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+class QFileSystemWatcher;
+class QSocketNotifier;
+class QTimer;
+
+// What changed under the watched folders since the last batch. Removals
+// name files as they were before the batch's renames, writes as they are
+// after, so applying removals, then renames, then writes is correct.
+struct LibraryChanges {
+    struct Rename {
+        QString from;
+        QString to;
+        bool folder;
+    };
+
+    QSet<QString> removedFiles;
+    QStringList removedFolders;
+    // Files and folders moved within the watched tree, in order; a folder
+    // carries everything below it.
+    std::vector<Rename> renames;
+    // Written or moved in; may already be in the playlist.
+    QSet<QString> writtenFiles;
+    // Subtrees that appeared and still need walking.
+    QStringList newFolders;
+    // Folders whose events were lost to a queue overflow; their files have
+    // to be listed again.
+    QStringList staleFolders;
+
+    bool isEmpty() const;
+};
+
+// Follows imported folders through inotify, one watch per folder, which
+// stays cheap where QFileSystemWatcher would keep a handle per file. Events
+// collect until the tree has been quiet for a moment, or for at most
+// kMaxDelayMs during a storm such as an rsync of a whole album collection,
+// and then go out as one LibraryChanges. Folders without events are never
+// listed again; after a kernel queue overflow only those whose modification
+// time moved are. Elsewhere QFileSystemWatcher watches the same folders and
+// only says which one changed, so that folder goes out as stale, with the
+// files modified since it was last listed as written.
+class LibraryWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit LibraryWatcher(QObject* parent = nullptr);
+    ~LibraryWatcher();
+
+    void addFolders(const QStringList& folders);
+    void clear();
+
+signals:
+    void changed(const LibraryChanges& changes);
+
+private:
+    void readEvents();
+    void folderChanged(const QString& folder);
+    void handleEvent(int watch, uint32_t mask, uint32_t cookie, const QString& name);
+    void fileWritten(const QString& path);
+    void fileRemoved(const QString& path);
+    void folderRemoved(const QString& path);
+    void renamed(const QString& from, const QString& to, bool folder);
+    QString originalPath(const QString& path) const;
+    void removeWatches(const QString& folder);
+    void recoverFromOverflow();
+    void scheduleFlush();
+    void flush();
+
+    int fd_;
+    QSocketNotifier* notifier_;
+    // Without inotify; watches are then numbered here.
+    QFileSystemWatcher* watcher_;
+    int nextWatch_;
+    // When each folder was last listed, for the same.
+    QHash<QString, qint64> listed_;
+    QTimer* flushTimer_;
+    QElapsedTimer pendingSince_;
+    QHash<int, QString> folders_;
+    QHash<QString, int> watches_;
+    // Folder modification times as of the last batch that covered them.
+    QHash<QString, qint64> modified_;
+    // IN_MOVED_FROM halves waiting for their IN_MOVED_TO, by cookie.
+    QHash<uint32_t, QPair<QString, bool>> movedFrom_;
+    QSet<QString> touchedFolders_;
+    LibraryChanges pending_;
+};
+
+#endif // LIBRARY_WATCHER_H
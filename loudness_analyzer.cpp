@@ -0,0 +1,343 @@
+#include "loudness_analyzer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LOUDNESS_ANALYZER_SSE2 1
+#endif
+
+namespace {
+
+const double kAbsoluteGate = -70.0;
+const double kPi = 3.14159265358979323846;
+
+double energyToLoudness(double energy) {
+    return energy > 0.0 ? -0.691 + 10.0 * std::log10(energy) : -200.0;
+}
+
+// BS.1770 K-weighting re-derived for an arbitrary sample rate: a high shelf
+// modelling the head followed by the RLB high-pass.
+void kWeighting(double sampleRate, BiquadCoefficients& shelf, BiquadCoefficients& highPass) {
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = std::tan(kPi * f0 / sampleRate);
+    double vh = std::pow(10.0, gain / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    shelf.b1 = 2.0 * (k * k - vh) / a0;
+    shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+    shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(kPi * f0 / sampleRate);
+    a0 = 1.0 + k / q + k * k;
+    highPass.b0 = 1.0;
+    highPass.b1 = -2.0;
+    highPass.b2 = 1.0;
+    highPass.a1 = 2.0 * (k * k - 1.0) / a0;
+    highPass.a2 = (1.0 - k / q + k * k) / a0;
+}
+
+double gatedLoudness(const std::vector<double>& energies, double relativeGate, std::vector<double>* passed) {
+    double sum = 0.0;
+    size_t count = 0;
+    for (double z : energies) {
+        if (energyToLoudness(z) > kAbsoluteGate) {
+            sum += z;
+            ++count;
+        }
+    }
+    if (count == 0) {
+        return -200.0;
+    }
+
+    double threshold = energyToLoudness(sum / count) + relativeGate;
+    sum = 0.0;
+    count = 0;
+    for (double z : energies) {
+        double loudness = energyToLoudness(z);
+        if (loudness > kAbsoluteGate && loudness > threshold) {
+            sum += z;
+            ++count;
+            if (passed) {
+                passed->push_back(loudness);
+            }
+        }
+    }
+    return count > 0 ? energyToLoudness(sum / count) : -200.0;
+}
+
+std::vector<double> slidingMeans(const std::vector<double>& subBlocks, size_t window) {
+    std::vector<double> means;
+    if (subBlocks.size() < window) {
+        return means;
+    }
+
+    means.reserve(subBlocks.size() - window + 1);
+    double sum = 0.0;
+    for (size_t i = 0; i < subBlocks.size(); ++i) {
+        sum += subBlocks[i];
+        if (i >= window) {
+            sum -= subBlocks[i - window];
+        }
+        if (i + 1 >= window) {
+            means.push_back(std::max(0.0, sum) / window);
+        }
+    }
+    return means;
+}
+
+} // namespace
+
+LoudnessAnalyzer::LoudnessAnalyzer()
+    : sampleRate_(0.0)
+    , channels_(0)
+    , subBlockFrames_(0)
+    , subBlockFill_(0)
+    , oversampling_(1)
+    , tapsPerPhase_(12)
+    , historyPos_(0)
+    , peak_(0.0f) {
+    std::memset(filters_, 0, sizeof(filters_));
+    std::memset(channelEnergy_, 0, sizeof(channelEnergy_));
+    for (int ch = 0; ch < kMaxChannels; ++ch) {
+        channelWeights_[ch] = 1.0;
+    }
+}
+
+void LoudnessAnalyzer::prepare(double sampleRate, int channels) {
+    sampleRate_ = sampleRate;
+    channels_ = std::max(0, std::min(channels, kMaxChannels));
+    subBlockFrames_ = std::max<size_t>(1, static_cast<size_t>(std::lround(sampleRate * 0.1)));
+    subBlockFill_ = 0;
+    subBlocks_.clear();
+    std::memset(channelEnergy_, 0, sizeof(channelEnergy_));
+
+    BiquadCoefficients shelf, highPass;
+    kWeighting(sampleRate, shelf, highPass);
+    std::memset(filters_, 0, sizeof(filters_));
+    for (FilterPair& pair : filters_) {
+        for (int lane = 0; lane < 2; ++lane) {
+            const BiquadCoefficients* stages[2] = { &shelf, &highPass };
+            for (int s = 0; s < 2; ++s) {
+                pair.coeffs[s][0][lane] = stages[s]->b0;
+                pair.coeffs[s][1][lane] = stages[s]->b1;
+                pair.coeffs[s][2][lane] = stages[s]->b2;
+                pair.coeffs[s][3][lane] = stages[s]->a1;
+                pair.coeffs[s][4][lane] = stages[s]->a2;
+            }
+        }
+    }
+
+    // 5.0 and 5.1 layouts weight the surrounds by +1.5 dB and drop the LFE.
+    for (int ch = 0; ch < kMaxChannels; ++ch) {
+        channelWeights_[ch] = 1.0;
+    }
+    if (channels_ == 5) {
+        channelWeights_[3] = channelWeights_[4] = 1.41;
+    } else if (channels_ == 6) {
+        channelWeights_[3] = 0.0;
+        channelWeights_[4] = channelWeights_[5] = 1.41;
+    }
+
+    // True peak: oversample to at least 176.4 kHz with a windowed-sinc
+    // polyphase interpolator, four phases per SIMD register.
+    oversampling_ = sampleRate < 96000.0 ? 4 : (sampleRate < 192000.0 ? 2 : 1);
+    const int taps = oversampling_ * tapsPerPhase_;
+    const double center = (taps - 1) / 2.0;
+    interpolator_.assign(tapsPerPhase_ * 4, 0.0f);
+    for (int phase = 0; phase < oversampling_; ++phase) {
+        for (int t = 0; t < tapsPerPhase_; ++t) {
+            int n = phase + oversampling_ * t;
+            double x = (n - center) / oversampling_;
+            double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+            double w = 0.42 - 0.5 * std::cos(2.0 * kPi * n / (taps - 1)) + 0.08 * std::cos(4.0 * kPi * n / (taps - 1));
+            // Stored oldest-sample first to match the history window.
+            int j = tapsPerPhase_ - 1 - t;
+            interpolator_[j * 4 + phase] = static_cast<float>(sinc * w);
+        }
+    }
+    history_.assign(static_cast<size_t>(channels_) * tapsPerPhase_ * 2, 0.0f);
+    historyPos_ = 0;
+    peak_ = 0.0f;
+}
+
+void LoudnessAnalyzer::process(const int16_t* interleaved, size_t frames) {
+    if (channels_ == 0) {
+        return;
+    }
+
+    processTruePeak(interleaved, frames);
+
+    size_t offset = 0;
+    while (offset < frames) {
+        size_t count = std::min(frames - offset, subBlockFrames_ - subBlockFill_);
+        for (int pair = 0; pair < (channels_ + 1) / 2; ++pair) {
+            processPair(pair, interleaved + offset * channels_, count);
+        }
+
+        offset += count;
+        subBlockFill_ += count;
+        if (subBlockFill_ == subBlockFrames_) {
+            closeSubBlock();
+        }
+    }
+}
+
+void LoudnessAnalyzer::processPair(int pair, const int16_t* interleaved, size_t frames) {
+    FilterPair& f = filters_[pair];
+    const int channels = channels_;
+    const int left = pair * 2;
+    const bool hasRight = left + 1 < channels;
+    const double scale = 1.0 / 32768.0;
+
+#ifdef LOUDNESS_ANALYZER_SSE2
+    const __m128d vscale = _mm_set1_pd(scale);
+    __m128d b0[2], b1[2], b2[2], a1[2], a2[2], s1[2], s2[2];
+    for (int s = 0; s < 2; ++s) {
+        b0[s] = _mm_load_pd(f.coeffs[s][0]);
+        b1[s] = _mm_load_pd(f.coeffs[s][1]);
+        b2[s] = _mm_load_pd(f.coeffs[s][2]);
+        a1[s] = _mm_load_pd(f.coeffs[s][3]);
+        a2[s] = _mm_load_pd(f.coeffs[s][4]);
+        s1[s] = _mm_load_pd(f.s1[s]);
+        s2[s] = _mm_load_pd(f.s2[s]);
+    }
+    __m128d energy = _mm_setzero_pd();
+
+    const int16_t* frame = interleaved + left;
+    for (size_t i = 0; i < frames; ++i, frame += channels) {
+        __m128d x = _mm_mul_pd(_mm_set_pd(hasRight ? frame[1] : 0, frame[0]), vscale);
+        for (int s = 0; s < 2; ++s) {
+            __m128d y = _mm_add_pd(_mm_mul_pd(b0[s], x), s1[s]);
+            s1[s] = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1[s], x), _mm_mul_pd(a1[s], y)), s2[s]);
+            s2[s] = _mm_sub_pd(_mm_mul_pd(b2[s], x), _mm_mul_pd(a2[s], y));
+            x = y;
+        }
+        energy = _mm_add_pd(energy, _mm_mul_pd(x, x));
+    }
+
+    for (int s = 0; s < 2; ++s) {
+        _mm_store_pd(f.s1[s], s1[s]);
+        _mm_store_pd(f.s2[s], s2[s]);
+    }
+    alignas(16) double sums[2];
+    _mm_store_pd(sums, energy);
+#else
+    double sums[2] = { 0.0, 0.0 };
+    for (int lane = 0; lane < (hasRight ? 2 : 1); ++lane) {
+        const int16_t* sample = interleaved + left + lane;
+        for (size_t i = 0; i < frames; ++i, sample += channels) {
+            double x = *sample * scale;
+            for (int s = 0; s < 2; ++s) {
+                double y = f.coeffs[s][0][lane] * x + f.s1[s][lane];
+                f.s1[s][lane] = f.coeffs[s][1][lane] * x - f.coeffs[s][3][lane] * y + f.s2[s][lane];
+                f.s2[s][lane] = f.coeffs[s][2][lane] * x - f.coeffs[s][4][lane] * y;
+                x = y;
+            }
+            sums[lane] += x * x;
+        }
+    }
+#endif
+
+    channelEnergy_[left] += sums[0];
+    if (hasRight) {
+        channelEnergy_[left + 1] += sums[1];
+    }
+}
+
+void LoudnessAnalyzer::processTruePeak(const int16_t* interleaved, size_t frames) {
+    const int channels = channels_;
+    const size_t taps = static_cast<size_t>(tapsPerPhase_);
+    const float scale = 1.0f / 32768.0f;
+
+    if (oversampling_ == 1) {
+        for (size_t i = 0; i < frames * channels; ++i) {
+            peak_ = std::max(peak_, std::fabs(interleaved[i] * scale));
+        }
+        return;
+    }
+
+#ifdef LOUDNESS_ANALYZER_SSE2
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak = _mm_set1_ps(peak_);
+#endif
+
+    for (size_t i = 0; i < frames; ++i) {
+        for (int ch = 0; ch < channels; ++ch) {
+            float* history = &history_[ch * taps * 2];
+            float x = interleaved[i * channels + ch] * scale;
+            history[historyPos_] = x;
+            history[historyPos_ + taps] = x;
+            const float* window = history + historyPos_ + 1;
+
+#ifdef LOUDNESS_ANALYZER_SSE2
+            __m128 acc = _mm_setzero_ps();
+            for (size_t j = 0; j < taps; ++j) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&interpolator_[j * 4]), _mm_set1_ps(window[j])));
+            }
+            peak = _mm_max_ps(peak, _mm_and_ps(acc, signMask));
+#else
+            for (int phase = 0; phase < oversampling_; ++phase) {
+                float acc = 0.0f;
+                for (size_t j = 0; j < taps; ++j) {
+                    acc += interpolator_[j * 4 + phase] * window[j];
+                }
+                peak_ = std::max(peak_, std::fabs(acc));
+            }
+#endif
+        }
+        historyPos_ = (historyPos_ + 1) % taps;
+    }
+
+#ifdef LOUDNESS_ANALYZER_SSE2
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, peak);
+    peak_ = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+}
+
+void LoudnessAnalyzer::closeSubBlock() {
+    double energy = 0.0;
+    for (int ch = 0; ch < channels_; ++ch) {
+        energy += channelWeights_[ch] * channelEnergy_[ch] / subBlockFrames_;
+        channelEnergy_[ch] = 0.0;
+    }
+    subBlocks_.push_back(energy);
+    subBlockFill_ = 0;
+}
+
+LoudnessResult LoudnessAnalyzer::finish() const {
+    LoudnessResult result;
+    result.truePeakDb = peak_ > 0.0f ? 20.0 * std::log10(peak_) : -200.0;
+
+    // Integrated loudness: 400 ms blocks on a 100 ms hop, gated at -70 LUFS
+    // and 10 LU below the ungated mean.
+    std::vector<double> blocks = slidingMeans(subBlocks_, 4);
+    double integrated = gatedLoudness(blocks, -10.0, nullptr);
+    if (integrated <= kAbsoluteGate) {
+        return result;
+    }
+    result.integratedLufs = integrated;
+    result.valid = true;
+
+    // Loudness range: spread between the 10th and 95th percentile of 3 s
+    // short-term loudness, gated 20 LU below the mean.
+    std::vector<double> shortTerm = slidingMeans(subBlocks_, 30);
+    std::vector<double> passed;
+    gatedLoudness(shortTerm, -20.0, &passed);
+    if (passed.size() > 1) {
+        std::sort(passed.begin(), passed.end());
+        size_t low = static_cast<size_t>(std::lround((passed.size() - 1) * 0.10));
+        size_t high = static_cast<size_t>(std::lround((passed.size() - 1) * 0.95));
+        result.loudnessRangeLu = passed[high] - passed[low];
+    }
+
+    return result;
+}
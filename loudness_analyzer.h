@@ -0,0 +1,67 @@
+#ifndef LOUDNESS_ANALYZER_H
+#define LOUDNESS_ANALYZER_H
+
+#include "biquad.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct LoudnessResult {
+    double integratedLufs;
+    double loudnessRangeLu;
+    double truePeakDb;
+    // Seconds of audio measured; 0 when not known.
+    double duration;
+    bool valid;
+
+    LoudnessResult() : integratedLufs(0.0), loudnessRangeLu(0.0), truePeakDb(-200.0), duration(0.0), valid(false) {}
+
+    // ReplayGain 2.0 gain towards the -18 LUFS reference level.
+    double replayGainDb() const { return valid ? -18.0 - integratedLufs : 0.0; }
+};
+
+// EBU R128 / ITU-R BS.1770-4 measurement: integrated loudness with absolute
+// and relative gating, loudness range (EBU Tech 3342) and true peak through
+// a polyphase oversampling interpolator. Samples can be fed in any number of
+// process() calls; the K-weighting filters run on SSE2 double lanes, one
+// lane per channel.
+class LoudnessAnalyzer {
+public:
+    static constexpr int kMaxChannels = 8;
+
+    LoudnessAnalyzer();
+
+    void prepare(double sampleRate, int channels);
+    void process(const int16_t* interleaved, size_t frames);
+    LoudnessResult finish() const;
+
+private:
+    struct alignas(16) FilterPair {
+        double coeffs[2][5][2];
+        double s1[2][2];
+        double s2[2][2];
+    };
+
+    void processPair(int pair, const int16_t* interleaved, size_t frames);
+    void processTruePeak(const int16_t* interleaved, size_t frames);
+    void closeSubBlock();
+
+    double sampleRate_;
+    int channels_;
+    size_t subBlockFrames_;
+    size_t subBlockFill_;
+
+    FilterPair filters_[kMaxChannels / 2];
+    double channelWeights_[kMaxChannels];
+    double channelEnergy_[kMaxChannels];
+    std::vector<double> subBlocks_;
+
+    int oversampling_;
+    int tapsPerPhase_;
+    std::vector<float> interpolator_;
+    std::vector<float> history_;
+    size_t historyPos_;
+    float peak_;
+};
+
+#endif // LOUDNESS_ANALYZER_H
@@ -0,0 +1,308 @@
+#include "loudness_scanner.h"
+#include "audio_decoder.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+
+const quint32 kCacheMagic = 0x4c554443; // "LUDC"
+const quint32 kCacheVersion = 3;
+const int kSaveInterval = 16;
+const size_t kAnalysisChunk = 65536;
+// Files checked against the cache per pool task, and reported together.
+const int kCheckChunk = 512;
+// Superseded records the journal may hold beyond one per entry before it
+// is rewritten.
+const qint64 kCompactSlack = 4096;
+
+} // namespace
+
+QDataStream& operator<<(QDataStream& out, const LoudnessScanner::CacheEntry& entry) {
+    return out << entry.size << entry.modified
+               << entry.result.integratedLufs << entry.result.loudnessRangeLu
+               << entry.result.truePeakDb << entry.result.duration << entry.result.valid;
+}
+
+QDataStream& operator>>(QDataStream& in, LoudnessScanner::CacheEntry& entry) {
+    return in >> entry.size >> entry.modified
+              >> entry.result.integratedLufs >> entry.result.loudnessRangeLu
+              >> entry.result.truePeakDb >> entry.result.duration >> entry.result.valid;
+}
+
+LoudnessScanner::LoudnessScanner(QObject* parent)
+    : QObject(parent)
+    , generation_(0)
+    , journalRecords_(0) {
+    pool_.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+
+    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dataDir);
+    cachePath_ = QDir(dataDir).absoluteFilePath("loudness.cache");
+    loadCache();
+}
+
+LoudnessScanner::~LoudnessScanner() {
+    generation_.fetch_add(1);
+    pool_.clear();
+    pool_.waitForDone();
+    if (!unsaved_.isEmpty()) {
+        saveCache();
+    }
+}
+
+void LoudnessScanner::analyze(const QStringList& filePaths) {
+    // Cached files still have to be looked at on disk, which is left to the
+    // pool; cache entries are copied out so it never touches cache_.
+    const unsigned generation = generation_.load();
+    std::vector<std::pair<QString, CacheEntry>> chunk;
+    QStringList misses;
+    auto flush = [this, generation, &chunk, &misses]() {
+        if (chunk.empty() && misses.isEmpty()) {
+            return;
+        }
+        pool_.start(QRunnable::create([this, generation, chunk, misses]() {
+            LoudnessResults hits;
+            QStringList changed = misses;
+            for (const auto& item : chunk) {
+                qint64 size = 0;
+                qint64 modified = 0;
+                if (fileStamp(item.first, size, modified) && size == item.second.size &&
+                    modified == item.second.modified) {
+                    hits.emplace_back(item.first, item.second.result);
+                } else {
+                    changed << item.first;
+                }
+            }
+            QMetaObject::invokeMethod(this, [this, generation, hits, changed]() {
+                onChecked(generation, hits, changed);
+            }, Qt::QueuedConnection);
+        }), 1);
+        chunk.clear();
+        misses.clear();
+    };
+
+    bool queuedAny = false;
+    for (const QString& filePath : filePaths) {
+        if (queued_.contains(filePath)) {
+            continue;
+        }
+        queued_.insert(filePath);
+        queuedAny = true;
+
+        auto it = cache_.constFind(filePath);
+        if (it == cache_.constEnd()) {
+            misses << filePath;
+        } else {
+            chunk.emplace_back(filePath, it.value());
+        }
+        if (static_cast<int>(chunk.size()) + misses.size() >= kCheckChunk) {
+            flush();
+        }
+    }
+    flush();
+
+    if (queuedAny) {
+        emit progressChanged();
+    }
+}
+
+void LoudnessScanner::cancel() {
+    generation_.fetch_add(1);
+    pool_.clear();
+    if (!queued_.isEmpty()) {
+        queued_.clear();
+        emit progressChanged();
+    }
+    if (!unsaved_.isEmpty()) {
+        saveCache();
+    }
+}
+
+void LoudnessScanner::startAnalysis(const QString& filePath) {
+    unsigned generation = generation_.load();
+    pool_.start(QRunnable::create([this, filePath, generation]() {
+        LoudnessResult result;
+        bool ok = analyzeFile(filePath, result, generation_, generation);
+        QMetaObject::invokeMethod(this, [this, filePath, generation, ok, result]() {
+            onAnalyzed(filePath, generation, ok, result);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void LoudnessScanner::onChecked(unsigned generation, const LoudnessResults& hits, const QStringList& misses) {
+    if (generation != generation_.load()) {
+        return;
+    }
+
+    LoudnessResults reported;
+    reported.reserve(hits.size());
+    for (const auto& hit : hits) {
+        if (queued_.remove(hit.first)) {
+            reported.push_back(hit);
+        }
+    }
+    for (const QString& filePath : misses) {
+        if (queued_.contains(filePath)) {
+            startAnalysis(filePath);
+        }
+    }
+
+    if (!reported.empty()) {
+        emit resultsReady(reported);
+        emit progressChanged();
+    }
+}
+
+bool LoudnessScanner::analyzeFile(const QString& filePath, LoudnessResult& result,
+                                  const std::atomic<unsigned>& generation, unsigned expected) {
+    AudioData audioData;
+    if (generation.load() != expected || !AudioDecoder::loadAudioFile(filePath, audioData)) {
+        return false;
+    }
+
+    LoudnessAnalyzer analyzer;
+    analyzer.prepare(audioData.sampleRate, audioData.channels);
+
+    const int16_t* samples = audioData.samples.data();
+    for (size_t frame = 0; frame < audioData.totalFrames; frame += kAnalysisChunk) {
+        if (generation.load(std::memory_order_relaxed) != expected) {
+            return false;
+        }
+        size_t count = std::min(kAnalysisChunk, audioData.totalFrames - frame);
+        analyzer.process(samples + frame * audioData.channels, count);
+    }
+
+    result = analyzer.finish();
+    result.duration = audioData.getDuration();
+    return true;
+}
+
+bool LoudnessScanner::fileStamp(const QString& filePath, qint64& size, qint64& modified) {
+    QFileInfo info(filePath);
+    if (!info.exists()) {
+        return false;
+    }
+    size = info.size();
+    modified = info.lastModified().toMSecsSinceEpoch();
+    return true;
+}
+
+void LoudnessScanner::onAnalyzed(const QString& filePath, unsigned generation, bool ok, const LoudnessResult& result) {
+    if (generation != generation_.load() || !queued_.remove(filePath)) {
+        return;
+    }
+
+    if (ok) {
+        CacheEntry entry;
+        entry.result = result;
+        if (fileStamp(filePath, entry.size, entry.modified)) {
+            cache_.insert(filePath, entry);
+            unsaved_ << filePath;
+        }
+        emit resultsReady(LoudnessResults{{filePath, result}});
+    } else {
+        qDebug() << "Loudness analysis failed:" << filePath;
+    }
+
+    if (unsaved_.size() >= kSaveInterval || (queued_.isEmpty() && !unsaved_.isEmpty())) {
+        saveCache();
+    }
+    emit progressChanged();
+}
+
+void LoudnessScanner::loadCache() {
+    QFile file(cachePath_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != kCacheMagic || version != kCacheVersion) {
+        qDebug() << "Ignoring loudness cache with unknown format";
+        file.close();
+        compactCache();
+        return;
+    }
+
+    // Later records replace earlier ones for the same file.
+    while (!in.atEnd()) {
+        QString filePath;
+        CacheEntry entry;
+        in >> filePath >> entry;
+        if (in.status() != QDataStream::Ok) {
+            break;
+        }
+        cache_.insert(filePath, entry);
+        ++journalRecords_;
+    }
+    const bool damaged = in.status() != QDataStream::Ok;
+    file.close();
+    qDebug() << "Loudness cache loaded:" << cache_.size() << "entries";
+
+    // A record cut short by a crash would misalign everything appended
+    // after it.
+    if (damaged || journalRecords_ > 2 * cache_.size() + kCompactSlack) {
+        compactCache();
+    }
+}
+
+void LoudnessScanner::saveCache() {
+    if (journalRecords_ + unsaved_.size() > 2 * cache_.size() + kCompactSlack) {
+        compactCache();
+        return;
+    }
+
+    QFile file(cachePath_);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "Failed to write loudness cache:" << cachePath_;
+        return;
+    }
+
+    QDataStream out(&file);
+    if (file.size() == 0) {
+        out << kCacheMagic << kCacheVersion;
+    }
+    for (const QString& filePath : unsaved_) {
+        auto it = cache_.constFind(filePath);
+        if (it == cache_.constEnd()) {
+            continue;
+        }
+        out << filePath << it.value();
+        ++journalRecords_;
+    }
+    unsaved_.clear();
+}
+
+void LoudnessScanner::compactCache() {
+    QSaveFile file(cachePath_);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write loudness cache:" << cachePath_;
+        return;
+    }
+
+    QDataStream out(&file);
+    out << kCacheMagic << kCacheVersion;
+    for (auto it = cache_.constBegin(); it != cache_.constEnd(); ++it) {
+        out << it.key() << it.value();
+    }
+
+    if (file.commit()) {
+        journalRecords_ = cache_.size();
+        unsaved_.clear();
+    } else {
+        qDebug() << "Failed to commit loudness cache:" << cachePath_;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef LOUDNESS_SCANNER_H
+#define LOUDNESS_SCANNER_H
+
+#include "loudness_analyzer.h"
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+class QDataStream;
+
+typedef std::vector<std::pair<QString, LoudnessResult>> LoudnessResults;
+
+// Runs LoudnessAnalyzer over files on a private thread pool, one track per
+// worker, so a large playlist keeps every core busy. Results are cached on
+// disk keyed by path, size and modification time; an interrupted scan picks
+// up where it stopped because finished tracks are served from the cache.
+// The cache file is a journal: new results are appended, and it is only
+// rewritten whole once superseded records make up most of it. Files are
+// checked against the cache on the pool too, a chunk at a time, and the
+// hits of a chunk are reported together.
+class LoudnessScanner : public QObject {
+    Q_OBJECT
+
+public:
+    explicit LoudnessScanner(QObject* parent = nullptr);
+    ~LoudnessScanner();
+
+    // Queues files for analysis. Cached results are reported as soon as
+    // their files are found unchanged.
+    void analyze(const QStringList& filePaths);
+    void cancel();
+
+    bool isBusy() const { return !queued_.isEmpty(); }
+    int pendingCount() const { return queued_.size(); }
+
+signals:
+    void resultsReady(const LoudnessResults& results);
+    void progressChanged();
+
+private:
+    struct CacheEntry {
+        qint64 size;
+        qint64 modified;
+        LoudnessResult result;
+    };
+    friend QDataStream& operator<<(QDataStream& out, const CacheEntry& entry);
+    friend QDataStream& operator>>(QDataStream& in, CacheEntry& entry);
+
+    static bool analyzeFile(const QString& filePath, LoudnessResult& result,
+                            const std::atomic<unsigned>& generation, unsigned expected);
+    static bool fileStamp(const QString& filePath, qint64& size, qint64& modified);
+    void startAnalysis(const QString& filePath);
+    void onChecked(unsigned generation, const LoudnessResults& hits, const QStringList& misses);
+    void onAnalyzed(const QString& filePath, unsigned generation, bool ok, const LoudnessResult& result);
+    void loadCache();
+    // Appends the unsaved results, or rewrites the file once mostly stale.
+    void saveCache();
+    void compactCache();
+
+    QThreadPool pool_;
+    std::atomic<unsigned> generation_;
+    QSet<QString> queued_;
+    QHash<QString, CacheEntry> cache_;
+    QString cachePath_;
+    QStringList unsaved_;
+    // Records in the file, superseded ones included.
+    qint64 journalRecords_;
+};
+
+#endif // LOUDNESS_SCANNER_H
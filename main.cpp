@@ -1,11 +1,26 @@
+#include <QDebug>
+#include <QElapsedTimer>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QQuickWindow>
 #include "audiomanager.h"
+#include "cover_art_provider.h"
 #include "track.h"
 #include "playlist_manager.h"
+#include "waveform_item.h"
+
+namespace {
+
+// Cold start, from main() to the first frame on screen.
+const qint64 kStartupTargetMs = 300;
+
+} // namespace
 
 int main(int argc, char* argv[]) {
+    QElapsedTimer startup;
+    startup.start();
+
     QGuiApplication app(argc, argv);
     app.setApplicationName("Hi-Res Music Player");
     app.setApplicationVersion("1.0");
@@ -15,6 +30,18 @@ int main(int argc, char* argv[]) {
     qmlRegisterType<AudioManager>("AudioEngine", 1, 0, "AudioManager");
     qmlRegisterType<Track>("AudioEngine", 1, 0, "Track");
     qmlRegisterType<PlaylistManager>("AudioEngine", 1, 0, "PlaylistManager");
+    qmlRegisterUncreatableType<PlaylistFilter>("AudioEngine", 1, 0, "PlaylistFilter",
+                                               "PlaylistFilter is owned by AudioManager");
+    qmlRegisterType<WaveformItem>("AudioEngine", 1, 0, "Waveform");
+    qmlRegisterUncreatableType<WaveformProvider>("AudioEngine", 1, 0, "WaveformProvider",
+                                                 "WaveformProvider is owned by AudioManager");
+    qmlRegisterUncreatableType<SpectrumAnalyzer>("AudioEngine", 1, 0, "SpectrumAnalyzer",
+                                                 "SpectrumAnalyzer is owned by AudioManager");
+    qmlRegisterUncreatableType<LevelMeter>("AudioEngine", 1, 0, "LevelMeter",
+                                           "LevelMeter is owned by AudioManager");
+
+    // The engine takes ownership.
+    engine.addImageProvider("cover", new CoverArtProvider);
 
     AudioManager audioManager;
     engine.rootContext()->setContextProperty("audioManager", &audioManager);
@@ -28,5 +55,17 @@ int main(int argc, char* argv[]) {
 
     engine.loadFromModule("HiResMusicApp", "Main");
 
+    const QList<QObject*> roots = engine.rootObjects();
+    if (QQuickWindow* window = roots.isEmpty() ? nullptr : qobject_cast<QQuickWindow*>(roots.first())) {
+        QObject::connect(window, &QQuickWindow::frameSwapped, &app, [startup]() {
+            const qint64 elapsed = startup.elapsed();
+            if (elapsed > kStartupTargetMs) {
+                qDebug() << "Startup: first frame after" << elapsed << "ms, over the" << kStartupTargetMs << "ms target";
+            } else {
+                qDebug() << "Startup: first frame after" << elapsed << "ms";
+            }
+        }, Qt::SingleShotConnection);
+    }
+
     return app.exec();
 }
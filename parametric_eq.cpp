@@ -0,0 +1,372 @@
+#include "parametric_eq.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARAMETRIC_EQ_SSE2 1
+#endif
+
+namespace {
+
+const double kSnapThreshold = 1e-9;
+
+BiquadCoefficients coefficientsFor(const EqBand& band, double sampleRate) {
+    if (!band.enabled || sampleRate <= 0.0) {
+        return BiquadCoefficients();
+    }
+
+    bool gainOnly = band.type == BiquadType::Peaking ||
+                    band.type == BiquadType::LowShelf ||
+                    band.type == BiquadType::HighShelf;
+    if (gainOnly && band.gainDb == 0.0) {
+        return BiquadCoefficients();
+    }
+
+    return BiquadCoefficients::design(band.type, sampleRate, band.frequency, band.gainDb, band.q);
+}
+
+void storeCoefficients(double dest[5][2], int lane, const BiquadCoefficients& c) {
+    dest[0][lane] = c.b0;
+    dest[1][lane] = c.b1;
+    dest[2][lane] = c.b2;
+    dest[3][lane] = c.a1;
+    dest[4][lane] = c.a2;
+}
+
+bool isIdentity(const double c[5][2]) {
+    for (int lane = 0; lane < 2; ++lane) {
+        if (c[0][lane] != 1.0 || c[1][lane] != 0.0 || c[2][lane] != 0.0 ||
+            c[3][lane] != 0.0 || c[4][lane] != 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+ParametricEq::ParametricEq()
+    : sampleRate_(0.0)
+    , channels_(0)
+    , enabled_(true)
+    , pendingVersion_(0)
+    , activeCount_(0)
+    , rtChannels_(0)
+    , smoothing_(1.0)
+    , appliedVersion_(0) {
+    std::memset(state_, 0, sizeof(state_));
+    for (int p = 0; p < kMaxPairs; ++p) {
+        for (int b = 0; b < kMaxBands; ++b) {
+            storeCoefficients(state_[p][b].current, 0, BiquadCoefficients());
+            storeCoefficients(state_[p][b].current, 1, BiquadCoefficients());
+            storeCoefficients(state_[p][b].target, 0, BiquadCoefficients());
+            storeCoefficients(state_[p][b].target, 1, BiquadCoefficients());
+        }
+    }
+}
+
+void ParametricEq::prepare(double sampleRate, int channels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sampleRate_ = sampleRate;
+    channels_ = std::max(0, std::min(channels, kMaxChannels));
+    publishLocked();
+
+    // The stream is closed, so the audio-thread state can be reset directly.
+    rtChannels_ = channels_;
+    smoothing_ = sampleRate > 0.0 ? 1.0 - std::exp(-static_cast<double>(kSubBlock) / (0.02 * sampleRate)) : 1.0;
+    applyTargets(true);
+    appliedVersion_ = pendingVersion_.load(std::memory_order_relaxed);
+}
+
+void ParametricEq::setBand(int channel, int index, const EqBand& band) {
+    if (index < 0 || index >= kMaxBands || channel >= kMaxChannels) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (channel < 0) {
+        for (int ch = 0; ch < kMaxChannels; ++ch) {
+            bands_[ch][index] = band;
+        }
+    } else {
+        bands_[channel][index] = band;
+    }
+    publishLocked();
+}
+
+EqBand ParametricEq::band(int channel, int index) const {
+    if (index < 0 || index >= kMaxBands || channel < 0 || channel >= kMaxChannels) {
+        return EqBand();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bands_[channel][index];
+}
+
+void ParametricEq::clearBands() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int ch = 0; ch < kMaxChannels; ++ch) {
+        for (int b = 0; b < kMaxBands; ++b) {
+            bands_[ch][b] = EqBand();
+        }
+    }
+    publishLocked();
+}
+
+void ParametricEq::setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (enabled_.load(std::memory_order_relaxed) != enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+        publishLocked();
+    }
+}
+
+void ParametricEq::publishLocked() {
+    bool enabled = enabled_.load(std::memory_order_relaxed);
+    for (int ch = 0; ch < kMaxChannels; ++ch) {
+        for (int b = 0; b < kMaxBands; ++b) {
+            pending_[ch][b] = enabled ? coefficientsFor(bands_[ch][b], sampleRate_) : BiquadCoefficients();
+        }
+    }
+    pendingVersion_.fetch_add(1, std::memory_order_release);
+}
+
+bool ParametricEq::update() {
+    if (pendingVersion_.load(std::memory_order_acquire) != appliedVersion_ && mutex_.try_lock()) {
+        applyTargets(false);
+        appliedVersion_ = pendingVersion_.load(std::memory_order_relaxed);
+        mutex_.unlock();
+    }
+    return activeCount_ > 0;
+}
+
+void ParametricEq::applyTargets(bool immediate) {
+    for (int p = 0; p < kMaxPairs; ++p) {
+        for (int b = 0; b < kMaxBands; ++b) {
+            BandState& band = state_[p][b];
+            for (int lane = 0; lane < 2; ++lane) {
+                int ch = p * 2 + lane;
+                storeCoefficients(band.target, lane,
+                                  ch < rtChannels_ ? pending_[ch][b] : BiquadCoefficients());
+            }
+
+            if (immediate) {
+                std::memcpy(band.current, band.target, sizeof(band.current));
+                band.s1[0] = band.s1[1] = 0.0;
+                band.s2[0] = band.s2[1] = 0.0;
+                band.smoothing = false;
+            } else {
+                band.smoothing = std::memcmp(band.current, band.target, sizeof(band.current)) != 0;
+            }
+        }
+    }
+    rebuildActiveBands();
+}
+
+void ParametricEq::advanceSmoothing() {
+    bool rebuild = false;
+    int pairs = (rtChannels_ + 1) / 2;
+
+    for (int i = 0; i < activeCount_; ++i) {
+        int b = activeBands_[i];
+        for (int p = 0; p < pairs; ++p) {
+            BandState& band = state_[p][b];
+            if (!band.smoothing) {
+                continue;
+            }
+
+            double maxDelta = 0.0;
+            for (int k = 0; k < 5; ++k) {
+                for (int lane = 0; lane < 2; ++lane) {
+                    double delta = band.target[k][lane] - band.current[k][lane];
+                    band.current[k][lane] += delta * smoothing_;
+                    maxDelta = std::max(maxDelta, std::fabs(delta));
+                }
+            }
+
+            if (maxDelta < kSnapThreshold) {
+                std::memcpy(band.current, band.target, sizeof(band.current));
+                band.smoothing = false;
+                rebuild = true;
+            }
+        }
+    }
+
+    if (rebuild) {
+        rebuildActiveBands();
+    }
+}
+
+void ParametricEq::rebuildActiveBands() {
+    int pairs = (rtChannels_ + 1) / 2;
+    activeCount_ = 0;
+
+    for (int b = 0; b < kMaxBands; ++b) {
+        bool active = false;
+        for (int p = 0; p < pairs; ++p) {
+            const BandState& band = state_[p][b];
+            if (band.smoothing || !isIdentity(band.current) || !isIdentity(band.target)) {
+                active = true;
+                break;
+            }
+        }
+
+        if (active) {
+            activeBands_[activeCount_++] = b;
+        } else {
+            // Faded out completely: drop the filter memory so the band starts
+            // clean when it is next enabled.
+            for (int p = 0; p < kMaxPairs; ++p) {
+                state_[p][b].s1[0] = state_[p][b].s1[1] = 0.0;
+                state_[p][b].s2[0] = state_[p][b].s2[1] = 0.0;
+            }
+        }
+    }
+}
+
+void ParametricEq::process(float* interleaved, size_t frames) {
+    if (activeCount_ == 0 || rtChannels_ == 0) {
+        return;
+    }
+
+    const int channels = rtChannels_;
+    const int pairs = (channels + 1) / 2;
+    alignas(16) double work[kSubBlock * 2];
+
+    for (size_t offset = 0; offset < frames; offset += kSubBlock) {
+        size_t count = std::min(kSubBlock, frames - offset);
+        advanceSmoothing();
+
+        for (int p = 0; p < pairs; ++p) {
+            int left = p * 2;
+            bool hasRight = left + 1 < channels;
+            float* frame = interleaved + offset * channels + left;
+
+            for (size_t i = 0; i < count; ++i, frame += channels) {
+                work[i * 2] = frame[0];
+                work[i * 2 + 1] = hasRight ? frame[1] : 0.0;
+            }
+
+            int i = 0;
+            for (; i + 1 < activeCount_; i += 2) {
+                processBandPair(state_[p][activeBands_[i]], state_[p][activeBands_[i + 1]], work, count);
+            }
+            if (i < activeCount_) {
+                processBand(state_[p][activeBands_[i]], work, count);
+            }
+
+            frame = interleaved + offset * channels + left;
+            for (size_t i = 0; i < count; ++i, frame += channels) {
+                frame[0] = static_cast<float>(work[i * 2]);
+                if (hasRight) {
+                    frame[1] = static_cast<float>(work[i * 2 + 1]);
+                }
+            }
+        }
+    }
+}
+
+// Runs two cascaded bands in one pass with the second band lagging one sample
+// behind the first. The two recurrences are independent within an iteration,
+// which roughly doubles throughput over running the bands back to back.
+void ParametricEq::processBandPair(BandState& first, BandState& second, double* work, size_t frames) {
+#ifdef PARAMETRIC_EQ_SSE2
+    if (frames == 0) {
+        return;
+    }
+
+    const __m128d fb0 = _mm_load_pd(first.current[0]);
+    const __m128d fb1 = _mm_load_pd(first.current[1]);
+    const __m128d fb2 = _mm_load_pd(first.current[2]);
+    const __m128d fa1 = _mm_load_pd(first.current[3]);
+    const __m128d fa2 = _mm_load_pd(first.current[4]);
+    const __m128d sb0 = _mm_load_pd(second.current[0]);
+    const __m128d sb1 = _mm_load_pd(second.current[1]);
+    const __m128d sb2 = _mm_load_pd(second.current[2]);
+    const __m128d sa1 = _mm_load_pd(second.current[3]);
+    const __m128d sa2 = _mm_load_pd(second.current[4]);
+    __m128d fs1 = _mm_load_pd(first.s1);
+    __m128d fs2 = _mm_load_pd(first.s2);
+    __m128d ss1 = _mm_load_pd(second.s1);
+    __m128d ss2 = _mm_load_pd(second.s2);
+
+    __m128d x = _mm_load_pd(work);
+    __m128d mid = _mm_add_pd(_mm_mul_pd(fb0, x), fs1);
+    fs1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(fb1, x), _mm_mul_pd(fa1, mid)), fs2);
+    fs2 = _mm_sub_pd(_mm_mul_pd(fb2, x), _mm_mul_pd(fa2, mid));
+
+    for (size_t i = 1; i < frames; ++i) {
+        x = _mm_load_pd(work + i * 2);
+        __m128d nextMid = _mm_add_pd(_mm_mul_pd(fb0, x), fs1);
+        fs1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(fb1, x), _mm_mul_pd(fa1, nextMid)), fs2);
+        fs2 = _mm_sub_pd(_mm_mul_pd(fb2, x), _mm_mul_pd(fa2, nextMid));
+
+        __m128d y = _mm_add_pd(_mm_mul_pd(sb0, mid), ss1);
+        ss1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, mid), _mm_mul_pd(sa1, y)), ss2);
+        ss2 = _mm_sub_pd(_mm_mul_pd(sb2, mid), _mm_mul_pd(sa2, y));
+        _mm_store_pd(work + (i - 1) * 2, y);
+
+        mid = nextMid;
+    }
+
+    __m128d y = _mm_add_pd(_mm_mul_pd(sb0, mid), ss1);
+    ss1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(sb1, mid), _mm_mul_pd(sa1, y)), ss2);
+    ss2 = _mm_sub_pd(_mm_mul_pd(sb2, mid), _mm_mul_pd(sa2, y));
+    _mm_store_pd(work + (frames - 1) * 2, y);
+
+    _mm_store_pd(first.s1, fs1);
+    _mm_store_pd(first.s2, fs2);
+    _mm_store_pd(second.s1, ss1);
+    _mm_store_pd(second.s2, ss2);
+#else
+    processBand(first, work, frames);
+    processBand(second, work, frames);
+#endif
+}
+
+void ParametricEq::processBand(BandState& band, double* work, size_t frames) {
+#ifdef PARAMETRIC_EQ_SSE2
+    const __m128d b0 = _mm_load_pd(band.current[0]);
+    const __m128d b1 = _mm_load_pd(band.current[1]);
+    const __m128d b2 = _mm_load_pd(band.current[2]);
+    const __m128d a1 = _mm_load_pd(band.current[3]);
+    const __m128d a2 = _mm_load_pd(band.current[4]);
+    __m128d s1 = _mm_load_pd(band.s1);
+    __m128d s2 = _mm_load_pd(band.s2);
+
+    for (size_t i = 0; i < frames; ++i) {
+        __m128d x = _mm_load_pd(work + i * 2);
+        __m128d y = _mm_add_pd(_mm_mul_pd(b0, x), s1);
+        s1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), s2);
+        s2 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+        _mm_store_pd(work + i * 2, y);
+    }
+
+    _mm_store_pd(band.s1, s1);
+    _mm_store_pd(band.s2, s2);
+#else
+    for (int lane = 0; lane < 2; ++lane) {
+        const double b0 = band.current[0][lane];
+        const double b1 = band.current[1][lane];
+        const double b2 = band.current[2][lane];
+        const double a1 = band.current[3][lane];
+        const double a2 = band.current[4][lane];
+        double s1 = band.s1[lane];
+        double s2 = band.s2[lane];
+
+        for (size_t i = 0; i < frames; ++i) {
+            double x = work[i * 2 + lane];
+            double y = b0 * x + s1;
+            s1 = b1 * x - a1 * y + s2;
+            s2 = b2 * x - a2 * y;
+            work[i * 2 + lane] = y;
+        }
+
+        band.s1[lane] = s1;
+        band.s2[lane] = s2;
+    }
+#endif
+}
@@ -0,0 +1,85 @@
+#ifndef PARAMETRIC_EQ_H
+#define PARAMETRIC_EQ_H
+
+#include "biquad.h"
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+struct EqBand {
+    BiquadType type;
+    double frequency;
+    double gainDb;
+    double q;
+    bool enabled;
+
+    EqBand() : type(BiquadType::Peaking), frequency(1000.0), gainDb(0.0), q(0.707), enabled(false) {}
+};
+
+// Cascade of up to kMaxBands biquads per channel. Channels are processed in
+// pairs, one SSE2 double lane per channel, so each band runs both channels of
+// a pair with a single instruction stream. Band edits made from the GUI thread
+// are picked up by the audio thread under a try_lock it never waits on, a
+// busy lock leaving them for the next block, and ramped in over a few
+// milliseconds so dragging a band does not zipper.
+class ParametricEq {
+public:
+    static constexpr int kMaxBands = 32;
+    static constexpr int kMaxChannels = 8;
+
+    ParametricEq();
+
+    // Call while the stream is closed.
+    void prepare(double sampleRate, int channels);
+
+    // GUI thread. A negative channel applies the band to every channel.
+    void setBand(int channel, int index, const EqBand& band);
+    EqBand band(int channel, int index) const;
+    void clearBands();
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Audio thread. update() picks up pending band edits and returns false
+    // when the EQ is fully transparent, so the caller can skip process().
+    bool update();
+    bool isActive() const { return activeCount_ > 0; }
+    void process(float* interleaved, size_t frames);
+
+private:
+    static constexpr int kMaxPairs = kMaxChannels / 2;
+    static constexpr size_t kSubBlock = 32;
+
+    struct alignas(16) BandState {
+        double current[5][2];
+        double target[5][2];
+        double s1[2];
+        double s2[2];
+        bool smoothing;
+    };
+
+    void publishLocked();
+    void applyTargets(bool immediate);
+    void advanceSmoothing();
+    void rebuildActiveBands();
+    static void processBand(BandState& band, double* work, size_t frames);
+    static void processBandPair(BandState& first, BandState& second, double* work, size_t frames);
+
+    // GUI side, guarded by mutex_.
+    mutable std::mutex mutex_;
+    EqBand bands_[kMaxChannels][kMaxBands];
+    BiquadCoefficients pending_[kMaxChannels][kMaxBands];
+    double sampleRate_;
+    int channels_;
+    std::atomic<bool> enabled_;
+    std::atomic<unsigned> pendingVersion_;
+
+    // Audio thread only.
+    BandState state_[kMaxPairs][kMaxBands];
+    int activeBands_[kMaxBands];
+    int activeCount_;
+    int rtChannels_;
+    double smoothing_;
+    unsigned appliedVersion_;
+};
+
+#endif // PARAMETRIC_EQ_H
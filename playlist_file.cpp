@@ -0,0 +1,377 @@
+#include "playlist_file.h"
+#include "audio_decoder.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringDecoder>
+#include <QTextStream>
+#include <QUrl>
+#include <QXmlStreamWriter>
+#include <cmath>
+
+namespace {
+
+// One line of a playlist as written: a track, or a run of CUE tracks
+// written as their sheet, which expands again when the playlist is read.
+// Tracks of an image added without its sheet are written as the image.
+struct PlaylistItem {
+    QString filePath;
+    QString artist;
+    QString title;
+    QString album;
+    double duration = 0.0;
+    int trackNumber = 0;
+    bool isVirtual = false;
+};
+
+template <typename Function>
+void forEachItem(const TrackStore& tracks, Function function) {
+    PlaylistItem item;
+    for (int row = 0; row < tracks.size(); ++row) {
+        QString filePath = tracks.isVirtual(row) && !tracks.cueSheet(row).isEmpty() ? tracks.cueSheet(row)
+                                                                                   : tracks.filePath(row);
+        if (tracks.isVirtual(row) && item.isVirtual && filePath == item.filePath) {
+            item.duration += tracks.duration(row);
+            continue;
+        }
+        if (row > 0) {
+            function(item);
+        }
+
+        item = PlaylistItem();
+        item.filePath = std::move(filePath);
+        item.isVirtual = tracks.isVirtual(row);
+        item.artist = tracks.isVirtual(row) && !tracks.albumArtist(row).isEmpty() ? tracks.albumArtist(row)
+                                                                                   : tracks.artist(row);
+        item.title = tracks.isVirtual(row) && !tracks.album(row).isEmpty() ? tracks.album(row) : tracks.title(row);
+        item.album = tracks.album(row);
+        item.duration = tracks.duration(row);
+        item.trackNumber = tracks.isVirtual(row) ? 0 : tracks.trackNumber(row);
+    }
+    if (tracks.size() > 0) {
+        function(item);
+    }
+}
+
+// "Artist - Title", as #EXTINF and PLS titles have it.
+QString displayTitle(const PlaylistItem& item) {
+    return item.artist.isEmpty() ? item.title : item.artist + " - " + item.title;
+}
+
+void splitDisplayTitle(const QString& text, TrackEntry& entry) {
+    const qsizetype dash = text.indexOf(" - ");
+    if (dash > 0) {
+        entry.artist = text.left(dash).trimmed();
+        entry.title = text.mid(dash + 3).trimmed();
+    } else {
+        entry.title = text;
+    }
+}
+
+// What follows "#EXTINF:": the length in seconds, -1 when unknown, then
+// optional key="value" attributes, a comma and the title.
+void parseExtinf(const QString& text, TrackEntry& entry) {
+    qsizetype comma = -1;
+    bool quoted = false;
+    for (qsizetype i = 0; i < text.size() && comma < 0; ++i) {
+        if (text[i] == QChar('"')) {
+            quoted = !quoted;
+        } else if (text[i] == QChar(',') && !quoted) {
+            comma = i;
+        }
+    }
+
+    const QString length = (comma < 0 ? text : text.left(comma)).trimmed().section(' ', 0, 0);
+    const double seconds = length.toDouble();
+    entry.duration = seconds > 0.0 ? seconds : 0.0;
+    if (comma >= 0) {
+        splitDisplayTitle(text.mid(comma + 1).trimmed(), entry);
+    }
+}
+
+} // namespace
+
+PlaylistFile::Format PlaylistFile::formatOf(const QString& filePath) {
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    if (suffix == "m3u") {
+        return M3u;
+    } else if (suffix == "m3u8") {
+        return M3u8;
+    } else if (suffix == "pls") {
+        return Pls;
+    } else if (suffix == "xspf") {
+        return Xspf;
+    }
+    return None;
+}
+
+PlaylistFile::PlaylistFile(const QString& filePath)
+    : format_(None)
+    , pendingNumber_(-1) {
+    const QString path = filePath.startsWith("file://") ? QUrl(filePath).toLocalFile() : filePath;
+    const Format format = formatOf(path);
+    file_.setFileName(path);
+    if (format == None || !file_.open(QIODevice::ReadOnly)) {
+        qDebug() << "Cannot open playlist:" << path;
+        return;
+    }
+
+    format_ = format;
+    directory_ = QFileInfo(path).absoluteDir();
+    if (format_ == Xspf) {
+        xml_.setDevice(&file_);
+    }
+}
+
+bool PlaylistFile::read(std::vector<TrackEntry>& entries, size_t count) {
+    switch (format_) {
+    case M3u:
+    case M3u8:
+        return readM3u(entries, count);
+    case Pls:
+        return readPls(entries, count);
+    case Xspf:
+        return readXspf(entries, count);
+    case None:
+        break;
+    }
+    return false;
+}
+
+bool PlaylistFile::readM3u(std::vector<TrackEntry>& entries, size_t count) {
+    const size_t first = entries.size();
+    while (entries.size() - first < count && !file_.atEnd()) {
+        const QString line = readLine();
+        if (line.isEmpty()) {
+            continue;
+        }
+        if (line.startsWith('#')) {
+            if (line.startsWith("#EXTINF:", Qt::CaseInsensitive)) {
+                parseExtinf(line.mid(8), pending_);
+            }
+            continue;
+        }
+
+        // The #EXTINF before a path belongs to it, playable or not.
+        TrackEntry entry = std::move(pending_);
+        pending_ = TrackEntry();
+        entry.filePath = resolve(line);
+        if (!entry.filePath.isEmpty()) {
+            entries.push_back(std::move(entry));
+        }
+    }
+    return entries.size() > first;
+}
+
+bool PlaylistFile::readPls(std::vector<TrackEntry>& entries, size_t count) {
+    // FileN, TitleN and LengthN describe entry N, and writers keep them
+    // together, so an entry is complete once another number comes up.
+    auto finish = [this, &entries]() {
+        if (!pending_.filePath.isEmpty()) {
+            entries.push_back(std::move(pending_));
+        }
+        pending_ = TrackEntry();
+    };
+
+    const size_t first = entries.size();
+    while (entries.size() - first < count && !file_.atEnd()) {
+        const QString line = readLine();
+        const qsizetype equals = line.indexOf('=');
+        if (equals <= 0) {
+            continue;
+        }
+        const QString key = line.left(equals).trimmed().toLower();
+        const QString value = line.mid(equals + 1).trimmed();
+        qsizetype digits = key.size();
+        while (digits > 0 && key[digits - 1].isDigit()) {
+            --digits;
+        }
+        if (digits == key.size()) {
+            // NumberOfEntries, Version.
+            continue;
+        }
+
+        const int number = key.mid(digits).toInt();
+        if (number != pendingNumber_) {
+            finish();
+            pendingNumber_ = number;
+        }
+        const QString name = key.left(digits);
+        if (name == "file") {
+            pending_.filePath = resolve(value);
+        } else if (name == "title") {
+            splitDisplayTitle(value, pending_);
+        } else if (name == "length") {
+            const double seconds = value.toDouble();
+            pending_.duration = seconds > 0.0 ? seconds : 0.0;
+        }
+    }
+    if (file_.atEnd()) {
+        finish();
+    }
+    return entries.size() > first;
+}
+
+bool PlaylistFile::readXspf(std::vector<TrackEntry>& entries, size_t count) {
+    const size_t first = entries.size();
+    while (entries.size() - first < count && !xml_.atEnd()) {
+        xml_.readNext();
+        if (xml_.isStartElement()) {
+            const QStringView name = xml_.name();
+            if (name == QLatin1String("track")) {
+                pending_ = TrackEntry();
+                pendingNumber_ = 0;
+            } else if (pendingNumber_ < 0) {
+                continue;
+            } else if (name == QLatin1String("location")) {
+                // The first playable location of several.
+                const QString location = xml_.readElementText();
+                if (pending_.filePath.isEmpty()) {
+                    pending_.filePath = resolve(location);
+                }
+            } else if (name == QLatin1String("title")) {
+                pending_.title = xml_.readElementText().trimmed();
+            } else if (name == QLatin1String("creator")) {
+                pending_.artist = xml_.readElementText().trimmed();
+            } else if (name == QLatin1String("album")) {
+                pending_.album = xml_.readElementText().trimmed();
+            } else if (name == QLatin1String("duration")) {
+                pending_.duration = std::max(0.0, xml_.readElementText().toDouble() / 1000.0);
+            } else if (name == QLatin1String("trackNum")) {
+                pending_.trackNumber = xml_.readElementText().toInt();
+            }
+        } else if (xml_.isEndElement() && xml_.name() == QLatin1String("track")) {
+            if (!pending_.filePath.isEmpty()) {
+                entries.push_back(std::move(pending_));
+            }
+            pending_ = TrackEntry();
+            pendingNumber_ = -1;
+        }
+    }
+    if (xml_.hasError()) {
+        qDebug() << "Playlist" << file_.fileName() << "stops at an XML error:" << xml_.errorString();
+    }
+    return entries.size() > first;
+}
+
+QString PlaylistFile::readLine() {
+    QByteArray line = file_.readLine();
+    if (line.startsWith("\xEF\xBB\xBF")) {
+        line.remove(0, 3);
+    }
+
+    // M3U8 is UTF-8 by definition; plain M3U and PLS are UTF-8 when they
+    // decode as such, and the local 8-bit code page otherwise.
+    if (format_ == M3u8) {
+        return QString::fromUtf8(line).trimmed();
+    }
+    QStringDecoder utf8(QStringConverter::Utf8);
+    QString text = utf8.decode(line);
+    if (utf8.hasError()) {
+        text = QString::fromLocal8Bit(line);
+    }
+    return text.trimmed();
+}
+
+QString PlaylistFile::resolve(const QString& location) const {
+    QString path = location.trimmed();
+    if (path.startsWith("file:", Qt::CaseInsensitive)) {
+        path = QUrl(path).toLocalFile();
+    } else if (path.contains("://")) {
+        return QString();
+    } else if (format_ == Xspf) {
+        // A relative URI.
+        path = QUrl::fromPercentEncoding(path.toUtf8());
+    }
+    if (path.isEmpty()) {
+        return QString();
+    }
+
+    // Playlists written on Windows separate with backslashes.
+    path.replace(QChar('\\'), QChar('/'));
+    path = QDir::cleanPath(directory_.absoluteFilePath(path));
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix != "cue" && !AudioDecoder::isFormatSupported(suffix)) {
+        return QString();
+    }
+    return path;
+}
+
+bool PlaylistFile::write(const QString& filePath, const TrackStore& tracks) {
+    const QString path = filePath.startsWith("file://") ? QUrl(filePath).toLocalFile() : filePath;
+    const Format format = formatOf(path);
+    QSaveFile file(path);
+    if (format == None || !file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Cannot write playlist:" << path;
+        return false;
+    }
+
+    QString folder = QFileInfo(path).absolutePath();
+    if (!folder.endsWith('/')) {
+        folder += '/';
+    }
+    auto location = [&folder](const QString& trackPath) {
+        return trackPath.startsWith(folder) ? trackPath.mid(folder.size()) : trackPath;
+    };
+    auto seconds = [](double duration) {
+        return duration > 0.0 ? static_cast<long long>(std::llround(duration)) : -1LL;
+    };
+
+    int written = 0;
+    if (format == Xspf) {
+        QXmlStreamWriter xml(&file);
+        xml.setAutoFormatting(true);
+        xml.writeStartDocument();
+        xml.writeStartElement("playlist");
+        xml.writeAttribute("version", "1");
+        xml.writeDefaultNamespace("http://xspf.org/ns/0/");
+        xml.writeStartElement("trackList");
+        forEachItem(tracks, [&](const PlaylistItem& item) {
+            xml.writeStartElement("track");
+            xml.writeTextElement("location", QUrl::fromLocalFile(item.filePath).toString(QUrl::FullyEncoded));
+            xml.writeTextElement("title", item.title);
+            if (!item.artist.isEmpty()) {
+                xml.writeTextElement("creator", item.artist);
+            }
+            if (!item.album.isEmpty()) {
+                xml.writeTextElement("album", item.album);
+            }
+            if (item.trackNumber > 0) {
+                xml.writeTextElement("trackNum", QString::number(item.trackNumber));
+            }
+            if (item.duration > 0.0) {
+                xml.writeTextElement("duration", QString::number(std::llround(item.duration * 1000.0)));
+            }
+            xml.writeEndElement();
+            ++written;
+        });
+        xml.writeEndDocument();
+    } else {
+        QTextStream out(&file);
+        if (format == Pls) {
+            out << "[playlist]\n";
+            forEachItem(tracks, [&](const PlaylistItem& item) {
+                ++written;
+                out << "File" << written << '=' << location(item.filePath) << '\n'
+                    << "Title" << written << '=' << displayTitle(item) << '\n'
+                    << "Length" << written << '=' << seconds(item.duration) << '\n';
+            });
+            out << "NumberOfEntries=" << written << '\n' << "Version=2\n";
+        } else {
+            out << "#EXTM3U\n";
+            forEachItem(tracks, [&](const PlaylistItem& item) {
+                out << "#EXTINF:" << seconds(item.duration) << ',' << displayTitle(item) << '\n'
+                    << location(item.filePath) << '\n';
+                ++written;
+            });
+        }
+        out.flush();
+    }
+
+    if (!file.commit()) {
+        qDebug() << "Cannot write playlist:" << path;
+        return false;
+    }
+    qDebug() << "Wrote" << written << "entries to" << path;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef PLAYLIST_FILE_H
+#define PLAYLIST_FILE_H
+
+#include "track_store.h"
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QXmlStreamReader>
+#include <vector>
+
+// M3U/M3U8, PLS and XSPF playlists, read a batch at a time so a long one
+// never sits in memory whole. Relative paths are resolved against the
+// playlist's folder and file URLs are turned into paths; other URLs and
+// unsupported files are skipped. What the playlist says about a track
+// (#EXTINF, TitleN/LengthN, XSPF elements) fills the entry in place of its
+// tags, and a duration of 0 is left for the first load to fill in. CUE
+// sheets come through as entries of their own, to be expanded.
+class PlaylistFile {
+public:
+    enum Format {
+        None,
+        M3u,
+        M3u8,
+        Pls,
+        Xspf
+    };
+
+    // By extension.
+    static Format formatOf(const QString& filePath);
+
+    explicit PlaylistFile(const QString& filePath);
+
+    bool isOpen() const { return format_ != None; }
+    // Appends up to count entries; false once there are none left.
+    bool read(std::vector<TrackEntry>& entries, size_t count);
+
+    // Writes the rows in the format the extension names. M3U and PLS paths
+    // below the playlist's folder are relative to it; XSPF locations are
+    // file:// URIs. CUE tracks are written as their sheet, once for each
+    // run of tracks from it.
+    static bool write(const QString& filePath, const TrackStore& tracks);
+
+private:
+    bool readM3u(std::vector<TrackEntry>& entries, size_t count);
+    bool readPls(std::vector<TrackEntry>& entries, size_t count);
+    bool readXspf(std::vector<TrackEntry>& entries, size_t count);
+    QString readLine();
+    // The path a playlist location names, empty when it is not a playable
+    // local file.
+    QString resolve(const QString& location) const;
+
+    QFile file_;
+    Format format_;
+    QDir directory_;
+    QXmlStreamReader xml_;
+    // The entry being put together: the #EXTINF before an M3U path, the
+    // keys read so far for a PLS number, or the XSPF <track> being read.
+    TrackEntry pending_;
+    // The PLS number; for XSPF 0 inside a <track> and -1 outside.
+    int pendingNumber_;
+};
+
+#endif // PLAYLIST_FILE_H
@@ -0,0 +1,275 @@
+#include "playlist_filter.h"
+#include "playlist_manager.h"
+#include <QRunnable>
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+// Past this many runs of rows coming and going, a search run again under
+// the same query resets the model instead.
+const size_t kMaxChangedRuns = 64;
+
+bool isMatch(const std::vector<quint32>& matches, quint32 id) {
+    return std::binary_search(matches.begin(), matches.end(), id);
+}
+
+// Whether a change to these roles can change what matches.
+bool affectsSearch(const QList<int>& roles) {
+    if (roles.isEmpty()) {
+        return true;
+    }
+    for (int role : roles) {
+        switch (role) {
+        case PlaylistManager::TitleRole:
+        case PlaylistManager::FilePathRole:
+        case PlaylistManager::ArtistRole:
+        case PlaylistManager::AlbumRole:
+        case PlaylistManager::AlbumArtistRole:
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+// Appends row to runs of consecutive rows as (first, count).
+void addToRuns(std::vector<std::pair<size_t, size_t>>& runs, size_t row) {
+    if (!runs.empty() && runs.back().first + runs.back().second == row) {
+        ++runs.back().second;
+    } else {
+        runs.emplace_back(row, 1);
+    }
+}
+
+} // namespace
+
+PlaylistFilter::PlaylistFilter(PlaylistManager* playlist, QObject* parent)
+    : QAbstractListModel(parent)
+    , playlist_(playlist)
+    , generation_(0) {
+    // One search at a time; the next waits for the one it cancelled.
+    pool_.setMaxThreadCount(1);
+
+    connect(playlist_, &QAbstractItemModel::rowsInserted, this, [this]() {
+        if (isActive()) {
+            search(false);
+        }
+    });
+    connect(playlist_, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+            [this](const QModelIndex&, int first, int last) {
+        onRowsAboutToBeRemoved(first, last);
+    });
+    connect(playlist_, &QAbstractItemModel::rowsMoved, this, &PlaylistFilter::remap);
+    connect(playlist_, &QAbstractItemModel::layoutChanged, this, &PlaylistFilter::remap);
+    connect(playlist_, &QAbstractItemModel::modelReset, this, [this]() {
+        if (!ids_.empty()) {
+            beginResetModel();
+            ids_.clear();
+            endResetModel();
+            emit countChanged();
+        }
+        matches_.clear();
+        search(false);
+    });
+    connect(playlist_, &QAbstractItemModel::dataChanged, this, &PlaylistFilter::onDataChanged);
+}
+
+PlaylistFilter::~PlaylistFilter() {
+    generation_.fetch_add(1);
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+int PlaylistFilter::rowCount(const QModelIndex& parent) const {
+    Q_UNUSED(parent)
+    return count();
+}
+
+QVariant PlaylistFilter::data(const QModelIndex& index, int role) const {
+    const int row = index.isValid() ? sourceRow(index.row()) : -1;
+    return row < 0 ? QVariant() : playlist_->data(playlist_->index(row), role);
+}
+
+QHash<int, QByteArray> PlaylistFilter::roleNames() const {
+    return playlist_->roleNames();
+}
+
+void PlaylistFilter::setQuery(const QString& query) {
+    if (query == query_) {
+        return;
+    }
+    query_ = query;
+    emit queryChanged();
+    search(true);
+}
+
+int PlaylistFilter::sourceRow(int row) const {
+    if (row < 0 || row >= count()) {
+        return -1;
+    }
+    return playlist_->tracks().rowOf(ids_[row]);
+}
+
+void PlaylistFilter::search(bool reset) {
+    const unsigned generation = generation_.fetch_add(1) + 1;
+    pool_.clear();
+
+    if (!isActive()) {
+        if (!ids_.empty()) {
+            beginResetModel();
+            ids_.clear();
+            endResetModel();
+            emit countChanged();
+        }
+        matches_.clear();
+        return;
+    }
+
+    // The index is only read under its own lock, and the playlist outlives
+    // the filter, whose destructor waits for the pool.
+    const SearchIndex* index = &playlist_->searchIndex();
+    const QString query = query_;
+    pool_.start(QRunnable::create([this, index, query, generation, reset]() {
+        auto matches = std::make_shared<std::vector<quint32>>();
+        if (!index->search(query, generation_, generation, *matches)) {
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, matches, generation, reset]() {
+            if (generation == generation_.load()) {
+                publish(*matches, reset);
+            }
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void PlaylistFilter::publish(const std::vector<quint32>& matches, bool reset) {
+    // Rows the search did not see have arrived since, and a newer search
+    // has been started for them.
+    const TrackStore& tracks = playlist_->tracks();
+    std::vector<quint32> ids;
+    for (int row = 0; row < tracks.size(); ++row) {
+        if (isMatch(matches, tracks.id(row))) {
+            ids.push_back(tracks.id(row));
+        }
+    }
+
+    const int oldCount = count();
+    if (reset) {
+        beginResetModel();
+        ids_.swap(ids);
+        matches_ = matches;
+        endResetModel();
+    } else {
+        update(ids, matches);
+    }
+    if (count() != oldCount) {
+        emit countChanged();
+    }
+}
+
+void PlaylistFilter::update(std::vector<quint32>& ids, const std::vector<quint32>& matches) {
+    // Both lists are in playlist order. Rows that no longer match go,
+    // those that newly match arrive, each run with one signal.
+    std::vector<std::pair<size_t, size_t>> removed;
+    for (size_t row = 0; row < ids_.size(); ++row) {
+        if (!isMatch(matches, ids_[row])) {
+            addToRuns(removed, row);
+        }
+    }
+    std::vector<std::pair<size_t, size_t>> added;
+    for (size_t row = 0; row < ids.size(); ++row) {
+        if (!isMatch(matches_, ids[row])) {
+            addToRuns(added, row);
+        }
+    }
+    matches_ = matches;
+
+    if (removed.size() + added.size() > kMaxChangedRuns) {
+        beginResetModel();
+        ids_.swap(ids);
+        endResetModel();
+        return;
+    }
+
+    for (auto it = removed.rbegin(); it != removed.rend(); ++it) {
+        const auto first = ids_.begin() + static_cast<std::ptrdiff_t>(it->first);
+        beginRemoveRows(QModelIndex(), static_cast<int>(it->first), static_cast<int>(it->first + it->second - 1));
+        ids_.erase(first, first + static_cast<std::ptrdiff_t>(it->second));
+        endRemoveRows();
+    }
+    // What is left is ids without the new rows, so each run goes where it
+    // is in ids once the runs before it are in.
+    for (const auto& run : added) {
+        const auto from = ids.begin() + static_cast<std::ptrdiff_t>(run.first);
+        beginInsertRows(QModelIndex(), static_cast<int>(run.first), static_cast<int>(run.first + run.second - 1));
+        ids_.insert(ids_.begin() + static_cast<std::ptrdiff_t>(run.first), from,
+                    from + static_cast<std::ptrdiff_t>(run.second));
+        endInsertRows();
+    }
+}
+
+size_t PlaylistFilter::lowerBound(int sourceRow) const {
+    const TrackStore& tracks = playlist_->tracks();
+    auto it = std::lower_bound(ids_.begin(), ids_.end(), sourceRow, [&tracks](quint32 id, int row) {
+        return tracks.rowOf(id) < row;
+    });
+    return static_cast<size_t>(it - ids_.begin());
+}
+
+void PlaylistFilter::onRowsAboutToBeRemoved(int first, int last) {
+    // Removed rows leave the index too, so no search is needed.
+    const size_t from = lowerBound(first);
+    const size_t to = lowerBound(last + 1);
+    if (from == to) {
+        return;
+    }
+    beginRemoveRows(QModelIndex(), static_cast<int>(from), static_cast<int>(to - 1));
+    ids_.erase(ids_.begin() + static_cast<std::ptrdiff_t>(from), ids_.begin() + static_cast<std::ptrdiff_t>(to));
+    endRemoveRows();
+    emit countChanged();
+}
+
+void PlaylistFilter::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                                   const QList<int>& roles) {
+    const size_t from = lowerBound(topLeft.row());
+    const size_t to = lowerBound(bottomRight.row() + 1);
+    if (from < to) {
+        emit dataChanged(index(static_cast<int>(from)), index(static_cast<int>(to - 1)), roles);
+    }
+    if (isActive() && affectsSearch(roles)) {
+        search(false);
+    }
+}
+
+void PlaylistFilter::remap() {
+    if (ids_.empty()) {
+        return;
+    }
+
+    // The same tracks in their new order; views keep their items by id.
+    emit layoutAboutToBeChanged();
+    const TrackStore& tracks = playlist_->tracks();
+    const QModelIndexList before = persistentIndexList();
+    std::vector<quint32> beforeIds;
+    beforeIds.reserve(static_cast<size_t>(before.size()));
+    for (const QModelIndex& index : before) {
+        beforeIds.push_back(ids_[static_cast<size_t>(index.row())]);
+    }
+
+    ids_.clear();
+    for (int row = 0; row < tracks.size(); ++row) {
+        if (isMatch(matches_, tracks.id(row))) {
+            ids_.push_back(tracks.id(row));
+        }
+    }
+
+    QModelIndexList after;
+    after.reserve(before.size());
+    for (quint32 id : beforeIds) {
+        after << index(static_cast<int>(lowerBound(tracks.rowOf(id))));
+    }
+    changePersistentIndexList(before, after);
+    emit layoutChanged();
+}
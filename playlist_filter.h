@@ -0,0 +1,71 @@
+#ifndef PLAYLIST_FILTER_H
+#define PLAYLIST_FILTER_H
+
+#include <QAbstractListModel>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <vector>
+
+class PlaylistManager;
+
+// The playlist rows whose title, artist, album, album artist or folder
+// hold every word of the query, in playlist order, with the playlist's
+// roles. Queries run on a worker against the playlist's SearchIndex; each
+// keystroke cancels the search before it, so only the latest is
+// published. Rows are kept as track ids and looked up on read, so the
+// playlist inserting rows elsewhere needs no remapping.
+//
+// A new query resets the model. When the playlist changes under the same
+// query, the search runs again and the difference arrives as row inserts
+// and removals, so the view keeps its place.
+class PlaylistFilter : public QAbstractListModel {
+    Q_OBJECT
+    Q_PROPERTY(QString query READ query WRITE setQuery NOTIFY queryChanged)
+    Q_PROPERTY(bool active READ isActive NOTIFY queryChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    explicit PlaylistFilter(PlaylistManager* playlist, QObject* parent = nullptr);
+    ~PlaylistFilter();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    QString query() const { return query_; }
+    void setQuery(const QString& query);
+    // An empty query filters nothing and has no rows.
+    bool isActive() const { return !query_.trimmed().isEmpty(); }
+    int count() const { return static_cast<int>(ids_.size()); }
+
+    // The playlist row behind a filtered one, -1 when out of range.
+    Q_INVOKABLE int sourceRow(int row) const;
+
+signals:
+    void queryChanged();
+    void countChanged();
+
+private:
+    void search(bool reset);
+    void publish(const std::vector<quint32>& matches, bool reset);
+    void update(std::vector<quint32>& ids, const std::vector<quint32>& matches);
+    // Filtered rows from first up to, not including, the one at or after
+    // the playlist row.
+    size_t lowerBound(int sourceRow) const;
+
+    void onRowsAboutToBeRemoved(int first, int last);
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles);
+    void remap();
+
+    PlaylistManager* playlist_;
+    QThreadPool pool_;
+    std::atomic<unsigned> generation_;
+    QString query_;
+    // Ids of the matching tracks, sorted, as of the last published search.
+    std::vector<quint32> matches_;
+    // Track ids of the rows, in playlist order.
+    std::vector<quint32> ids_;
+};
+
+#endif // PLAYLIST_FILTER_H
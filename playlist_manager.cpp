@@ -1,7 +1,41 @@
 #include "playlist_manager.h"
 #include "audio_decoder.h"
+#include "cue_sheet.h"
+#include "playlist_file.h"
+#include "tag_reader.h"
+#include <QDataStream>
 #include <QDebug>
+#include <QDir>
 #include <QFileInfo>
+#include <QHash>
+#include <QQmlEngine>
+#include <QUrl>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Playlist file entries inserted at a time; the file is read no further
+// ahead than this.
+const size_t kPlaylistBatchSize = 2048;
+
+// The roles that can be sorted on.
+const std::pair<int, TrackSorter::Field> kSortFields[] = {
+    {PlaylistManager::TitleRole, TrackSorter::Title},
+    {PlaylistManager::FilePathRole, TrackSorter::FilePath},
+    {PlaylistManager::FileNameRole, TrackSorter::FileName},
+    {PlaylistManager::ExtensionRole, TrackSorter::Extension},
+    {PlaylistManager::DurationRole, TrackSorter::Duration},
+    {PlaylistManager::ArtistRole, TrackSorter::Artist},
+    {PlaylistManager::AlbumRole, TrackSorter::Album},
+    {PlaylistManager::AlbumArtistRole, TrackSorter::AlbumArtist},
+    {PlaylistManager::GenreRole, TrackSorter::Genre},
+    {PlaylistManager::YearRole, TrackSorter::Year},
+    {PlaylistManager::TrackNumberRole, TrackSorter::TrackNumber},
+    {PlaylistManager::DiscNumberRole, TrackSorter::DiscNumber}
+};
+
+} // namespace
 
 PlaylistManager::PlaylistManager(QObject* parent)
     : QAbstractListModel(parent), currentIndex_(-1) {
@@ -9,29 +43,48 @@ PlaylistManager::PlaylistManager(QObject* parent)
 
 int PlaylistManager::rowCount(const QModelIndex& parent) const {
     Q_UNUSED(parent)
-    return static_cast<int>(tracks_.size());
+    return tracks_.size();
 }
 
 QVariant PlaylistManager::data(const QModelIndex& index, int role) const {
-    if (!index.isValid() || index.row() >= static_cast<int>(tracks_.size())) {
+    const int row = index.row();
+    if (!index.isValid() || row >= tracks_.size()) {
         return QVariant();
     }
 
-    const auto& track = tracks_[index.row()];
-    
     switch (role) {
     case TitleRole:
-        return track->title();
+        return tracks_.title(row);
     case FilePathRole:
-        return track->filePath();
+        return tracks_.filePath(row);
     case FileNameRole:
-        return track->fileName();
+        return tracks_.fileName(row);
     case ExtensionRole:
-        return track->extension();
+        return tracks_.extension(row);
     case DurationRole:
-        return track->duration();
+        return tracks_.duration(row);
     case IsCurrentRole:
-        return index.row() == currentIndex_;
+        return row == currentIndex_;
+    case LoudnessRole:
+        return tracks_.hasLoudness(row) ? QVariant(tracks_.loudness(row)) : QVariant();
+    case LoudnessRangeRole:
+        return tracks_.hasLoudness(row) ? QVariant(tracks_.loudnessRange(row)) : QVariant();
+    case TruePeakRole:
+        return tracks_.hasLoudness(row) ? QVariant(tracks_.truePeak(row)) : QVariant();
+    case ArtistRole:
+        return tracks_.artist(row);
+    case AlbumRole:
+        return tracks_.album(row);
+    case AlbumArtistRole:
+        return tracks_.albumArtist(row);
+    case GenreRole:
+        return tracks_.genre(row);
+    case YearRole:
+        return tracks_.year(row);
+    case TrackNumberRole:
+        return tracks_.trackNumber(row);
+    case DiscNumberRole:
+        return tracks_.discNumber(row);
     default:
         return QVariant();
     }
@@ -45,112 +98,251 @@ QHash<int, QByteArray> PlaylistManager::roleNames() const {
     roles[ExtensionRole] = "extension";
     roles[DurationRole] = "duration";
     roles[IsCurrentRole] = "isCurrent";
+    roles[LoudnessRole] = "loudness";
+    roles[LoudnessRangeRole] = "loudnessRange";
+    roles[TruePeakRole] = "truePeak";
+    roles[ArtistRole] = "artist";
+    roles[AlbumRole] = "album";
+    roles[AlbumArtistRole] = "albumArtist";
+    roles[GenreRole] = "genre";
+    roles[YearRole] = "year";
+    roles[TrackNumberRole] = "trackNumber";
+    roles[DiscNumberRole] = "discNumber";
     return roles;
 }
 
 void PlaylistManager::addTrack(const QString& filePath) {
-    if (!AudioDecoder::isFormatSupported(QFileInfo(filePath).suffix().toLower())) {
-        qDebug() << "Unsupported format:" << filePath;
+    insertTracks(tracks_.size(), QStringList() << filePath);
+}
+
+void PlaylistManager::addTracks(const QStringList& filePaths) {
+    insertTracks(tracks_.size(), filePaths);
+}
+
+void PlaylistManager::insertTracks(int row, const QStringList& filePaths) {
+    row = std::max(0, std::min(row, tracks_.size()));
+    std::vector<TrackEntry> created;
+    created.reserve(filePaths.size());
+    for (const QString& filePath : filePaths) {
+        if (PlaylistFile::formatOf(filePath) != PlaylistFile::None) {
+            insertEntries(row, created);
+            row += static_cast<int>(created.size());
+            created.clear();
+            row += insertPlaylist(row, filePath);
+            continue;
+        }
+        // Tags give most lengths; the rest are filled in by the loudness
+        // pass rather than decoding every file here.
+        std::vector<TrackEntry> entries = createTracks(filePath, false);
+        created.insert(created.end(), std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+    }
+    insertEntries(row, created);
+}
+
+int PlaylistManager::insertPlaylist(int row, const QString& filePath) {
+    PlaylistFile playlist(filePath);
+    if (!playlist.isOpen()) {
+        return 0;
+    }
+
+    row = std::max(0, std::min(row, tracks_.size()));
+    int added = 0;
+    std::vector<TrackEntry> batch;
+    std::vector<TrackEntry> entries;
+    while (playlist.read(batch, kPlaylistBatchSize)) {
+        // CUE sheets listed in the playlist are expanded like added ones.
+        for (TrackEntry& entry : batch) {
+            if (entry.filePath.endsWith(".cue", Qt::CaseInsensitive)) {
+                std::vector<TrackEntry> expanded = createTracks(entry.filePath, false);
+                entries.insert(entries.end(), std::make_move_iterator(expanded.begin()),
+                               std::make_move_iterator(expanded.end()));
+            } else {
+                entries.push_back(std::move(entry));
+            }
+        }
+        insertEntries(row + added, entries);
+        added += static_cast<int>(entries.size());
+        batch.clear();
+        entries.clear();
+    }
+
+    qDebug() << "Playlist" << filePath << "added" << added << "tracks";
+    return added;
+}
+
+bool PlaylistManager::savePlaylist(const QString& filePath) const {
+    return PlaylistFile::write(filePath, tracks_);
+}
+
+void PlaylistManager::insertEntries(int row, const std::vector<TrackEntry>& entries) {
+    if (entries.empty()) {
         return;
     }
 
-    beginInsertRows(QModelIndex(), static_cast<int>(tracks_.size()), static_cast<int>(tracks_.size()));
-    
-    auto track = std::make_unique<Track>(filePath, this);
-    tracks_.push_back(std::move(track));
-    
+    bool wasEmpty = tracks_.isEmpty();
+    row = std::max(0, std::min(row, tracks_.size()));
+    int last = row + static_cast<int>(entries.size()) - 1;
+
+    beginInsertRows(QModelIndex(), row, last);
+    tracks_.insert(row, entries);
+    for (int index = row; index <= last; ++index) {
+        indexTrack(index);
+    }
+    if (currentIndex_ >= row) {
+        currentIndex_ += static_cast<int>(entries.size());
+    }
     endInsertRows();
 
-    emit trackAdded(static_cast<int>(tracks_.size()) - 1);
+    emit tracksAdded(row, last);
     emit trackCountChanged();
 
-    // Set first track as current if playlist was empty (only for single track add)
-    if (tracks_.size() == 1 && currentIndex_ == -1) {
-        qDebug() << "Setting first track as current";
+    // Set current index only once after all tracks are added
+    if (wasEmpty && currentIndex_ == -1) {
+        qDebug() << "Setting current index to 0 after adding tracks to empty playlist";
         setCurrentIndex(0);
     }
 
-    qDebug() << "Track added:" << filePath;
-    
+    qDebug() << "Added" << entries.size() << "tracks at row" << row
+             << "Current index:" << currentIndex_ << "Track count:" << tracks_.size();
+
     // Emit currentIndexChanged to update hasNext/hasPrevious properties
     emit currentIndexChanged();
 }
 
-void PlaylistManager::addTracks(const QStringList& filePaths) {
-    bool wasEmpty = tracks_.empty();
-    int originalCurrentIndex = currentIndex_;
-    
-    // Temporarily disable currentIndex setting during batch add
-    bool wasCurrentIndexSet = false;
-    
-    for (const QString& filePath : filePaths) {
-        if (!AudioDecoder::isFormatSupported(QFileInfo(filePath).suffix().toLower())) {
-            qDebug() << "Unsupported format:" << filePath;
-            continue;
-        }
+std::vector<TrackEntry> PlaylistManager::createTracks(const QString& filePath, bool probeDuration) {
+    std::vector<TrackEntry> created;
+    QString suffix = QFileInfo(filePath).suffix().toLower();
+    TagReader tags;
 
-        beginInsertRows(QModelIndex(), static_cast<int>(tracks_.size()), static_cast<int>(tracks_.size()));
-        
-        auto track = std::make_unique<Track>(filePath, this);
-        tracks_.push_back(std::move(track));
-        
-        endInsertRows();
+    if (suffix == "cue") {
+        QString cuePath = filePath.startsWith("file://") ? QUrl(filePath).toLocalFile() : filePath;
+        QList<CueEntry> entries;
+        if (!CueSheet::parse(cuePath, entries)) {
+            return created;
+        }
 
-        emit trackAdded(static_cast<int>(tracks_.size()) - 1);
-        emit trackCountChanged();
+        // Read each referenced image once; its tracks split that duration
+        // and share its album tags. The spans need the length, so it is
+        // probed when the headers do not give it.
+        QString imagePath;
+        TrackEntry image;
+        for (const CueEntry& entry : entries) {
+            if (entry.filePath != imagePath) {
+                imagePath = entry.filePath;
+                image = TrackEntry();
+                image.duration = -1.0;
+                bool usable = AudioDecoder::isFormatSupported(QFileInfo(imagePath).suffix().toLower())
+                    && tags.read(imagePath);
+                if (usable) {
+                    tags.fill(image);
+                    image.duration = tags.duration() > 0.0 ? tags.duration() : AudioDecoder::getAudioDuration(imagePath);
+                } else {
+                    qDebug() << "CUE sheet references missing or unsupported file:" << imagePath;
+                }
+            }
+
+            double fileDuration = image.duration;
+            if (fileDuration < 0.0 || entry.start >= fileDuration) {
+                continue;
+            }
+            double end = entry.end > 0.0 ? std::min(entry.end, fileDuration) : fileDuration;
+            TrackEntry track = image;
+            track.filePath = entry.filePath;
+            track.title = entry.title;
+            if (!entry.performer.isEmpty()) {
+                track.artist = entry.performer;
+            }
+            track.trackNumber = entry.number;
+            track.startTime = entry.start;
+            track.endTime = entry.end > 0.0 ? end : 0.0;
+            track.duration = end - entry.start;
+            track.isVirtual = true;
+            track.cueSheet = cuePath;
+            created.push_back(track);
+        }
+        qDebug() << "CUE sheet" << cuePath << "expanded to" << created.size() << "tracks";
+        return created;
+    }
 
-        qDebug() << "Track added:" << filePath;
+    if (!AudioDecoder::isFormatSupported(suffix)) {
+        qDebug() << "Unsupported format:" << filePath;
+        return created;
     }
-    
-    // Set current index only once after all tracks are added
-    if (wasEmpty && !tracks_.empty() && originalCurrentIndex == -1) {
-        qDebug() << "Setting current index to 0 after adding all tracks to empty playlist";
-        setCurrentIndex(0);
+    TrackEntry track;
+    track.filePath = filePath.startsWith("file://") ? QUrl(filePath).toLocalFile() : filePath;
+    if (tags.read(track.filePath)) {
+        tags.fill(track);
+        track.duration = tags.duration();
     }
-    
-    qDebug() << "Added" << filePaths.size() << "tracks. Current index:" << currentIndex_ << "Track count:" << tracks_.size();
-    
-    // Emit currentIndexChanged to update hasNext/hasPrevious properties
-    emit currentIndexChanged();
+    if (track.duration <= 0.0 && probeDuration) {
+        track.duration = AudioDecoder::getAudioDuration(track.filePath);
+    }
+    created.push_back(track);
+    return created;
 }
 
 void PlaylistManager::removeTrack(int index) {
-    if (index < 0 || index >= static_cast<int>(tracks_.size())) {
+    removeTracks(QList<int>() << index);
+}
+
+void PlaylistManager::removeTracks(const QList<int>& rows) {
+    std::vector<int> sorted = validRows(rows);
+    if (sorted.empty()) {
         return;
     }
 
-    beginRemoveRows(QModelIndex(), index, index);
-    
-    tracks_.erase(tracks_.begin() + index);
-    
-    endRemoveRows();
-
-    // Adjust current index if needed
-    if (index == currentIndex_) {
-        if (tracks_.empty()) {
-            currentIndex_ = -1;
-        } else if (currentIndex_ >= static_cast<int>(tracks_.size())) {
-            currentIndex_ = static_cast<int>(tracks_.size()) - 1;
+    int oldIndex = currentIndex_;
+    int removedBefore = static_cast<int>(std::lower_bound(sorted.begin(), sorted.end(), currentIndex_) - sorted.begin());
+    bool currentRemoved = std::binary_search(sorted.begin(), sorted.end(), currentIndex_);
+
+    // From the end, so the rows still to go keep their indexes.
+    auto end = sorted.rbegin();
+    while (end != sorted.rend()) {
+        int last = *end;
+        int first = last;
+        while (++end != sorted.rend() && *end == first - 1) {
+            --first;
         }
-        emit currentIndexChanged();
-    } else if (index < currentIndex_) {
-        currentIndex_--;
-        emit currentIndexChanged();
+
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int row = first; row <= last; ++row) {
+            releaseTrack(row);
+            searchIndex_.remove(tracks_.id(row));
+        }
+        tracks_.remove(first, last - first + 1);
+        endRemoveRows();
+
+        emit tracksRemoved(first, last);
     }
 
-    emit trackRemoved(index);
+    // A removed current track hands over to the one that took its place.
+    if (currentIndex_ >= 0) {
+        currentIndex_ = tracks_.isEmpty() ? -1 : std::min(currentIndex_ - removedBefore, tracks_.size() - 1);
+        if (currentRemoved && currentIndex_ >= 0) {
+            QModelIndex modelIndex = createIndex(currentIndex_, 0);
+            emit dataChanged(modelIndex, modelIndex, {IsCurrentRole});
+        }
+    }
+    if (currentIndex_ != oldIndex || currentRemoved) {
+        emit currentIndexChanged();
+    }
     emit trackCountChanged();
 
-    qDebug() << "Track removed at index:" << index;
+    qDebug() << "Removed" << sorted.size() << "tracks";
 }
 
 void PlaylistManager::clearPlaylist() {
-    if (tracks_.empty()) {
+    if (tracks_.isEmpty()) {
         return;
     }
 
     beginResetModel();
+    for (auto it = trackObjects_.constBegin(); it != trackObjects_.constEnd(); ++it) {
+        it.value()->deleteLater();
+    }
+    trackObjects_.clear();
     tracks_.clear();
+    searchIndex_.clear();
     currentIndex_ = -1;
     endResetModel();
 
@@ -161,33 +353,175 @@ void PlaylistManager::clearPlaylist() {
     qDebug() << "Playlist cleared";
 }
 
+void PlaylistManager::writeSession(QDataStream& out) const {
+    tracks_.write(out);
+    out << static_cast<qint32>(currentIndex_);
+}
+
+bool PlaylistManager::restoreSession(QDataStream& in) {
+    beginResetModel();
+    for (auto it = trackObjects_.constBegin(); it != trackObjects_.constEnd(); ++it) {
+        it.value()->deleteLater();
+    }
+    trackObjects_.clear();
+    searchIndex_.clear();
+
+    qint32 current = -1;
+    bool ok = tracks_.read(in);
+    if (ok) {
+        in >> current;
+        ok = in.status() == QDataStream::Ok;
+    }
+    if (!ok) {
+        tracks_.clear();
+    }
+    for (int row = 0; row < tracks_.size(); ++row) {
+        indexTrack(row);
+    }
+    currentIndex_ = current >= 0 && current < tracks_.size() ? current : (tracks_.isEmpty() ? -1 : 0);
+    endResetModel();
+
+    emit trackCountChanged();
+    emit currentIndexChanged();
+    qDebug() << "Restored" << tracks_.size() << "tracks, current index" << currentIndex_;
+    return ok;
+}
+
 void PlaylistManager::moveTrack(int fromIndex, int toIndex) {
-    if (fromIndex < 0 || fromIndex >= static_cast<int>(tracks_.size()) ||
-        toIndex < 0 || toIndex >= static_cast<int>(tracks_.size()) ||
+    if (fromIndex < 0 || fromIndex >= tracks_.size() ||
+        toIndex < 0 || toIndex >= tracks_.size() ||
         fromIndex == toIndex) {
         return;
     }
 
-    beginMoveRows(QModelIndex(), fromIndex, fromIndex, QModelIndex(), 
-                  toIndex > fromIndex ? toIndex + 1 : toIndex);
+    moveTracks(QList<int>() << fromIndex, toIndex > fromIndex ? toIndex + 1 : toIndex);
+}
+
+void PlaylistManager::moveTracks(const QList<int>& rows, int destination) {
+    std::vector<int> sorted = validRows(rows);
+    if (sorted.empty() || destination < 0 || destination > tracks_.size()) {
+        return;
+    }
+
+    // Contiguous runs as (first, count), split where the destination falls.
+    std::vector<std::pair<int, int>> ranges;
+    for (int row : sorted) {
+        if (!ranges.empty() && ranges.back().first + ranges.back().second == row && row != destination) {
+            ++ranges.back().second;
+        } else {
+            ranges.emplace_back(row, 1);
+        }
+    }
+
+    int oldIndex = currentIndex_;
+
+    // Runs above the destination go last first, each settling right above
+    // the one before; runs below go in order, each right below it. Either
+    // way the runs still to move keep their indexes.
+    int insertAt = destination;
+    for (auto it = ranges.rbegin(); it != ranges.rend(); ++it) {
+        if (it->first < destination) {
+            moveRange(it->first, it->second, insertAt);
+            insertAt -= it->second;
+        }
+    }
+    insertAt = destination;
+    for (const auto& range : ranges) {
+        if (range.first >= destination) {
+            moveRange(range.first, range.second, insertAt);
+            insertAt += range.second;
+        }
+    }
+
+    if (currentIndex_ != oldIndex) {
+        emit currentIndexChanged();
+    }
+
+    qDebug() << "Moved" << sorted.size() << "tracks to" << destination;
+}
+
+void PlaylistManager::sortBy(const QList<int>& roles, Qt::SortOrder order) {
+    std::vector<TrackSorter::Key> keys;
+    for (int role : roles) {
+        for (const auto& sortField : kSortFields) {
+            if (sortField.first == role) {
+                keys.push_back({sortField.second, order == Qt::DescendingOrder});
+            }
+        }
+    }
+    if (keys.empty()) {
+        return;
+    }
+
+    const std::vector<int> sorted = TrackSorter::order(tracks_, keys);
+    bool unchanged = true;
+    for (size_t row = 0; row < sorted.size() && unchanged; ++row) {
+        unchanged = sorted[row] == static_cast<int>(row);
+    }
+    if (unchanged) {
+        return;
+    }
+
+    // One layout change rather than a reset, so views move their delegates
+    // instead of making new ones. Persistent indexes and the current row
+    // follow their tracks by id.
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    const QModelIndexList before = persistentIndexList();
+    std::vector<quint32> beforeIds;
+    beforeIds.reserve(static_cast<size_t>(before.size()));
+    for (const QModelIndex& index : before) {
+        beforeIds.push_back(tracks_.id(index.row()));
+    }
+    const int oldIndex = currentIndex_;
+    const quint32 currentId = currentIndex_ >= 0 ? tracks_.id(currentIndex_) : 0;
+
+    tracks_.reorder(sorted);
+
+    QModelIndexList after;
+    after.reserve(before.size());
+    for (quint32 id : beforeIds) {
+        after << createIndex(tracks_.rowOf(id), 0);
+    }
+    changePersistentIndexList(before, after);
+    if (oldIndex >= 0) {
+        currentIndex_ = tracks_.rowOf(currentId);
+    }
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    if (currentIndex_ != oldIndex) {
+        emit currentIndexChanged();
+    }
+    qDebug() << "Sorted" << tracks_.size() << "tracks by" << keys.size() << "keys";
+}
 
-    auto track = std::move(tracks_[fromIndex]);
-    tracks_.erase(tracks_.begin() + fromIndex);
-    tracks_.insert(tracks_.begin() + toIndex, std::move(track));
+void PlaylistManager::moveRange(int first, int count, int destination) {
+    if (destination >= first && destination <= first + count) {
+        return;
+    }
 
-    // Update current index if affected
-    if (fromIndex == currentIndex_) {
-        currentIndex_ = toIndex;
-    } else if (fromIndex < currentIndex_ && toIndex >= currentIndex_) {
-        currentIndex_--;
-    } else if (fromIndex > currentIndex_ && toIndex <= currentIndex_) {
-        currentIndex_++;
+    beginMoveRows(QModelIndex(), first, first + count - 1, QModelIndex(), destination);
+
+    bool hasCurrent = currentIndex_ >= 0;
+    quint32 currentId = hasCurrent ? tracks_.id(currentIndex_) : 0;
+    tracks_.move(first, count, destination);
+    if (hasCurrent) {
+        currentIndex_ = tracks_.rowOf(currentId);
     }
 
     endMoveRows();
-    emit currentIndexChanged();
+}
 
-    qDebug() << "Track moved from" << fromIndex << "to" << toIndex;
+std::vector<int> PlaylistManager::validRows(const QList<int>& rows) const {
+    std::vector<int> sorted;
+    sorted.reserve(rows.size());
+    for (int row : rows) {
+        if (row >= 0 && row < tracks_.size()) {
+            sorted.push_back(row);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    return sorted;
 }
 
 bool PlaylistManager::next() {
@@ -210,7 +544,7 @@ bool PlaylistManager::previous() {
 }
 
 bool PlaylistManager::setCurrentIndex(int index) {
-    if (index < -1 || index >= static_cast<int>(tracks_.size())) {
+    if (index < -1 || index >= tracks_.size()) {
         return false;
     }
 
@@ -237,7 +571,7 @@ bool PlaylistManager::setCurrentIndex(int index) {
 }
 
 bool PlaylistManager::hasNext() const {
-    bool result = currentIndex_ >= 0 && currentIndex_ < static_cast<int>(tracks_.size()) - 1;
+    bool result = currentIndex_ >= 0 && currentIndex_ < tracks_.size() - 1;
     qDebug() << "hasNext() called - currentIndex_:" << currentIndex_ << "tracks_.size():" << tracks_.size() << "result:" << result;
     return result;
 }
@@ -246,14 +580,184 @@ bool PlaylistManager::hasPrevious() const {
     return currentIndex_ > 0;
 }
 
-Track* PlaylistManager::currentTrack() const {
-    if (currentIndex_ >= 0 && currentIndex_ < static_cast<int>(tracks_.size())) {
-        return tracks_[currentIndex_].get();
+QString PlaylistManager::currentFilePath() const {
+    return currentIndex_ >= 0 && currentIndex_ < tracks_.size() ? tracks_.filePath(currentIndex_) : QString();
+}
+
+Track* PlaylistManager::track(int index) {
+    if (index < 0 || index >= tracks_.size()) {
+        return nullptr;
+    }
+
+    Track*& track = trackObjects_[tracks_.id(index)];
+    if (!track) {
+        track = new Track(tracks_.entry(index), this);
+        if (tracks_.hasLoudness(index)) {
+            track->setLoudness(tracks_.loudness(index), tracks_.loudnessRange(index), tracks_.truePeak(index));
+        }
+        // Returned to QML, which would otherwise take ownership.
+        QQmlEngine::setObjectOwnership(track, QQmlEngine::CppOwnership);
     }
-    return nullptr;
+    return track;
 }
 
-QString PlaylistManager::currentFilePath() const {
-    Track* track = currentTrack();
-    return track ? track->filePath() : QString();
-}
\ No newline at end of file
+void PlaylistManager::releaseTrack(int index) {
+    if (Track* track = trackObjects_.take(tracks_.id(index))) {
+        track->deleteLater();
+    }
+}
+
+void PlaylistManager::indexTrack(int index) {
+    const QString filePath = tracks_.filePath(index);
+    searchIndex_.insert(tracks_.id(index), tracks_.title(index), tracks_.artist(index), tracks_.album(index),
+                        tracks_.albumArtist(index), filePath.left(filePath.lastIndexOf(QChar('/'))));
+}
+
+QStringList PlaylistManager::applyLibraryChanges(const LibraryChanges& changes) {
+    auto folderOf = [](const QString& path) {
+        return path.left(path.lastIndexOf(QChar('/')));
+    };
+
+    // Removals name files as they were before the batch's renames.
+    std::vector<int> removed = tracks_.rowsInFolders(changes.removedFolders, true);
+    QStringList folders;
+    for (const QString& file : changes.removedFiles) {
+        folders << folderOf(file);
+    }
+    folders.removeDuplicates();
+    for (int row : tracks_.rowsInFolders(folders, false)) {
+        if (changes.removedFiles.contains(tracks_.filePath(row))) {
+            removed.push_back(row);
+        }
+    }
+
+    // Folders that lost their events: files that are gone go, files not
+    // listed yet count as written.
+    QSet<QString> written = changes.writtenFiles;
+    for (const QString& folder : changes.staleFolders) {
+        QSet<QString> present;
+        const QStringList names = QDir(folder).entryList(QDir::Files);
+        for (const QString& name : names) {
+            QString suffix = QFileInfo(name).suffix().toLower();
+            if (suffix == "cue" || AudioDecoder::isFormatSupported(suffix)) {
+                present.insert(folder + '/' + name);
+            }
+        }
+        for (int row : tracks_.rowsInFolders(QStringList() << folder, false)) {
+            QString filePath = tracks_.filePath(row);
+            if (!present.remove(filePath) && !QFileInfo::exists(filePath)) {
+                removed.push_back(row);
+            }
+        }
+        for (const QString& filePath : present) {
+            written.insert(filePath);
+        }
+    }
+
+    QList<int> removedRows;
+    removedRows.reserve(static_cast<qsizetype>(removed.size()));
+    for (int row : removed) {
+        removedRows << row;
+    }
+    removeTracks(removedRows);
+
+    for (const LibraryChanges::Rename& rename : changes.renames) {
+        renamePath(rename.from, rename.to, rename.folder);
+    }
+
+    // Written files that are listed already changed in place; their tags
+    // are read again, and a duration the headers do not give is probed
+    // when the track is next loaded.
+    folders.clear();
+    for (const QString& file : written) {
+        folders << folderOf(file);
+    }
+    folders.removeDuplicates();
+    QHash<QString, std::vector<int>> listed;
+    for (int row : tracks_.rowsInFolders(folders, false)) {
+        listed[tracks_.filePath(row)].push_back(row);
+    }
+
+    QStringList paths = written.values();
+    std::sort(paths.begin(), paths.end());
+    QStringList changed;
+    std::vector<TrackEntry> added;
+    for (const QString& path : paths) {
+        auto it = listed.constFind(path);
+        if (it != listed.constEnd()) {
+            std::vector<TrackEntry> entries = createTracks(path, false);
+            for (int row : it.value()) {
+                if (!tracks_.isVirtual(row) && !entries.empty()) {
+                    setTrackTags(row, entries.front());
+                    setTrackDuration(row, entries.front().duration);
+                }
+            }
+            changed << path;
+        } else {
+            std::vector<TrackEntry> entries = createTracks(path, false);
+            added.insert(added.end(), std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+        }
+    }
+    insertEntries(tracks_.size(), added);
+    return changed;
+}
+
+void PlaylistManager::renamePath(const QString& from, const QString& to, bool folder) {
+    std::vector<int> rows = folder ? tracks_.rowsInFolders(QStringList() << from, true) : tracks_.rowsOf(from);
+    if (rows.empty()) {
+        return;
+    }
+
+    for (int row : rows) {
+        QString filePath = to + tracks_.filePath(row).mid(from.size());
+        tracks_.setFilePath(row, filePath);
+        indexTrack(row);
+        if (Track* track = trackObjects_.value(tracks_.id(row))) {
+            track->setFilePath(filePath);
+        }
+    }
+    emit dataChanged(createIndex(rows.front(), 0), createIndex(rows.back(), 0),
+                     {TitleRole, FilePathRole, FileNameRole, ExtensionRole});
+}
+
+void PlaylistManager::setTrackDuration(int index, double duration) {
+    if (index < 0 || index >= tracks_.size() || tracks_.duration(index) == duration) {
+        return;
+    }
+
+    tracks_.setDuration(index, duration);
+    if (Track* track = trackObjects_.value(tracks_.id(index))) {
+        track->setDuration(duration);
+    }
+    QModelIndex modelIndex = createIndex(index, 0);
+    emit dataChanged(modelIndex, modelIndex, {DurationRole});
+}
+
+void PlaylistManager::setTrackTags(int index, const TrackEntry& entry) {
+    if (index < 0 || index >= tracks_.size()) {
+        return;
+    }
+
+    tracks_.setTags(index, entry);
+    indexTrack(index);
+    if (Track* track = trackObjects_.value(tracks_.id(index))) {
+        track->setTags(tracks_.entry(index));
+    }
+    QModelIndex modelIndex = createIndex(index, 0);
+    emit dataChanged(modelIndex, modelIndex, {TitleRole, ArtistRole, AlbumRole, AlbumArtistRole, GenreRole,
+                                              YearRole, TrackNumberRole, DiscNumberRole});
+}
+
+std::vector<int> PlaylistManager::setTrackLoudness(const QString& filePath, double integratedLufs, double rangeLu,
+                                                   double truePeakDb) {
+    std::vector<int> rows = tracks_.rowsOf(filePath);
+    for (int row : rows) {
+        tracks_.setLoudness(row, integratedLufs, rangeLu, truePeakDb);
+        if (Track* track = trackObjects_.value(tracks_.id(row))) {
+            track->setLoudness(integratedLufs, rangeLu, truePeakDb);
+        }
+        QModelIndex modelIndex = createIndex(row, 0);
+        emit dataChanged(modelIndex, modelIndex, {LoudnessRole, LoudnessRangeRole, TruePeakRole});
+    }
+    return rows;
+}
@@ -4,9 +4,13 @@
 #include <QObject>
 #include <QStringList>
 #include <QAbstractListModel>
+#include <QHash>
 #include <vector>
-#include <memory>
 #include "track.h"
+#include "track_store.h"
+#include "library_watcher.h"
+#include "search_index.h"
+#include "track_sorter.h"
 
 class PlaylistManager : public QAbstractListModel {
     Q_OBJECT
@@ -14,6 +18,7 @@ class PlaylistManager : public QAbstractListModel {
     Q_PROPERTY(int trackCount READ trackCount NOTIFY trackCountChanged)
     Q_PROPERTY(bool hasNext READ hasNext NOTIFY currentIndexChanged)
     Q_PROPERTY(bool hasPrevious READ hasPrevious NOTIFY currentIndexChanged)
+    Q_PROPERTY(QString currentFilePath READ currentFilePath NOTIFY currentIndexChanged)
 
 public:
     enum PlaylistRoles {
@@ -22,8 +27,19 @@ public:
         FileNameRole,
         ExtensionRole,
         DurationRole,
-        IsCurrentRole
+        IsCurrentRole,
+        LoudnessRole,
+        LoudnessRangeRole,
+        TruePeakRole,
+        ArtistRole,
+        AlbumRole,
+        AlbumArtistRole,
+        GenreRole,
+        YearRole,
+        TrackNumberRole,
+        DiscNumberRole
     };
+    Q_ENUM(PlaylistRoles)
 
     explicit PlaylistManager(QObject* parent = nullptr);
 
@@ -39,6 +55,28 @@ public:
     Q_INVOKABLE void clearPlaylist();
     Q_INVOKABLE void moveTrack(int fromIndex, int toIndex);
 
+    // Batch edits. Each contiguous range gets one model signal, and the
+    // count and index notifications are sent once per call.
+    // Playlist files among the paths are read in batches and their
+    // entries inserted in their place, see insertPlaylist().
+    Q_INVOKABLE void insertTracks(int row, const QStringList& filePaths);
+    void insertEntries(int row, const std::vector<TrackEntry>& entries);
+    // Inserts the entries of an M3U/M3U8, PLS or XSPF file a batch at a
+    // time, taking their lengths and titles from the playlist rather than
+    // from the files. Returns the number of rows added.
+    int insertPlaylist(int row, const QString& filePath);
+    // Writes the playlist as M3U/M3U8, PLS or XSPF, by extension.
+    Q_INVOKABLE bool savePlaylist(const QString& filePath) const;
+    Q_INVOKABLE void removeTracks(const QList<int>& rows);
+    // Gathers the rows, in order, before destination, counted as before
+    // the move.
+    Q_INVOKABLE void moveTracks(const QList<int>& rows, int destination);
+    // Sorts by the first role, ties by the next and so on, keeping the
+    // order of rows that tie on all of them. Text compares by the locale,
+    // ignoring case and with numbers by value. Roles that cannot be sorted
+    // on are skipped.
+    Q_INVOKABLE void sortBy(const QList<int>& roles, Qt::SortOrder order = Qt::AscendingOrder);
+
     // Navigation
     Q_INVOKABLE bool next();
     Q_INVOKABLE bool previous();
@@ -46,25 +84,60 @@ public:
 
     // Properties
     int currentIndex() const { return currentIndex_; }
-    int trackCount() const { return static_cast<int>(tracks_.size()); }
+    int trackCount() const { return tracks_.size(); }
     bool hasNext() const;
     bool hasPrevious() const;
 
-    // Current track access
-    Track* currentTrack() const;
+    // The rows themselves; data() and the player read straight from here.
+    const TrackStore& tracks() const { return tracks_; }
+    // Kept in step with the rows, by id; searched from worker threads.
+    const SearchIndex& searchIndex() const { return searchIndex_; }
     QString currentFilePath() const;
+    // QObject for one row, made on first request for bindings that need
+    // one and kept up to date until the row is removed.
+    Q_INVOKABLE Track* track(int index);
+
+    // One track for an audio file, one per TRACK for a CUE sheet, with the
+    // tags filled in. Without probeDuration the duration is only what the
+    // headers tell, and 0 otherwise until the track is loaded. Safe to call
+    // from any thread.
+    static std::vector<TrackEntry> createTracks(const QString& filePath, bool probeDuration = true);
+
+    // Brings the rows in line with changes on disk. New files are appended,
+    // renamed ones keep their place. Returns the files that were already
+    // listed and have been rewritten.
+    QStringList applyLibraryChanges(const LibraryChanges& changes);
+
+    // The rows and current index for the session snapshot. restoreSession
+    // replaces the playlist in one reset without touching the files, and
+    // leaves it empty if the data is damaged.
+    void writeSession(QDataStream& out) const;
+    bool restoreSession(QDataStream& in);
+
+    void setTrackDuration(int index, double duration);
+    void setTrackTags(int index, const TrackEntry& entry);
+    // Stores analysis results on every entry of the given file and returns
+    // those rows.
+    std::vector<int> setTrackLoudness(const QString& filePath, double integratedLufs, double rangeLu, double truePeakDb);
 
 signals:
     void currentIndexChanged();
     void trackCountChanged();
-    void trackAdded(int index);
-    void trackRemoved(int index);
+    void tracksAdded(int first, int last);
+    void tracksRemoved(int first, int last);
     void playlistCleared();
 
 private:
     void updateCurrentTrack();
+    void releaseTrack(int index);
+    void indexTrack(int index);
+    void moveRange(int first, int count, int destination);
+    void renamePath(const QString& from, const QString& to, bool folder);
+    std::vector<int> validRows(const QList<int>& rows) const;
 
-    std::vector<std::unique_ptr<Track>> tracks_;
+    TrackStore tracks_;
+    SearchIndex searchIndex_;
+    QHash<quint32, Track*> trackObjects_;
     int currentIndex_;
 };
 
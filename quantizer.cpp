@@ -0,0 +1,204 @@
+#include "quantizer.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QUANTIZER_SSE2 1
+#endif
+
+namespace {
+
+// Wannamaker's 9-tap "improved E-weighted" error filter, designed for
+// 44.1 kHz and close enough at 48 kHz.
+const float kEWeighted[] = { 2.412f, -3.370f, 3.937f, -4.174f, 3.353f, -2.205f, 1.281f, -0.569f, 0.0847f };
+
+// Second-order high-pass noise transfer (1 - z^-1)^2 for high sample rates,
+// where everything above 20 kHz is free real estate.
+const float kSecondOrder[] = { 2.0f, -1.0f };
+
+// Bounds the fed-back error so a clipped sample can't destabilise the loop.
+const float kErrorLimit = 2.0f;
+
+} // namespace
+
+Quantizer::Quantizer()
+    : mode_(static_cast<int>(DitherMode::Tpdf))
+    , channels_(0)
+    , bits_(16)
+    , scale_(32768.0f)
+    , minValue_(-32768)
+    , maxValue_(32767)
+    , taps_(0)
+    , errorPos_(0) {
+    std::memset(coeffs_, 0, sizeof(coeffs_));
+    std::memset(errors_, 0, sizeof(errors_));
+    rng_[0] = 0x9e3779b9u;
+    rng_[1] = 0x85ebca6bu;
+    rng_[2] = 0xc2b2ae35u;
+    rng_[3] = 0x27d4eb2fu;
+}
+
+void Quantizer::prepare(double sampleRate, int channels, int bits) {
+    channels_ = std::max(1, std::min(channels, kMaxChannels));
+    bits_ = bits == 24 ? 24 : 16;
+    scale_ = bits_ == 24 ? 8388608.0f : 32768.0f;
+    maxValue_ = bits_ == 24 ? 8388607 : 32767;
+    minValue_ = -maxValue_ - 1;
+
+    const float* coeffs = sampleRate <= 50000.0 ? kEWeighted : kSecondOrder;
+    taps_ = sampleRate <= 50000.0 ? 9 : 2;
+    std::memset(coeffs_, 0, sizeof(coeffs_));
+    std::memcpy(coeffs_, coeffs, taps_ * sizeof(float));
+    std::memset(errors_, 0, sizeof(errors_));
+    errorPos_ = 0;
+}
+
+void Quantizer::process(const float* input, void* output, size_t frames) {
+    const DitherMode mode = this->mode();
+    const size_t channels = static_cast<size_t>(channels_);
+
+    while (frames > 0) {
+        size_t count = std::min(frames, kChunk);
+        size_t samples = count * channels;
+
+        if (mode == DitherMode::NoiseShaped) {
+            quantizeShaped(input, quantized_, count);
+        } else {
+            quantizePlain(input, quantized_, samples, mode == DitherMode::Tpdf);
+        }
+
+        if (bits_ == 16) {
+            int16_t* out = static_cast<int16_t*>(output);
+            for (size_t i = 0; i < samples; ++i) {
+                out[i] = static_cast<int16_t>(quantized_[i]);
+            }
+            output = out + samples;
+        } else {
+            uint8_t* out = static_cast<uint8_t*>(output);
+            for (size_t i = 0; i < samples; ++i, out += 3) {
+                uint32_t value = static_cast<uint32_t>(quantized_[i]);
+                out[0] = static_cast<uint8_t>(value);
+                out[1] = static_cast<uint8_t>(value >> 8);
+                out[2] = static_cast<uint8_t>(value >> 16);
+            }
+            output = out;
+        }
+
+        input += samples;
+        frames -= count;
+    }
+}
+
+void Quantizer::fillNoise(float* noise, size_t count) {
+    // TPDF noise spanning +-1 LSB: the difference of the two 16-bit halves
+    // of each xorshift32 output.
+    const float scale = 1.0f / 65536.0f;
+    size_t i = 0;
+#ifdef QUANTIZER_SSE2
+    __m128i state = _mm_load_si128(reinterpret_cast<const __m128i*>(rng_));
+    const __m128i lowMask = _mm_set1_epi32(0xffff);
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i < count; i += 4) {
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+        state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+        state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+        __m128i diff = _mm_sub_epi32(_mm_and_si128(state, lowMask), _mm_srli_epi32(state, 16));
+        _mm_store_ps(noise + i, _mm_mul_ps(_mm_cvtepi32_ps(diff), vscale));
+    }
+    _mm_store_si128(reinterpret_cast<__m128i*>(rng_), state);
+#else
+    for (; i < count; i += 4) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint32_t x = rng_[lane];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            rng_[lane] = x;
+            noise[i + lane] = (static_cast<int32_t>(x & 0xffff) - static_cast<int32_t>(x >> 16)) * scale;
+        }
+    }
+#endif
+}
+
+void Quantizer::quantizePlain(const float* input, int32_t* output, size_t samples, bool dither) {
+    if (dither) {
+        fillNoise(noise_, samples);
+    }
+
+    const float minValue = static_cast<float>(minValue_);
+    const float maxValue = static_cast<float>(maxValue_);
+    size_t i = 0;
+#ifdef QUANTIZER_SSE2
+    const __m128 vscale = _mm_set1_ps(scale_);
+    const __m128 vmin = _mm_set1_ps(minValue);
+    const __m128 vmax = _mm_set1_ps(maxValue);
+    for (; i + 4 <= samples; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(input + i), vscale);
+        if (dither) {
+            x = _mm_add_ps(x, _mm_load_ps(noise_ + i));
+        }
+        x = _mm_max_ps(vmin, _mm_min_ps(vmax, x));
+        _mm_store_si128(reinterpret_cast<__m128i*>(output + i), _mm_cvtps_epi32(x));
+    }
+#endif
+    for (; i < samples; ++i) {
+        float x = input[i] * scale_ + (dither ? noise_[i] : 0.0f);
+        x = std::max(minValue, std::min(maxValue, x));
+        output[i] = static_cast<int32_t>(x < 0.0f ? x - 0.5f : x + 0.5f);
+    }
+}
+
+void Quantizer::quantizeShaped(const float* input, int32_t* output, size_t frames) {
+    // Error feedback with the channels of a frame side by side in SIMD
+    // lanes: v = x - h * e, q = round(v + d), e = q - v.
+    const int channels = channels_;
+    const int groups = (channels + 3) / 4;
+    const int taps = taps_;
+    const float minValue = static_cast<float>(minValue_);
+    const float maxValue = static_cast<float>(maxValue_);
+
+    fillNoise(noise_, frames * groups * 4);
+
+    for (size_t f = 0; f < frames; ++f) {
+        const float* frame = input + f * channels;
+        int32_t* out = output + f * channels;
+        int newest = errorPos_ == 0 ? taps - 1 : errorPos_ - 1;
+
+        for (int g = 0; g < groups; ++g) {
+            const int lanes = std::min(4, channels - g * 4);
+            alignas(16) float x[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            alignas(16) int32_t q[4];
+            std::memcpy(x, frame + g * 4, lanes * sizeof(float));
+            const float* noise = noise_ + (f * groups + g) * 4;
+
+#ifdef QUANTIZER_SSE2
+            __m128 feedback = _mm_setzero_ps();
+            for (int k = 0, idx = errorPos_; k < taps; ++k, idx = idx + 1 == taps ? 0 : idx + 1) {
+                feedback = _mm_add_ps(feedback, _mm_mul_ps(_mm_set1_ps(coeffs_[k]), _mm_load_ps(&errors_[idx][g * 4])));
+            }
+            __m128 v = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(x), _mm_set1_ps(scale_)), feedback);
+            __m128 target = _mm_max_ps(_mm_set1_ps(minValue), _mm_min_ps(_mm_set1_ps(maxValue), _mm_add_ps(v, _mm_load_ps(noise))));
+            __m128i rounded = _mm_cvtps_epi32(target);
+            __m128 error = _mm_sub_ps(_mm_cvtepi32_ps(rounded), v);
+            error = _mm_max_ps(_mm_set1_ps(-kErrorLimit), _mm_min_ps(_mm_set1_ps(kErrorLimit), error));
+            _mm_store_ps(&errors_[newest][g * 4], error);
+            _mm_store_si128(reinterpret_cast<__m128i*>(q), rounded);
+#else
+            for (int lane = 0; lane < 4; ++lane) {
+                const int ch = g * 4 + lane;
+                float feedback = 0.0f;
+                for (int k = 0, idx = errorPos_; k < taps; ++k, idx = idx + 1 == taps ? 0 : idx + 1) {
+                    feedback += coeffs_[k] * errors_[idx][ch];
+                }
+                float v = x[lane] * scale_ - feedback;
+                float target = std::max(minValue, std::min(maxValue, v + noise[lane]));
+                q[lane] = static_cast<int32_t>(target < 0.0f ? target - 0.5f : target + 0.5f);
+                errors_[newest][ch] = std::max(-kErrorLimit, std::min(kErrorLimit, q[lane] - v));
+            }
+#endif
+            std::memcpy(out + g * 4, q, lanes * sizeof(int32_t));
+        }
+        errorPos_ = newest;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class DitherMode {
+    Off,
+    Tpdf,
+    NoiseShaped
+};
+
+// Converts the float pipeline to the device's integer format. TPDF dither
+// decorrelates the rounding error from the signal so quiet passages and
+// volume changes don't pick up truncation distortion; the noise-shaped mode
+// additionally feeds the error back through a filter that moves it to where
+// the ear is least sensitive. Random numbers come from four xorshift
+// generators running in parallel SSE2 lanes.
+class Quantizer {
+public:
+    static constexpr int kMaxChannels = 8;
+
+    Quantizer();
+
+    // Call while the stream is closed. bits is 16 or 24.
+    void prepare(double sampleRate, int channels, int bits);
+
+    // GUI thread.
+    void setMode(DitherMode mode) { mode_.store(static_cast<int>(mode), std::memory_order_relaxed); }
+    DitherMode mode() const { return static_cast<DitherMode>(mode_.load(std::memory_order_relaxed)); }
+
+    // Audio thread. output receives int16 or packed little-endian int24
+    // samples depending on the prepared bit depth.
+    void process(const float* input, void* output, size_t frames);
+
+private:
+    static constexpr int kMaxTaps = 9;
+    static constexpr size_t kChunk = 256;
+
+    void quantizePlain(const float* input, int32_t* output, size_t samples, bool dither);
+    void quantizeShaped(const float* input, int32_t* output, size_t frames);
+    void fillNoise(float* noise, size_t count);
+
+    std::atomic<int> mode_;
+
+    // Audio thread only.
+    int channels_;
+    int bits_;
+    float scale_;
+    int32_t minValue_;
+    int32_t maxValue_;
+    int taps_;
+    float coeffs_[kMaxTaps];
+    alignas(16) float errors_[kMaxTaps][kMaxChannels];
+    int errorPos_;
+    alignas(16) uint32_t rng_[4];
+    alignas(16) float noise_[kChunk * kMaxChannels];
+    alignas(16) int32_t quantized_[kChunk * kMaxChannels];
+};
+
+#endif // QUANTIZER_H
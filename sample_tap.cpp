@@ -0,0 +1,73 @@
+#include "sample_tap.h"
+#include <algorithm>
+#include <cstring>
+
+SampleTap::SampleTap()
+    : ring_(new float[kCapacity]())
+    , position_(0)
+    , sampleRate_(44100.0)
+    , enabled_(false)
+    , channels_(2) {
+}
+
+void SampleTap::prepare(double sampleRate, int channels) {
+    sampleRate_.store(sampleRate, std::memory_order_relaxed);
+    channels_ = std::max(1, channels);
+}
+
+void SampleTap::write(const float* interleaved, size_t frames) {
+    append(interleaved, frames, 1.0f);
+}
+
+void SampleTap::write(const int16_t* interleaved, size_t frames) {
+    append(interleaved, frames, 1.0f / 32768.0f);
+}
+
+template <typename T>
+void SampleTap::append(const T* interleaved, size_t frames, float scale) {
+    const int channels = channels_;
+    const float gain = scale / channels;
+    size_t position = position_.load(std::memory_order_relaxed);
+
+    while (frames > 0) {
+        size_t offset = position & (kCapacity - 1);
+        size_t count = std::min(frames, kCapacity - offset);
+        float* out = ring_.get() + offset;
+
+        if (channels == 2) {
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = (static_cast<float>(interleaved[2 * i]) + static_cast<float>(interleaved[2 * i + 1])) * gain;
+            }
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                float sum = 0.0f;
+                for (int ch = 0; ch < channels; ++ch) {
+                    sum += static_cast<float>(interleaved[i * channels + ch]);
+                }
+                out[i] = sum * gain;
+            }
+        }
+
+        interleaved += count * channels;
+        position += count;
+        frames -= count;
+    }
+
+    position_.store(position, std::memory_order_release);
+}
+
+bool SampleTap::read(size_t end, float* output, size_t count) const {
+    if (count > kCapacity || end < count || end > position()) {
+        return false;
+    }
+
+    size_t start = end - count;
+    size_t offset = start & (kCapacity - 1);
+    size_t first = std::min(count, kCapacity - offset);
+    memcpy(output, ring_.get() + offset, first * sizeof(float));
+    memcpy(output + first, ring_.get(), (count - first) * sizeof(float));
+
+    // The copy is only good if the writer has not wrapped onto it meanwhile.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return position() - start <= kCapacity;
+}
@@ -0,0 +1,50 @@
+#ifndef SAMPLE_TAP_H
+#define SAMPLE_TAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Single-producer ring of the mono sum of the output, written by the audio
+// callback and read by analysis threads. The writer never blocks or
+// allocates; a reader copies a window behind position() and detects, after
+// the fact, whether the writer lapped it during the copy.
+class SampleTap {
+public:
+    static constexpr size_t kCapacity = 32768;
+
+    SampleTap();
+
+    // Call while the stream is closed.
+    void prepare(double sampleRate, int channels);
+
+    // Readers switch the tap on; a disabled tap costs the callback one load.
+    void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Audio thread.
+    void write(const float* interleaved, size_t frames);
+    void write(const int16_t* interleaved, size_t frames);
+
+    // Any thread. position() counts frames written since construction.
+    double sampleRate() const { return sampleRate_.load(std::memory_order_relaxed); }
+    size_t position() const { return position_.load(std::memory_order_acquire); }
+    // Copies the frames [end - count, end). Returns false if they are no
+    // longer, or not yet, in the ring.
+    bool read(size_t end, float* output, size_t count) const;
+
+private:
+    template <typename T>
+    void append(const T* interleaved, size_t frames, float scale);
+
+    std::unique_ptr<float[]> ring_;
+    std::atomic<size_t> position_;
+    std::atomic<double> sampleRate_;
+    std::atomic<bool> enabled_;
+
+    // Audio thread only.
+    int channels_;
+};
+
+#endif // SAMPLE_TAP_H
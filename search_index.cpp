@@ -0,0 +1,558 @@
+#include "search_index.h"
+#include <QtAlgorithms>
+#include <algorithm>
+#include <mutex>
+
+namespace {
+
+const size_t kMaxTitleLength = 0xffff;
+// Below this many stale documents the postings are left as they are.
+const size_t kMinStaleForCompaction = 65536;
+// Bitmap words or posting lists gone through between looks at the
+// generation.
+const size_t kCancelCheckInterval = 1024;
+// Checking one document against a word costs about as much as setting
+// this many bits from posting lists.
+const size_t kCheckCost = 8;
+
+void setBit(std::vector<quint64>& bits, size_t slot) {
+    bits[slot >> 6] |= quint64(1) << (slot & 63);
+}
+
+size_t countBits(const std::vector<quint64>& bits) {
+    size_t count = 0;
+    for (quint64 word : bits) {
+        count += qPopulationCount(word);
+    }
+    return count;
+}
+
+} // namespace
+
+SearchIndex::SearchIndex()
+    : liveCount_(0)
+    , staleCount_(0)
+    , values_(1)
+    , valueRows_(1) {
+}
+
+void SearchIndex::insert(quint32 id, const QString& title, const QString& artist, const QString& album,
+                         const QString& albumArtist, const QString& folder) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    quint32 slot;
+    auto it = slots_.find(id);
+    if (it != slots_.end()) {
+        slot = it->second;
+        --liveCount_;
+        ++staleCount_;
+        setBit(reindexed_, slot);
+    } else if (!freeSlots_.empty()) {
+        // Marked reindexed when it was freed, so what the postings still
+        // hold for it is checked.
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        slots_.emplace(id, slot);
+    } else {
+        slot = static_cast<quint32>(documents_.size());
+        documents_.push_back(Document{ id, 0, 0, { 0, 0, 0, 0 }, 0 });
+        live_.resize((documents_.size() + 63) / 64, 0);
+        reindexed_.resize(live_.size(), 0);
+        slots_.emplace(id, slot);
+    }
+
+    Document& document = documents_[slot];
+    document.id = id;
+
+    const Text folded = fold(title);
+    const size_t length = std::min(folded.size(), kMaxTitleLength);
+    document.textStart = static_cast<quint32>(text_.size());
+    document.textLength = static_cast<quint16>(length);
+    text_.insert(text_.end(), folded.begin(), folded.begin() + static_cast<std::ptrdiff_t>(length));
+    document.letters = 0;
+    for (size_t i = 0; i < length; ++i) {
+        document.letters |= letterBit(folded[i]);
+    }
+
+    const QString* fields[4] = { &artist, &album, &albumArtist, &folder };
+    for (int i = 0; i < 4; ++i) {
+        document.values[i] = internValue(*fields[i]);
+        if (document.values[i] != 0) {
+            addSorted(valueRows_[document.values[i]], slot);
+        }
+    }
+    setBit(live_, slot);
+    ++liveCount_;
+
+    titlePostings_.add(text_.data() + document.textStart, document.textLength, slot);
+    compactIfWasteful();
+}
+
+void SearchIndex::remove(quint32 id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = slots_.find(id);
+    if (it != slots_.end()) {
+        const quint32 slot = it->second;
+        slots_.erase(it);
+        freeSlots_.push_back(slot);
+        live_[slot >> 6] &= ~(quint64(1) << (slot & 63));
+        setBit(reindexed_, slot);
+        --liveCount_;
+        ++staleCount_;
+        compactIfWasteful();
+    }
+}
+
+void SearchIndex::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    documents_.clear();
+    slots_.clear();
+    freeSlots_.clear();
+    text_.clear();
+    live_.clear();
+    reindexed_.clear();
+    liveCount_ = 0;
+    staleCount_ = 0;
+    titlePostings_.clear();
+    values_.resize(1);
+    valueIds_.clear();
+    valuePostings_.clear();
+    valueRows_.resize(1);
+}
+
+bool SearchIndex::search(const QString& query, const std::atomic<unsigned>& generation, unsigned wanted,
+                         std::vector<quint32>& matches) const {
+    auto cancelled = [&generation, wanted]() {
+        return generation.load(std::memory_order_relaxed) != wanted;
+    };
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    // The ids of the slots set in bits.
+    auto idsOf = [this, &matches](const std::vector<quint64>& bits) {
+        matches.clear();
+        for (size_t i = 0; i < bits.size(); ++i) {
+            for (quint64 word = bits[i]; word != 0; word &= word - 1) {
+                matches.push_back(documents_[i * 64 + qCountTrailingZeroBits(word)].id);
+            }
+        }
+        std::sort(matches.begin(), matches.end());
+    };
+
+    const Text folded = fold(query);
+    std::vector<Term> terms;
+    for (size_t start = 0; start < folded.size();) {
+        size_t end = std::min(folded.find(u' ', start), folded.size());
+        terms.push_back(term(folded.substr(start, end - start)));
+        start = end + 1;
+    }
+    if (terms.empty()) {
+        idsOf(live_);
+        return !cancelled();
+    }
+
+    // The cheapest word is looked up. Each of the others is looked up too
+    // while that costs less than checking what is left against it.
+    std::sort(terms.begin(), terms.end(), [](const Term& a, const Term& b) { return a.cost < b.cost; });
+    std::vector<quint64> hits(live_.size(), 0);
+    if (!found(terms.front(), generation, wanted, hits)) {
+        return false;
+    }
+
+    std::vector<quint64> bits;
+    for (size_t t = 1; t < terms.size(); ++t) {
+        const Term& filter = terms[t];
+        const size_t left = countBits(hits);
+        if (left == 0 || cancelled()) {
+            break;
+        }
+
+        if (filter.cost < left * kCheckCost) {
+            bits.assign(live_.size(), 0);
+            if (!found(filter, generation, wanted, bits)) {
+                return false;
+            }
+            for (size_t i = 0; i < hits.size(); ++i) {
+                hits[i] &= bits[i];
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i < hits.size(); ++i) {
+            if (i % kCancelCheckInterval == 0 && cancelled()) {
+                return false;
+            }
+            for (quint64 word = hits[i]; word != 0; word &= word - 1) {
+                const size_t bit = qCountTrailingZeroBits(word);
+                if (!documentContains(documents_[i * 64 + bit], filter)) {
+                    hits[i] &= ~(quint64(1) << bit);
+                }
+            }
+        }
+    }
+
+    if (cancelled()) {
+        return false;
+    }
+    idsOf(hits);
+    return !cancelled();
+}
+
+SearchIndex::Text SearchIndex::fold(const QString& text) {
+    Text folded;
+    folded.reserve(static_cast<size_t>(text.size()));
+
+    // Most tags are plain ASCII and need no decomposition.
+    const bool ascii = std::all_of(text.begin(), text.end(), [](QChar c) { return c.unicode() < 0x80; });
+    const QString decomposed = ascii ? text : text.normalized(QString::NormalizationForm_KD);
+
+    bool space = true;
+    for (QChar c : decomposed) {
+        if (c.isSpace()) {
+            if (!space) {
+                folded.push_back(u' ');
+                space = true;
+            }
+            continue;
+        }
+        // Zero is what titles are padded with in the postings.
+        if (c.isNull()) {
+            continue;
+        }
+        if (ascii) {
+            char16_t u = c.unicode();
+            folded.push_back(u >= 'A' && u <= 'Z' ? static_cast<char16_t>(u + 32) : u);
+        } else if (!c.isMark()) {
+            folded.push_back(c.toCaseFolded().unicode());
+        } else {
+            continue;
+        }
+        space = false;
+    }
+    if (!folded.empty() && folded.back() == u' ') {
+        folded.pop_back();
+    }
+    return folded;
+}
+
+void SearchIndex::trigrams(const char16_t* text, size_t length, size_t padding, std::vector<quint64>& keys) {
+    auto at = [text, length](size_t i) { return i < length ? quint64(text[i]) : quint64(0); };
+    keys.clear();
+    for (size_t i = 0; i + 2 < length + padding; ++i) {
+        keys.push_back((at(i) << 32) | (at(i + 1) << 16) | at(i + 2));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+quint64 SearchIndex::prefixKey(quint64 trigram, size_t length) {
+    const quint64 mask = length == 1 ? quint64(0xffff) << 32 : quint64(0xffffffff) << 16;
+    return (trigram & mask) | (quint64(length) << 48);
+}
+
+quint64 SearchIndex::letterBit(char16_t c) {
+    if (c >= 'a' && c <= 'z') {
+        return quint64(1) << (c - 'a');
+    }
+    if (c >= '0' && c <= '9') {
+        return quint64(1) << (26 + c - '0');
+    }
+    return quint64(1) << (36 + c % 28);
+}
+
+bool SearchIndex::exact(const Text& word) {
+    return word.size() == 1 && ((word[0] >= 'a' && word[0] <= 'z') || (word[0] >= '0' && word[0] <= '9'));
+}
+
+bool SearchIndex::contains(const char16_t* text, size_t length, const Text& word) {
+    const size_t size = word.size();
+    if (size == 0) {
+        return true;
+    }
+    if (size > length) {
+        return false;
+    }
+    const char16_t first = word[0];
+    for (size_t i = 0, last = length - size; i <= last; ++i) {
+        if (text[i] == first && std::equal(word.begin() + 1, word.end(), text + i + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SearchIndex::addSorted(std::vector<quint32>& ids, quint32 id) {
+    // Slots are handed out in order and freed ones reused, so this is
+    // nearly always an append.
+    if (ids.empty() || ids.back() < id) {
+        ids.push_back(id);
+        return;
+    }
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (*it != id) {
+        ids.insert(it, id);
+    }
+}
+
+std::vector<quint32> SearchIndex::intersect(std::vector<const std::vector<quint32>*> lists) {
+    if (lists.empty()) {
+        return std::vector<quint32>();
+    }
+
+    // Shortest list first; the others are only searched for its ids.
+    std::sort(lists.begin(), lists.end(), [](const std::vector<quint32>* a, const std::vector<quint32>* b) {
+        return a->size() < b->size();
+    });
+    std::vector<quint32> result = *lists.front();
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+        const std::vector<quint32>& list = *lists[i];
+        auto from = list.begin();
+        size_t kept = 0;
+        for (quint32 id : result) {
+            from = std::lower_bound(from, list.end(), id);
+            if (from == list.end()) {
+                break;
+            }
+            if (*from == id) {
+                result[kept++] = id;
+            }
+        }
+        result.resize(kept);
+    }
+    return result;
+}
+
+quint32 SearchIndex::internValue(const QString& value) {
+    if (value.isEmpty()) {
+        return 0;
+    }
+    Text folded = fold(value);
+    if (folded.empty()) {
+        return 0;
+    }
+    auto it = valueIds_.find(folded);
+    if (it != valueIds_.end()) {
+        return it->second;
+    }
+
+    const quint32 id = static_cast<quint32>(values_.size());
+    valuePostings_.add(folded.data(), folded.size(), id);
+    valueIds_.emplace(folded, id);
+    values_.push_back(std::move(folded));
+    valueRows_.emplace_back();
+    return id;
+}
+
+SearchIndex::Term SearchIndex::term(Text word) const {
+    Term term;
+    term.letters = 0;
+    for (char16_t c : word) {
+        term.letters |= letterBit(c);
+    }
+    term.exact = exact(word);
+    term.cost = 0;
+    if (term.exact) {
+        // Every title's letter bits are gone through instead.
+        term.cost = documents_.size();
+    } else {
+        term.lists = titlePostings_.lists(word);
+        for (const std::vector<quint32>* ids : term.lists) {
+            term.cost = word.size() < 3 ? term.cost + ids->size()
+                                        : term.cost == 0 ? ids->size() : std::min(term.cost, ids->size());
+        }
+    }
+
+    // Values are few; which of them hold the word is worked out once, not
+    // per row. Their postings are exact for words of up to three letters.
+    term.valueHits.assign(values_.size(), false);
+    term.valueRows = 0;
+    auto add = [this, &word, &term](quint32 value) {
+        const Text& text = values_[value];
+        if (!term.valueHits[value] && (word.size() <= 3 || contains(text.data(), text.size(), word))) {
+            term.values.push_back(value);
+            term.valueHits[value] = true;
+            term.valueRows += valueRows_[value].size();
+        }
+    };
+    const std::vector<const std::vector<quint32>*> lists = valuePostings_.lists(word);
+    if (word.size() >= 3) {
+        for (quint32 value : intersect(lists)) {
+            add(value);
+        }
+    } else {
+        for (const std::vector<quint32>* values : lists) {
+            for (quint32 value : *values) {
+                add(value);
+            }
+        }
+    }
+
+    term.cost += std::min(term.valueRows, documents_.size());
+    term.word = std::move(word);
+    return term;
+}
+
+bool SearchIndex::found(const Term& term, const std::atomic<unsigned>& generation, unsigned wanted,
+                        std::vector<quint64>& bits) const {
+    auto cancelled = [&generation, wanted]() {
+        return generation.load(std::memory_order_relaxed) != wanted;
+    };
+
+    // The postings of a short word's trigrams, or the single one of a
+    // three-letter word, are exact for documents indexed once; the other
+    // titles found are checked.
+    const Text& word = term.word;
+    if (word.size() >= 3) {
+        for (quint32 slot : intersect(term.lists)) {
+            setBit(bits, slot);
+        }
+    } else {
+        for (size_t i = 0; i < term.lists.size(); ++i) {
+            if (i % kCancelCheckInterval == 0 && cancelled()) {
+                return false;
+            }
+            for (quint32 slot : *term.lists[i]) {
+                setBit(bits, slot);
+            }
+        }
+    }
+    const bool checkAll = word.size() > 3;
+    for (size_t i = 0; i < bits.size(); ++i) {
+        bits[i] &= live_[i];
+        for (quint64 check = checkAll ? bits[i] : bits[i] & reindexed_[i]; check != 0; check &= check - 1) {
+            const size_t bit = qCountTrailingZeroBits(check);
+            if (!titleContains(documents_[i * 64 + bit], word)) {
+                bits[i] &= ~(quint64(1) << bit);
+            }
+        }
+    }
+
+    // Values held by many rows are cheaper to look for in every document
+    // than to follow row by row.
+    if (term.exact || term.valueRows > documents_.size() / kCheckCost) {
+        const std::vector<bool>& hits = term.valueHits;
+        for (size_t i = 0; i < bits.size(); ++i) {
+            if (i % kCancelCheckInterval == 0 && cancelled()) {
+                return false;
+            }
+            for (quint64 rest = live_[i] & ~bits[i]; rest != 0; rest &= rest - 1) {
+                const size_t bit = qCountTrailingZeroBits(rest);
+                const Document& document = documents_[i * 64 + bit];
+                if ((term.exact && (document.letters & term.letters) != 0) || valueHit(document, hits)) {
+                    bits[i] |= quint64(1) << bit;
+                }
+            }
+        }
+        return !cancelled();
+    }
+
+    for (quint32 value : term.values) {
+        for (quint32 slot : valueRows_[value]) {
+            const quint32* values = documents_[slot].values;
+            if (test(live_, slot) && std::find(values, values + 4, value) != values + 4) {
+                setBit(bits, slot);
+            }
+        }
+    }
+    return !cancelled();
+}
+
+void SearchIndex::Postings::add(const char16_t* text, size_t length, quint32 id) {
+    std::vector<quint64> keys;
+    trigrams(text, length, 2, keys);
+    for (quint64 key : keys) {
+        std::vector<quint32>& list = ids[key];
+        if (list.empty()) {
+            prefixes[prefixKey(key, 1)].push_back(key);
+            prefixes[prefixKey(key, 2)].push_back(key);
+        }
+        addSorted(list, id);
+    }
+}
+
+void SearchIndex::Postings::clear() {
+    ids.clear();
+    prefixes.clear();
+}
+
+std::vector<const std::vector<quint32>*> SearchIndex::Postings::lists(const Text& word) const {
+    std::vector<const std::vector<quint32>*> result;
+    std::vector<quint64> keys;
+    if (word.size() >= 3) {
+        trigrams(word.data(), word.size(), 0, keys);
+        for (quint64 key : keys) {
+            auto it = ids.find(key);
+            if (it == ids.end()) {
+                return std::vector<const std::vector<quint32>*>();
+            }
+            result.push_back(&it->second);
+        }
+        return result;
+    }
+
+    // Padded the way texts are, the word is the start of a trigram.
+    trigrams(word.data(), word.size(), 3 - word.size(), keys);
+    auto it = prefixes.find(prefixKey(keys.front(), word.size()));
+    if (it != prefixes.end()) {
+        for (quint64 key : it->second) {
+            result.push_back(&ids.find(key)->second);
+        }
+    }
+    return result;
+}
+
+bool SearchIndex::test(const std::vector<quint64>& bits, size_t slot) {
+    return (bits[slot >> 6] >> (slot & 63)) & 1;
+}
+
+bool SearchIndex::titleContains(const Document& document, const Text& word) const {
+    return contains(text_.data() + document.textStart, document.textLength, word);
+}
+
+bool SearchIndex::documentContains(const Document& document, const Term& term) const {
+    if ((document.letters & term.letters) == term.letters && (term.exact || titleContains(document, term.word))) {
+        return true;
+    }
+    return valueHit(document, term.valueHits);
+}
+
+bool SearchIndex::valueHit(const Document& document, const std::vector<bool>& hits) {
+    return hits[document.values[0]] || hits[document.values[1]] || hits[document.values[2]] || hits[document.values[3]];
+}
+
+void SearchIndex::compactIfWasteful() {
+    if (staleCount_ < kMinStaleForCompaction || staleCount_ < liveCount_) {
+        return;
+    }
+
+    // Rebuilt from the live documents, which drops removed slots from the
+    // postings and the text of replaced titles.
+    std::vector<char16_t> text;
+    text.reserve(text_.size());
+    titlePostings_.clear();
+    std::fill(reindexed_.begin(), reindexed_.end(), 0);
+    for (std::vector<quint32>& rows : valueRows_) {
+        rows.clear();
+    }
+    for (size_t slot = 0; slot < documents_.size(); ++slot) {
+        if (!test(live_, slot)) {
+            continue;
+        }
+        Document& document = documents_[slot];
+        const auto start = text_.begin() + document.textStart;
+        document.textStart = static_cast<quint32>(text.size());
+        text.insert(text.end(), start, start + document.textLength);
+        for (quint32 value : document.values) {
+            std::vector<quint32>& rows = valueRows_[value];
+            if (value != 0 && (rows.empty() || rows.back() != slot)) {
+                rows.push_back(static_cast<quint32>(slot));
+            }
+        }
+    }
+    text_.swap(text);
+    for (size_t slot = 0; slot < documents_.size(); ++slot) {
+        if (test(live_, slot)) {
+            const Document& document = documents_[slot];
+            titlePostings_.add(text_.data() + document.textStart, document.textLength, static_cast<quint32>(slot));
+        }
+    }
+    staleCount_ = 0;
+}
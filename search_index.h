@@ -0,0 +1,131 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Trigram index over the playlist's titles, artists, albums and folders,
+// keyed by TrackStore row id. Text is folded (case, diacritics,
+// compatibility forms) both when it is indexed and when it is searched.
+// Ids are never reused, so documents sit in dense slots instead, and a
+// removed document's slot goes to the next one added.
+// Titles get postings per row. The other fields are indexed once per value
+// and list the rows that carry it, so the names a library repeats cost one
+// entry per row rather than one per character.
+//
+// Updates come from the GUI thread and searches from a worker; a
+// readers-writer lock keeps them apart.
+class SearchIndex {
+public:
+    SearchIndex();
+
+    // Adds the row, or replaces what was indexed for it.
+    void insert(quint32 id, const QString& title, const QString& artist, const QString& album,
+                const QString& albumArtist, const QString& folder);
+    void remove(quint32 id);
+    void clear();
+
+    // Ids of the rows that contain every word of the query in one of their
+    // fields, sorted. Gives up and returns false as soon as generation
+    // moves away from wanted.
+    bool search(const QString& query, const std::atomic<unsigned>& generation, unsigned wanted,
+                std::vector<quint32>& matches) const;
+
+private:
+    typedef std::u16string Text;
+
+    struct Document {
+        quint32 id;
+        quint32 textStart;
+        quint16 textLength;
+        // Artist, album, album artist and folder; 0 is none.
+        quint32 values[4];
+        // Characters in the title, one bit each for a-z and 0-9 and the
+        // rest hashed into the remaining bits.
+        quint64 letters;
+    };
+
+    // Trigram postings of texts padded with two zeros, so that every
+    // position starts a trigram and one- and two-letter words are found
+    // through the trigrams they begin.
+    struct Postings {
+        std::unordered_map<quint64, std::vector<quint32>> ids;
+        std::unordered_map<quint64, std::vector<quint64>> prefixes;
+
+        void add(const char16_t* text, size_t length, quint32 id);
+        void clear();
+        // A text that contains a long word is in all of the lists, one that
+        // contains a short word in at least one. None when no text can.
+        std::vector<const std::vector<quint32>*> lists(const Text& word) const;
+    };
+
+    // A word of the query and what is worked out for it once per search.
+    struct Term {
+        Text word;
+        // The word's title posting lists, none for an exact one.
+        std::vector<const std::vector<quint32>*> lists;
+        // Rough number of ids found() goes through.
+        size_t cost;
+        // Letter bits a title needs to contain word.
+        quint64 letters;
+        bool exact;
+        // Values that contain word, a lookup of the same by value, and how
+        // many rows they have.
+        std::vector<quint32> values;
+        std::vector<bool> valueHits;
+        size_t valueRows;
+    };
+
+    static Text fold(const QString& text);
+    // Sorted, distinct trigrams of text followed by padding zeros.
+    static void trigrams(const char16_t* text, size_t length, size_t padding, std::vector<quint64>& keys);
+    static quint64 prefixKey(quint64 trigram, size_t length);
+    static quint64 letterBit(char16_t c);
+    // Whether the letter bits alone decide if a title contains word.
+    static bool exact(const Text& word);
+    static bool contains(const char16_t* text, size_t length, const Text& word);
+    static void addSorted(std::vector<quint32>& ids, quint32 id);
+    // Ids in every one of lists.
+    static std::vector<quint32> intersect(std::vector<const std::vector<quint32>*> lists);
+
+    quint32 internValue(const QString& value);
+    Term term(Text word) const;
+    // Sets the bits of the live slots whose documents contain the term.
+    bool found(const Term& term, const std::atomic<unsigned>& generation, unsigned wanted,
+               std::vector<quint64>& bits) const;
+    static bool test(const std::vector<quint64>& bits, size_t slot);
+    bool titleContains(const Document& document, const Text& word) const;
+    bool documentContains(const Document& document, const Term& term) const;
+    static bool valueHit(const Document& document, const std::vector<bool>& hits);
+    void compactIfWasteful();
+
+    // By slot; postings and value rows hold slots too.
+    std::vector<Document> documents_;
+    std::unordered_map<quint32, quint32> slots_;
+    std::vector<quint32> freeSlots_;
+    std::vector<char16_t> text_;
+    // Bitmaps by slot: documents in the playlist, and slots indexed more
+    // than once or removed, whose postings may hold old trigrams.
+    std::vector<quint64> live_;
+    std::vector<quint64> reindexed_;
+    size_t liveCount_;
+    // Removed or replaced documents whose slots are still in the postings.
+    size_t staleCount_;
+    Postings titlePostings_;
+
+    // Folded values; 0 is the empty one.
+    std::vector<Text> values_;
+    std::unordered_map<Text, quint32> valueIds_;
+    Postings valuePostings_;
+    // Slots of the documents that had each value, stale ones included.
+    std::vector<std::vector<quint32>> valueRows_;
+
+    mutable std::shared_mutex mutex_;
+};
+
+#endif // SEARCH_INDEX_H
@@ -0,0 +1,532 @@
+#include "seek_index.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const quint32 kCacheMagic = 0x534B4958; // "SKIX"
+const quint32 kCacheVersion = 1;
+
+// MP3 decoders run 529 samples behind the stream; LAME's delay and padding
+// fields exclude it.
+const uint64_t kMp3DecoderDelay = 529;
+
+struct Mp3Header {
+    int version;        // 1, 2, or 25 for MPEG 2.5
+    int layer;
+    unsigned sampleRate;
+    int channels;
+    size_t length;
+    unsigned samples;
+};
+
+bool parseMp3Header(const uint8_t* p, Mp3Header& header) {
+    static const unsigned kBitrates[5][15] = {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},  // MPEG 1 layer I
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},     // MPEG 1 layer II
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},      // MPEG 1 layer III
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},     // MPEG 2/2.5 layer I
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}           // MPEG 2/2.5 layer II/III
+    };
+    static const unsigned kSampleRates[3] = {44100, 48000, 32000};
+
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+    int versionBits = (p[1] >> 3) & 3;
+    int layerBits = (p[1] >> 1) & 3;
+    int bitrateIndex = p[2] >> 4;
+    int rateIndex = (p[2] >> 2) & 3;
+    // Free format bitrates are not indexable.
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) {
+        return false;
+    }
+
+    header.version = versionBits == 3 ? 1 : versionBits == 2 ? 2 : 25;
+    header.layer = 4 - layerBits;
+    header.sampleRate = kSampleRates[rateIndex] >> (header.version == 1 ? 0 : header.version == 2 ? 1 : 2);
+    header.channels = (p[3] >> 6) == 3 ? 1 : 2;
+
+    int table = header.version == 1 ? header.layer - 1 : (header.layer == 1 ? 3 : 4);
+    unsigned bitrate = kBitrates[table][bitrateIndex] * 1000;
+    unsigned padding = (p[2] >> 1) & 1;
+    if (header.layer == 1) {
+        header.samples = 384;
+        header.length = (12 * bitrate / header.sampleRate + padding) * 4;
+    } else {
+        header.samples = header.layer == 3 && header.version != 1 ? 576 : 1152;
+        header.length = header.samples / 8 * bitrate / header.sampleRate + padding;
+    }
+    return header.length > 4;
+}
+
+uint8_t crc8(const uint8_t* data, size_t size) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+// FLAC frame header: sync, block size, the UTF-8 style coded frame or sample
+// number and a CRC-8 over all of it.
+bool parseFlacHeader(const uint8_t* p, const uint8_t* end, uint64_t& number, unsigned& blockSize, bool& variable) {
+    if (end - p < 16 || p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) {
+        return false;
+    }
+    variable = (p[1] & 1) != 0;
+    int sizeCode = p[2] >> 4;
+    int rateCode = p[2] & 0x0F;
+    int channelCode = p[3] >> 4;
+    int depthCode = (p[3] >> 1) & 7;
+    if (sizeCode == 0 || rateCode == 15 || channelCode > 10 || depthCode == 3 || (p[3] & 1)) {
+        return false;
+    }
+
+    const uint8_t* q = p + 4;
+    uint8_t lead = *q++;
+    int extra = 0;
+    if (lead < 0x80) {
+        number = lead;
+    } else if ((lead & 0xE0) == 0xC0) {
+        number = lead & 0x1F;
+        extra = 1;
+    } else if ((lead & 0xF0) == 0xE0) {
+        number = lead & 0x0F;
+        extra = 2;
+    } else if ((lead & 0xF8) == 0xF0) {
+        number = lead & 0x07;
+        extra = 3;
+    } else if ((lead & 0xFC) == 0xF8) {
+        number = lead & 0x03;
+        extra = 4;
+    } else if ((lead & 0xFE) == 0xFC) {
+        number = lead & 0x01;
+        extra = 5;
+    } else if (lead == 0xFE) {
+        number = 0;
+        extra = 6;
+    } else {
+        return false;
+    }
+    for (int i = 0; i < extra; ++i, ++q) {
+        if ((*q & 0xC0) != 0x80) {
+            return false;
+        }
+        number = (number << 6) | (*q & 0x3F);
+    }
+
+    if (sizeCode == 1) {
+        blockSize = 192;
+    } else if (sizeCode <= 5) {
+        blockSize = 576u << (sizeCode - 2);
+    } else if (sizeCode == 6) {
+        blockSize = *q++ + 1u;
+    } else if (sizeCode == 7) {
+        blockSize = ((q[0] << 8) | q[1]) + 1u;
+        q += 2;
+    } else {
+        blockSize = 256u << (sizeCode - 8);
+    }
+    if (rateCode == 12) {
+        q += 1;
+    } else if (rateCode == 13 || rateCode == 14) {
+        q += 2;
+    }
+
+    return crc8(p, q - p) == *q;
+}
+
+size_t skipId3v2(const uint8_t* data, size_t size) {
+    if (size < 10 || memcmp(data, "ID3", 3) != 0) {
+        return 0;
+    }
+    size_t tagSize = (static_cast<size_t>(data[6] & 0x7F) << 21) | ((data[7] & 0x7F) << 14) |
+                     ((data[8] & 0x7F) << 7) | (data[9] & 0x7F);
+    size_t footer = (data[5] & 0x10) ? 10 : 0;
+    return std::min(size, 10 + tagSize + footer);
+}
+
+// Next candidate sync byte at or after pos.
+size_t nextSync(const uint8_t* data, size_t size, size_t pos) {
+    if (pos >= size) {
+        return size;
+    }
+    const void* hit = memchr(data + pos, 0xFF, size - pos);
+    return hit ? static_cast<const uint8_t*>(hit) - data : size;
+}
+
+}
+
+SeekIndex::SeekIndex()
+    : format_(Format::None)
+    , sampleRate_(0)
+    , channels_(0)
+    , totalSamples_(0)
+    , leadingSamples_(0) {
+}
+
+bool SeekIndex::isIndexable(const QString& extension) {
+    return extension == "mp3" || extension == "flac" || extension == "aac";
+}
+
+double SeekIndex::duration() const {
+    return sampleRate_ > 0 ? static_cast<double>(totalSamples_) / sampleRate_ : 0.0;
+}
+
+bool SeekIndex::load(const QString& filePath) {
+    if (readCache(filePath)) {
+        return true;
+    }
+    if (!build(filePath)) {
+        return false;
+    }
+    writeCache(filePath);
+    return true;
+}
+
+bool SeekIndex::build(const QString& filePath) {
+    clear();
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const size_t size = static_cast<size_t>(file.size());
+    const uint8_t* data = file.map(0, file.size());
+    if (!data) {
+        qDebug() << "Cannot map file for seek index:" << filePath;
+        return false;
+    }
+
+    size_t start = skipId3v2(data, size);
+    QString extension = QFileInfo(filePath).suffix().toLower();
+    bool ok = false;
+    if (size - start >= 4 && memcmp(data + start, "fLaC", 4) == 0) {
+        ok = scanFlac(data, size, start);
+    } else if (extension == "aac") {
+        ok = scanAdts(data, size, start);
+    } else if (extension == "mp3") {
+        ok = scanMp3(data, size, start);
+    }
+    file.unmap(const_cast<uint8_t*>(data));
+
+    if (!ok) {
+        clear();
+        return false;
+    }
+    qDebug() << "Seek index built:" << filePath << frameOffsets_.size() << "frames," << duration() << "seconds";
+    return true;
+}
+
+bool SeekIndex::locate(uint64_t sample, uint64_t& offset, uint64_t& skip) const {
+    if (frameOffsets_.empty()) {
+        return false;
+    }
+
+    uint64_t position = std::min(sample, totalSamples_) + leadingSamples_;
+    auto it = std::upper_bound(frameSamples_.begin(), frameSamples_.end(), position);
+    size_t frame = it == frameSamples_.begin() ? 0 : static_cast<size_t>(it - frameSamples_.begin()) - 1;
+    if (format_ == Format::Mp3 && frame > 0) {
+        --frame;
+    }
+    offset = frameOffsets_[frame];
+    skip = position - frameSamples_[frame];
+    return true;
+}
+
+bool SeekIndex::scanMp3(const uint8_t* data, size_t size, size_t start) {
+    Mp3Header first;
+    Mp3Header header;
+    bool locked = false;
+    uint64_t position = 0;
+    uint64_t padding = 0;
+
+    size_t pos = nextSync(data, size, start);
+    while (pos + 4 <= size) {
+        if (!parseMp3Header(data + pos, header) || pos + header.length > size ||
+            (locked && (header.version != first.version || header.layer != first.layer ||
+                        header.sampleRate != first.sampleRate))) {
+            pos = nextSync(data, size, pos + 1);
+            continue;
+        }
+
+        if (!locked) {
+            // Junk can look like a header; trust the first one only when
+            // another follows right where it says it ends.
+            Mp3Header following;
+            size_t next = pos + header.length;
+            if (next + 4 <= size && (!parseMp3Header(data + next, following) ||
+                                     following.version != header.version || following.layer != header.layer)) {
+                pos = nextSync(data, size, pos + 1);
+                continue;
+            }
+            locked = true;
+            first = header;
+
+            // A Xing/Info or VBRI frame carries no audio; LAME's extension of
+            // it records the encoder delay and padding that decoders trim.
+            size_t sideInfo = header.version == 1 ? (header.channels == 1 ? 17 : 32) : (header.channels == 1 ? 9 : 17);
+            const uint8_t* tag = data + pos + 4 + sideInfo;
+            bool xing = header.length >= 4 + sideInfo + 120 &&
+                        (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0);
+            bool vbri = header.length >= 4 + 32 + 4 && memcmp(data + pos + 36, "VBRI", 4) == 0;
+            if (xing) {
+                uint32_t flags = (tag[4] << 24) | (tag[5] << 16) | (tag[6] << 8) | tag[7];
+                size_t lame = 8 + ((flags & 1) ? 4 : 0) + ((flags & 2) ? 4 : 0) + ((flags & 4) ? 100 : 0) +
+                              ((flags & 8) ? 4 : 0);
+                const uint8_t* ext = tag + lame;
+                if (4 + sideInfo + lame + 24 <= header.length &&
+                    (memcmp(ext, "LAME", 4) == 0 || memcmp(ext, "Lavf", 4) == 0 || memcmp(ext, "Lavc", 4) == 0)) {
+                    uint64_t delay = (ext[21] << 4) | (ext[22] >> 4);
+                    padding = ((ext[22] & 0x0F) << 8) | ext[23];
+                    leadingSamples_ = delay + kMp3DecoderDelay;
+                }
+            }
+            if (xing || vbri) {
+                pos += header.length;
+                continue;
+            }
+        }
+
+        frameSamples_.push_back(position);
+        frameOffsets_.push_back(pos);
+        position += header.samples;
+        pos += header.length;
+    }
+
+    if (!locked || frameOffsets_.empty()) {
+        return false;
+    }
+    format_ = Format::Mp3;
+    sampleRate_ = first.sampleRate;
+    channels_ = first.channels;
+    uint64_t trimmed = leadingSamples_ + (padding > kMp3DecoderDelay ? padding - kMp3DecoderDelay : 0);
+    totalSamples_ = position > trimmed ? position - trimmed : 0;
+    return true;
+}
+
+bool SeekIndex::scanFlac(const uint8_t* data, size_t size, size_t start) {
+    // Metadata blocks; STREAMINFO always comes first.
+    size_t pos = start + 4;
+    unsigned minBlockSize = 0;
+    uint64_t streamSamples = 0;
+    bool last = false;
+    while (!last && pos + 4 <= size) {
+        last = (data[pos] & 0x80) != 0;
+        int type = data[pos] & 0x7F;
+        size_t length = (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+        const uint8_t* block = data + pos + 4;
+        if (type == 0 && length >= 34 && pos + 4 + length <= size) {
+            minBlockSize = (block[0] << 8) | block[1];
+            sampleRate_ = (block[10] << 12) | (block[11] << 4) | (block[12] >> 4);
+            channels_ = ((block[12] >> 1) & 7) + 1;
+            streamSamples = (static_cast<uint64_t>(block[13] & 0x0F) << 32) |
+                            (static_cast<uint64_t>(block[14]) << 24) | (block[15] << 16) | (block[16] << 8) | block[17];
+        }
+        pos += 4 + length;
+    }
+    if (sampleRate_ == 0 || minBlockSize == 0) {
+        return false;
+    }
+
+    // FLAC frames carry no length, so each one is found by its sync code. A
+    // match must pass the header CRC and continue the sample count.
+    const uint8_t* end = data + size;
+    uint64_t expected = 0;
+    pos = nextSync(data, size, pos);
+    while (pos + 16 <= size) {
+        uint64_t number = 0;
+        unsigned blockSize = 0;
+        bool variable = false;
+        if (parseFlacHeader(data + pos, end, number, blockSize, variable)) {
+            uint64_t position = variable ? number : number * minBlockSize;
+            if (position == expected) {
+                frameSamples_.push_back(position);
+                frameOffsets_.push_back(pos);
+                expected = position + blockSize;
+            }
+        }
+        pos = nextSync(data, size, pos + 1);
+    }
+
+    if (frameOffsets_.empty()) {
+        return false;
+    }
+    format_ = Format::Flac;
+    totalSamples_ = streamSamples > 0 ? streamSamples : expected;
+    return true;
+}
+
+bool SeekIndex::scanAdts(const uint8_t* data, size_t size, size_t start) {
+    static const unsigned kSampleRates[13] = {
+        96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+    };
+
+    auto parse = [&](size_t at, size_t& length, unsigned& rate, int& channels, unsigned& samples) {
+        const uint8_t* p = data + at;
+        if (at + 7 > size || p[0] != 0xFF || (p[1] & 0xF6) != 0xF0) {
+            return false;
+        }
+        int rateIndex = (p[2] >> 2) & 0x0F;
+        length = ((p[3] & 3) << 11) | (p[4] << 3) | (p[5] >> 5);
+        if (rateIndex > 12 || length < 7) {
+            return false;
+        }
+        rate = kSampleRates[rateIndex];
+        channels = ((p[2] & 1) << 2) | (p[3] >> 6);
+        samples = ((p[6] & 3) + 1) * 1024;
+        return true;
+    };
+
+    // Durations count the core AAC rate; an HE-AAC decoder doubles both the
+    // rate and the samples per frame, which leaves the times unchanged.
+    uint64_t position = 0;
+    size_t pos = nextSync(data, size, start);
+    while (pos + 7 <= size) {
+        size_t length = 0;
+        unsigned rate = 0;
+        int channels = 0;
+        unsigned samples = 0;
+        if (!parse(pos, length, rate, channels, samples) || pos + length > size ||
+            (sampleRate_ != 0 && rate != sampleRate_)) {
+            pos = nextSync(data, size, pos + 1);
+            continue;
+        }
+        if (sampleRate_ == 0) {
+            size_t nextLength = 0;
+            unsigned nextRate = 0;
+            int nextChannels = 0;
+            unsigned nextSamples = 0;
+            if (pos + length + 7 <= size &&
+                (!parse(pos + length, nextLength, nextRate, nextChannels, nextSamples) || nextRate != rate)) {
+                pos = nextSync(data, size, pos + 1);
+                continue;
+            }
+            sampleRate_ = rate;
+            channels_ = channels == 7 ? 8 : channels;
+        }
+
+        frameSamples_.push_back(position);
+        frameOffsets_.push_back(pos);
+        position += samples;
+        pos += length;
+    }
+
+    if (frameOffsets_.empty()) {
+        return false;
+    }
+    format_ = Format::Adts;
+    totalSamples_ = position;
+    return true;
+}
+
+void SeekIndex::clear() {
+    format_ = Format::None;
+    sampleRate_ = 0;
+    channels_ = 0;
+    totalSamples_ = 0;
+    leadingSamples_ = 0;
+    frameSamples_.clear();
+    frameOffsets_.clear();
+}
+
+QString SeekIndex::cachePath(const QString& filePath) {
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/seekindex";
+    QByteArray key = QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return dir + "/" + QString::fromLatin1(key) + ".idx";
+}
+
+bool SeekIndex::readCache(const QString& filePath) {
+    QFile file(cachePath(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QFileInfo info(filePath);
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 size = 0;
+    qint64 modified = 0;
+    quint8 format = 0;
+    quint32 sampleRate = 0;
+    qint32 channels = 0;
+    quint64 totalSamples = 0;
+    quint64 leadingSamples = 0;
+    quint32 count = 0;
+    in >> magic >> version >> size >> modified >> format >> sampleRate >> channels
+       >> totalSamples >> leadingSamples >> count;
+    if (magic != kCacheMagic || version != kCacheVersion || size != info.size() ||
+        modified != info.lastModified().toMSecsSinceEpoch() || in.status() != QDataStream::Ok ||
+        static_cast<qint64>(count) * 4 > size) {
+        return false;
+    }
+
+    // Frames are stored as byte and sample deltas, eight bytes each.
+    clear();
+    frameSamples_.resize(count);
+    frameOffsets_.resize(count);
+    quint64 offset = 0;
+    quint64 position = 0;
+    in >> offset;
+    for (quint32 i = 0; i < count; ++i) {
+        quint32 bytes = 0;
+        quint32 samples = 0;
+        in >> bytes >> samples;
+        frameOffsets_[i] = offset;
+        frameSamples_[i] = position;
+        offset += bytes;
+        position += samples;
+    }
+    if (in.status() != QDataStream::Ok) {
+        clear();
+        return false;
+    }
+
+    format_ = static_cast<Format>(format);
+    sampleRate_ = sampleRate;
+    channels_ = channels;
+    totalSamples_ = totalSamples;
+    leadingSamples_ = leadingSamples;
+    return true;
+}
+
+void SeekIndex::writeCache(const QString& filePath) const {
+    QString path = cachePath(filePath);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write seek index:" << path;
+        return;
+    }
+
+    QFileInfo info(filePath);
+    QDataStream out(&file);
+    const size_t count = frameOffsets_.size();
+    out << kCacheMagic << kCacheVersion << info.size() << info.lastModified().toMSecsSinceEpoch()
+        << static_cast<quint8>(format_) << static_cast<quint32>(sampleRate_) << static_cast<qint32>(channels_)
+        << static_cast<quint64>(totalSamples_) << static_cast<quint64>(leadingSamples_)
+        << static_cast<quint32>(count) << static_cast<quint64>(count > 0 ? frameOffsets_[0] : 0);
+    for (size_t i = 0; i < count; ++i) {
+        // The last frame's deltas only need to be non-negative.
+        uint64_t nextOffset = i + 1 < count ? frameOffsets_[i + 1] : frameOffsets_[i];
+        uint64_t nextSample = i + 1 < count ? frameSamples_[i + 1] : frameSamples_[i];
+        out << static_cast<quint32>(nextOffset - frameOffsets_[i])
+            << static_cast<quint32>(nextSample - frameSamples_[i]);
+    }
+    file.commit();
+}
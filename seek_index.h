@@ -0,0 +1,70 @@
+#ifndef SEEK_INDEX_H
+#define SEEK_INDEX_H
+
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frame-to-byte-offset table of a compressed file, built by walking the
+// frame headers without decoding anything: MPEG audio (MP3 and its Xing or
+// LAME header), native FLAC (frame headers verified by their CRC-8) and raw
+// ADTS AAC. The table has an entry for every frame, so finding where to
+// start decoding for any sample is a binary search, and it yields the exact
+// decoded length of VBR files. Tables are kept on disk next to the waveform
+// cache, keyed by path, size and modification time.
+class SeekIndex {
+public:
+    enum class Format {
+        None,
+        Mp3,
+        Flac,
+        Adts
+    };
+
+    SeekIndex();
+
+    // Reads the cached table or scans the file and caches the result.
+    bool load(const QString& filePath);
+    // Scans the file; false when it is not in one of the formats above.
+    bool build(const QString& filePath);
+    static bool isIndexable(const QString& extension);
+
+    bool isEmpty() const { return frameOffsets_.empty(); }
+    Format format() const { return format_; }
+    unsigned sampleRate() const { return sampleRate_; }
+    int channels() const { return channels_; }
+    // Samples per channel a decoder outputs, after gapless trimming.
+    uint64_t totalSamples() const { return totalSamples_; }
+    double duration() const;
+
+    // Byte offset to start decoding at for output sample `sample`, and how
+    // many decoded samples to drop from there. MP3 frames may borrow bits
+    // from the one before (the bit reservoir), so for MP3 this is the
+    // previous frame: at most one extra frame is decoded.
+    bool locate(uint64_t sample, uint64_t& offset, uint64_t& skip) const;
+
+private:
+    bool scanMp3(const uint8_t* data, size_t size, size_t start);
+    bool scanFlac(const uint8_t* data, size_t size, size_t start);
+    bool scanAdts(const uint8_t* data, size_t size, size_t start);
+    void clear();
+
+    static QString cachePath(const QString& filePath);
+    bool readCache(const QString& filePath);
+    void writeCache(const QString& filePath) const;
+
+    Format format_;
+    unsigned sampleRate_;
+    int channels_;
+    uint64_t totalSamples_;
+    // Decoder output skipped before the first sample, e.g. encoder delay.
+    uint64_t leadingSamples_;
+
+    // Per frame: first sample in stream position, before trimming, and the
+    // byte offset of its header.
+    std::vector<uint64_t> frameSamples_;
+    std::vector<uint64_t> frameOffsets_;
+};
+
+#endif // SEEK_INDEX_H
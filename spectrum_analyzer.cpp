@@ -0,0 +1,268 @@
+#include "spectrum_analyzer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+// Level release and peak fall, in seconds.
+const float kReleaseTime = 0.25f;
+const float kPeakHoldTime = 0.8f;
+const float kPeakFallPerSecond = 0.6f;
+
+size_t fftSizeFor(double sampleRate) {
+    // Keep the window near 40 ms so bass resolution doesn't drop at high rates.
+    size_t size = 2048;
+    while (size < 8192 && size < sampleRate * 0.04) {
+        size *= 2;
+    }
+    return size;
+}
+
+double maxFrequency(double sampleRate) {
+    return std::min(SpectrumAnalyzer::kMaxFrequency, sampleRate * 0.5 * 0.95);
+}
+
+double bandEdge(size_t band, size_t bands, double sampleRate) {
+    double ratio = maxFrequency(sampleRate) / SpectrumAnalyzer::kMinFrequency;
+    return SpectrumAnalyzer::kMinFrequency * std::pow(ratio, static_cast<double>(band) / bands);
+}
+
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(SampleTap& tap, QObject* parent)
+    : QAbstractListModel(parent)
+    , tap_(tap)
+    , active_(false)
+    , rate_(30)
+    , busy_(false)
+    , resetPending_(true)
+    , lastPosition_(0)
+    , generation_(0)
+    , config_{0, 0, 0.0}
+    , powerScale_(1.0f) {
+    pool_.setMaxThreadCount(1);
+    front_.levels.assign(64, 0.0f);
+    front_.peaks.assign(64, 0.0f);
+    timer_.setTimerType(Qt::PreciseTimer);
+    connect(&timer_, &QTimer::timeout, this, &SpectrumAnalyzer::tick);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+    tap_.setEnabled(false);
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+int SpectrumAnalyzer::rowCount(const QModelIndex& parent) const {
+    if (parent.isValid()) {
+        return 0;
+    }
+    return bands();
+}
+
+QVariant SpectrumAnalyzer::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= bands()) {
+        return QVariant();
+    }
+
+    size_t band = static_cast<size_t>(index.row());
+    switch (role) {
+    case LevelRole:
+        return front_.levels[band];
+    case PeakRole:
+        return front_.peaks[band];
+    case FrequencyRole: {
+        double sampleRate = tap_.sampleRate();
+        return std::sqrt(bandEdge(band, bands(), sampleRate) * bandEdge(band + 1, bands(), sampleRate));
+    }
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> SpectrumAnalyzer::roleNames() const {
+    QHash<int, QByteArray> roles;
+    roles[LevelRole] = "level";
+    roles[PeakRole] = "peak";
+    roles[FrequencyRole] = "frequency";
+    return roles;
+}
+
+void SpectrumAnalyzer::setActive(bool active) {
+    if (active == active_) {
+        return;
+    }
+
+    active_ = active;
+    tap_.setEnabled(active);
+    if (active) {
+        resetPending_ = true;
+        lastPosition_ = tap_.position();
+        timer_.start(1000 / rate_);
+    } else {
+        timer_.stop();
+    }
+    emit activeChanged();
+}
+
+void SpectrumAnalyzer::setRate(int rate) {
+    rate = std::clamp(rate, 1, 120);
+    if (rate == rate_) {
+        return;
+    }
+
+    rate_ = rate;
+    if (timer_.isActive()) {
+        timer_.start(1000 / rate_);
+    }
+    emit rateChanged();
+}
+
+void SpectrumAnalyzer::setBands(int bands) {
+    bands = std::clamp(bands, 1, 256);
+    if (bands == this->bands()) {
+        return;
+    }
+
+    // A result in flight was computed for the old layout.
+    ++generation_;
+    resetPending_ = true;
+    beginResetModel();
+    front_.levels.assign(bands, 0.0f);
+    front_.peaks.assign(bands, 0.0f);
+    endResetModel();
+    emit bandsChanged();
+}
+
+void SpectrumAnalyzer::reset() {
+    resetPending_ = true;
+    std::fill(front_.levels.begin(), front_.levels.end(), 0.0f);
+    std::fill(front_.peaks.begin(), front_.peaks.end(), 0.0f);
+    if (bands() > 0) {
+        emit dataChanged(index(0), index(bands() - 1), {LevelRole, PeakRole});
+    }
+}
+
+void SpectrumAnalyzer::tick() {
+    size_t position = tap_.position();
+    // Nothing new while paused or stopped, so the worker stays asleep.
+    if (busy_ || position == lastPosition_) {
+        return;
+    }
+
+    Config config{fftSizeFor(tap_.sampleRate()), static_cast<size_t>(bands()), tap_.sampleRate()};
+    double elapsed = static_cast<double>(position - lastPosition_) / config.sampleRate;
+    bool reset = resetPending_;
+    unsigned generation = generation_;
+    lastPosition_ = position;
+    resetPending_ = false;
+    busy_ = true;
+
+    pool_.start(QRunnable::create([this, config, position, elapsed, reset, generation]() {
+        bool ok = analyze(config, position, elapsed, reset);
+
+        QMetaObject::invokeMethod(this, [this, ok, generation]() {
+            busy_ = false;
+            if (!ok || generation != generation_ || back_.levels.size() != front_.levels.size()) {
+                return;
+            }
+            std::swap(front_, back_);
+            emit dataChanged(index(0), index(bands() - 1), {LevelRole, PeakRole});
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void SpectrumAnalyzer::configure(const Config& config) {
+    config_ = config;
+    fft_.setSize(config.fftSize);
+    window_.resize(config.fftSize);
+    input_.resize(config.fftSize);
+    re_.resize(fft_.bins());
+    im_.resize(fft_.bins());
+    power_.resize(fft_.bins());
+
+    double windowEnergy = 0.0;
+    for (size_t i = 0; i < config.fftSize; ++i) {
+        window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * kPi * i / config.fftSize));
+        windowEnergy += static_cast<double>(window_[i]) * window_[i];
+    }
+    // A full-scale sine sums to 1.0 across its main lobe.
+    powerScale_ = static_cast<float>(4.0 / (config.fftSize * windowEnergy));
+
+    const double binWidth = config.sampleRate / config.fftSize;
+    bandStart_.resize(config.bands);
+    bandEnd_.resize(config.bands);
+    bandCenter_.resize(config.bands);
+    for (size_t band = 0; band < config.bands; ++band) {
+        double low = bandEdge(band, config.bands, config.sampleRate);
+        double high = bandEdge(band + 1, config.bands, config.sampleRate);
+        bandStart_[band] = static_cast<size_t>(std::ceil(low / binWidth));
+        bandEnd_[band] = std::min(static_cast<size_t>(std::ceil(high / binWidth)), fft_.bins() - 1);
+        bandCenter_[band] = static_cast<float>(std::sqrt(low * high) / binWidth);
+    }
+
+    levels_.assign(config.bands, 0.0f);
+    peaks_.assign(config.bands, 0.0f);
+    peakAge_.assign(config.bands, 0.0f);
+}
+
+bool SpectrumAnalyzer::analyze(const Config& config, size_t end, double elapsed, bool reset) {
+    if (config != config_) {
+        configure(config);
+    }
+    if (reset) {
+        std::fill(levels_.begin(), levels_.end(), 0.0f);
+        std::fill(peaks_.begin(), peaks_.end(), 0.0f);
+        std::fill(peakAge_.begin(), peakAge_.end(), 0.0f);
+    }
+
+    if (!tap_.read(end, input_.data(), config.fftSize)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < config.fftSize; ++i) {
+        input_[i] *= window_[i];
+    }
+    fft_.forward(input_.data(), re_.data(), im_.data());
+    for (size_t i = 0; i < power_.size(); ++i) {
+        power_[i] = (re_[i] * re_[i] + im_[i] * im_[i]) * powerScale_;
+    }
+
+    const float dt = static_cast<float>(std::min(elapsed, 1.0));
+    const float release = std::exp(-dt / kReleaseTime);
+    const float range = static_cast<float>(-kFloorDb);
+
+    for (size_t band = 0; band < config.bands; ++band) {
+        float sum = 0.0f;
+        if (bandEnd_[band] > bandStart_[band]) {
+            for (size_t bin = bandStart_[band]; bin < bandEnd_[band]; ++bin) {
+                sum += power_[bin];
+            }
+        } else {
+            // Narrower than a bin: interpolate at the band centre.
+            float position = std::min(bandCenter_[band], static_cast<float>(power_.size() - 2));
+            size_t bin = static_cast<size_t>(position);
+            float frac = position - bin;
+            sum = power_[bin] + (power_[bin + 1] - power_[bin]) * frac;
+        }
+
+        float db = 10.0f * std::log10(std::max(sum, 1e-12f));
+        float level = std::clamp((db + range) / range, 0.0f, 1.0f);
+        levels_[band] = std::max(level, levels_[band] * release);
+
+        if (levels_[band] >= peaks_[band]) {
+            peaks_[band] = levels_[band];
+            peakAge_[band] = 0.0f;
+        } else {
+            peakAge_[band] += dt;
+            if (peakAge_[band] > kPeakHoldTime) {
+                peaks_[band] = std::max(levels_[band], peaks_[band] - kPeakFallPerSecond * dt);
+            }
+        }
+    }
+
+    back_.levels.assign(levels_.begin(), levels_.end());
+    back_.peaks.assign(peaks_.begin(), peaks_.end());
+    return true;
+}
@@ -0,0 +1,107 @@
+#ifndef SPECTRUM_ANALYZER_H
+#define SPECTRUM_ANALYZER_H
+
+#include "fft.h"
+#include "sample_tap.h"
+#include <QAbstractListModel>
+#include <QThreadPool>
+#include <QTimer>
+#include <vector>
+
+// Log-frequency spectrum of the output for the visualizer. A timer on the
+// GUI thread hands one analysis at a time to a worker, which reads the
+// latest window from the callback's SampleTap, runs a Hann-windowed FFT and
+// fills the back buffer; the GUI thread swaps it to the front and emits
+// dataChanged. While inactive the timer is stopped and the tap disabled, so
+// neither the callback nor any thread does work for the view.
+class SpectrumAnalyzer : public QAbstractListModel {
+    Q_OBJECT
+    Q_PROPERTY(bool active READ isActive WRITE setActive NOTIFY activeChanged)
+    Q_PROPERTY(int rate READ rate WRITE setRate NOTIFY rateChanged)
+    Q_PROPERTY(int bands READ bands WRITE setBands NOTIFY bandsChanged)
+
+public:
+    enum SpectrumRoles {
+        LevelRole = Qt::UserRole + 1,
+        PeakRole,
+        FrequencyRole
+    };
+
+    static constexpr double kMinFrequency = 20.0;
+    static constexpr double kMaxFrequency = 20000.0;
+    static constexpr double kFloorDb = -80.0;
+
+    explicit SpectrumAnalyzer(SampleTap& tap, QObject* parent = nullptr);
+    ~SpectrumAnalyzer();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    bool isActive() const { return active_; }
+    void setActive(bool active);
+    // Analyses per second.
+    int rate() const { return rate_; }
+    void setRate(int rate);
+    int bands() const { return static_cast<int>(front_.levels.size()); }
+    void setBands(int bands);
+
+    // Drops the display to silence, e.g. when playback stops.
+    void reset();
+
+signals:
+    void activeChanged();
+    void rateChanged();
+    void bandsChanged();
+
+private:
+    // Levels and peaks are 0..1 over kFloorDb..0 dBFS.
+    struct Frame {
+        std::vector<float> levels;
+        std::vector<float> peaks;
+    };
+
+    struct Config {
+        size_t fftSize;
+        size_t bands;
+        double sampleRate;
+        bool operator!=(const Config& other) const {
+            return fftSize != other.fftSize || bands != other.bands || sampleRate != other.sampleRate;
+        }
+    };
+
+    void tick();
+    // Worker thread.
+    bool analyze(const Config& config, size_t end, double elapsed, bool reset);
+    void configure(const Config& config);
+
+    SampleTap& tap_;
+    QTimer timer_;
+    QThreadPool pool_;
+    bool active_;
+    int rate_;
+    bool busy_;
+    bool resetPending_;
+    size_t lastPosition_;
+    unsigned generation_;
+    Frame front_;
+
+    // Owned by the worker while busy_ is set.
+    Frame back_;
+    Config config_;
+    RealFft fft_;
+    std::vector<float> window_;
+    std::vector<float> input_;
+    std::vector<float> re_;
+    std::vector<float> im_;
+    std::vector<float> power_;
+    std::vector<size_t> bandStart_;
+    std::vector<size_t> bandEnd_;
+    std::vector<float> bandCenter_;
+    std::vector<float> levels_;
+    std::vector<float> peaks_;
+    std::vector<float> peakAge_;
+    float powerScale_;
+};
+
+#endif // SPECTRUM_ANALYZER_H
@@ -0,0 +1,872 @@
+#include "tag_reader.h"
+#include "track_store.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const qint64 kWindowSize = 65536;
+// Larger reads come from corrupt sizes; no header region needs them.
+const qint64 kMaxFetch = 4 * 1024 * 1024;
+// Text beyond this is not a title or a name.
+const size_t kMaxFieldBytes = 1024;
+// Enough for a picture header: type, MIME type and a description.
+const qint64 kMaxPictureHeader = 2048;
+const int kFrontCover = 3;
+// Ogg comment packets can carry base64 cover art; the text comes first.
+const int kMaxCommentPacket = 256 * 1024;
+
+constexpr uint32_t fourCc(const char (&id)[5]) {
+    return (static_cast<uint32_t>(static_cast<uint8_t>(id[0])) << 24) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(id[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(id[2])) << 8) |
+           static_cast<uint32_t>(static_cast<uint8_t>(id[3]));
+}
+
+// MP4 item names start with the copyright sign, 0xA9 in Mac Roman.
+constexpr uint32_t itunes(const char (&id)[4]) {
+    return 0xA9000000u | (static_cast<uint32_t>(id[0]) << 16) | (static_cast<uint32_t>(id[1]) << 8) |
+           static_cast<uint32_t>(id[2]);
+}
+
+uint16_t be16(const uint8_t* p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+uint32_t be24(const uint8_t* p) { return (static_cast<uint32_t>(p[0]) << 16) | (p[1] << 8) | p[2]; }
+uint32_t be32(const uint8_t* p) { return (static_cast<uint32_t>(p[0]) << 24) | be24(p + 1); }
+uint64_t be64(const uint8_t* p) { return (static_cast<uint64_t>(be32(p)) << 32) | be32(p + 4); }
+uint16_t le16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+uint32_t le32(const uint8_t* p) { return le16(p) | (static_cast<uint32_t>(le16(p + 2)) << 16); }
+uint64_t le64(const uint8_t* p) { return le32(p) | (static_cast<uint64_t>(le32(p + 4)) << 32); }
+uint32_t syncsafe(const uint8_t* p) {
+    return ((p[0] & 0x7f) << 21) | ((p[1] & 0x7f) << 14) | ((p[2] & 0x7f) << 7) | (p[3] & 0x7f);
+}
+
+// Length up to the first NUL, for fixed-width ID3v1 fields.
+size_t fixedLength(const uint8_t* p, size_t width) {
+    const uint8_t* end = std::find(p, p + width, 0);
+    return static_cast<size_t>(end - p);
+}
+
+bool keyIs(const uint8_t* key, size_t length, const char* name) {
+    size_t i = 0;
+    for (; i < length && name[i]; ++i) {
+        uint8_t c = key[i];
+        if ((c >= 'a' && c <= 'z' ? c - 32 : c) != static_cast<uint8_t>(name[i])) {
+            return false;
+        }
+    }
+    return i == length && !name[i];
+}
+
+// ID3v1 genre numbers, also used by ID3v2 "(n)" references and MP4 gnre.
+const char* const kGenres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop",
+    "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap",
+    "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska", "Death Metal", "Pranks",
+    "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance",
+    "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock",
+    "Ethnic", "Gothic", "Darkwave", "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+    "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap", "Pop/Funk", "Jungle",
+    "Native American", "Cabaret", "New Wave", "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi",
+    "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock"
+};
+const int kGenreCount = static_cast<int>(sizeof(kGenres) / sizeof(kGenres[0]));
+
+TagReader::Field id3Field(uint32_t id) {
+    switch (id) {
+    case fourCc("TIT2"): case fourCc("\0TT2"): return TagReader::Title;
+    case fourCc("TPE1"): case fourCc("\0TP1"): return TagReader::Artist;
+    case fourCc("TALB"): case fourCc("\0TAL"): return TagReader::Album;
+    case fourCc("TPE2"): case fourCc("\0TP2"): return TagReader::AlbumArtist;
+    case fourCc("TCON"): case fourCc("\0TCO"): return TagReader::Genre;
+    case fourCc("TDRC"): case fourCc("TYER"): case fourCc("\0TYE"): return TagReader::Date;
+    case fourCc("TRCK"): case fourCc("\0TRK"): return TagReader::TrackNumber;
+    case fourCc("TPOS"): case fourCc("\0TPA"): return TagReader::DiscNumber;
+    default: return TagReader::FieldCount;
+    }
+}
+
+TagReader::Field vorbisField(const uint8_t* key, size_t length) {
+    if (keyIs(key, length, "TITLE")) return TagReader::Title;
+    if (keyIs(key, length, "ARTIST")) return TagReader::Artist;
+    if (keyIs(key, length, "ALBUM")) return TagReader::Album;
+    if (keyIs(key, length, "ALBUMARTIST") || keyIs(key, length, "ALBUM ARTIST")) return TagReader::AlbumArtist;
+    if (keyIs(key, length, "GENRE")) return TagReader::Genre;
+    if (keyIs(key, length, "DATE") || keyIs(key, length, "YEAR")) return TagReader::Date;
+    if (keyIs(key, length, "TRACKNUMBER")) return TagReader::TrackNumber;
+    if (keyIs(key, length, "DISCNUMBER")) return TagReader::DiscNumber;
+    return TagReader::FieldCount;
+}
+
+// MPEG audio frame header fields, indexed [version][layer] where version
+// is 0 for MPEG-1 and 1 for MPEG-2/2.5, and layer 0..2 is I..III.
+const int kBitrates[2][3][16] = {
+    { { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+      { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+      { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 } },
+    { { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 } }
+};
+const int kSampleRates[3] = { 44100, 48000, 32000 };
+
+} // namespace
+
+TagReader::TagReader()
+    : fileSize_(0)
+    , windowStart_(-1)
+    , duration_(0.0)
+    , pictureType_(-1)
+    , pictureOffset_(0)
+    , pictureLength_(0) {
+    std::memset(spans_, 0, sizeof(spans_));
+}
+
+bool TagReader::read(const QString& filePath) {
+    data_.clear();
+    std::memset(spans_, 0, sizeof(spans_));
+    duration_ = 0.0;
+    windowStart_ = -1;
+    pictureType_ = -1;
+    pictureOffset_ = 0;
+    pictureLength_ = 0;
+    pictureData_.clear();
+
+    file_.close();
+    file_.setFileName(filePath);
+    if (!file_.open(QIODevice::ReadOnly)) {
+        qDebug() << "Cannot read tags of" << filePath;
+        return false;
+    }
+    fileSize_ = file_.size();
+
+    qint64 offset = 0;
+    const uint8_t* head = fetch(0, 12);
+    if (head && std::memcmp(head, "ID3", 3) == 0) {
+        // The tag may sit in front of FLAC as well as MPEG audio.
+        offset = 10 + syncsafe(head + 6) + ((head[5] & 0x10) ? 10 : 0);
+        readId3v2(0);
+        head = fetch(offset, 12);
+    }
+
+    if (!head) {
+    } else if (std::memcmp(head, "fLaC", 4) == 0) {
+        readFlac(offset);
+    } else if (offset == 0 && std::memcmp(head, "OggS", 4) == 0) {
+        readOgg();
+    } else if (offset == 0 && std::memcmp(head, "RIFF", 4) == 0 && std::memcmp(head + 8, "WAVE", 4) == 0) {
+        readRiff(false);
+    } else if (offset == 0 && std::memcmp(head, "FORM", 4) == 0 &&
+               (std::memcmp(head + 8, "AIFF", 4) == 0 || std::memcmp(head + 8, "AIFC", 4) == 0)) {
+        readRiff(true);
+    } else if (offset == 0 && std::memcmp(head + 4, "ftyp", 4) == 0) {
+        readMp4(0, fileSize_, 0);
+    } else if (offset == 0 && std::memcmp(head, "DSD ", 4) == 0) {
+        readDsf();
+    } else {
+        readMpegDuration(offset);
+        readId3v1();
+    }
+
+    file_.close();
+    return true;
+}
+
+QString TagReader::text(Field field) const {
+    const Span& span = spans_[field];
+    if (span.length == 0) {
+        return QString();
+    }
+
+    const char* raw = data_.constData() + span.offset;
+    size_t length = span.length;
+    QString value;
+    if (span.encoding == Latin1) {
+        value = QString::fromLatin1(raw, static_cast<qsizetype>(length));
+    } else if (span.encoding == Utf8) {
+        value = QString::fromUtf8(raw, static_cast<qsizetype>(length));
+    } else {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(raw);
+        bool bigEndian = span.encoding == Utf16Be;
+        if (span.encoding == Utf16 && length >= 2 && (p[0] == 0xfe || p[0] == 0xff) && p[0] + p[1] == 0x1fd) {
+            bigEndian = p[0] == 0xfe;
+            p += 2;
+            length -= 2;
+        }
+        char16_t units[kMaxFieldBytes / 2];
+        const size_t count = length / 2;
+        for (size_t i = 0; i < count; ++i) {
+            units[i] = static_cast<char16_t>(bigEndian ? be16(p + 2 * i) : le16(p + 2 * i));
+        }
+        value = QString::fromUtf16(units, static_cast<qsizetype>(count));
+    }
+
+    // ID3v2.4 and Vorbis allow several values; the first one is shown.
+    qsizetype nul = value.indexOf(QChar(0));
+    if (nul >= 0) {
+        value = value.left(nul);
+    }
+    value = value.trimmed();
+
+    // "(17)", "(17)Rock and Roll" and "17" are ID3v1 genre references.
+    if (field == Genre && !value.isEmpty()) {
+        qsizetype close = value.startsWith('(') ? value.indexOf(')') : -1;
+        if (close > 0 && close + 1 < value.size()) {
+            return value.mid(close + 1);
+        }
+        bool ok = false;
+        int genre = (close > 0 ? value.mid(1, close - 1) : value).toInt(&ok);
+        if (ok) {
+            return genre >= 0 && genre < kGenreCount ? QString::fromLatin1(kGenres[genre]) : QString();
+        }
+    }
+    return value;
+}
+
+int TagReader::number(Field field) const {
+    QString value = text(field);
+    int number = 0;
+    for (QChar c : value) {
+        if (!c.isDigit()) {
+            break;
+        }
+        number = number * 10 + c.digitValue();
+    }
+    return number;
+}
+
+void TagReader::fill(TrackEntry& entry) const {
+    entry.title = text(Title);
+    entry.artist = text(Artist);
+    entry.album = text(Album);
+    entry.albumArtist = text(AlbumArtist);
+    entry.genre = text(Genre);
+    entry.year = number(Date);
+    entry.trackNumber = number(TrackNumber);
+    entry.discNumber = number(DiscNumber);
+}
+
+QByteArray TagReader::picture() {
+    if (pictureLength_ <= 0) {
+        return QByteArray();
+    }
+    if (!pictureData_.isEmpty()) {
+        return pictureData_.mid(pictureOffset_, pictureLength_);
+    }
+
+    QByteArray data;
+    if (file_.open(QIODevice::ReadOnly) && file_.seek(pictureOffset_)) {
+        data = file_.read(pictureLength_);
+    }
+    file_.close();
+    return data.size() == pictureLength_ ? data : QByteArray();
+}
+
+const uint8_t* TagReader::fetch(qint64 offset, qint64 length) {
+    if (offset < 0 || length < 0 || length > kMaxFetch || offset + length > fileSize_) {
+        return nullptr;
+    }
+    if (windowStart_ >= 0 && offset >= windowStart_ && offset + length <= windowStart_ + window_.size()) {
+        return reinterpret_cast<const uint8_t*>(window_.constData()) + (offset - windowStart_);
+    }
+
+    qint64 size = std::min(std::max(length, kWindowSize), fileSize_ - offset);
+    window_.resize(size);
+    if (!file_.seek(offset) || file_.read(window_.data(), size) != size) {
+        windowStart_ = -1;
+        return nullptr;
+    }
+    windowStart_ = offset;
+    return reinterpret_cast<const uint8_t*>(window_.constData());
+}
+
+void TagReader::keep(Field field, const uint8_t* data, size_t length, Encoding encoding) {
+    if (field >= FieldCount || has(field)) {
+        return;
+    }
+    length = std::min(length, kMaxFieldBytes);
+    if (encoding != Latin1 && encoding != Utf8) {
+        length &= ~static_cast<size_t>(1);
+    }
+    if (length == 0) {
+        return;
+    }
+    spans_[field] = { static_cast<uint32_t>(data_.size()), static_cast<uint32_t>(length), encoding };
+    data_.append(reinterpret_cast<const char*>(data), static_cast<qsizetype>(length));
+}
+
+void TagReader::keepNumber(Field field, int value) {
+    if (value > 0) {
+        QByteArray digits = QByteArray::number(value);
+        keep(field, reinterpret_cast<const uint8_t*>(digits.constData()), static_cast<size_t>(digits.size()), Latin1);
+    }
+}
+
+bool TagReader::keepPicture(int type, qint64 offset, qint64 length) {
+    // The first picture, unless a front cover comes later.
+    if (length <= 0 || (pictureType_ >= 0 && (type != kFrontCover || pictureType_ == kFrontCover))) {
+        return false;
+    }
+    pictureType_ = type;
+    pictureOffset_ = offset;
+    pictureLength_ = length;
+    pictureData_.clear();
+    return true;
+}
+
+// FLAC PICTURE block layout, also base64 encoded in Vorbis comments.
+// offset is where data sits in the file, or -1 when it is in memory only.
+void TagReader::readFlacPicture(const uint8_t* data, size_t length, qint64 offset) {
+    if (length < 8) {
+        return;
+    }
+    size_t pos = 8 + static_cast<size_t>(be32(data + 4));
+    if (pos + 4 > length) {
+        return;
+    }
+    pos += 4 + static_cast<size_t>(be32(data + pos));
+    if (pos + 20 > length) {
+        return;
+    }
+    const int type = static_cast<int>(be32(data));
+    const qint64 size = be32(data + pos + 16);
+    pos += 20;
+    if (offset >= 0) {
+        keepPicture(type, offset + static_cast<qint64>(pos), size);
+    } else if (size <= static_cast<qint64>(length - pos) && keepPicture(type, 0, size)) {
+        pictureData_ = QByteArray(reinterpret_cast<const char*>(data + pos), static_cast<qsizetype>(size));
+    }
+}
+
+void TagReader::readId3v2(qint64 offset) {
+    const uint8_t* header = fetch(offset, 10);
+    if (!header || std::memcmp(header, "ID3", 3) != 0 || header[3] < 2 || header[3] > 4) {
+        return;
+    }
+    const int version = header[3];
+    const bool unsynchronised = (header[5] & 0x80) != 0;
+    qint64 pos = offset + 10;
+    const qint64 end = pos + syncsafe(header + 6);
+
+    if ((header[5] & 0x40) && version >= 3) {
+        const uint8_t* extended = fetch(pos, 4);
+        if (!extended) {
+            return;
+        }
+        pos += version == 3 ? be32(extended) + 4 : syncsafe(extended);
+    }
+
+    const int headerSize = version == 2 ? 6 : 10;
+    while (pos + headerSize <= end) {
+        const uint8_t* frame = fetch(pos, headerSize);
+        if (!frame || frame[0] == 0) {
+            break; // padding
+        }
+
+        uint32_t id;
+        uint32_t size;
+        uint16_t flags = 0;
+        if (version == 2) {
+            id = be24(frame);
+            size = be24(frame + 3);
+        } else {
+            id = be32(frame);
+            size = version == 4 ? syncsafe(frame + 4) : be32(frame + 4);
+            flags = be16(frame + 8);
+        }
+        pos += headerSize;
+        if (size == 0 || pos + size > end) {
+            break;
+        }
+
+        Field field = id3Field(id);
+        // Compressed and encrypted frames are left alone.
+        bool readable = version == 2 || (version == 3 ? (flags & 0x00c0) == 0 : (flags & 0x000c) == 0);
+        qint64 body = pos;
+        if (version == 3 && (flags & 0x0020)) {
+            body += 1;
+        } else if (version == 4) {
+            body += ((flags & 0x0040) ? 1 : 0) + ((flags & 0x0001) ? 4 : 0);
+        }
+        // Pictures are used as stored, so unsynchronised ones are passed over.
+        const bool picture = id == fourCc("APIC") || id == fourCc("\0PIC");
+        if (picture && readable && !unsynchronised && !(version == 4 && (flags & 0x0002))) {
+            const qint64 length = std::min<qint64>(pos + size - body, kMaxPictureHeader);
+            const uint8_t* header = length > 4 ? fetch(body, length) : nullptr;
+            if (header && header[0] <= 3) {
+                // Encoding, MIME type (three letters in v2.2), picture type,
+                // then a NUL-terminated description.
+                const uint8_t* mime = version == 2 ? header + 4 : static_cast<const uint8_t*>(std::memchr(header + 1, 0, length - 1));
+                const uint8_t* end = header + length;
+                if (mime && mime + 1 < end) {
+                    const int type = version == 2 ? mime[-1] : mime[1];
+                    const uint8_t* description = version == 2 ? mime : mime + 2;
+                    const bool wide = header[0] == 1 || header[0] == 2;
+                    const uint8_t* p = description;
+                    while (p + (wide ? 1 : 0) < end && (p[0] != 0 || (wide && p[1] != 0))) {
+                        p += wide ? 2 : 1;
+                    }
+                    p += wide ? 2 : 1;
+                    if (p < end) {
+                        keepPicture(type, body + (p - header), pos + size - body - (p - header));
+                    }
+                }
+            }
+        }
+        if (field != FieldCount && readable && !has(field)) {
+            qint64 length = std::min<qint64>(pos + size - body, kMaxFieldBytes + 1);
+            const uint8_t* text = length > 1 ? fetch(body, length) : nullptr;
+            if (text && text[0] <= 3) {
+                // Unsynchronisation put a 0x00 after every 0xff; take it out.
+                uint8_t plain[kMaxFieldBytes + 1];
+                size_t count = 0;
+                const bool undo = unsynchronised || (version == 4 && (flags & 0x0002));
+                for (qint64 i = 1; i < length; ++i) {
+                    if (!(undo && text[i] == 0 && text[i - 1] == 0xff)) {
+                        plain[count++] = text[i];
+                    }
+                }
+                static const Encoding encodings[] = { Latin1, Utf16, Utf16Be, Utf8 };
+                keep(field, plain, count, encodings[text[0]]);
+            }
+        }
+        pos += size;
+    }
+}
+
+void TagReader::readId3v1() {
+    const uint8_t* tag = fileSize_ >= 128 ? fetch(fileSize_ - 128, 128) : nullptr;
+    if (!tag || std::memcmp(tag, "TAG", 3) != 0) {
+        return;
+    }
+
+    keep(Title, tag + 3, fixedLength(tag + 3, 30), Latin1);
+    keep(Artist, tag + 33, fixedLength(tag + 33, 30), Latin1);
+    keep(Album, tag + 63, fixedLength(tag + 63, 30), Latin1);
+    keep(Date, tag + 93, fixedLength(tag + 93, 4), Latin1);
+    // ID3v1.1 takes the last comment byte for the track number.
+    if (tag[125] == 0 && tag[126] != 0) {
+        keepNumber(TrackNumber, tag[126]);
+    }
+    if (tag[127] < kGenreCount) {
+        const char* genre = kGenres[tag[127]];
+        keep(Genre, reinterpret_cast<const uint8_t*>(genre), std::strlen(genre), Latin1);
+    }
+}
+
+void TagReader::readMpegDuration(qint64 offset) {
+    // Junk or padding may sit between the tag and the first frame.
+    const qint64 scan = std::min<qint64>(4096, fileSize_ - offset);
+    const uint8_t* data = scan > 4 ? fetch(offset, scan) : nullptr;
+    if (!data) {
+        return;
+    }
+
+    for (qint64 i = 0; i + 4 <= scan; ++i) {
+        const uint8_t* h = data + i;
+        if (h[0] != 0xff || (h[1] & 0xe0) != 0xe0) {
+            continue;
+        }
+        const int versionBits = (h[1] >> 3) & 3;
+        const int layerBits = (h[1] >> 1) & 3;
+        const int bitrateIndex = h[2] >> 4;
+        const int rateIndex = (h[2] >> 2) & 3;
+        if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) {
+            continue;
+        }
+
+        const bool mpeg1 = versionBits == 3;
+        const int layer = 3 - layerBits;
+        const int sampleRate = kSampleRates[rateIndex] >> (mpeg1 ? 0 : versionBits == 2 ? 1 : 2);
+        const int samplesPerFrame = layer == 0 ? 384 : (layer == 2 && !mpeg1) ? 576 : 1152;
+        const int bitrate = kBitrates[mpeg1 ? 0 : 1][layer][bitrateIndex] * 1000;
+        const bool mono = (h[3] >> 6) == 3;
+        const qint64 frame = offset + i;
+
+        // A VBR header in the first frame counts the frames.
+        const qint64 xing = frame + 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+        const uint8_t* x = fetch(xing, 12);
+        if (x && (std::memcmp(x, "Xing", 4) == 0 || std::memcmp(x, "Info", 4) == 0) && (be32(x + 4) & 1)) {
+            duration_ = static_cast<double>(be32(x + 8)) * samplesPerFrame / sampleRate;
+            return;
+        }
+        const uint8_t* v = fetch(frame + 36, 18);
+        if (v && std::memcmp(v, "VBRI", 4) == 0) {
+            duration_ = static_cast<double>(be32(v + 14)) * samplesPerFrame / sampleRate;
+            return;
+        }
+
+        // Constant bitrate: the size says it, close enough until decoded.
+        qint64 audioEnd = fileSize_;
+        const uint8_t* trailer = fileSize_ - frame > 128 ? fetch(fileSize_ - 128, 3) : nullptr;
+        if (trailer && std::memcmp(trailer, "TAG", 3) == 0) {
+            audioEnd -= 128;
+        }
+        duration_ = static_cast<double>(audioEnd - frame) * 8.0 / bitrate;
+        return;
+    }
+}
+
+void TagReader::readFlac(qint64 offset) {
+    qint64 pos = offset + 4;
+    for (;;) {
+        const uint8_t* header = fetch(pos, 4);
+        if (!header) {
+            return;
+        }
+        const bool last = (header[0] & 0x80) != 0;
+        const int type = header[0] & 0x7f;
+        const uint32_t length = be24(header + 1);
+        pos += 4;
+
+        if (type == 0 && length >= 18) {
+            const uint8_t* info = fetch(pos, 18);
+            if (info) {
+                uint32_t sampleRate = (static_cast<uint32_t>(info[10]) << 12) | (info[11] << 4) | (info[12] >> 4);
+                uint64_t samples = (static_cast<uint64_t>(info[13] & 0x0f) << 32) | be32(info + 14);
+                if (sampleRate > 0 && samples > 0) {
+                    duration_ = static_cast<double>(samples) / sampleRate;
+                }
+            }
+        } else if (type == 4) {
+            const uint8_t* comments = fetch(pos, length);
+            if (comments) {
+                readVorbisComments(comments, length);
+            }
+        } else if (type == 6) {
+            const qint64 headerLength = std::min<qint64>(length, kMaxPictureHeader);
+            const uint8_t* header = fetch(pos, headerLength);
+            if (header) {
+                readFlacPicture(header, static_cast<size_t>(headerLength), pos);
+            }
+        }
+
+        pos += length;
+        if (last) {
+            return;
+        }
+    }
+}
+
+void TagReader::readOgg() {
+    QByteArray packet;
+    int packetIndex = 0;
+    uint32_t sampleRate = 0;
+    uint16_t preSkip = 0;
+    bool opus = false;
+    qint64 pos = 0;
+
+    // The identification header is the first packet, the comments the
+    // second; both usually fit the first two pages.
+    for (int page = 0; page < 64 && packetIndex < 2; ++page) {
+        const uint8_t* header = fetch(pos, 27);
+        if (!header || std::memcmp(header, "OggS", 4) != 0) {
+            return;
+        }
+        const int segments = header[26];
+        const uint8_t* table = fetch(pos + 27, segments);
+        if (!table) {
+            return;
+        }
+        uint8_t lacing[255];
+        std::memcpy(lacing, table, segments);
+        qint64 pageSize = 0;
+        for (int s = 0; s < segments; ++s) {
+            pageSize += lacing[s];
+        }
+        const qint64 dataPos = pos + 27 + segments;
+        const uint8_t* body = fetch(dataPos, pageSize);
+        if (!body) {
+            return;
+        }
+
+        qint64 at = 0;
+        for (int s = 0; s < segments && packetIndex < 2; ++s) {
+            if (packet.size() < kMaxCommentPacket) {
+                packet.append(reinterpret_cast<const char*>(body + at), lacing[s]);
+            }
+            at += lacing[s];
+            if (lacing[s] == 255) {
+                continue;
+            }
+
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(packet.constData());
+            const size_t size = static_cast<size_t>(packet.size());
+            if (packetIndex == 0) {
+                if (size >= 16 && std::memcmp(p, "\x01vorbis", 7) == 0) {
+                    sampleRate = le32(p + 12);
+                } else if (size >= 12 && std::memcmp(p, "OpusHead", 8) == 0) {
+                    opus = true;
+                    sampleRate = 48000;
+                    preSkip = le16(p + 10);
+                } else {
+                    return;
+                }
+            } else if (!opus && size > 7 && std::memcmp(p, "\x03vorbis", 7) == 0) {
+                readVorbisComments(p + 7, size - 7);
+            } else if (opus && size > 8 && std::memcmp(p, "OpusTags", 8) == 0) {
+                readVorbisComments(p + 8, size - 8);
+            }
+            packet.clear();
+            ++packetIndex;
+        }
+        pos = dataPos + pageSize;
+    }
+
+    // The granule position of the last page is the stream length in samples.
+    const qint64 tail = std::min<qint64>(fileSize_, kWindowSize);
+    const uint8_t* end = sampleRate > 0 ? fetch(fileSize_ - tail, tail) : nullptr;
+    for (qint64 i = tail - 27; end && i >= 0; --i) {
+        if (std::memcmp(end + i, "OggS", 4) == 0) {
+            uint64_t granule = le64(end + i + 6);
+            if (granule > preSkip && granule != ~0ull) {
+                duration_ = static_cast<double>(granule - preSkip) / sampleRate;
+            }
+            break;
+        }
+    }
+}
+
+void TagReader::readVorbisComments(const uint8_t* data, size_t length) {
+    if (length < 8) {
+        return;
+    }
+    size_t pos = 4 + static_cast<size_t>(le32(data));
+    if (pos + 4 > length) {
+        return;
+    }
+    uint32_t count = le32(data + pos);
+    pos += 4;
+
+    for (uint32_t i = 0; i < count && pos + 4 <= length; ++i) {
+        size_t size = le32(data + pos);
+        pos += 4;
+        if (size > length - pos) {
+            return;
+        }
+        const uint8_t* comment = data + pos;
+        const uint8_t* equals = static_cast<const uint8_t*>(std::memchr(comment, '=', size));
+        if (equals) {
+            size_t keyLength = static_cast<size_t>(equals - comment);
+            if (keyIs(comment, keyLength, "METADATA_BLOCK_PICTURE")) {
+                QByteArray block = QByteArray::fromBase64(
+                    QByteArray::fromRawData(reinterpret_cast<const char*>(equals + 1), static_cast<qsizetype>(size - keyLength - 1)));
+                readFlacPicture(reinterpret_cast<const uint8_t*>(block.constData()), static_cast<size_t>(block.size()), -1);
+            } else {
+                keep(vorbisField(comment, keyLength), equals + 1, size - keyLength - 1, Utf8);
+            }
+        }
+        pos += size;
+    }
+}
+
+void TagReader::readMp4(qint64 offset, qint64 end, int depth) {
+    while (offset + 8 <= end && depth < 8) {
+        const uint8_t* header = fetch(offset, 8);
+        if (!header) {
+            return;
+        }
+        qint64 size = be32(header);
+        const uint32_t type = be32(header + 4);
+        qint64 headerSize = 8;
+        if (size == 1) {
+            const uint8_t* large = fetch(offset + 8, 8);
+            if (!large) {
+                return;
+            }
+            size = static_cast<qint64>(be64(large));
+            headerSize = 16;
+        } else if (size == 0) {
+            size = end - offset;
+        }
+        if (size < headerSize || offset + size > end) {
+            return;
+        }
+
+        const qint64 body = offset + headerSize;
+        const qint64 bodyEnd = offset + size;
+        switch (type) {
+        case fourCc("moov"):
+        case fourCc("udta"):
+            readMp4(body, bodyEnd, depth + 1);
+            break;
+        case fourCc("meta"): {
+            // A full box in ISO files, a plain one in QuickTime files.
+            const uint8_t* next = fetch(body, 8);
+            if (next) {
+                readMp4(be32(next + 4) == fourCc("hdlr") ? body : body + 4, bodyEnd, depth + 1);
+            }
+            break;
+        }
+        case fourCc("ilst"):
+            for (qint64 item = body; item + 8 <= bodyEnd;) {
+                const uint8_t* itemHeader = fetch(item, 8);
+                qint64 itemSize = itemHeader ? be32(itemHeader) : 0;
+                if (itemSize < 8 || item + itemSize > bodyEnd) {
+                    break;
+                }
+                readMp4Item(be32(itemHeader + 4), item + 8, item + itemSize);
+                item += itemSize;
+            }
+            break;
+        case fourCc("mvhd"): {
+            const uint8_t* movie = fetch(body, 32);
+            if (movie) {
+                const bool wide = movie[0] == 1;
+                uint32_t timescale = be32(movie + (wide ? 20 : 12));
+                uint64_t length = wide ? be64(movie + 24) : be32(movie + 16);
+                if (timescale > 0) {
+                    duration_ = static_cast<double>(length) / timescale;
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        offset = bodyEnd;
+    }
+}
+
+void TagReader::readMp4Item(uint32_t type, qint64 offset, qint64 end) {
+    const uint8_t* header = fetch(offset, 16);
+    if (!header || be32(header + 4) != fourCc("data")) {
+        return;
+    }
+    const qint64 size = std::min<qint64>(be32(header), end - offset);
+    if (type == fourCc("covr")) {
+        keepPicture(kFrontCover, offset + 16, size - 16);
+        return;
+    }
+    const qint64 length = std::min<qint64>(size - 16, kMaxFieldBytes);
+    const uint8_t* payload = length > 0 ? fetch(offset + 16, length) : nullptr;
+    if (!payload) {
+        return;
+    }
+
+    switch (type) {
+    case itunes("nam"): keep(Title, payload, length, Utf8); break;
+    case itunes("ART"): keep(Artist, payload, length, Utf8); break;
+    case itunes("alb"): keep(Album, payload, length, Utf8); break;
+    case fourCc("aART"): keep(AlbumArtist, payload, length, Utf8); break;
+    case itunes("gen"): keep(Genre, payload, length, Utf8); break;
+    case itunes("day"): keep(Date, payload, length, Utf8); break;
+    case fourCc("gnre"):
+        if (length >= 2 && be16(payload) >= 1 && be16(payload) <= kGenreCount) {
+            const char* genre = kGenres[be16(payload) - 1];
+            keep(Genre, reinterpret_cast<const uint8_t*>(genre), std::strlen(genre), Latin1);
+        }
+        break;
+    case fourCc("trkn"):
+        if (length >= 4) {
+            keepNumber(TrackNumber, be16(payload + 2));
+        }
+        break;
+    case fourCc("disk"):
+        if (length >= 4) {
+            keepNumber(DiscNumber, be16(payload + 2));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void TagReader::readRiff(bool bigEndian) {
+    const uint8_t* header = fetch(0, 12);
+    if (!header) {
+        return;
+    }
+    const qint64 end = std::min<qint64>(fileSize_, 8 + static_cast<qint64>(bigEndian ? be32(header + 4) : le32(header + 4)));
+    uint32_t byteRate = 0;
+    qint64 dataSize = 0;
+
+    for (qint64 pos = 12; pos + 8 <= end;) {
+        const uint8_t* chunk = fetch(pos, 8);
+        if (!chunk) {
+            return;
+        }
+        const uint32_t id = be32(chunk);
+        const qint64 size = bigEndian ? be32(chunk + 4) : le32(chunk + 4);
+        const qint64 body = pos + 8;
+
+        if (id == fourCc("fmt ") && !bigEndian) {
+            const uint8_t* format = fetch(body, 16);
+            byteRate = format ? le32(format + 8) : 0;
+        } else if (id == fourCc("data") && !bigEndian) {
+            // Streamed files leave the size at its maximum.
+            dataSize = std::min(size, fileSize_ - body);
+        } else if (id == fourCc("COMM") && bigEndian) {
+            const uint8_t* common = fetch(body, 18);
+            if (common) {
+                // The rate is an 80-bit extended float.
+                int exponent = ((common[8] & 0x7f) << 8) | common[9];
+                double rate = std::ldexp(static_cast<double>(be64(common + 10)), exponent - 16383 - 63);
+                if (rate > 0.0) {
+                    duration_ = be32(common + 2) / rate;
+                }
+            }
+        } else if (id == fourCc("LIST") && !bigEndian) {
+            const uint8_t* type = fetch(body, 4);
+            if (type && std::memcmp(type, "INFO", 4) == 0) {
+                for (qint64 item = body + 4; item + 8 <= body + size;) {
+                    const uint8_t* info = fetch(item, 8);
+                    if (!info) {
+                        break;
+                    }
+                    const uint32_t infoId = be32(info);
+                    const qint64 infoSize = le32(info + 4);
+                    Field field = infoId == fourCc("INAM") ? Title
+                                : infoId == fourCc("IART") ? Artist
+                                : infoId == fourCc("IPRD") ? Album
+                                : infoId == fourCc("IGNR") ? Genre
+                                : infoId == fourCc("ICRD") ? Date
+                                : infoId == fourCc("ITRK") ? TrackNumber
+                                : FieldCount;
+                    const qint64 length = std::min<qint64>(infoSize, kMaxFieldBytes);
+                    const uint8_t* value = field != FieldCount && length > 0 ? fetch(item + 8, length) : nullptr;
+                    if (value) {
+                        keep(field, value, fixedLength(value, static_cast<size_t>(length)), Utf8);
+                    }
+                    item += 8 + infoSize + (infoSize & 1);
+                }
+            }
+        } else if ((id == fourCc("NAME") || id == fourCc("AUTH")) && bigEndian) {
+            const qint64 length = std::min<qint64>(size, kMaxFieldBytes);
+            const uint8_t* value = fetch(body, length);
+            if (value) {
+                keep(id == fourCc("NAME") ? Title : Artist, value, fixedLength(value, static_cast<size_t>(length)), Latin1);
+            }
+        } else if (id == fourCc("id3 ") || id == fourCc("ID3 ")) {
+            readId3v2(body);
+        }
+
+        pos = body + size + (size & 1);
+    }
+
+    if (byteRate > 0 && dataSize > 0) {
+        duration_ = static_cast<double>(dataSize) / byteRate;
+    }
+}
+
+void TagReader::readDsf() {
+    const uint8_t* header = fetch(0, 28);
+    if (!header) {
+        return;
+    }
+    const uint64_t metadata = le64(header + 20);
+
+    const uint8_t* format = fetch(28, 52);
+    if (format && std::memcmp(format, "fmt ", 4) == 0) {
+        uint32_t sampleRate = le32(format + 28);
+        uint64_t samples = le64(format + 36);
+        if (sampleRate > 0) {
+            duration_ = static_cast<double>(samples) / sampleRate;
+        }
+    }
+    if (metadata > 0) {
+        readId3v2(static_cast<qint64>(metadata));
+    }
+}
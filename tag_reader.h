@@ -0,0 +1,101 @@
+#ifndef TAG_READER_H
+#define TAG_READER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <cstdint>
+
+struct TrackEntry;
+
+// Reads the tags of an audio file without decoding it: ID3v2 (also inside
+// WAV, AIFF and DSF), ID3v1, FLAC and Ogg Vorbis/Opus comments, MP4 ilst
+// and RIFF INFO. Embedded pictures are located on the way but only read
+// when asked for. Only the header regions are read, through a 64 KB window
+// that skips over audio and cover art, and the raw bytes of the wanted
+// fields are kept; text is decoded when it is asked for. Where the headers
+// give it away the duration comes along for free, so a library import does
+// not need a decoder to show track lengths.
+//
+// One reader can be reused for many files, which keeps the buffers.
+class TagReader {
+public:
+    enum Field {
+        Title,
+        Artist,
+        Album,
+        AlbumArtist,
+        Genre,
+        Date,
+        TrackNumber,
+        DiscNumber,
+        FieldCount
+    };
+
+    TagReader();
+
+    // False when the file cannot be opened; a file without tags reads as
+    // empty.
+    bool read(const QString& filePath);
+
+    bool has(Field field) const { return spans_[field].length > 0; }
+    QString text(Field field) const;
+    // Leading number of the field: 3 for "3/12", 1999 for "1999-05-01".
+    int number(Field field) const;
+    // Seconds, or 0 when the headers do not tell.
+    double duration() const { return duration_; }
+    // Copies the title and tag fields into entry.
+    void fill(TrackEntry& entry) const;
+    bool hasPicture() const { return pictureLength_ > 0; }
+    // The encoded embedded picture, the front cover where there are
+    // several, or empty. Reads it from the file read() looked at.
+    QByteArray picture();
+
+private:
+    enum Encoding : uint8_t {
+        Latin1,
+        Utf16,
+        Utf16Be,
+        Utf8,
+        Utf16Le
+    };
+
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+        Encoding encoding;
+    };
+
+    const uint8_t* fetch(qint64 offset, qint64 length);
+    void keep(Field field, const uint8_t* data, size_t length, Encoding encoding);
+    void keepNumber(Field field, int value);
+    bool keepPicture(int type, qint64 offset, qint64 length);
+    void readFlacPicture(const uint8_t* data, size_t length, qint64 offset);
+
+    void readId3v2(qint64 offset);
+    void readId3v1();
+    void readMpegDuration(qint64 offset);
+    void readFlac(qint64 offset);
+    void readOgg();
+    void readVorbisComments(const uint8_t* data, size_t length);
+    void readMp4(qint64 offset, qint64 end, int depth);
+    void readMp4Item(uint32_t type, qint64 offset, qint64 end);
+    void readRiff(bool bigEndian);
+    void readDsf();
+
+    QFile file_;
+    qint64 fileSize_;
+    QByteArray window_;
+    qint64 windowStart_;
+    QByteArray data_;
+    Span spans_[FieldCount];
+    double duration_;
+    int pictureType_;
+    qint64 pictureOffset_;
+    qint64 pictureLength_;
+    // Pictures that only exist decoded, e.g. base64 in an Ogg comment;
+    // pictureOffset_ indexes this instead of the file when set.
+    QByteArray pictureData_;
+};
+
+#endif // TAG_READER_H
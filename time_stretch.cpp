@@ -0,0 +1,332 @@
+#include "time_stretch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TIME_STRETCH_SSE2 1
+#endif
+
+namespace {
+
+struct Preset {
+    double windowSeconds;
+    // One-sided.
+    double searchSeconds;
+    size_t decimation;
+};
+
+// By StretchQuality. Longer windows keep tonal music smooth, shorter ones
+// keep speech crisp.
+const Preset kPresets[] = {
+    {0.030, 0.008, 8}, // Fast
+    {0.040, 0.012, 4}, // Balanced
+    {0.050, 0.015, 2}  // High
+};
+
+float dot(const float* a, const float* b, size_t count) {
+    size_t i = 0;
+    float sum = 0.0f;
+#ifdef TIME_STRETCH_SSE2
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    sum = _mm_cvtss_f32(acc0);
+#endif
+    for (; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Mean of each group of factor samples.
+void decimate(const float* input, float* output, size_t count, size_t factor) {
+    const float scale = 1.0f / factor;
+    for (size_t i = 0; i < count; ++i, input += factor) {
+        float sum = 0.0f;
+        for (size_t j = 0; j < factor; ++j) {
+            sum += input[j];
+        }
+        output[i] = sum * scale;
+    }
+}
+
+}
+
+TimeStretcher::TimeStretcher()
+    : speed_(1.0f)
+    , quality_(static_cast<int>(StretchQuality::Balanced))
+    , sampleRate_(44100.0)
+    , channels_(2)
+    , active_(false)
+    , appliedQuality_(-1)
+    , hop_(0)
+    , range_(0)
+    , decimation_(1)
+    , inputFrames_(0)
+    , capacity_(0)
+    , draining_(false)
+    , inputEnd_(0)
+    , hasSegment_(false)
+    , segmentStart_(0)
+    , nominal_(0.0)
+    , outputFrames_(0)
+    , outputRead_(0) {
+}
+
+void TimeStretcher::prepare(double sampleRate, int channels) {
+    sampleRate_ = sampleRate;
+    channels_ = std::max(1, channels);
+
+    // Size for the most demanding quality so switching never allocates.
+    const Preset& high = kPresets[static_cast<int>(StretchQuality::High)];
+    size_t maxHop = static_cast<size_t>(sampleRate * high.windowSeconds / 2.0) + 1;
+    size_t maxRange = static_cast<size_t>(sampleRate * high.searchSeconds) + 1;
+    // A hop needs its segment plus the search range beyond the nominal
+    // position, which itself may run kMaxSpeed hops ahead of the last one.
+    capacity_ = 2 * maxHop + 2 * maxRange + static_cast<size_t>(kMaxSpeed * maxHop) + 2 * kMaxWrite;
+
+    input_.assign(capacity_ * channels_, 0.0f);
+    mono_.assign(capacity_, 0.0f);
+    window_.reserve(2 * maxHop);
+    output_.assign(maxHop * channels_, 0.0f);
+    tail_.assign(maxHop * channels_, 0.0f);
+    coarseTemplate_.assign(maxHop, 0.0f);
+    coarseRegion_.assign(2 * maxRange + maxHop + 1, 0.0f);
+    coarseEnergy_.assign(2 * maxRange + maxHop + 2, 0.0);
+
+    appliedQuality_ = -1;
+    update();
+}
+
+void TimeStretcher::setSpeed(float speed) {
+    speed_.store(std::clamp(speed, kMinSpeed, kMaxSpeed), std::memory_order_relaxed);
+}
+
+bool TimeStretcher::update() {
+    int quality = quality_.load(std::memory_order_relaxed);
+    if (quality != appliedQuality_) {
+        configure(static_cast<StretchQuality>(quality));
+    }
+    active_ = speed_.load(std::memory_order_relaxed) != 1.0f;
+    return active_;
+}
+
+void TimeStretcher::configure(StretchQuality quality) {
+    appliedQuality_ = static_cast<int>(quality);
+    const Preset& preset = kPresets[appliedQuality_];
+    hop_ = std::max<size_t>(16, static_cast<size_t>(sampleRate_ * preset.windowSeconds / 2.0));
+    range_ = static_cast<size_t>(sampleRate_ * preset.searchSeconds);
+    decimation_ = preset.decimation;
+
+    // Periodic Hann over two hops sums to exactly one at 50% overlap.
+    const double pi = 3.14159265358979323846;
+    window_.resize(2 * hop_);
+    for (size_t i = 0; i < window_.size(); ++i) {
+        window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(pi * i / hop_));
+    }
+    reset();
+}
+
+void TimeStretcher::reset() {
+    inputFrames_ = 0;
+    draining_ = false;
+    inputEnd_ = 0;
+    hasSegment_ = false;
+    segmentStart_ = 0;
+    nominal_ = 0.0;
+    outputFrames_ = 0;
+    outputRead_ = 0;
+    std::fill(tail_.begin(), tail_.end(), 0.0f);
+}
+
+void TimeStretcher::write(const float* interleaved, size_t frames) {
+    frames = std::min(frames, kMaxWrite);
+    if (inputFrames_ + frames > capacity_) {
+        discardConsumed();
+        frames = std::min(frames, capacity_ - inputFrames_);
+    }
+
+    memcpy(input_.data() + inputFrames_ * channels_, interleaved, frames * channels_ * sizeof(float));
+    float* mono = mono_.data() + inputFrames_;
+    if (channels_ == 2) {
+        for (size_t i = 0; i < frames; ++i) {
+            mono[i] = interleaved[2 * i] + interleaved[2 * i + 1];
+        }
+    } else {
+        for (size_t i = 0; i < frames; ++i) {
+            float sum = 0.0f;
+            for (int ch = 0; ch < channels_; ++ch) {
+                sum += interleaved[i * channels_ + ch];
+            }
+            mono[i] = sum;
+        }
+    }
+    inputFrames_ += frames;
+}
+
+void TimeStretcher::drain() {
+    if (!draining_) {
+        draining_ = true;
+        inputEnd_ = inputFrames_;
+    }
+}
+
+bool TimeStretcher::isFinished() const {
+    return draining_ && nominal_ >= static_cast<double>(inputEnd_) && outputRead_ >= outputFrames_;
+}
+
+size_t TimeStretcher::read(float* interleaved, size_t frames) {
+    size_t produced = 0;
+    while (produced < frames) {
+        if (outputRead_ >= outputFrames_ && !synthesize()) {
+            break;
+        }
+
+        size_t count = std::min(frames - produced, outputFrames_ - outputRead_);
+        memcpy(interleaved + produced * channels_, output_.data() + outputRead_ * channels_,
+               count * channels_ * sizeof(float));
+        outputRead_ += count;
+        produced += count;
+    }
+    return produced;
+}
+
+double TimeStretcher::pendingInput() const {
+    // What remains of the FIFO past the nominal position, plus the output
+    // still queued, measured in input frames.
+    double queued = static_cast<double>(outputFrames_ - outputRead_) * speed_.load(std::memory_order_relaxed);
+    double end = draining_ ? static_cast<double>(inputEnd_) : static_cast<double>(inputFrames_);
+    return std::max(0.0, end - nominal_) + queued;
+}
+
+bool TimeStretcher::synthesize() {
+    if (draining_ && nominal_ >= static_cast<double>(inputEnd_)) {
+        return false;
+    }
+
+    const size_t hop = hop_;
+    const size_t channels = static_cast<size_t>(channels_);
+    size_t target = static_cast<size_t>(nominal_ + 0.5);
+    size_t low = hasSegment_ ? (target > range_ ? target - range_ : 0) : target;
+    size_t high = hasSegment_ ? target + range_ : target;
+
+    // The candidate segments and the template must all be in the FIFO.
+    size_t needed = std::max(high + 2 * hop, hasSegment_ ? segmentStart_ + 2 * hop : 0);
+    if (needed > inputFrames_) {
+        if (!draining_) {
+            return false;
+        }
+        // Past the end of the input everything is silence.
+        if (needed > capacity_) {
+            size_t before = inputFrames_;
+            discardConsumed();
+            size_t dropped = before - inputFrames_;
+            high -= dropped;
+            low -= dropped;
+            target -= dropped;
+            needed -= dropped;
+            if (needed > capacity_) {
+                return false;
+            }
+        }
+        std::fill(input_.begin() + inputFrames_ * channels, input_.begin() + needed * channels, 0.0f);
+        std::fill(mono_.begin() + inputFrames_, mono_.begin() + needed, 0.0f);
+        inputFrames_ = needed;
+    }
+
+    size_t start = hasSegment_ ? search(segmentStart_ + hop, low, high) : target;
+
+    const float* segment = input_.data() + start * channels;
+    const float* fadeIn = window_.data();
+    const float* fadeOut = window_.data() + hop;
+    for (size_t i = 0; i < hop; ++i) {
+        for (size_t ch = 0; ch < channels; ++ch) {
+            size_t k = i * channels + ch;
+            output_[k] = tail_[k] + segment[k] * fadeIn[i];
+            tail_[k] = segment[hop * channels + k] * fadeOut[i];
+        }
+    }
+
+    hasSegment_ = true;
+    segmentStart_ = start;
+    nominal_ += speed_.load(std::memory_order_relaxed) * hop;
+    outputFrames_ = hop;
+    outputRead_ = 0;
+    return true;
+}
+
+size_t TimeStretcher::search(size_t templateStart, size_t low, size_t high) {
+    const size_t hop = hop_;
+    const size_t factor = decimation_;
+
+    // Coarse pass: normalised cross-correlation on the decimated mono mix.
+    size_t length = hop / factor;
+    size_t candidates = (high - low) / factor + 1;
+    decimate(mono_.data() + templateStart, coarseTemplate_.data(), length, factor);
+    decimate(mono_.data() + low, coarseRegion_.data(), candidates + length - 1, factor);
+
+    coarseEnergy_[0] = 0.0;
+    for (size_t i = 0; i < candidates + length - 1; ++i) {
+        coarseEnergy_[i + 1] = coarseEnergy_[i] + static_cast<double>(coarseRegion_[i]) * coarseRegion_[i];
+    }
+
+    size_t best = 0;
+    float bestScore = -1e30f;
+    for (size_t c = 0; c < candidates; ++c) {
+        float energy = static_cast<float>(coarseEnergy_[c + length] - coarseEnergy_[c]);
+        float score = dot(coarseTemplate_.data(), coarseRegion_.data() + c, length) / std::sqrt(energy + 1e-9f);
+        if (score > bestScore) {
+            bestScore = score;
+            best = c;
+        }
+    }
+
+    // Fine pass at full rate around the coarse winner.
+    size_t centre = low + best * factor;
+    size_t first = std::max(low, centre >= factor ? centre - factor + 1 : 0);
+    size_t last = std::min(high, centre + factor - 1);
+    const float* templ = mono_.data() + templateStart;
+    size_t result = centre;
+    bestScore = -1e30f;
+    for (size_t k = first; k <= last; ++k) {
+        const float* candidate = mono_.data() + k;
+        float score = dot(templ, candidate, hop) / std::sqrt(dot(candidate, candidate, hop) + 1e-9f);
+        if (score > bestScore) {
+            bestScore = score;
+            result = k;
+        }
+    }
+    return result;
+}
+
+void TimeStretcher::discardConsumed() {
+    // Everything before the next template and the lowest candidate is done.
+    size_t keep = static_cast<size_t>(std::max(0.0, nominal_ - static_cast<double>(range_)));
+    if (hasSegment_) {
+        keep = std::min(keep, segmentStart_ + hop_);
+    }
+    keep = std::min(keep, inputFrames_);
+    if (keep == 0) {
+        return;
+    }
+
+    const size_t channels = static_cast<size_t>(channels_);
+    memmove(input_.data(), input_.data() + keep * channels, (inputFrames_ - keep) * channels * sizeof(float));
+    memmove(mono_.data(), mono_.data() + keep, (inputFrames_ - keep) * sizeof(float));
+    inputFrames_ -= keep;
+    nominal_ -= keep;
+    if (hasSegment_) {
+        segmentStart_ -= keep;
+    }
+    if (draining_) {
+        inputEnd_ -= std::min(inputEnd_, keep);
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef TIME_STRETCH_H
+#define TIME_STRETCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+enum class StretchQuality {
+    Fast,
+    Balanced,
+    High
+};
+
+// WSOLA time-stretch: changes playback speed without changing pitch by
+// overlap-adding Hann-windowed input segments at a fixed synthesis hop while
+// the analysis position advances at speed times that hop. Each segment is
+// nudged within a search range to the offset whose start best matches the
+// natural continuation of the previous one, found with a coarse search on a
+// decimated mono mix followed by a full-rate refinement, both SSE2 dot
+// products. Quality trades window length, search range and coarse
+// decimation against CPU.
+//
+// Input is pushed with write() and output pulled with read(); all buffers
+// are sized in prepare() so neither call allocates.
+class TimeStretcher {
+public:
+    static constexpr float kMinSpeed = 0.5f;
+    static constexpr float kMaxSpeed = 2.0f;
+    // Most frames a single write() accepts.
+    static constexpr size_t kMaxWrite = 1024;
+
+    TimeStretcher();
+
+    // Call while the stream is closed.
+    void prepare(double sampleRate, int channels);
+
+    // GUI thread.
+    void setSpeed(float speed);
+    float speed() const { return speed_.load(std::memory_order_relaxed); }
+    void setQuality(StretchQuality quality) { quality_.store(static_cast<int>(quality), std::memory_order_relaxed); }
+    StretchQuality quality() const { return static_cast<StretchQuality>(quality_.load(std::memory_order_relaxed)); }
+
+    // Audio thread. update() returns false at unity speed, where the caller
+    // should bypass the stretcher; quality changes reset it.
+    bool update();
+    bool isActive() const { return active_; }
+    void reset();
+
+    // Appends up to kMaxWrite interleaved frames. Only call after read()
+    // came up short, which guarantees the room.
+    void write(const float* interleaved, size_t frames);
+    // Marks the end of the input; the rest drains padded with silence.
+    void drain();
+    bool isFinished() const;
+    size_t read(float* interleaved, size_t frames);
+
+    // Input frames taken in but not yet heard, for position reporting.
+    double pendingInput() const;
+
+private:
+    void configure(StretchQuality quality);
+    bool synthesize();
+    size_t search(size_t templateStart, size_t low, size_t high);
+    void discardConsumed();
+
+    std::atomic<float> speed_;
+    std::atomic<int> quality_;
+
+    // Audio thread only.
+    double sampleRate_;
+    int channels_;
+    bool active_;
+    int appliedQuality_;
+    size_t hop_;
+    size_t range_;
+    size_t decimation_;
+    std::vector<float> window_;
+
+    // Input FIFO, interleaved and as a mono sum for the similarity search.
+    std::vector<float> input_;
+    std::vector<float> mono_;
+    size_t inputFrames_;
+    size_t capacity_;
+    bool draining_;
+    size_t inputEnd_;
+
+    bool hasSegment_;
+    size_t segmentStart_;
+    double nominal_;
+
+    // Last hop of output not yet read, and the windowed second half of the
+    // previous segment waiting for its overlap partner.
+    std::vector<float> output_;
+    size_t outputFrames_;
+    size_t outputRead_;
+    std::vector<float> tail_;
+
+    std::vector<float> coarseTemplate_;
+    std::vector<float> coarseRegion_;
+    std::vector<double> coarseEnergy_;
+};
+
+#endif // TIME_STRETCH_H
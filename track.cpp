@@ -1,16 +1,41 @@
 #include "track.h"
 #include "audio_decoder.h"
+#include "tag_reader.h"
 #include <QUrl>
 
 Track::Track(QObject* parent)
-    : QObject(parent), duration_(0.0) {
+    : QObject(parent), year_(0), trackNumber_(0), discNumber_(0), duration_(0.0), startTime_(0.0), endTime_(0.0), virtual_(false)
+    , hasLoudness_(false), loudness_(0.0), loudnessRange_(0.0), truePeak_(0.0) {
 }
 
 Track::Track(const QString& filePath, QObject* parent)
-    : QObject(parent), duration_(0.0) {
+    : QObject(parent), year_(0), trackNumber_(0), discNumber_(0), duration_(0.0), startTime_(0.0), endTime_(0.0), virtual_(false)
+    , hasLoudness_(false), loudness_(0.0), loudnessRange_(0.0), truePeak_(0.0) {
     setFilePath(filePath);
 }
 
+Track::Track(const QString& filePath, double startTime, double endTime,
+             const QString& title, double duration, QObject* parent)
+    : QObject(parent), title_(title), filePath_(filePath), year_(0), trackNumber_(0), discNumber_(0)
+    , duration_(duration)
+    , startTime_(startTime), endTime_(endTime), virtual_(true)
+    , hasLoudness_(false), loudness_(0.0), loudnessRange_(0.0), truePeak_(0.0) {
+    QFileInfo fileInfo(filePath_);
+    fileName_ = fileInfo.baseName();
+    extension_ = fileInfo.suffix().toLower();
+}
+
+Track::Track(const TrackEntry& entry, QObject* parent)
+    : QObject(parent), title_(entry.title), filePath_(entry.filePath), artist_(entry.artist)
+    , album_(entry.album), albumArtist_(entry.albumArtist), genre_(entry.genre), year_(entry.year)
+    , trackNumber_(entry.trackNumber), discNumber_(entry.discNumber), duration_(entry.duration)
+    , startTime_(entry.startTime), endTime_(entry.endTime), virtual_(entry.isVirtual)
+    , hasLoudness_(false), loudness_(0.0), loudnessRange_(0.0), truePeak_(0.0) {
+    QFileInfo fileInfo(filePath_);
+    fileName_ = fileInfo.baseName();
+    extension_ = fileInfo.suffix().toLower();
+}
+
 void Track::setFilePath(const QString& filePath) {
     QString actualPath = filePath;
     if (filePath.startsWith("file://")) {
@@ -31,6 +56,35 @@ void Track::setDuration(double duration) {
     }
 }
 
+void Track::setTags(const TrackEntry& entry) {
+    if (title_ != entry.title) {
+        title_ = entry.title;
+        emit titleChanged();
+    }
+    if (artist_ != entry.artist || album_ != entry.album || albumArtist_ != entry.albumArtist ||
+        genre_ != entry.genre || year_ != entry.year || trackNumber_ != entry.trackNumber ||
+        discNumber_ != entry.discNumber) {
+        artist_ = entry.artist;
+        album_ = entry.album;
+        albumArtist_ = entry.albumArtist;
+        genre_ = entry.genre;
+        year_ = entry.year;
+        trackNumber_ = entry.trackNumber;
+        discNumber_ = entry.discNumber;
+        emit tagsChanged();
+    }
+}
+
+void Track::setLoudness(double integratedLufs, double rangeLu, double truePeakDb) {
+    if (!hasLoudness_ || loudness_ != integratedLufs || loudnessRange_ != rangeLu || truePeak_ != truePeakDb) {
+        hasLoudness_ = true;
+        loudness_ = integratedLufs;
+        loudnessRange_ = rangeLu;
+        truePeak_ = truePeakDb;
+        emit loudnessChanged();
+    }
+}
+
 bool Track::isValid() const {
     return !filePath_.isEmpty() && QFileInfo::exists(filePath_);
 }
@@ -56,11 +110,15 @@ void Track::updateFromFilePath() {
         emit fileNameChanged();
     }
 
-    QString newTitle = newFileName;
-    if (title_ != newTitle) {
-        title_ = newTitle;
-        emit titleChanged();
+    TagReader tags;
+    TrackEntry entry;
+    if (tags.read(filePath_)) {
+        tags.fill(entry);
+    }
+    if (entry.title.isEmpty()) {
+        entry.title = newFileName;
     }
+    setTags(entry);
 
     QString newExtension = fileInfo.suffix().toLower();
     if (extension_ != newExtension) {
@@ -68,7 +126,7 @@ void Track::updateFromFilePath() {
         emit extensionChanged();
     }
     
-    double newDuration = AudioDecoder::getAudioDuration(filePath_);
+    double newDuration = tags.duration() > 0.0 ? tags.duration() : AudioDecoder::getAudioDuration(filePath_);
     if (duration_ != newDuration) {
         duration_ = newDuration;
         emit durationChanged();
@@ -4,27 +4,66 @@
 #include <QString>
 #include <QFileInfo>
 #include <QObject>
+#include "track_store.h"
 
+// QObject view of one playlist entry for QML bindings. The playlist itself
+// lives in a TrackStore; PlaylistManager creates these on request and keeps
+// them in step with their row.
 class Track : public QObject {
     Q_OBJECT
     Q_PROPERTY(QString title READ title NOTIFY titleChanged)
     Q_PROPERTY(QString filePath READ filePath NOTIFY filePathChanged)
     Q_PROPERTY(QString fileName READ fileName NOTIFY fileNameChanged)
     Q_PROPERTY(QString extension READ extension NOTIFY extensionChanged)
+    Q_PROPERTY(QString artist READ artist NOTIFY tagsChanged)
+    Q_PROPERTY(QString album READ album NOTIFY tagsChanged)
+    Q_PROPERTY(QString albumArtist READ albumArtist NOTIFY tagsChanged)
+    Q_PROPERTY(QString genre READ genre NOTIFY tagsChanged)
+    Q_PROPERTY(int year READ year NOTIFY tagsChanged)
+    Q_PROPERTY(int trackNumber READ trackNumber NOTIFY tagsChanged)
+    Q_PROPERTY(int discNumber READ discNumber NOTIFY tagsChanged)
     Q_PROPERTY(double duration READ duration NOTIFY durationChanged)
+    Q_PROPERTY(bool hasLoudness READ hasLoudness NOTIFY loudnessChanged)
+    Q_PROPERTY(double loudness READ loudness NOTIFY loudnessChanged)
+    Q_PROPERTY(double loudnessRange READ loudnessRange NOTIFY loudnessChanged)
+    Q_PROPERTY(double truePeak READ truePeak NOTIFY loudnessChanged)
 
 public:
     explicit Track(QObject* parent = nullptr);
     explicit Track(const QString& filePath, QObject* parent = nullptr);
+    // A span of a larger file, e.g. one CUE sheet track. endTime is 0 when
+    // the span runs to the end of the file; duration is not probed again.
+    Track(const QString& filePath, double startTime, double endTime,
+          const QString& title, double duration, QObject* parent = nullptr);
+    explicit Track(const TrackEntry& entry, QObject* parent = nullptr);
 
     QString title() const { return title_; }
     QString filePath() const { return filePath_; }
     QString fileName() const { return fileName_; }
     QString extension() const { return extension_; }
+    QString artist() const { return artist_; }
+    QString album() const { return album_; }
+    QString albumArtist() const { return albumArtist_; }
+    QString genre() const { return genre_; }
+    int year() const { return year_; }
+    int trackNumber() const { return trackNumber_; }
+    int discNumber() const { return discNumber_; }
     double duration() const { return duration_; }
+    double startTime() const { return startTime_; }
+    double endTime() const { return endTime_; }
+    bool isVirtual() const { return virtual_; }
+
+    // EBU R128 measurements, valid once hasLoudness() is true.
+    bool hasLoudness() const { return hasLoudness_; }
+    double loudness() const { return loudness_; }
+    double loudnessRange() const { return loudnessRange_; }
+    double truePeak() const { return truePeak_; }
 
     void setFilePath(const QString& filePath);
     void setDuration(double duration);
+    // Title and tag fields from entry.
+    void setTags(const TrackEntry& entry);
+    void setLoudness(double integratedLufs, double rangeLu, double truePeakDb);
 
     bool isValid() const;
 
@@ -33,7 +72,9 @@ signals:
     void filePathChanged();
     void fileNameChanged();
     void extensionChanged();
+    void tagsChanged();
     void durationChanged();
+    void loudnessChanged();
 
 private:
     void updateFromFilePath();
@@ -42,7 +83,21 @@ private:
     QString filePath_;
     QString fileName_;
     QString extension_;
+    QString artist_;
+    QString album_;
+    QString albumArtist_;
+    QString genre_;
+    int year_;
+    int trackNumber_;
+    int discNumber_;
     double duration_;
+    double startTime_;
+    double endTime_;
+    bool virtual_;
+    bool hasLoudness_;
+    double loudness_;
+    double loudnessRange_;
+    double truePeak_;
 };
 
 #endif // TRACK_H
\ No newline at end of file
@@ -0,0 +1,243 @@
+#include "track_sorter.h"
+#include "track_store.h"
+#include <QCollator>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Smallest share of the work worth a thread of its own.
+const size_t kMinChunk = 4096;
+
+// Where each chunk of count items starts, one chunk per core, and count.
+std::vector<size_t> chunkBounds(size_t count) {
+    const size_t threads = static_cast<size_t>(std::max(1, QThread::idealThreadCount()));
+    const size_t chunks = std::max<size_t>(1, std::min(threads, count / kMinChunk));
+    std::vector<size_t> bounds;
+    for (size_t chunk = 0; chunk <= chunks; ++chunk) {
+        bounds.push_back(count * chunk / chunks);
+    }
+    return bounds;
+}
+
+// Runs function(chunk, first, last) on each chunk, returning once all are
+// done.
+template <typename Function>
+void forEachChunk(const std::vector<size_t>& bounds, Function function) {
+    const size_t chunks = bounds.size() - 1;
+    if (chunks == 1) {
+        function(size_t(0), bounds[0], bounds[1]);
+        return;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(static_cast<int>(chunks));
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        const size_t first = bounds[chunk];
+        const size_t last = bounds[chunk + 1];
+        pool.start(QRunnable::create([&function, chunk, first, last]() { function(chunk, first, last); }));
+    }
+    pool.waitForDone();
+}
+
+// std::sort on one chunk per core, then the sorted chunks merged in pairs,
+// the pairs of each round side by side.
+template <typename Less>
+void parallelSort(std::vector<int>& items, Less less) {
+    std::vector<size_t> bounds = chunkBounds(items.size());
+    forEachChunk(bounds, [&items, &less](size_t, size_t first, size_t last) {
+        std::sort(items.begin() + static_cast<std::ptrdiff_t>(first),
+                  items.begin() + static_cast<std::ptrdiff_t>(last), less);
+    });
+    if (bounds.size() <= 2) {
+        return;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(static_cast<int>(bounds.size() / 2));
+    std::vector<int> buffer(items.size());
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged;
+        for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            merged.push_back(bounds[i]);
+            const size_t first = bounds[i];
+            const size_t middle = bounds[i + 1];
+            const size_t last = i + 2 < bounds.size() ? bounds[i + 2] : middle;
+            pool.start(QRunnable::create([&items, &buffer, &less, first, middle, last]() {
+                std::merge(items.begin() + static_cast<std::ptrdiff_t>(first),
+                           items.begin() + static_cast<std::ptrdiff_t>(middle),
+                           items.begin() + static_cast<std::ptrdiff_t>(middle),
+                           items.begin() + static_cast<std::ptrdiff_t>(last),
+                           buffer.begin() + static_cast<std::ptrdiff_t>(first), less);
+            }));
+        }
+        merged.push_back(items.size());
+        pool.waitForDone();
+        items.swap(buffer);
+        bounds.swap(merged);
+    }
+}
+
+// Each string's place in collation order; equal strings share one.
+std::vector<quint64> collationRanks(const std::vector<QString>& strings) {
+    // Sort keys are made once per string, with a collator per thread as
+    // one is not safe to share. A key cannot be made empty, so each chunk
+    // fills a list of its own.
+    const size_t count = strings.size();
+    const std::vector<size_t> bounds = chunkBounds(count);
+    std::vector<std::vector<QCollatorSortKey>> keys(bounds.size() - 1);
+    forEachChunk(bounds, [&strings, &keys](size_t chunk, size_t first, size_t last) {
+        QCollator collator;
+        collator.setCaseSensitivity(Qt::CaseInsensitive);
+        collator.setNumericMode(true);
+        keys[chunk].reserve(last - first);
+        for (size_t i = first; i < last; ++i) {
+            keys[chunk].push_back(collator.sortKey(strings[i]));
+        }
+    });
+    std::vector<const QCollatorSortKey*> byString;
+    byString.reserve(count);
+    for (const auto& chunk : keys) {
+        for (const QCollatorSortKey& key : chunk) {
+            byString.push_back(&key);
+        }
+    }
+    auto key = [&byString](int i) -> const QCollatorSortKey& { return *byString[static_cast<size_t>(i)]; };
+
+    std::vector<int> sorted(count);
+    for (size_t i = 0; i < count; ++i) {
+        sorted[i] = static_cast<int>(i);
+    }
+    parallelSort(sorted, [&key](int a, int b) {
+        const int order = key(a).compare(key(b));
+        return order != 0 ? order < 0 : a < b;
+    });
+
+    std::vector<quint64> ranks(count);
+    quint64 rank = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0 && key(sorted[i - 1]).compare(key(sorted[i])) != 0) {
+            ++rank;
+        }
+        ranks[static_cast<size_t>(sorted[i])] = rank;
+    }
+    return ranks;
+}
+
+// Ranks of the interned tag values, mapped onto the rows through tagId.
+template <typename TagId>
+void tagRanks(const TrackStore& tracks, TagId tagId, std::vector<quint64>& ranks) {
+    std::vector<QString> tags;
+    tags.reserve(tracks.tagCount());
+    for (quint32 id = 0; id < tracks.tagCount(); ++id) {
+        tags.push_back(tracks.tag(id));
+    }
+    const std::vector<quint64> tagRank = collationRanks(tags);
+    for (int row = 0; row < tracks.size(); ++row) {
+        ranks[static_cast<size_t>(row)] = tagRank[tagId(row)];
+    }
+}
+
+// Ranks of a string made for every row.
+template <typename Text>
+void rowRanks(const TrackStore& tracks, Text text, std::vector<quint64>& ranks) {
+    std::vector<QString> strings(static_cast<size_t>(tracks.size()));
+    forEachChunk(chunkBounds(strings.size()), [&strings, &text](size_t, size_t first, size_t last) {
+        for (size_t row = first; row < last; ++row) {
+            strings[row] = text(static_cast<int>(row));
+        }
+    });
+    ranks = collationRanks(strings);
+}
+
+// The bits of a double as an integer that orders the same way.
+quint64 orderedBits(double value) {
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | (quint64(1) << 63);
+}
+
+std::vector<quint64> fieldRanks(const TrackStore& tracks, TrackSorter::Field field) {
+    std::vector<quint64> ranks(static_cast<size_t>(tracks.size()));
+    switch (field) {
+    case TrackSorter::Title:
+        rowRanks(tracks, [&tracks](int row) { return tracks.title(row); }, ranks);
+        break;
+    case TrackSorter::FilePath:
+        rowRanks(tracks, [&tracks](int row) { return tracks.filePath(row); }, ranks);
+        break;
+    case TrackSorter::FileName:
+        rowRanks(tracks, [&tracks](int row) { return tracks.fileName(row); }, ranks);
+        break;
+    case TrackSorter::Extension:
+        rowRanks(tracks, [&tracks](int row) { return tracks.extension(row); }, ranks);
+        break;
+    case TrackSorter::Artist:
+        tagRanks(tracks, [&tracks](int row) { return tracks.artistId(row); }, ranks);
+        break;
+    case TrackSorter::Album:
+        tagRanks(tracks, [&tracks](int row) { return tracks.albumId(row); }, ranks);
+        break;
+    case TrackSorter::AlbumArtist:
+        tagRanks(tracks, [&tracks](int row) { return tracks.albumArtistId(row); }, ranks);
+        break;
+    case TrackSorter::Genre:
+        tagRanks(tracks, [&tracks](int row) { return tracks.genreId(row); }, ranks);
+        break;
+    case TrackSorter::Year:
+    case TrackSorter::TrackNumber:
+    case TrackSorter::DiscNumber:
+        for (int row = 0; row < tracks.size(); ++row) {
+            const int value = field == TrackSorter::Year ? tracks.year(row)
+                            : field == TrackSorter::TrackNumber ? tracks.trackNumber(row)
+                                                                 : tracks.discNumber(row);
+            ranks[static_cast<size_t>(row)] = static_cast<quint64>(value);
+        }
+        break;
+    case TrackSorter::Duration:
+        for (int row = 0; row < tracks.size(); ++row) {
+            ranks[static_cast<size_t>(row)] = orderedBits(tracks.duration(row));
+        }
+        break;
+    }
+    return ranks;
+}
+
+} // namespace
+
+std::vector<int> TrackSorter::order(const TrackStore& tracks, const std::vector<Key>& keys) {
+    const size_t rows = static_cast<size_t>(tracks.size());
+    std::vector<int> order(rows);
+    for (size_t row = 0; row < rows; ++row) {
+        order[row] = static_cast<int>(row);
+    }
+    if (keys.empty() || rows < 2) {
+        return order;
+    }
+
+    // A row's keys side by side, so comparing two rows reads two short runs.
+    const size_t width = keys.size();
+    std::vector<quint64> ranks(rows * width);
+    for (size_t k = 0; k < width; ++k) {
+        const std::vector<quint64> field = fieldRanks(tracks, keys[k].field);
+        for (size_t row = 0; row < rows; ++row) {
+            ranks[row * width + k] = keys[k].descending ? ~field[row] : field[row];
+        }
+    }
+
+    // Ties go by the current row, which keeps the sort stable.
+    parallelSort(order, [&ranks, width](int a, int b) {
+        const quint64* left = ranks.data() + static_cast<size_t>(a) * width;
+        const quint64* right = ranks.data() + static_cast<size_t>(b) * width;
+        for (size_t k = 0; k < width; ++k) {
+            if (left[k] != right[k]) {
+                return left[k] < right[k];
+            }
+        }
+        return a < b;
+    });
+    return order;
+}
@@ -0,0 +1,43 @@
+#ifndef TRACK_SORTER_H
+#define TRACK_SORTER_H
+
+#include <vector>
+
+class TrackStore;
+
+// Orders TrackStore rows by several fields at once. Every field is turned
+// into one number per row before sorting: strings become their rank in
+// collation order, from sort keys made once per distinct string (per tag
+// value for the interned fields), numbers are used as they are. Rows then
+// compare as a few integers, and are sorted in one chunk per core merged
+// pairwise. Ties keep their current order.
+//
+// Strings collate by the system locale, case-insensitively and with digit
+// runs compared as numbers, so "Track 2" comes before "Track 10".
+class TrackSorter {
+public:
+    enum Field {
+        Title,
+        Artist,
+        Album,
+        AlbumArtist,
+        Genre,
+        Year,
+        TrackNumber,
+        DiscNumber,
+        Duration,
+        FilePath,
+        FileName,
+        Extension
+    };
+
+    struct Key {
+        Field field;
+        bool descending;
+    };
+
+    // Row i of the sorted playlist is row order[i] of tracks.
+    static std::vector<int> order(const TrackStore& tracks, const std::vector<Key>& keys);
+};
+
+#endif // TRACK_SORTER_H
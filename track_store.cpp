@@ -0,0 +1,542 @@
+#include "track_store.h"
+#include <QDataStream>
+#include <QIODevice>
+#include <QStringView>
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+
+const quint16 kMaxStringLength = 0xffff;
+
+quint16 clampNumber(int value) {
+    return static_cast<quint16>(std::max(0, std::min(value, 0xffff)));
+}
+
+// Index just past the directory part of a path, i.e. where the name starts.
+qsizetype nameOffset(const QString& path) {
+    return std::max(path.lastIndexOf(QChar('/')), path.lastIndexOf(QChar('\\'))) + 1;
+}
+
+// FNV-1a over the name, with the directory id in the top bits.
+quint64 hashPath(quint32 directory, const QChar* name, size_t length) {
+    quint32 hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ name[i].unicode()) * 16777619u;
+    }
+    return (static_cast<quint64>(directory) << 32) | hash;
+}
+
+template <typename T>
+void writeColumn(QDataStream& out, const std::vector<T>& column) {
+    out << static_cast<quint32>(column.size());
+    out.writeRawData(reinterpret_cast<const char*>(column.data()), static_cast<int>(column.size() * sizeof(T)));
+}
+
+template <typename T>
+bool readColumn(QDataStream& in, std::vector<T>& column) {
+    quint32 size = 0;
+    in >> size;
+    const qint64 bytes = static_cast<qint64>(size) * static_cast<qint64>(sizeof(T));
+    if (in.status() != QDataStream::Ok || !in.device() || bytes > in.device()->bytesAvailable()) {
+        return false;
+    }
+    column.resize(size);
+    return in.readRawData(reinterpret_cast<char*>(column.data()), static_cast<int>(bytes)) == bytes;
+}
+
+// Id of text in strings, added if new; the empty string is 0.
+quint32 intern(const QString& text, std::vector<QString>& strings, QHash<QString, quint32>& ids) {
+    if (text.isEmpty()) {
+        return 0;
+    }
+    auto it = ids.constFind(text);
+    if (it != ids.constEnd()) {
+        return it.value();
+    }
+    quint32 id = static_cast<quint32>(strings.size());
+    strings.push_back(text);
+    ids.insert(text, id);
+    return id;
+}
+
+void writeStrings(QDataStream& out, const std::vector<QString>& strings) {
+    out << static_cast<quint32>(strings.size());
+    for (const QString& string : strings) {
+        out << string;
+    }
+}
+
+bool readStrings(QDataStream& in, std::vector<QString>& strings) {
+    quint32 size = 0;
+    in >> size;
+    strings.clear();
+    for (quint32 i = 0; i < size && in.status() == QDataStream::Ok; ++i) {
+        strings.emplace_back();
+        in >> strings.back();
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+} // namespace
+
+TrackStore::TrackStore()
+    : deadChars_(0)
+    , tags_(1)
+    , sheets_(1) {
+}
+
+template <typename Function>
+void TrackStore::forEachColumn(Function function) {
+    function(ids_);
+    function(directory_);
+    function(nameStart_);
+    function(nameLength_);
+    function(titleStart_);
+    function(titleLength_);
+    function(format_);
+    function(flags_);
+    function(duration_);
+    function(startTime_);
+    function(endTime_);
+    function(loudness_);
+    function(loudnessRange_);
+    function(truePeak_);
+    function(artist_);
+    function(album_);
+    function(albumArtist_);
+    function(genre_);
+    function(sheet_);
+    function(year_);
+    function(trackNumber_);
+    function(discNumber_);
+}
+
+template <typename Function>
+void TrackStore::forEachColumn(Function function) const {
+    const_cast<TrackStore*>(this)->forEachColumn([&function](const auto& column) { function(column); });
+}
+
+void TrackStore::reserve(size_t rows) {
+    forEachColumn([rows](auto& column) { column.reserve(rows); });
+}
+
+void TrackStore::insert(int row, const std::vector<TrackEntry>& entries) {
+    if (entries.empty()) {
+        return;
+    }
+    row = std::max(0, std::min(row, size()));
+    const size_t first = ids_.size();
+
+    // Bulk adds are mostly runs from one folder with one format, so the
+    // previous lookups are tried before the hashes.
+    quint32 directory = directories_.empty() ? 0 : static_cast<quint32>(directories_.size() - 1);
+    quint16 format = formats_.empty() ? 0 : static_cast<quint16>(formats_.size() - 1);
+
+    for (const TrackEntry& entry : entries) {
+        const QString& path = entry.filePath;
+        const qsizetype name = nameOffset(path);
+        directory = internDirectory(path, name, directory);
+        format = internFormat(path, name, format);
+
+        ids_.push_back(static_cast<quint32>(rows_.size()));
+        rows_.push_back(-1);
+        directory_.push_back(directory);
+        nameStart_.emplace_back();
+        nameLength_.emplace_back();
+        appendString(path, name, nameStart_.back(), nameLength_.back());
+        titleStart_.emplace_back();
+        titleLength_.emplace_back();
+        appendString(entry.title, 0, titleStart_.back(), titleLength_.back());
+        format_.push_back(format);
+        flags_.push_back(entry.isVirtual ? Virtual : 0);
+        duration_.push_back(entry.duration);
+        startTime_.push_back(entry.startTime);
+        endTime_.push_back(entry.endTime);
+        loudness_.push_back(0.0f);
+        loudnessRange_.push_back(0.0f);
+        truePeak_.push_back(0.0f);
+        artist_.push_back(internTag(entry.artist));
+        album_.push_back(internTag(entry.album));
+        albumArtist_.push_back(internTag(entry.albumArtist));
+        genre_.push_back(internTag(entry.genre));
+        sheet_.push_back(internSheet(entry.cueSheet));
+        year_.push_back(clampNumber(entry.year));
+        trackNumber_.push_back(clampNumber(entry.trackNumber));
+        discNumber_.push_back(clampNumber(entry.discNumber));
+        indexPath(size() - 1);
+    }
+
+    if (static_cast<size_t>(row) < first) {
+        forEachColumn([row, first](auto& column) {
+            std::rotate(column.begin() + row, column.begin() + first, column.end());
+        });
+    }
+    updateRows(row);
+}
+
+void TrackStore::setFilePath(int row, const QString& filePath) {
+    unindexPath(row);
+    const qsizetype name = nameOffset(filePath);
+    directory_[row] = internDirectory(filePath, name, directory_[row]);
+    format_[row] = internFormat(filePath, name, format_[row]);
+
+    const QChar* current = chars_.data() + nameStart_[row];
+    const size_t length = static_cast<size_t>(filePath.size() - name);
+    if (length != nameLength_[row] || !std::equal(current, current + length, filePath.constData() + name)) {
+        deadChars_ += nameLength_[row];
+        appendString(filePath, name, nameStart_[row], nameLength_[row]);
+        compactIfWasteful();
+    }
+    indexPath(row);
+}
+
+void TrackStore::remove(int row, int count) {
+    count = std::min(count, size() - row);
+    if (row < 0 || count <= 0) {
+        return;
+    }
+
+    for (int i = row; i < row + count; ++i) {
+        deadChars_ += nameLength_[i] + titleLength_[i];
+        rows_[ids_[i]] = -1;
+        unindexPath(i);
+    }
+    forEachColumn([row, count](auto& column) {
+        column.erase(column.begin() + row, column.begin() + row + count);
+    });
+    updateRows(row);
+    compactIfWasteful();
+}
+
+void TrackStore::move(int first, int count, int destination) {
+    const int last = first + count;
+    if (first < 0 || count <= 0 || last > size() || destination < 0 || destination > size() ||
+        (destination >= first && destination <= last)) {
+        return;
+    }
+
+    forEachColumn([first, last, destination](auto& column) {
+        if (destination < first) {
+            std::rotate(column.begin() + destination, column.begin() + first, column.begin() + last);
+        } else {
+            std::rotate(column.begin() + first, column.begin() + last, column.begin() + destination);
+        }
+    });
+    updateRows(std::min(first, destination));
+}
+
+void TrackStore::reorder(const std::vector<int>& order) {
+    if (order.size() != ids_.size()) {
+        return;
+    }
+
+    forEachColumn([&order](auto& column) {
+        std::remove_reference_t<decltype(column)> sorted;
+        sorted.reserve(column.size());
+        for (int row : order) {
+            sorted.push_back(column[static_cast<size_t>(row)]);
+        }
+        column.swap(sorted);
+    });
+    updateRows(0);
+}
+
+void TrackStore::clear() {
+    forEachColumn([](auto& column) { column.clear(); });
+    chars_.clear();
+    deadChars_ = 0;
+    directories_.clear();
+    directoryIds_.clear();
+    formats_.clear();
+    formatIds_.clear();
+    tags_.resize(1);
+    tagIds_.clear();
+    sheets_.resize(1);
+    sheetIds_.clear();
+    pathIds_.clear();
+    // Ids are never reused, so stale ones keep resolving to nothing.
+    std::fill(rows_.begin(), rows_.end(), -1);
+}
+
+int TrackStore::rowOf(quint32 id) const {
+    return id < rows_.size() ? rows_[id] : -1;
+}
+
+QString TrackStore::filePath(int row) const {
+    return directories_[directory_[row]] + QString(chars_.data() + nameStart_[row], nameLength_[row]);
+}
+
+QString TrackStore::fileName(int row) const {
+    const QChar* name = chars_.data() + nameStart_[row];
+    const QChar* end = name + nameLength_[row];
+    return QString(name, std::find(name, end, QChar('.')) - name);
+}
+
+QString TrackStore::title(int row) const {
+    return titleLength_[row] > 0 ? QString(chars_.data() + titleStart_[row], titleLength_[row]) : fileName(row);
+}
+
+TrackEntry TrackStore::entry(int row) const {
+    TrackEntry entry;
+    entry.filePath = filePath(row);
+    entry.title = title(row);
+    entry.artist = artist(row);
+    entry.album = album(row);
+    entry.albumArtist = albumArtist(row);
+    entry.genre = genre(row);
+    entry.year = year_[row];
+    entry.trackNumber = trackNumber_[row];
+    entry.discNumber = discNumber_[row];
+    entry.duration = duration_[row];
+    entry.startTime = startTime_[row];
+    entry.endTime = endTime_[row];
+    entry.isVirtual = isVirtual(row);
+    entry.cueSheet = cueSheet(row);
+    return entry;
+}
+
+void TrackStore::setLoudness(int row, double integratedLufs, double rangeLu, double truePeakDb) {
+    flags_[row] |= HasLoudness;
+    loudness_[row] = static_cast<float>(integratedLufs);
+    loudnessRange_[row] = static_cast<float>(rangeLu);
+    truePeak_[row] = static_cast<float>(truePeakDb);
+}
+
+void TrackStore::setTags(int row, const TrackEntry& entry) {
+    const QChar* current = chars_.data() + titleStart_[row];
+    const size_t length = static_cast<size_t>(entry.title.size());
+    if (length != titleLength_[row] || !std::equal(current, current + length, entry.title.constData())) {
+        deadChars_ += titleLength_[row];
+        appendString(entry.title, 0, titleStart_[row], titleLength_[row]);
+        compactIfWasteful();
+    }
+    artist_[row] = internTag(entry.artist);
+    album_[row] = internTag(entry.album);
+    albumArtist_[row] = internTag(entry.albumArtist);
+    genre_[row] = internTag(entry.genre);
+    year_[row] = clampNumber(entry.year);
+    trackNumber_[row] = clampNumber(entry.trackNumber);
+    discNumber_[row] = clampNumber(entry.discNumber);
+}
+
+std::vector<int> TrackStore::rowsInFolders(const QStringList& folders, bool recursive) const {
+    std::vector<bool> wanted(directories_.size(), false);
+    bool any = false;
+    for (const QString& folder : folders) {
+        const QString prefix = folder.endsWith('/') ? folder : folder + '/';
+        if (!recursive) {
+            auto it = directoryIds_.constFind(prefix);
+            if (it != directoryIds_.constEnd()) {
+                wanted[it.value()] = true;
+                any = true;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < directories_.size(); ++i) {
+            if (directories_[i].startsWith(prefix)) {
+                wanted[i] = true;
+                any = true;
+            }
+        }
+    }
+
+    std::vector<int> rows;
+    if (!any) {
+        return rows;
+    }
+    for (size_t i = 0; i < directory_.size(); ++i) {
+        if (wanted[directory_[i]]) {
+            rows.push_back(static_cast<int>(i));
+        }
+    }
+    return rows;
+}
+
+void TrackStore::write(QDataStream& out) const {
+    out << static_cast<quint32>(ids_.size());
+    forEachColumn([&out](const auto& column) { writeColumn(out, column); });
+    writeColumn(out, chars_);
+    writeStrings(out, directories_);
+    writeStrings(out, formats_);
+    writeStrings(out, tags_);
+    writeStrings(out, sheets_);
+}
+
+bool TrackStore::read(QDataStream& in) {
+    clear();
+
+    quint32 rows = 0;
+    in >> rows;
+    bool ok = in.status() == QDataStream::Ok;
+    forEachColumn([&in, &ok, rows](auto& column) {
+        ok = ok && readColumn(in, column) && column.size() == rows;
+    });
+    ok = ok && readColumn(in, chars_) && readStrings(in, directories_) && readStrings(in, formats_)
+        && readStrings(in, tags_) && !tags_.empty() && tags_[0].isEmpty()
+        && readStrings(in, sheets_) && !sheets_.empty() && sheets_[0].isEmpty();
+
+    // Everything a row points at has to be there.
+    size_t liveChars = 0;
+    for (size_t i = 0; ok && i < rows; ++i) {
+        ok = directory_[i] < directories_.size() && format_[i] < formats_.size()
+            && size_t(nameStart_[i]) + nameLength_[i] <= chars_.size()
+            && size_t(titleStart_[i]) + titleLength_[i] <= chars_.size()
+            && artist_[i] < tags_.size() && album_[i] < tags_.size()
+            && albumArtist_[i] < tags_.size() && genre_[i] < tags_.size()
+            && sheet_[i] < sheets_.size();
+        liveChars += nameLength_[i] + titleLength_[i];
+    }
+    if (!ok) {
+        clear();
+        tags_.assign(1, QString());
+        sheets_.assign(1, QString());
+        return false;
+    }
+
+    deadChars_ = chars_.size() - liveChars;
+    for (size_t i = 0; i < directories_.size(); ++i) {
+        directoryIds_.insert(directories_[i], static_cast<quint32>(i));
+    }
+    for (size_t i = 0; i < formats_.size(); ++i) {
+        formatIds_.insert(formats_[i], static_cast<quint16>(i));
+    }
+    for (size_t i = 1; i < tags_.size(); ++i) {
+        tagIds_.insert(tags_[i], static_cast<quint32>(i));
+    }
+    for (size_t i = 1; i < sheets_.size(); ++i) {
+        sheetIds_.insert(sheets_[i], static_cast<quint32>(i));
+    }
+
+    // Ids carry on from the ones handed out before.
+    const quint32 firstId = static_cast<quint32>(rows_.size());
+    for (size_t i = 0; i < rows; ++i) {
+        ids_[i] = firstId + static_cast<quint32>(i);
+    }
+    rows_.resize(rows_.size() + rows);
+    updateRows(0);
+    pathIds_.reserve(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        indexPath(static_cast<int>(i));
+    }
+    return true;
+}
+
+std::vector<int> TrackStore::rowsOf(const QString& filePath) const {
+    std::vector<int> rows;
+    const qsizetype name = nameOffset(filePath);
+    auto it = directoryIds_.constFind(filePath.left(name));
+    if (it == directoryIds_.constEnd()) {
+        return rows;
+    }
+
+    const quint32 directory = it.value();
+    const QChar* wanted = filePath.constData() + name;
+    const size_t length = static_cast<size_t>(filePath.size() - name);
+    auto range = pathIds_.equal_range(hashPath(directory, wanted, length));
+    for (auto id = range.first; id != range.second; ++id) {
+        const int row = rows_[id->second];
+        if (directory_[row] == directory && nameLength_[row] == length &&
+            std::equal(wanted, wanted + length, chars_.data() + nameStart_[row])) {
+            rows.push_back(row);
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+quint32 TrackStore::internDirectory(const QString& path, qsizetype name, quint32 hint) {
+    QStringView directory = QStringView(path).left(name);
+    if (hint < directories_.size() && directory == directories_[hint]) {
+        return hint;
+    }
+
+    QString key = directory.toString();
+    auto it = directoryIds_.constFind(key);
+    if (it != directoryIds_.constEnd()) {
+        return it.value();
+    }
+    quint32 id = static_cast<quint32>(directories_.size());
+    directories_.push_back(key);
+    directoryIds_.insert(key, id);
+    return id;
+}
+
+quint16 TrackStore::internFormat(const QString& path, qsizetype name, quint16 hint) {
+    const qsizetype dot = path.lastIndexOf(QChar('.'));
+    QStringView suffix = dot >= name ? QStringView(path).sliced(dot + 1) : QStringView();
+    if (hint < formats_.size() && suffix == formats_[hint]) {
+        return hint;
+    }
+
+    QString key = suffix.toString().toLower();
+    auto it = formatIds_.constFind(key);
+    if (it != formatIds_.constEnd()) {
+        return it.value();
+    }
+    quint16 id = static_cast<quint16>(formats_.size());
+    formats_.push_back(key);
+    formatIds_.insert(key, id);
+    return id;
+}
+
+void TrackStore::appendString(const QString& text, qsizetype from, quint32& start, quint16& length) {
+    const qsizetype count = std::min<qsizetype>(text.size() - from, kMaxStringLength);
+    start = static_cast<quint32>(chars_.size());
+    length = static_cast<quint16>(count);
+    chars_.insert(chars_.end(), text.constData() + from, text.constData() + from + count);
+}
+
+quint32 TrackStore::internTag(const QString& text) {
+    return intern(text, tags_, tagIds_);
+}
+
+quint32 TrackStore::internSheet(const QString& path) {
+    return intern(path, sheets_, sheetIds_);
+}
+
+void TrackStore::updateRows(int from) {
+    for (size_t i = static_cast<size_t>(from); i < ids_.size(); ++i) {
+        rows_[ids_[i]] = static_cast<int>(i);
+    }
+}
+
+quint64 TrackStore::pathKey(int row) const {
+    return hashPath(directory_[row], chars_.data() + nameStart_[row], nameLength_[row]);
+}
+
+void TrackStore::indexPath(int row) {
+    pathIds_.emplace(pathKey(row), ids_[row]);
+}
+
+void TrackStore::unindexPath(int row) {
+    auto range = pathIds_.equal_range(pathKey(row));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == ids_[row]) {
+            pathIds_.erase(it);
+            return;
+        }
+    }
+}
+
+void TrackStore::compactIfWasteful() {
+    if (deadChars_ > 65536 && deadChars_ > chars_.size() / 2) {
+        compact();
+    }
+}
+
+void TrackStore::compact() {
+    std::vector<QChar> chars;
+    chars.reserve(chars_.size() - deadChars_);
+    for (size_t i = 0; i < ids_.size(); ++i) {
+        const QChar* name = chars_.data() + nameStart_[i];
+        nameStart_[i] = static_cast<quint32>(chars.size());
+        chars.insert(chars.end(), name, name + nameLength_[i]);
+
+        const QChar* title = chars_.data() + titleStart_[i];
+        titleStart_[i] = static_cast<quint32>(chars.size());
+        chars.insert(chars.end(), title, title + titleLength_[i]);
+    }
+    chars_.swap(chars);
+    deadChars_ = 0;
+}
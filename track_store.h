@@ -0,0 +1,184 @@
+#ifndef TRACK_STORE_H
+#define TRACK_STORE_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class QDataStream;
+
+// One playlist entry, as it is added or read back whole.
+struct TrackEntry {
+    QString filePath;
+    // Empty when neither the tags nor a CUE sheet name the track; it is
+    // then titled by its base name.
+    QString title;
+    QString artist;
+    QString album;
+    QString albumArtist;
+    QString genre;
+    int year;
+    int trackNumber;
+    int discNumber;
+    double duration;
+    double startTime;
+    double endTime;
+    bool isVirtual;
+    // The CUE sheet a virtual track was read from, if any.
+    QString cueSheet;
+
+    TrackEntry()
+        : year(0), trackNumber(0), discNumber(0), duration(0.0), startTime(0.0), endTime(0.0), isVirtual(false) {}
+};
+
+// Columnar playlist storage. A row is an index into parallel arrays rather
+// than an object: directories and extensions are interned, file names and
+// titles share one UTF-16 character pool, artist, album and genre strings
+// are interned, and the numbers sit in contiguous arrays, so a row costs
+// about 80 bytes plus its file name. Every row also
+// gets an id that stays with it through inserts, removals and moves.
+class TrackStore {
+public:
+    TrackStore();
+
+    int size() const { return static_cast<int>(ids_.size()); }
+    bool isEmpty() const { return ids_.empty(); }
+    void reserve(size_t rows);
+
+    // Inserts the entries before row; size() appends.
+    void insert(int row, const std::vector<TrackEntry>& entries);
+    void remove(int row, int count = 1);
+    // Moves count rows from first to before destination, which counts rows
+    // as they were before the move, as in QAbstractItemModel::beginMoveRows.
+    void move(int first, int count, int destination);
+    // Puts the rows in the given order: row i becomes the row that was at
+    // order[i]. order must hold every row once.
+    void reorder(const std::vector<int>& order);
+    void clear();
+
+    quint32 id(int row) const { return ids_[row]; }
+    // -1 once the row is gone.
+    int rowOf(quint32 id) const;
+
+    QString filePath(int row) const;
+    // Base name, up to the first dot, as QFileInfo::baseName().
+    QString fileName(int row) const;
+    QString title(int row) const;
+    QString extension(int row) const { return formats_[format_[row]]; }
+    double duration(int row) const { return duration_[row]; }
+    double startTime(int row) const { return startTime_[row]; }
+    double endTime(int row) const { return endTime_[row]; }
+    bool isVirtual(int row) const { return (flags_[row] & Virtual) != 0; }
+    bool hasLoudness(int row) const { return (flags_[row] & HasLoudness) != 0; }
+    double loudness(int row) const { return loudness_[row]; }
+    double loudnessRange(int row) const { return loudnessRange_[row]; }
+    double truePeak(int row) const { return truePeak_[row]; }
+    const QString& artist(int row) const { return tags_[artist_[row]]; }
+    const QString& album(int row) const { return tags_[album_[row]]; }
+    const QString& albumArtist(int row) const { return tags_[albumArtist_[row]]; }
+    const QString& genre(int row) const { return tags_[genre_[row]]; }
+    const QString& cueSheet(int row) const { return sheets_[sheet_[row]]; }
+    int year(int row) const { return year_[row]; }
+    int trackNumber(int row) const { return trackNumber_[row]; }
+    int discNumber(int row) const { return discNumber_[row]; }
+    TrackEntry entry(int row) const;
+
+    // Interned tag values, so a value shared by many rows is handled once.
+    quint32 tagCount() const { return static_cast<quint32>(tags_.size()); }
+    const QString& tag(quint32 tagId) const { return tags_[tagId]; }
+    quint32 artistId(int row) const { return artist_[row]; }
+    quint32 albumId(int row) const { return album_[row]; }
+    quint32 albumArtistId(int row) const { return albumArtist_[row]; }
+    quint32 genreId(int row) const { return genre_[row]; }
+    // Rows from the same folder share one.
+    quint32 directoryId(int row) const { return directory_[row]; }
+
+    void setDuration(int row, double duration) { duration_[row] = duration; }
+    void setFilePath(int row, const QString& filePath);
+    void setLoudness(int row, double integratedLufs, double rangeLu, double truePeakDb);
+    // Title and tag fields from entry; path, span and duration stay.
+    void setTags(int row, const TrackEntry& entry);
+
+    // The rows and their shared strings as they are held, in this machine's
+    // byte order, for the session snapshot. read() replaces the rows, which
+    // get new ids; if the data does not hold up it leaves the store empty
+    // and returns false.
+    void write(QDataStream& out) const;
+    bool read(QDataStream& in);
+
+    // Rows that play filePath, in order; CUE images have several.
+    std::vector<int> rowsOf(const QString& filePath) const;
+    // Rows whose file sits in one of the folders, or anywhere below them.
+    std::vector<int> rowsInFolders(const QStringList& folders, bool recursive) const;
+
+private:
+    enum Flag : uint8_t {
+        Virtual = 1,
+        HasLoudness = 2
+    };
+
+    template <typename Function>
+    void forEachColumn(Function function);
+    template <typename Function>
+    void forEachColumn(Function function) const;
+    quint32 internDirectory(const QString& path, qsizetype name, quint32 hint);
+    quint16 internFormat(const QString& path, qsizetype name, quint16 hint);
+    void appendString(const QString& text, qsizetype from, quint32& start, quint16& length);
+    quint32 internTag(const QString& text);
+    quint32 internSheet(const QString& path);
+    void updateRows(int from);
+    quint64 pathKey(int row) const;
+    void indexPath(int row);
+    void unindexPath(int row);
+    void compactIfWasteful();
+    void compact();
+
+    // Per row.
+    std::vector<quint32> ids_;
+    std::vector<quint32> directory_;
+    std::vector<quint32> nameStart_;
+    std::vector<quint16> nameLength_;
+    std::vector<quint32> titleStart_;
+    std::vector<quint16> titleLength_;
+    std::vector<quint16> format_;
+    std::vector<uint8_t> flags_;
+    std::vector<double> duration_;
+    std::vector<double> startTime_;
+    std::vector<double> endTime_;
+    std::vector<float> loudness_;
+    std::vector<float> loudnessRange_;
+    std::vector<float> truePeak_;
+    std::vector<quint32> artist_;
+    std::vector<quint32> album_;
+    std::vector<quint32> albumArtist_;
+    std::vector<quint32> genre_;
+    std::vector<quint32> sheet_;
+    std::vector<quint16> year_;
+    std::vector<quint16> trackNumber_;
+    std::vector<quint16> discNumber_;
+
+    // Shared.
+    std::vector<QChar> chars_;
+    size_t deadChars_;
+    std::vector<QString> directories_;
+    QHash<QString, quint32> directoryIds_;
+    std::vector<QString> formats_;
+    QHash<QString, quint16> formatIds_;
+    // Tag values; 0 is the empty string. Kept until clear(), as a library
+    // repeats the same few artists and albums.
+    std::vector<QString> tags_;
+    QHash<QString, quint32> tagIds_;
+    // CUE sheet paths; 0 is none.
+    std::vector<QString> sheets_;
+    QHash<QString, quint32> sheetIds_;
+    // Indexed by id.
+    std::vector<int> rows_;
+    // Ids by a hash of directory and file name, for rowsOf(); ids rather
+    // than rows so moves leave it alone.
+    std::unordered_multimap<quint64, quint32> pathIds_;
+};
+
+#endif // TRACK_STORE_H
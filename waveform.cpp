@@ -0,0 +1,145 @@
+#include "waveform.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WAVEFORM_SSE2 1
+#endif
+
+namespace {
+
+WaveformPyramid::Bucket scanBucket(const int16_t* samples, size_t count) {
+    int16_t minValue = 32767;
+    int16_t maxValue = -32768;
+    double sumSquares = 0.0;
+    size_t i = 0;
+
+#ifdef WAVEFORM_SSE2
+    __m128i vmin = _mm_set1_epi16(32767);
+    __m128i vmax = _mm_set1_epi16(-32768);
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        vmin = _mm_min_epi16(vmin, x);
+        vmax = _mm_max_epi16(vmax, x);
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(lo, lo));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(hi, hi));
+    }
+    alignas(16) int16_t mins[8];
+    alignas(16) int16_t maxs[8];
+    alignas(16) float sums[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(mins), vmin);
+    _mm_store_si128(reinterpret_cast<__m128i*>(maxs), vmax);
+    _mm_store_ps(sums, _mm_add_ps(sum0, sum1));
+    for (int lane = 0; lane < 8; ++lane) {
+        minValue = std::min(minValue, mins[lane]);
+        maxValue = std::max(maxValue, maxs[lane]);
+    }
+    sumSquares = static_cast<double>(sums[0]) + sums[1] + sums[2] + sums[3];
+#endif
+
+    for (; i < count; ++i) {
+        minValue = std::min(minValue, samples[i]);
+        maxValue = std::max(maxValue, samples[i]);
+        sumSquares += static_cast<double>(samples[i]) * samples[i];
+    }
+
+    WaveformPyramid::Bucket bucket;
+    bucket.min = minValue;
+    bucket.max = maxValue;
+    bucket.rms = static_cast<uint16_t>(std::min(65535.0, std::sqrt(sumSquares / std::max<size_t>(1, count))));
+    return bucket;
+}
+
+WaveformPyramid::Bucket merge(const WaveformPyramid::Bucket& a, const WaveformPyramid::Bucket& b) {
+    WaveformPyramid::Bucket bucket;
+    bucket.min = std::min(a.min, b.min);
+    bucket.max = std::max(a.max, b.max);
+    bucket.rms = static_cast<uint16_t>(std::sqrt((static_cast<double>(a.rms) * a.rms + static_cast<double>(b.rms) * b.rms) * 0.5));
+    return bucket;
+}
+
+} // namespace
+
+WaveformPyramid::WaveformPyramid()
+    : totalFrames_(0) {
+}
+
+void WaveformPyramid::build(const int16_t* interleaved, size_t frames, int channels) {
+    levels_.clear();
+    totalFrames_ = frames;
+    if (frames == 0 || channels <= 0) {
+        return;
+    }
+
+    const size_t bucketCount = (frames + kBaseFrames - 1) / kBaseFrames;
+    const size_t bucketSamples = kBaseFrames * channels;
+    const size_t totalSamples = frames * channels;
+
+    std::vector<Bucket> base(bucketCount);
+    for (size_t b = 0; b < bucketCount; ++b) {
+        size_t start = b * bucketSamples;
+        base[b] = scanBucket(interleaved + start, std::min(bucketSamples, totalSamples - start));
+    }
+
+    levels_.push_back(std::move(base));
+    buildLevels();
+}
+
+void WaveformPyramid::assign(std::vector<std::vector<Bucket>>&& levels, size_t frames) {
+    levels_ = std::move(levels);
+    totalFrames_ = frames;
+}
+
+void WaveformPyramid::buildLevels() {
+    while (levels_.back().size() > 1) {
+        const std::vector<Bucket>& previous = levels_.back();
+        std::vector<Bucket> next((previous.size() + 1) / 2);
+        for (size_t i = 0; i < next.size(); ++i) {
+            next[i] = 2 * i + 1 < previous.size() ? merge(previous[2 * i], previous[2 * i + 1]) : previous[2 * i];
+        }
+        levels_.push_back(std::move(next));
+    }
+}
+
+void WaveformPyramid::render(size_t columns, std::vector<Bucket>& output,
+                             size_t firstFrame, size_t lastFrame) const {
+    output.clear();
+    if (levels_.empty() || columns == 0) {
+        return;
+    }
+
+    // Level 0 buckets covering the range, at least one.
+    const size_t baseCount = levels_[0].size();
+    size_t baseFirst = std::min(firstFrame / kBaseFrames, baseCount - 1);
+    size_t baseLast = lastFrame > firstFrame ? (lastFrame + kBaseFrames - 1) / kBaseFrames : baseCount;
+    baseLast = std::clamp(baseLast, baseFirst + 1, baseCount);
+
+    size_t level = 0;
+    const size_t span = baseLast - baseFirst;
+    while (level + 1 < levels_.size() && ((span + (size_t(2) << level) - 1) >> (level + 1)) >= columns) {
+        ++level;
+    }
+
+    const std::vector<Bucket>& buckets = levels_[level];
+    const size_t offset = baseFirst >> level;
+    const size_t count = std::min(buckets.size(), ((baseLast - 1) >> level) + 1) - offset;
+    output.resize(columns);
+    for (size_t c = 0; c < columns; ++c) {
+        size_t first = offset + c * count / columns;
+        size_t last = std::max(first + 1, offset + (c + 1) * count / columns);
+        Bucket bucket = buckets[first];
+        double sumSquares = static_cast<double>(bucket.rms) * bucket.rms;
+        for (size_t i = first + 1; i < last; ++i) {
+            bucket.min = std::min(bucket.min, buckets[i].min);
+            bucket.max = std::max(bucket.max, buckets[i].max);
+            sumSquares += static_cast<double>(buckets[i].rms) * buckets[i].rms;
+        }
+        bucket.rms = static_cast<uint16_t>(std::sqrt(sumSquares / (last - first)));
+        output[c] = bucket;
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Min/max/RMS overview of a track at power-of-two zoom levels. Level 0 holds
+// one bucket per kBaseFrames frames across all channels; each further level
+// halves the previous one, so a view of any width is drawn from the nearest
+// level without touching the samples again.
+class WaveformPyramid {
+public:
+    static constexpr size_t kBaseFrames = 1024;
+
+    struct Bucket {
+        int16_t min;
+        int16_t max;
+        uint16_t rms;
+    };
+
+    WaveformPyramid();
+
+    void build(const int16_t* interleaved, size_t frames, int channels);
+    void assign(std::vector<std::vector<Bucket>>&& levels, size_t frames);
+
+    bool isEmpty() const { return levels_.empty(); }
+    size_t totalFrames() const { return totalFrames_; }
+    const std::vector<std::vector<Bucket>>& levels() const { return levels_; }
+
+    // Reduces the track, or frames firstFrame..lastFrame of it, to exactly
+    // `columns` buckets from the coarsest level that still has at least one
+    // bucket per column.
+    void render(size_t columns, std::vector<Bucket>& output,
+                size_t firstFrame = 0, size_t lastFrame = 0) const;
+
+private:
+    void buildLevels();
+
+    std::vector<std::vector<Bucket>> levels_;
+    size_t totalFrames_;
+};
+
+#endif // WAVEFORM_H
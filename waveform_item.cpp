@@ -0,0 +1,145 @@
+#include "waveform_item.h"
+#include <QQuickWindow>
+#include <QSGFlatColorMaterial>
+#include <QSGGeometryNode>
+#include <cmath>
+
+namespace {
+
+QSGGeometryNode* createLineNode(const QColor& color) {
+    auto* node = new QSGGeometryNode;
+    auto* geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+    geometry->setDrawingMode(QSGGeometry::DrawLines);
+    geometry->setLineWidth(1.0f);
+    node->setGeometry(geometry);
+    node->setFlag(QSGNode::OwnsGeometry);
+
+    auto* material = new QSGFlatColorMaterial;
+    material->setColor(color);
+    node->setMaterial(material);
+    node->setFlag(QSGNode::OwnsMaterial);
+    return node;
+}
+
+} // namespace
+
+WaveformItem::WaveformItem(QQuickItem* parent)
+    : QQuickItem(parent)
+    , color_("#535353")
+    , rmsColor_("#b3b3b3")
+    , geometryDirty_(true)
+    , colorDirty_(true) {
+    setFlag(ItemHasContents, true);
+}
+
+void WaveformItem::setSource(WaveformProvider* source) {
+    if (source_ == source) {
+        return;
+    }
+    if (source_) {
+        disconnect(source_, nullptr, this, nullptr);
+    }
+    source_ = source;
+    if (source_) {
+        connect(source_, &WaveformProvider::changed, this, &WaveformItem::markDirty);
+    }
+    markDirty();
+    emit sourceChanged();
+}
+
+void WaveformItem::setColor(const QColor& color) {
+    if (color_ != color) {
+        color_ = color;
+        colorDirty_ = true;
+        update();
+        emit colorChanged();
+    }
+}
+
+void WaveformItem::setRmsColor(const QColor& color) {
+    if (rmsColor_ != color) {
+        rmsColor_ = color;
+        colorDirty_ = true;
+        update();
+        emit colorChanged();
+    }
+}
+
+void WaveformItem::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) {
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        markDirty();
+    }
+}
+
+void WaveformItem::markDirty() {
+    geometryDirty_ = true;
+    update();
+}
+
+QSGNode* WaveformItem::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) {
+    Q_UNUSED(data)
+
+    std::shared_ptr<const WaveformPyramid> pyramid = source_ ? source_->pyramid() : nullptr;
+    if (!pyramid || width() < 1.0 || height() < 1.0) {
+        delete oldNode;
+        return nullptr;
+    }
+
+    QSGNode* root = oldNode;
+    if (!root) {
+        root = new QSGNode;
+        root->appendChildNode(createLineNode(color_));
+        root->appendChildNode(createLineNode(rmsColor_));
+        geometryDirty_ = true;
+        colorDirty_ = false;
+    }
+
+    auto* peakNode = static_cast<QSGGeometryNode*>(root->firstChild());
+    auto* rmsNode = static_cast<QSGGeometryNode*>(root->lastChild());
+
+    if (colorDirty_) {
+        static_cast<QSGFlatColorMaterial*>(peakNode->material())->setColor(color_);
+        static_cast<QSGFlatColorMaterial*>(rmsNode->material())->setColor(rmsColor_);
+        peakNode->markDirty(QSGNode::DirtyMaterial);
+        rmsNode->markDirty(QSGNode::DirtyMaterial);
+        colorDirty_ = false;
+    }
+
+    if (geometryDirty_) {
+        const qreal ratio = window() ? window()->effectiveDevicePixelRatio() : 1.0;
+        const int columns = std::max(1, static_cast<int>(std::ceil(width() * ratio)));
+        const float step = static_cast<float>(width() / columns);
+        const float middle = static_cast<float>(height() / 2.0);
+        const float scale = middle / 32768.0f;
+
+        std::vector<WaveformPyramid::Bucket> buckets;
+        pyramid->render(columns, buckets, source_->rangeStart(), source_->rangeEnd());
+
+        QSGGeometry* peaks = peakNode->geometry();
+        QSGGeometry* rms = rmsNode->geometry();
+        peaks->allocate(columns * 2);
+        rms->allocate(columns * 2);
+        QSGGeometry::Point2D* peakVertices = peaks->vertexDataAsPoint2D();
+        QSGGeometry::Point2D* rmsVertices = rms->vertexDataAsPoint2D();
+
+        for (int c = 0; c < columns; ++c) {
+            const WaveformPyramid::Bucket& bucket = buckets[c];
+            const float x = (c + 0.5f) * step;
+            // Keep silent stretches visible as a hairline.
+            const float top = std::min(middle - 0.5f, middle - bucket.max * scale);
+            const float bottom = std::max(middle + 0.5f, middle - bucket.min * scale);
+            const float level = std::min(bucket.rms * scale, middle);
+            peakVertices[c * 2].set(x, top);
+            peakVertices[c * 2 + 1].set(x, bottom);
+            rmsVertices[c * 2].set(x, middle - level);
+            rmsVertices[c * 2 + 1].set(x, middle + level);
+        }
+
+        peakNode->markDirty(QSGNode::DirtyGeometry);
+        rmsNode->markDirty(QSGNode::DirtyGeometry);
+        geometryDirty_ = false;
+    }
+
+    return root;
+}
@@ -0,0 +1,47 @@
+#ifndef WAVEFORM_ITEM_H
+#define WAVEFORM_ITEM_H
+
+#include "waveform_provider.h"
+#include <QColor>
+#include <QPointer>
+#include <QQuickItem>
+
+// Scene-graph waveform: one vertical line per device pixel for the peak
+// envelope and a second one for RMS. Geometry is rebuilt from the pyramid
+// only when the size or the track changes; playback progress is drawn by
+// the QML around it.
+class WaveformItem : public QQuickItem {
+    Q_OBJECT
+    Q_PROPERTY(WaveformProvider* source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(QColor rmsColor READ rmsColor WRITE setRmsColor NOTIFY colorChanged)
+
+public:
+    explicit WaveformItem(QQuickItem* parent = nullptr);
+
+    WaveformProvider* source() const { return source_; }
+    void setSource(WaveformProvider* source);
+    QColor color() const { return color_; }
+    void setColor(const QColor& color);
+    QColor rmsColor() const { return rmsColor_; }
+    void setRmsColor(const QColor& color);
+
+signals:
+    void sourceChanged();
+    void colorChanged();
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+
+private:
+    void markDirty();
+
+    QPointer<WaveformProvider> source_;
+    QColor color_;
+    QColor rmsColor_;
+    bool geometryDirty_;
+    bool colorDirty_;
+};
+
+#endif // WAVEFORM_ITEM_H
@@ -0,0 +1,148 @@
+#include "waveform_provider.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+const quint32 kCacheMagic = 0x57564650; // "WVFP"
+const quint32 kCacheVersion = 1;
+
+} // namespace
+
+WaveformProvider::WaveformProvider(QObject* parent)
+    : QObject(parent)
+    , rangeStart_(0)
+    , rangeEnd_(0)
+    , generation_(0) {
+    pool_.setMaxThreadCount(1);
+}
+
+WaveformProvider::~WaveformProvider() {
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+void WaveformProvider::load(const QString& filePath, std::shared_ptr<const AudioData> audioData) {
+    if (filePath == path_) {
+        return;
+    }
+    clear();
+    path_ = filePath;
+
+    unsigned generation = generation_;
+    pool_.start(QRunnable::create([this, filePath, audioData, generation]() {
+        auto pyramid = std::make_shared<WaveformPyramid>();
+        if (!readCache(filePath, *pyramid) && audioData) {
+            pyramid->build(audioData->samples.data(), audioData->totalFrames, audioData->channels);
+            writeCache(filePath, *pyramid);
+        }
+
+        QMetaObject::invokeMethod(this, [this, pyramid, generation]() {
+            if (generation == generation_ && !pyramid->isEmpty()) {
+                pyramid_ = pyramid;
+                emit changed();
+            }
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void WaveformProvider::clear() {
+    ++generation_;
+    pool_.clear();
+    path_.clear();
+    if (pyramid_) {
+        pyramid_.reset();
+        emit changed();
+    }
+}
+
+void WaveformProvider::setRange(size_t startFrame, size_t endFrame) {
+    if (rangeStart_ != startFrame || rangeEnd_ != endFrame) {
+        rangeStart_ = startFrame;
+        rangeEnd_ = endFrame;
+        emit changed();
+    }
+}
+
+void WaveformProvider::buildCache(const QString& filePath, const AudioData& audioData) {
+    WaveformPyramid pyramid;
+    if (!readCache(filePath, pyramid)) {
+        pyramid.build(audioData.samples.data(), audioData.totalFrames, audioData.channels);
+        writeCache(filePath, pyramid);
+    }
+}
+
+QString WaveformProvider::cachePath(const QString& filePath) {
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/waveforms";
+    QByteArray key = QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return dir + "/" + QString::fromLatin1(key) + ".wfm";
+}
+
+bool WaveformProvider::readCache(const QString& filePath, WaveformPyramid& pyramid) {
+    QFile file(cachePath(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QFileInfo info(filePath);
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 size = 0;
+    qint64 modified = 0;
+    quint64 frames = 0;
+    quint32 levelCount = 0;
+    in >> magic >> version >> size >> modified >> frames >> levelCount;
+    if (magic != kCacheMagic || version != kCacheVersion || size != info.size() ||
+        modified != info.lastModified().toMSecsSinceEpoch() || levelCount > 64) {
+        return false;
+    }
+
+    std::vector<std::vector<WaveformPyramid::Bucket>> levels(levelCount);
+    for (auto& level : levels) {
+        quint32 count = 0;
+        in >> count;
+        if (in.status() != QDataStream::Ok || count > frames / WaveformPyramid::kBaseFrames + 1) {
+            return false;
+        }
+        level.resize(count);
+        if (in.readRawData(reinterpret_cast<char*>(level.data()), count * sizeof(WaveformPyramid::Bucket)) !=
+            static_cast<int>(count * sizeof(WaveformPyramid::Bucket))) {
+            return false;
+        }
+    }
+
+    pyramid.assign(std::move(levels), frames);
+    return true;
+}
+
+void WaveformProvider::writeCache(const QString& filePath, const WaveformPyramid& pyramid) {
+    QString path = cachePath(filePath);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write waveform cache:" << path;
+        return;
+    }
+
+    QFileInfo info(filePath);
+    QDataStream out(&file);
+    out << kCacheMagic << kCacheVersion << info.size() << info.lastModified().toMSecsSinceEpoch()
+        << static_cast<quint64>(pyramid.totalFrames()) << static_cast<quint32>(pyramid.levels().size());
+    for (const auto& level : pyramid.levels()) {
+        out << static_cast<quint32>(level.size());
+        out.writeRawData(reinterpret_cast<const char*>(level.data()),
+                         static_cast<int>(level.size() * sizeof(WaveformPyramid::Bucket)));
+    }
+    file.commit();
+}
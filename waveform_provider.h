@@ -0,0 +1,56 @@
+#ifndef WAVEFORM_PROVIDER_H
+#define WAVEFORM_PROVIDER_H
+
+#include "audio_decoder.h"
+#include "waveform.h"
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <memory>
+
+// Builds the waveform overview of the loaded track on a worker thread from
+// the already decoded samples and keeps a copy on disk, keyed by path, size
+// and modification time, so revisiting a track only reads the small cache.
+class WaveformProvider : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(bool ready READ isReady NOTIFY changed)
+
+public:
+    explicit WaveformProvider(QObject* parent = nullptr);
+    ~WaveformProvider();
+
+    // audioData may be null when the overview is expected in the cache,
+    // e.g. for a track that was pre-decoded with buildCache(). Loading the
+    // file that is already shown keeps its overview.
+    void load(const QString& filePath, std::shared_ptr<const AudioData> audioData);
+    void clear();
+
+    // Frames of the file the view covers, for tracks of a CUE sheet image.
+    // An empty range shows the whole file.
+    void setRange(size_t startFrame, size_t endFrame);
+    size_t rangeStart() const { return rangeStart_; }
+    size_t rangeEnd() const { return rangeEnd_; }
+
+    // Worker threads: computes and stores the overview unless cached.
+    static void buildCache(const QString& filePath, const AudioData& audioData);
+
+    bool isReady() const { return pyramid_ != nullptr; }
+    std::shared_ptr<const WaveformPyramid> pyramid() const { return pyramid_; }
+
+signals:
+    void changed();
+
+private:
+    static QString cachePath(const QString& filePath);
+    static bool readCache(const QString& filePath, WaveformPyramid& pyramid);
+    static void writeCache(const QString& filePath, const WaveformPyramid& pyramid);
+
+    QThreadPool pool_;
+    std::shared_ptr<const WaveformPyramid> pyramid_;
+    QString path_;
+    size_t rangeStart_;
+    size_t rangeEnd_;
+    unsigned generation_;
+};
+
+#endif // WAVEFORM_PROVIDER_H